@@ -0,0 +1,308 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include "AssetPack.h"
+#include "Lz4.h"
+#include "MeshCache.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+static size_t alignTo(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static bool endsWith(const std::string& text, const std::string& suffix) {
+    return text.size() >= suffix.size() &&
+           text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// files under directory, recursively, as directory/.../name
+static void listFiles(const std::string& directory, std::vector<std::string>* files) {
+#ifdef _WIN32
+    WIN32_FIND_DATAA found;
+    HANDLE search = FindFirstFileA((directory + "/*").c_str(), &found);
+    if (search == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    do {
+        std::string name = found.cFileName;
+        if (name == "." || name == "..") {
+            continue;
+        }
+        if (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            listFiles(directory + "/" + name, files);
+        } else {
+            files->push_back(directory + "/" + name);
+        }
+    } while (FindNextFileA(search, &found));
+    FindClose(search);
+#else
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) {
+        return;
+    }
+    while (dirent* found = readdir(dir)) {
+        std::string name = found->d_name;
+        if (name == "." || name == "..") {
+            continue;
+        }
+        std::string path = directory + "/" + name;
+        struct stat path_stat;
+        if (stat(path.c_str(), &path_stat) != 0) {
+            continue;
+        }
+        if (S_ISDIR(path_stat.st_mode)) {
+            listFiles(path, files);
+        } else if (S_ISREG(path_stat.st_mode)) {
+            files->push_back(path);
+        }
+    }
+    closedir(dir);
+#endif
+}
+
+AssetPack::AssetPack() {}
+
+AssetPack::~AssetPack() {}
+
+bool AssetPack::open(const std::string& filename) {
+    close();
+    if (!file.open(filename) || file.getSize() < sizeof(AssetPackHeader)) {
+        close();
+        return false;
+    }
+
+    const u8* data = file.getData();
+    header = reinterpret_cast<const AssetPackHeader*>(data);
+    size_t entries_offset = sizeof(AssetPackHeader);
+    size_t names_offset = entries_offset + sizeof(AssetPackEntry) * size_t(header->entry_count);
+    size_t payloads_offset = names_offset + header->string_bytes;
+    if (header->magic != ASSET_PACK_MAGIC || header->version != ASSET_PACK_VERSION ||
+        payloads_offset > file.getSize() || header->string_bytes == 0 ||
+        data[payloads_offset - 1] != '\0') {
+        close();
+        return false;
+    }
+    entries = reinterpret_cast<const AssetPackEntry*>(data + entries_offset);
+    names = reinterpret_cast<const char*>(data + names_offset);
+
+    // every payload inside the file, every name inside the strings and in order
+    for (u32 i = 0; i < header->entry_count; i++) {
+        const AssetPackEntry& entry = entries[i];
+        if (entry.offset < payloads_offset || entry.offset > file.getSize() ||
+            entry.stored_size > file.getSize() - entry.offset ||
+            entry.name_offset >= header->string_bytes ||
+            (entry.compression != PackCompression::None &&
+             entry.compression != PackCompression::LZ4) ||
+            (entry.compression == PackCompression::None && entry.stored_size != entry.size) ||
+            (i > 0 && strcmp(names + entries[i - 1].name_offset, names + entry.name_offset) >= 0)) {
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+void AssetPack::close() {
+    file.close();
+    header = nullptr;
+    entries = nullptr;
+    names = nullptr;
+}
+
+const AssetPackEntry* AssetPack::find(const std::string& path) {
+    if (!header) {
+        return nullptr;
+    }
+    std::string name = normalizePath(path);
+    const AssetPackEntry* end = entries + header->entry_count;
+    const AssetPackEntry* found =
+        std::lower_bound(entries, end, name, [this](const AssetPackEntry& entry,
+                                                    const std::string& key) {
+            return strcmp(names + entry.name_offset, key.c_str()) < 0;
+        });
+    if (found == end || name != names + found->name_offset) {
+        return nullptr;
+    }
+    return found;
+}
+
+const u8* AssetPack::read(const AssetPackEntry& entry, std::vector<u8>* storage) {
+    if (entry.compression == PackCompression::None) {
+        return getStored(entry);
+    }
+    storage->resize(static_cast<size_t>(entry.size));
+    if (!readInto(entry, storage->data())) {
+        return nullptr;
+    }
+    return storage->data();
+}
+
+bool AssetPack::readInto(const AssetPackEntry& entry, void* dst) {
+    const u8* stored = getStored(entry);
+    size_t size = static_cast<size_t>(entry.size);
+    if (entry.compression == PackCompression::LZ4) {
+        return lz4Decompress(stored, static_cast<size_t>(entry.stored_size),
+                             static_cast<u8*>(dst), size);
+    }
+    if (size > 0) {
+        memcpy(dst, stored, size);
+    }
+    return true;
+}
+
+const u8* AssetPack::map(const std::string& path, MappedFile* file, std::vector<u8>* storage,
+                         size_t* size) {
+    const AssetPackEntry* entry = find(path);
+    if (entry) {
+        *size = static_cast<size_t>(entry->size);
+        return read(*entry, storage);
+    }
+    if (!file->open(path)) {
+        return nullptr;
+    }
+    *size = file->getSize();
+    return file->getData();
+}
+
+bool AssetPack::build(const std::string& filename, const std::vector<std::string>& directories) {
+    std::vector<std::string> paths;
+    for (const std::string& directory : directories) {
+        listFiles(directory, &paths);
+    }
+    for (std::string& path : paths) {
+        path = normalizePath(path);
+    }
+    paths.erase(std::remove_if(paths.begin(), paths.end(),
+                               [](const std::string& path) {
+                                   return endsWith(path, MESH_CACHE_EXTENSION) ||
+                                          endsWith(path, ".tmp");
+                               }),
+                paths.end());
+    std::sort(paths.begin(), paths.end());
+    paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+    // empty files don't map and carry nothing anyway
+    paths.erase(std::remove_if(paths.begin(), paths.end(),
+                               [](const std::string& path) {
+                                   MappedFile source;
+                                   if (source.open(path)) {
+                                       return false;
+                                   }
+                                   printf("Skipping empty or unreadable %s\n", path.c_str());
+                                   return true;
+                               }),
+                paths.end());
+
+    std::string strings;
+    std::vector<AssetPackEntry> entries(paths.size());
+    for (size_t i = 0; i < paths.size(); i++) {
+        entries[i].name_offset = static_cast<u32>(strings.size());
+        strings += paths[i];
+        strings.push_back('\0');
+    }
+    strings.resize(alignTo(std::max<size_t>(strings.size(), 1), 8), '\0');
+
+    AssetPackHeader header = {};
+    header.magic = ASSET_PACK_MAGIC;
+    header.version = ASSET_PACK_VERSION;
+    header.entry_count = static_cast<u32>(entries.size());
+    header.string_bytes = static_cast<u32>(strings.size());
+    size_t offset = sizeof(AssetPackHeader) + sizeof(AssetPackEntry) * entries.size() +
+                    strings.size();
+
+    // write aside and swap in, like the mesh cache; the table goes in last once every
+    // payload's place is known
+    std::string temp_name = filename + ".tmp";
+    std::ofstream out(temp_name, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        return false;
+    }
+    std::vector<char> placeholder(offset, 0);
+    out.write(placeholder.data(), placeholder.size());
+
+    u64 raw_bytes = 0;
+    u64 stored_bytes = 0;
+    static const char PADDING[ASSET_PACK_ALIGNMENT] = {};
+    for (size_t i = 0; i < paths.size(); i++) {
+        MappedFile source;
+        if (!source.open(paths[i])) {
+            out.close();
+            std::remove(temp_name.c_str());
+            return false;
+        }
+        const u8* data = source.getData();
+        size_t size = source.getSize();
+
+        AssetPackEntry& entry = entries[i];
+        entry.size = size;
+        entry.content_hash = fnv1a64(data, size);
+        entry.compression = PackCompression::None;
+        std::vector<u8> compressed = lz4Compress(data, size);
+        if (compressed.size() <= size * (1.0f - ASSET_PACK_MIN_SAVING)) {
+            entry.compression = PackCompression::LZ4;
+            data = compressed.data();
+            size = compressed.size();
+        }
+
+        size_t aligned = alignTo(offset, ASSET_PACK_ALIGNMENT);
+        out.write(PADDING, aligned - offset);
+        entry.offset = aligned;
+        entry.stored_size = size;
+        out.write(reinterpret_cast<const char*>(data), size);
+        offset = aligned + size;
+        raw_bytes += entry.size;
+        stored_bytes += entry.stored_size;
+    }
+
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(entries.data()),
+              sizeof(AssetPackEntry) * entries.size());
+    out.write(strings.data(), strings.size());
+    if (!out.good()) {
+        out.close();
+        std::remove(temp_name.c_str());
+        return false;
+    }
+    out.close();
+
+    printf("%s: %u files, %.2f MB -> %.2f MB stored\n", filename.c_str(), header.entry_count,
+           raw_bytes / (1024.0 * 1024.0), stored_bytes / (1024.0 * 1024.0));
+    std::remove(filename.c_str());
+    return std::rename(temp_name.c_str(), filename.c_str()) == 0;
+}
+
+std::string AssetPack::normalizePath(const std::string& path) {
+    std::vector<std::string> parts;
+    std::string part;
+    for (size_t i = 0; i <= path.size(); i++) {
+        char c = i < path.size() ? path[i] : '/';
+        if (c != '/' && c != '\\') {
+            part.push_back(c);
+            continue;
+        }
+        if (part == ".." && !parts.empty() && parts.back() != "..") {
+            parts.pop_back();
+        } else if (!part.empty() && part != ".") {
+            parts.push_back(part);
+        }
+        part.clear();
+    }
+
+    std::string normalized;
+    for (const std::string& p : parts) {
+        if (!normalized.empty()) {
+            normalized.push_back('/');
+        }
+        normalized += p;
+    }
+    return normalized;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+#include "Utilities.h"
+
+// Looked for in the working directory, loose files are the fallback for anything not in it
+const char* const ASSET_PACK_FILENAME = "assets.pack";
+const u32 ASSET_PACK_MAGIC = 0x4b504156; // "VAPK"
+const u32 ASSET_PACK_VERSION = 1;
+// every payload starts on a cache line, so mapped KTX2 levels and SPIR-V keep their alignment
+const u32 ASSET_PACK_ALIGNMENT = 64;
+// an entry is only stored compressed when that saves at least this fraction of it
+const float ASSET_PACK_MIN_SAVING = 0.125f;
+
+enum class PackCompression : u32 {
+    None,
+    LZ4, // raw LZ4 block, see Lz4.h
+};
+
+struct AssetPackHeader {
+    u32 magic;
+    u32 version;
+    u32 entry_count;
+    u32 string_bytes; // entry names, zero terminated, padded to 8 bytes
+};
+
+// The table of contents is sorted by name
+struct AssetPackEntry {
+    u64 offset;       // of the stored payload from the start of the pack
+    u64 stored_size;  // bytes in the pack
+    u64 size;         // bytes once decompressed
+    u64 content_hash; // FNV-1a of the decompressed bytes, the same as hashing the loose file
+    u32 name_offset;  // into the name strings
+    PackCompression compression;
+};
+
+// Read-only archive of the Models/Textures/shaders files. Layout: header, table of contents,
+// names, then the payloads, each aligned to ASSET_PACK_ALIGNMENT. The pack is memory-mapped;
+// readers get the stored bytes in place and copy or decompress them wherever they go
+// (staging memory included) without an intermediate heap copy. Lookups are thread safe.
+class AssetPack {
+public:
+    AssetPack();
+    ~AssetPack();
+
+    // false when the pack is missing or malformed
+    bool open(const std::string& filename);
+    void close();
+
+    bool isOpen() {
+        return file.isOpen();
+    }
+    u32 getEntryCount() {
+        return header ? header->entry_count : 0;
+    }
+
+    // entry of a path relative to the working directory like "Textures/stx_hada.png", either
+    // separator; null when the pack doesn't have it
+    const AssetPackEntry* find(const std::string& path);
+    const char* getName(const AssetPackEntry& entry) {
+        return names + entry.name_offset;
+    }
+    // the payload as stored, compressed or not
+    const u8* getStored(const AssetPackEntry& entry) {
+        return file.getData() + entry.offset;
+    }
+
+    // Decompressed contents. Uncompressed entries come straight out of the mapping and
+    // storage is left alone, compressed ones are decoded into storage. Null on corrupt data.
+    const u8* read(const AssetPackEntry& entry, std::vector<u8>* storage);
+    // decompresses or copies the contents into dst, which has room for entry.size bytes
+    bool readInto(const AssetPackEntry& entry, void* dst);
+    // Contents of a path, from the pack like read() or, when it doesn't have it, the loose file
+    // mapped into file. Null when neither works; works on a closed pack too.
+    const u8* map(const std::string& path, MappedFile* file, std::vector<u8>* storage,
+                  size_t* size);
+
+    // Packer: every file under the directories, recursively, LZ4 compressed where it pays.
+    // Mesh cache files are left out, they are written next to the sources at run time.
+    static bool build(const std::string& filename, const std::vector<std::string>& directories);
+
+    // "Models\\a.obj", "./Models/a.obj" -> "Models/a.obj"
+    static std::string normalizePath(const std::string& path);
+
+private:
+    MappedFile file;
+    const AssetPackHeader* header = nullptr;
+    const AssetPackEntry* entries = nullptr;
+    const char* names = nullptr;
+};
@@ -0,0 +1,461 @@
+#include <algorithm>
+#include <cstring>
+#include "GeometryArena.h"
+
+GeometryArena::GeometryArena() {}
+
+GeometryArena::~GeometryArena() {}
+
+void GeometryArena::init(MemoryAllocator* new_allocator, VkDevice new_device,
+                         StagingRing* new_staging) {
+    allocator = new_allocator;
+    device = new_device;
+    staging = new_staging;
+
+    createPool(GeometryPool::Vertices, sizeof(Vertex), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+               VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, INITIAL_VERTEX_CAPACITY);
+    createPool(GeometryPool::CompactVertices, sizeof(CompactVertex),
+               VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+               INITIAL_VERTEX_CAPACITY);
+    createPool(GeometryPool::Indices, sizeof(u32), VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+               VK_ACCESS_INDEX_READ_BIT, INITIAL_INDEX_CAPACITY);
+    createPool(GeometryPool::Indices16, sizeof(u16), VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+               VK_ACCESS_INDEX_READ_BIT, INITIAL_INDEX_CAPACITY);
+    createPool(GeometryPool::Colors, sizeof(u32), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+               VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, INITIAL_COLOR_CAPACITY);
+}
+
+void GeometryArena::destroy() {
+    releaseRetired();
+    for (Pool& pool : pools) {
+        destroyPool(pool);
+    }
+}
+
+GeometryRange GeometryArena::allocate(GeometryPool pool, const void* data, u32 count) {
+    size_t bytes = size_t(getPool(pool).stride) * count;
+    return allocate(pool, count, [data, bytes](void* dst) { memcpy(dst, data, bytes); });
+}
+
+GeometryRange GeometryArena::allocate(GeometryPool pool, u32 count,
+                                      const std::function<void(void* dst)>& write) {
+    GeometryRange range = allocateRange(getPool(pool), count);
+    upload(getPool(pool), range, write);
+    return range;
+}
+
+void GeometryArena::release(GeometryPool pool, GeometryRange range) {
+    retireRange(getPool(pool), range);
+}
+
+void GeometryArena::beginFrame(u64 frame) {
+    current_frame = frame;
+
+    // frame - MAX_FRAME_DRAWS has been waited on, so was every frame recorded before it
+    auto done = [frame](u64 retired_frame) { return retired_frame + MAX_FRAME_DRAWS <= frame; };
+
+    size_t kept = 0;
+    for (size_t i = 0; i < retired_ranges.size(); i++) {
+        if (done(retired_ranges[i].frame)) {
+            freeRange(*retired_ranges[i].pool, retired_ranges[i].range);
+        } else {
+            retired_ranges[kept++] = retired_ranges[i];
+        }
+    }
+    retired_ranges.resize(kept);
+
+    kept = 0;
+    for (size_t i = 0; i < retired_buffers.size(); i++) {
+        if (done(retired_buffers[i].frame)) {
+            allocator->destroyBuffer(retired_buffers[i].buffer, retired_buffers[i].memory);
+        } else {
+            retired_buffers[kept++] = retired_buffers[i];
+        }
+    }
+    retired_buffers.resize(kept);
+}
+
+void GeometryArena::releaseRetired() {
+    for (const RetiredRange& retired : retired_ranges) {
+        freeRange(*retired.pool, retired.range);
+    }
+    retired_ranges.clear();
+
+    for (RetiredBuffer& retired : retired_buffers) {
+        allocator->destroyBuffer(retired.buffer, retired.memory);
+    }
+    retired_buffers.clear();
+}
+
+void GeometryArena::defragment(VkCommandBuffer cmd_buffer, VkDeviceSize max_bytes,
+                               std::vector<GeometryMove>* moves) {
+    VkDeviceSize copied = 0;
+    for (Pool& pool : pools) {
+        if (copied < max_bytes) {
+            copied += compactPool(cmd_buffer, pool, max_bytes - copied, moves);
+        }
+    }
+
+    for (Pool& pool : pools) {
+        if (pool.capacity <= pool.initial_capacity) {
+            continue;
+        }
+        // highest element still live or waiting for frames in flight
+        u32 top = 0;
+        if (!pool.live_ranges.empty()) {
+            auto last = std::prev(pool.live_ranges.end());
+            top = last->first + last->second;
+        }
+        for (const RetiredRange& retired : retired_ranges) {
+            if (retired.pool == &pool) {
+                top = std::max(top, retired.range.offset + retired.range.count);
+            }
+        }
+        // quarter full before halving, so growth and shrinking can't ping-pong
+        if (top <= pool.capacity / 4) {
+            shrinkPool(cmd_buffer, pool, std::max(pool.initial_capacity, pool.capacity / 2));
+        }
+    }
+}
+
+void GeometryArena::recordGrowCopies(VkCommandBuffer cmd_buffer) {
+    for (Pool& pool : pools) {
+        while (!pool.grows.empty() && staging->isReady(pool.grows.front().ticket)) {
+            PendingGrow& grow = pool.grows.front();
+            VkBuffer next_buffer = pool.grows.size() > 1 ? pool.grows[1].buffer : pool.buffer;
+
+            std::vector<VkBufferCopy> regions;
+            regions.reserve(grow.ranges.size());
+            for (const auto& live : grow.ranges) {
+                VkBufferCopy region = {};
+                region.srcOffset = pool.stride * live.first;
+                region.dstOffset = region.srcOffset;
+                region.size = pool.stride * live.second;
+                regions.push_back(region);
+            }
+
+            if (!regions.empty()) {
+                // the acquires just recorded, and earlier carry-over copies, wrote the source
+                VkMemoryBarrier mem_barrier = {};
+                mem_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+                mem_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                mem_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+                vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                     VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &mem_barrier, 0,
+                                     nullptr, 0, nullptr);
+
+                vkCmdCopyBuffer(cmd_buffer, grow.buffer, next_buffer,
+                                static_cast<u32>(regions.size()), regions.data());
+
+                mem_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                mem_barrier.dstAccessMask = pool.read_access | VK_ACCESS_TRANSFER_READ_BIT;
+
+                vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                     VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+                                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                     0, 1, &mem_barrier, 0, nullptr, 0, nullptr);
+            }
+
+            // frames in flight still read the old buffer
+            retired_buffers.push_back({grow.buffer, grow.memory, current_frame});
+            pool.grows.erase(pool.grows.begin());
+        }
+    }
+}
+
+void GeometryArena::bindVertices(VkCommandBuffer cmd_buffer, VertexFormat format) {
+    if (format == VertexFormat::Float) {
+        VkBuffer vertex_buffers[] = {drawBuffer(getPool(GeometryPool::Vertices))};
+        VkDeviceSize offsets[] = {0};
+        vkCmdBindVertexBuffers(cmd_buffer, 0, 1, vertex_buffers, offsets);
+        return;
+    }
+    VkBuffer vertex_buffers[] = {drawBuffer(getPool(GeometryPool::CompactVertices)),
+                                 drawBuffer(getPool(GeometryPool::Colors))};
+    VkDeviceSize offsets[] = {0, 0};
+    vkCmdBindVertexBuffers(cmd_buffer, 0, 2, vertex_buffers, offsets);
+}
+
+void GeometryArena::bindIndices(VkCommandBuffer cmd_buffer, VkIndexType index_type) {
+    GeometryPool pool =
+        index_type == VK_INDEX_TYPE_UINT16 ? GeometryPool::Indices16 : GeometryPool::Indices;
+    vkCmdBindIndexBuffer(cmd_buffer, drawBuffer(getPool(pool)), 0, index_type);
+}
+
+void GeometryArena::createPool(GeometryPool id, VkDeviceSize stride, VkBufferUsageFlags usage,
+                               VkAccessFlags read_access, u32 capacity) {
+    Pool& pool = getPool(id);
+    pool.id = id;
+    pool.stride = stride;
+    pool.usage = usage;
+    pool.read_access = read_access;
+    pool.capacity = capacity;
+    pool.initial_capacity = capacity;
+    pool.free_ranges.clear();
+    pool.free_ranges[0] = capacity;
+    pool.live_ranges.clear();
+
+    // TRANSFER_SRC so the contents can be carried over when the pool grows
+    allocator->createDeviceBuffer(stride * capacity,
+                                  usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                                      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                  MemoryCategory::Geometry, &pool.buffer, &pool.memory);
+}
+
+void GeometryArena::destroyPool(Pool& pool) {
+    for (PendingGrow& grow : pool.grows) {
+        allocator->destroyBuffer(grow.buffer, grow.memory);
+    }
+    pool.grows.clear();
+    if (pool.buffer != VK_NULL_HANDLE) {
+        allocator->destroyBuffer(pool.buffer, pool.memory);
+        pool.buffer = VK_NULL_HANDLE;
+    }
+}
+
+void GeometryArena::growPool(Pool& pool, u32 min_capacity) {
+    u32 new_capacity = std::max(pool.capacity * 2, min_capacity);
+
+    VkBuffer new_buffer;
+    MemoryAllocation new_memory;
+    allocator->createDeviceBuffer(pool.stride * new_capacity,
+                                  pool.usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                                      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                  MemoryCategory::Geometry, &new_buffer, &new_memory);
+
+    // Uploads into the old buffer may still be in flight on the transfer queue, so its live
+    // ranges are only copied once their batch has been acquired, see recordGrowCopies
+    pool.grows.push_back({pool.buffer, pool.memory, staging->flush(), pool.live_ranges});
+
+    // the new tail becomes free, merged with a free range ending at the old capacity
+    u32 tail_offset = pool.capacity;
+    u32 tail_count = new_capacity - pool.capacity;
+    if (!pool.free_ranges.empty()) {
+        auto last = std::prev(pool.free_ranges.end());
+        if (last->first + last->second == tail_offset) {
+            tail_offset = last->first;
+            tail_count += last->second;
+            pool.free_ranges.erase(last);
+        }
+    }
+    pool.free_ranges[tail_offset] = tail_count;
+
+    pool.buffer = new_buffer;
+    pool.memory = new_memory;
+    pool.capacity = new_capacity;
+}
+
+void GeometryArena::shrinkPool(VkCommandBuffer cmd_buffer, Pool& pool, u32 new_capacity) {
+    u32 copy_count = 0;
+    if (!pool.live_ranges.empty()) {
+        auto last = std::prev(pool.live_ranges.end());
+        copy_count = last->first + last->second;
+    }
+
+    VkBuffer new_buffer;
+    MemoryAllocation new_memory;
+    allocator->createDeviceBuffer(pool.stride * new_capacity,
+                                  pool.usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                                      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                  MemoryCategory::Geometry, &new_buffer, &new_memory);
+
+    if (copy_count > 0) {
+        copyBuffer(cmd_buffer, pool.buffer, new_buffer, pool.stride * copy_count);
+
+        VkMemoryBarrier mem_barrier = {};
+        mem_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        mem_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        mem_barrier.dstAccessMask = pool.read_access | VK_ACCESS_TRANSFER_READ_BIT;
+
+        vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             0, 1, &mem_barrier, 0, nullptr, 0, nullptr);
+    }
+
+    // frames in flight still read the old buffer
+    retired_buffers.push_back({pool.buffer, pool.memory, current_frame});
+
+    // everything above the new capacity is free, drop it from the free list
+    auto it = pool.free_ranges.lower_bound(new_capacity);
+    pool.free_ranges.erase(it, pool.free_ranges.end());
+    if (!pool.free_ranges.empty()) {
+        auto last = std::prev(pool.free_ranges.end());
+        last->second = std::min(last->second, new_capacity - last->first);
+    }
+
+    pool.buffer = new_buffer;
+    pool.memory = new_memory;
+    pool.capacity = new_capacity;
+}
+
+VkDeviceSize GeometryArena::compactPool(VkCommandBuffer cmd_buffer, Pool& pool,
+                                        VkDeviceSize max_bytes, std::vector<GeometryMove>* moves) {
+    // a few of the highest ranges per frame, each into the lowest hole below it that fits
+    const size_t max_candidates = 16;
+    std::vector<std::pair<u32, u32>> candidates;
+    for (auto it = pool.live_ranges.rbegin();
+         it != pool.live_ranges.rend() && candidates.size() < max_candidates; ++it) {
+        candidates.push_back(*it);
+    }
+
+    VkDeviceSize copied = 0;
+    std::vector<VkBufferCopy> copies;
+    for (const std::pair<u32, u32>& live : candidates) {
+        u32 offset = live.first;
+        u32 count = live.second;
+        VkDeviceSize bytes = pool.stride * count;
+        // let one oversized range through so it isn't stuck forever
+        if (copied > 0 && copied + bytes > max_bytes) {
+            break;
+        }
+
+        auto below = pool.free_ranges.lower_bound(offset);
+        auto hole =
+            std::find_if(pool.free_ranges.begin(), below,
+                         [count](const std::pair<const u32, u32>& r) { return r.second >= count; });
+        if (hole == below) {
+            continue;
+        }
+
+        u32 new_offset = hole->first;
+        takeFreeRange(pool, hole->first, new_offset, count);
+        pool.live_ranges[new_offset] = count;
+        // the old copy stays readable for the frames in flight
+        retireRange(pool, {offset, count});
+
+        VkBufferCopy copy = {};
+        copy.srcOffset = pool.stride * offset;
+        copy.dstOffset = pool.stride * new_offset;
+        copy.size = bytes;
+        copies.push_back(copy);
+
+        GeometryMove move;
+        move.pool = pool.id;
+        move.old_offset = offset;
+        move.new_offset = new_offset;
+        moves->push_back(move);
+
+        copied += bytes;
+    }
+
+    if (copies.empty()) {
+        return 0;
+    }
+
+    // earlier frames may have written the source with their own moves
+    VkMemoryBarrier mem_barrier = {};
+    mem_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    mem_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    mem_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &mem_barrier, 0, nullptr, 0,
+                         nullptr);
+
+    // source and destination never overlap, the destination was free
+    vkCmdCopyBuffer(cmd_buffer, pool.buffer, pool.buffer, static_cast<u32>(copies.size()),
+                    copies.data());
+
+    mem_barrier.dstAccessMask = pool.read_access | VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                         1, &mem_barrier, 0, nullptr, 0, nullptr);
+    return copied;
+}
+
+GeometryRange GeometryArena::allocateRange(Pool& pool, u32 count) {
+    GeometryRange range;
+    if (count == 0) {
+        return range;
+    }
+
+    auto it =
+        std::find_if(pool.free_ranges.begin(), pool.free_ranges.end(),
+                     [count](const std::pair<const u32, u32>& r) { return r.second >= count; });
+    if (it == pool.free_ranges.end()) {
+        growPool(pool, pool.capacity + count);
+        // after growing the tail range is always large enough
+        it = std::prev(pool.free_ranges.end());
+    }
+
+    range.offset = it->first;
+    range.count = count;
+
+    takeFreeRange(pool, it->first, range.offset, count);
+    pool.live_ranges[range.offset] = count;
+    return range;
+}
+
+void GeometryArena::takeFreeRange(Pool& pool, u32 free_offset, u32 offset, u32 count) {
+    u32 free_count = pool.free_ranges[free_offset];
+    pool.free_ranges.erase(free_offset);
+
+    if (offset > free_offset) {
+        pool.free_ranges[free_offset] = offset - free_offset;
+    }
+    u32 end = offset + count;
+    u32 free_end = free_offset + free_count;
+    if (free_end > end) {
+        pool.free_ranges[end] = free_end - end;
+    }
+}
+
+void GeometryArena::retireRange(Pool& pool, GeometryRange range) {
+    if (range.count == 0) {
+        return;
+    }
+    pool.live_ranges.erase(range.offset);
+    // the range may be reused before a pending copy runs, which mustn't overwrite it
+    for (PendingGrow& grow : pool.grows) {
+        grow.ranges.erase(range.offset);
+    }
+    retired_ranges.push_back({&pool, range, current_frame});
+}
+
+void GeometryArena::freeRange(Pool& pool, GeometryRange range) {
+    if (range.count == 0) {
+        return;
+    }
+
+    u32 offset = range.offset;
+    u32 count = range.count;
+
+    auto next = pool.free_ranges.lower_bound(offset);
+    if (next != pool.free_ranges.end() && offset + count == next->first) {
+        count += next->second;
+        next = pool.free_ranges.erase(next);
+    }
+    if (next != pool.free_ranges.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset) {
+            offset = prev->first;
+            count += prev->second;
+            pool.free_ranges.erase(prev);
+        }
+    }
+    pool.free_ranges[offset] = count;
+}
+
+void GeometryArena::upload(Pool& pool, GeometryRange range,
+                           const std::function<void(void* dst)>& write) {
+    if (range.count == 0) {
+        return;
+    }
+    VkDeviceSize buffer_size = pool.stride * range.count;
+
+    // resizable BAR/UMA: the range is free so no frame reads it, write it in place.
+    // Host coherent writes are visible to everything submitted afterwards.
+    if (pool.memory.mapped) {
+        write(static_cast<u8*>(pool.memory.mapped) + pool.stride * range.offset);
+        return;
+    }
+
+    // "stage" the data in the upload ring, the copy goes out with the next flush
+    StagingRegion region = staging->allocate(buffer_size);
+    write(region.mapped);
+
+    copyBuffer(staging->commandBuffer(), region.buffer, pool.buffer, buffer_size, region.offset,
+               pool.stride * range.offset);
+    staging->releaseBuffer(pool.buffer, pool.stride * range.offset, buffer_size, pool.read_access,
+                           VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <functional>
+#include <map>
+#include <vector>
+#include <GLFW/glfw3.h>
+#include "MemoryAllocator.h"
+#include "StagingRing.h"
+#include "Utilities.h"
+#include "VertexFormat.h"
+
+const u32 INITIAL_VERTEX_CAPACITY = 1 << 16;
+const u32 INITIAL_INDEX_CAPACITY = 1 << 18;
+const u32 INITIAL_COLOR_CAPACITY = 1 << 10;
+
+// Bytes of live geometry the defragmenter may copy per frame
+const VkDeviceSize GEOMETRY_DEFRAG_BYTES_PER_FRAME = 4ull * 1024 * 1024;
+
+// The buffers of the arena, one per element type
+enum class GeometryPool : u32 {
+    Vertices,        // Vertex
+    CompactVertices, // CompactVertex
+    Indices,         // u32
+    Indices16,       // u16
+    Colors,          // RGBA8, one per compact mesh
+};
+const u32 GEOMETRY_POOL_COUNT = 5;
+
+// A range of elements inside one of the arena buffers
+struct GeometryRange {
+    u32 offset = 0;
+    u32 count = 0;
+};
+
+// A live range the defragmenter moved, owners must switch to new_offset
+struct GeometryMove {
+    GeometryPool pool = GeometryPool::Vertices;
+    u32 old_offset = 0;
+    u32 new_offset = 0;
+};
+
+// Packs the geometry of every mesh into one buffer per element type, see GeometryPool.
+// They grow on demand, so a draw only needs its vertexOffset/firstIndex. Uploads go through
+// the staging ring, or straight into the buffers when they landed in host visible memory.
+//
+// Freed ranges are only reused once the frames that could still read them are done, see
+// beginFrame. defragment() slides live ranges down into holes a few megabytes per frame and
+// halves a buffer once its top three quarters are empty, so long sessions that stream models
+// in and out keep the arena close to the live geometry size.
+//
+// A full pool switches to a buffer twice as large right away. Its live ranges are carried
+// over by recordGrowCopies in the first frame after every upload into the old buffer has been
+// acquired; until then draws keep reading the old one.
+class GeometryArena {
+public:
+    GeometryArena();
+    ~GeometryArena();
+
+    void init(MemoryAllocator* allocator, VkDevice device, StagingRing* staging);
+    void destroy();
+
+    // count elements of the pool's type
+    GeometryRange allocate(GeometryPool pool, const void* data, u32 count);
+    // write fills the range in place, in staging or straight in the buffer; the memory may be
+    // write-combined, so write it once in order and never read it back
+    GeometryRange allocate(GeometryPool pool, u32 count,
+                           const std::function<void(void* dst)>& write);
+    void release(GeometryPool pool, GeometryRange range);
+
+    // frame: number of the frame about to be recorded, its fence has been waited on
+    void beginFrame(u64 frame);
+    // frees every retired range and buffer right away, only while the device is idle
+    void releaseRetired();
+
+    // Records the carry-over copies of grown pools whose old buffer is complete, right after
+    // StagingRing::recordAcquires and before anything else reads the arena.
+    void recordGrowCopies(VkCommandBuffer cmd_buffer);
+
+    // Records copies moving live ranges into lower holes, up to max_bytes, into a graphics
+    // command buffer before anything reads the arena. Owners must apply the moves before
+    // recording their draws. Only call while no upload is pending (StagingRing::isIdle).
+    void defragment(VkCommandBuffer cmd_buffer, VkDeviceSize max_bytes,
+                    std::vector<GeometryMove>* moves);
+
+    // the vertex buffer of a format, with the colors for the compact ones
+    void bindVertices(VkCommandBuffer cmd_buffer, VertexFormat format);
+    void bindIndices(VkCommandBuffer cmd_buffer, VkIndexType index_type);
+
+private:
+    // a replaced buffer whose live ranges still have to be copied into the next one
+    struct PendingGrow {
+        VkBuffer buffer;
+        MemoryAllocation memory;
+        u64 ticket; // staging batch of the last upload into it
+        std::map<u32, u32> ranges;
+    };
+
+    struct Pool {
+        GeometryPool id = GeometryPool::Vertices;
+        VkBuffer buffer = VK_NULL_HANDLE;
+        MemoryAllocation memory;
+        VkDeviceSize stride = 0;
+        VkBufferUsageFlags usage = 0;
+        // how the graphics queue reads the pool, for the ownership transfer after uploads
+        VkAccessFlags read_access = 0;
+        u32 capacity = 0;
+        u32 initial_capacity = 0;
+        // free element ranges keyed by offset, neighbours always merged
+        std::map<u32, u32> free_ranges;
+        // allocated ranges keyed by offset
+        std::map<u32, u32> live_ranges;
+        // oldest first, draws read the first one's buffer while there are any
+        std::vector<PendingGrow> grows;
+    };
+
+    // freed or moved-away ranges and replaced buffers, kept until no frame reads them
+    struct RetiredRange {
+        Pool* pool;
+        GeometryRange range;
+        u64 frame;
+    };
+    struct RetiredBuffer {
+        VkBuffer buffer;
+        MemoryAllocation memory;
+        u64 frame;
+    };
+
+    MemoryAllocator* allocator;
+    VkDevice device;
+    StagingRing* staging;
+
+    Pool pools[GEOMETRY_POOL_COUNT];
+
+    u64 current_frame = 0;
+    std::vector<RetiredRange> retired_ranges;
+    std::vector<RetiredBuffer> retired_buffers;
+
+    Pool& getPool(GeometryPool pool) {
+        return pools[static_cast<u32>(pool)];
+    }
+
+    void createPool(GeometryPool id, VkDeviceSize stride, VkBufferUsageFlags usage,
+                    VkAccessFlags read_access, u32 capacity);
+    void destroyPool(Pool& pool);
+    // the buffer holding every resident range of the pool
+    VkBuffer drawBuffer(Pool& pool) {
+        return pool.grows.empty() ? pool.buffer : pool.grows.front().buffer;
+    }
+    void growPool(Pool& pool, u32 min_capacity);
+    void shrinkPool(VkCommandBuffer cmd_buffer, Pool& pool, u32 new_capacity);
+    VkDeviceSize compactPool(VkCommandBuffer cmd_buffer, Pool& pool, VkDeviceSize max_bytes,
+                             std::vector<GeometryMove>* moves);
+
+    GeometryRange allocateRange(Pool& pool, u32 count);
+    // take count elements at exactly offset out of the free range starting at free_offset
+    void takeFreeRange(Pool& pool, u32 free_offset, u32 offset, u32 count);
+    void retireRange(Pool& pool, GeometryRange range);
+    void freeRange(Pool& pool, GeometryRange range);
+
+    void upload(Pool& pool, GeometryRange range, const std::function<void(void* dst)>& write);
+};
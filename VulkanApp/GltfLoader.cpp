@@ -0,0 +1,656 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include "GltfLoader.h"
+#include "Json.h"
+
+// accessor component types
+const u32 GLTF_UNSIGNED_BYTE = 5121;
+const u32 GLTF_UNSIGNED_SHORT = 5123;
+const u32 GLTF_UNSIGNED_INT = 5125;
+const u32 GLTF_FLOAT = 5126;
+const u32 GLTF_TRIANGLES = 4;
+
+struct GlbHeader {
+    u32 magic;
+    u32 version;
+    u32 length;
+};
+struct GlbChunkHeader {
+    u32 length;
+    u32 type;
+};
+
+// bytes of a buffer or buffer view, stride 0 when the elements are tightly packed
+struct GltfBytes {
+    const u8* data = nullptr;
+    size_t size = 0;
+    u32 stride = 0;
+};
+
+struct GltfAccessor {
+    const u8* data = nullptr;
+    u32 stride = 0;
+    u32 count = 0;
+    u32 component_type = 0;
+    u32 components = 0;
+    bool normalized = false;
+};
+
+struct GltfPrimitive {
+    MeshSource source;
+    u32 material = 0;
+    bool valid = true;
+};
+
+static void forEach(ThreadPool* pool, u32 count, const std::function<void(u32)>& body) {
+    if (pool) {
+        pool->parallelFor(count, body);
+        return;
+    }
+    for (u32 i = 0; i < count; i++) {
+        body(i);
+    }
+}
+
+static u32 componentSize(u32 component_type) {
+    switch (component_type) {
+    case 5120: // BYTE
+    case GLTF_UNSIGNED_BYTE:
+        return 1;
+    case 5122: // SHORT
+    case GLTF_UNSIGNED_SHORT:
+        return 2;
+    case GLTF_UNSIGNED_INT:
+    case GLTF_FLOAT:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+static u32 componentCount(const std::string& type) {
+    static const char* const TYPES[] = {"SCALAR", "VEC2", "VEC3", "VEC4", "MAT2", "MAT3", "MAT4"};
+    static const u32 COUNTS[] = {1, 2, 3, 4, 4, 9, 16};
+    for (u32 i = 0; i < 7; i++) {
+        if (type == TYPES[i]) {
+            return COUNTS[i];
+        }
+    }
+    return 0;
+}
+
+// a non-negative integer member, false when missing or anything else
+static bool getInteger(const JsonDocument& doc, const JsonValue& object, const char* key,
+                       u64* out) {
+    const JsonValue* value = doc.find(object, key);
+    if (!value || value->type != JsonType::Number || value->number < 0.0 ||
+        value->number >= 9007199254740992.0 || value->number != std::floor(value->number)) {
+        return false;
+    }
+    *out = static_cast<u64>(value->number);
+    return true;
+}
+
+static bool getIndex(const JsonDocument& doc, const JsonValue& object, const char* key,
+                     u32* out) {
+    u64 value;
+    if (!getInteger(doc, object, key, &value) || value > 0xFFFFFFFFull) {
+        return false;
+    }
+    *out = static_cast<u32>(value);
+    return true;
+}
+
+// element i of an array of indices, false unless it is one below limit
+static bool getElementIndex(const JsonDocument& doc, const JsonValue& array, u32 i, u32 limit,
+                            u32* out) {
+    const JsonValue* value = doc.get(array, i);
+    if (!value || value->type != JsonType::Number || !(value->number >= 0.0) ||
+        value->number >= limit || value->number != std::floor(value->number)) {
+        return false;
+    }
+    *out = static_cast<u32>(value->number);
+    return true;
+}
+
+// array member of exactly count numbers
+static bool getFloats(const JsonDocument& doc, const JsonValue& object, const char* key,
+                      float* out, u32 count) {
+    const JsonValue* array = doc.find(object, key);
+    if (!array || array->type != JsonType::Array || array->count != count) {
+        return false;
+    }
+    for (u32 i = 0; i < count; i++) {
+        const JsonValue* value = doc.get(*array, i);
+        if (value->type != JsonType::Number) {
+            return false;
+        }
+        out[i] = static_cast<float>(value->number);
+    }
+    return true;
+}
+
+static int hexDigit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c = static_cast<char>(c | 0x20);
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+// relative URIs are percent-encoded, "my%20model.bin" -> "my model.bin"
+static std::string decodeUri(const std::string& uri) {
+    std::string path;
+    for (size_t i = 0; i < uri.size(); i++) {
+        if (uri[i] == '%' && i + 2 < uri.size() && hexDigit(uri[i + 1]) >= 0 &&
+            hexDigit(uri[i + 2]) >= 0) {
+            path.push_back(static_cast<char>(hexDigit(uri[i + 1]) * 16 + hexDigit(uri[i + 2])));
+            i += 2;
+        } else {
+            path.push_back(uri[i]);
+        }
+    }
+    return path;
+}
+
+// "data:application/octet-stream;base64,..." -> out; false when it isn't a base64 data URI
+static bool decodeDataUri(const std::string& uri, std::vector<u8>* out) {
+    if (uri.compare(0, 5, "data:") != 0) {
+        return false;
+    }
+    size_t comma = uri.find(',');
+    if (comma == std::string::npos || comma < 7 || uri.compare(comma - 7, 7, ";base64") != 0) {
+        return false;
+    }
+    return decodeBase64(uri.data() + comma + 1, uri.size() - comma - 1, out);
+}
+
+bool decodeBase64(const char* text, size_t size, std::vector<u8>* out) {
+    while (size > 0 && text[size - 1] == '=') {
+        size--;
+    }
+    if (size % 4 == 1) {
+        return false;
+    }
+    out->clear();
+    out->reserve(size / 4 * 3 + 2);
+    u32 bits = 0;
+    u32 bit_count = 0;
+    for (size_t i = 0; i < size; i++) {
+        char c = text[i];
+        int value = c >= 'A' && c <= 'Z'   ? c - 'A'
+                    : c >= 'a' && c <= 'z' ? c - 'a' + 26
+                    : c >= '0' && c <= '9' ? c - '0' + 52
+                    : c == '+'             ? 62
+                    : c == '/'             ? 63
+                                           : -1;
+        if (value < 0) {
+            return false;
+        }
+        bits = (bits << 6) | u32(value);
+        bit_count += 6;
+        if (bit_count >= 8) {
+            bit_count -= 8;
+            out->push_back(static_cast<u8>(bits >> bit_count));
+        }
+    }
+    return true;
+}
+
+// The buffers the accessors read from, in place: the GLB's BIN chunk, mapped .bin files
+// (or their pack entries) or decoded data URIs
+static bool loadBuffers(const std::string& filename, const JsonDocument& doc, AssetPack* pack,
+                        const GltfBytes& bin_chunk, GltfModel* model,
+                        std::vector<GltfBytes>* buffers) {
+    size_t separator = filename.find_last_of("/\\");
+    std::string directory = separator == std::string::npos ? "" : filename.substr(0, separator + 1);
+    const JsonValue* array = doc.find(doc.getRoot(), "buffers");
+    u32 count = array && array->type == JsonType::Array ? array->count : 0;
+    buffers->resize(count);
+    for (u32 i = 0; i < count; i++) {
+        const JsonValue& buffer = *doc.get(*array, i);
+        u64 length;
+        if (!getInteger(doc, buffer, "byteLength", &length)) {
+            return false;
+        }
+        const JsonValue* uri = doc.find(buffer, "uri");
+        GltfBytes& bytes = (*buffers)[i];
+        if (!uri) {
+            // only the first buffer of a GLB may leave it out, it is the BIN chunk
+            if (i != 0 || !bin_chunk.data) {
+                return false;
+            }
+            bytes = bin_chunk;
+        } else {
+            std::string text = doc.getString(*uri);
+            model->buffer_storage.push_back(std::vector<u8>());
+            std::vector<u8>* storage = &model->buffer_storage.back();
+            if (decodeDataUri(text, storage)) {
+                bytes.data = storage->data();
+                bytes.size = storage->size();
+            } else {
+                model->buffer_files.push_back(std::unique_ptr<MappedFile>(new MappedFile()));
+                std::string path = directory + decodeUri(text);
+                bytes.data = pack->map(path, model->buffer_files.back().get(), storage,
+                                       &bytes.size);
+                if (!bytes.data) {
+                    printf("%s: buffer %s not found\n", filename.c_str(), path.c_str());
+                    return false;
+                }
+            }
+        }
+        if (bytes.size < length) {
+            return false;
+        }
+        bytes.size = static_cast<size_t>(length);
+    }
+    return true;
+}
+
+static bool loadBufferViews(const JsonDocument& doc, const std::vector<GltfBytes>& buffers,
+                            std::vector<GltfBytes>* views) {
+    const JsonValue* array = doc.find(doc.getRoot(), "bufferViews");
+    u32 count = array && array->type == JsonType::Array ? array->count : 0;
+    views->resize(count);
+    for (u32 i = 0; i < count; i++) {
+        const JsonValue& view = *doc.get(*array, i);
+        u32 buffer;
+        u64 offset = 0;
+        u64 length;
+        u64 stride = 0;
+        if (!getIndex(doc, view, "buffer", &buffer) || buffer >= buffers.size() ||
+            !getInteger(doc, view, "byteLength", &length) ||
+            (doc.find(view, "byteOffset") && !getInteger(doc, view, "byteOffset", &offset)) ||
+            (doc.find(view, "byteStride") && !getInteger(doc, view, "byteStride", &stride)) ||
+            offset > buffers[buffer].size || length > buffers[buffer].size - offset ||
+            stride > 252) {
+            return false;
+        }
+        (*views)[i].data = buffers[buffer].data + offset;
+        (*views)[i].size = static_cast<size_t>(length);
+        (*views)[i].stride = static_cast<u32>(stride);
+    }
+    return true;
+}
+
+// an accessor's elements in place; sparse ones and ones without a view aren't supported
+static bool readAccessor(const JsonDocument& doc, const std::vector<GltfBytes>& views, u32 index,
+                         GltfAccessor* accessor) {
+    const JsonValue* array = doc.find(doc.getRoot(), "accessors");
+    const JsonValue* object = array ? doc.get(*array, index) : nullptr;
+    u32 view_index;
+    u32 component_type;
+    u64 offset = 0;
+    u64 count;
+    if (!object || doc.find(*object, "sparse") ||
+        !getIndex(doc, *object, "bufferView", &view_index) || view_index >= views.size() ||
+        !getIndex(doc, *object, "componentType", &component_type) ||
+        !getInteger(doc, *object, "count", &count) || count == 0 || count > 0xFFFFFFFFull ||
+        (doc.find(*object, "byteOffset") && !getInteger(doc, *object, "byteOffset", &offset))) {
+        return false;
+    }
+    u32 components = componentCount(doc.getString(*object, "type"));
+    u32 element_size = componentSize(component_type) * components;
+    if (element_size == 0) {
+        return false;
+    }
+
+    const GltfBytes& view = views[view_index];
+    u32 stride = view.stride ? view.stride : element_size;
+    if (stride < element_size || offset > view.size ||
+        (count - 1) * stride + element_size > view.size - offset) {
+        return false;
+    }
+    const JsonValue* normalized = doc.find(*object, "normalized");
+    accessor->data = view.data + offset;
+    accessor->stride = stride;
+    accessor->count = static_cast<u32>(count);
+    accessor->component_type = component_type;
+    accessor->components = components;
+    accessor->normalized = normalized && normalized->type == JsonType::Boolean &&
+                           normalized->boolean;
+    return true;
+}
+
+// A primitive as a MeshSource over its accessors, false when it isn't triangles the
+// renderer can read
+static bool readPrimitive(const JsonDocument& doc, const std::vector<GltfBytes>& views,
+                          const JsonValue& object, u32 default_material,
+                          GltfPrimitive* primitive) {
+    u32 mode = GLTF_TRIANGLES;
+    const JsonValue* attributes = doc.find(object, "attributes");
+    u32 position_index;
+    if ((doc.find(object, "mode") && !getIndex(doc, object, "mode", &mode)) ||
+        mode != GLTF_TRIANGLES || !attributes ||
+        !getIndex(doc, *attributes, "POSITION", &position_index)) {
+        return false;
+    }
+
+    GltfAccessor positions;
+    if (!readAccessor(doc, views, position_index, &positions) ||
+        positions.component_type != GLTF_FLOAT || positions.components != 3) {
+        return false;
+    }
+    MeshSource& source = primitive->source;
+    source.positions = {positions.data, positions.stride, ComponentType::Float};
+    source.vertex_count = positions.count;
+
+    u32 uv_index;
+    if (getIndex(doc, *attributes, "TEXCOORD_0", &uv_index)) {
+        GltfAccessor uvs;
+        if (!readAccessor(doc, views, uv_index, &uvs) || uvs.components != 2 ||
+            uvs.count < positions.count) {
+            return false;
+        }
+        if (uvs.component_type == GLTF_FLOAT) {
+            source.uvs = {uvs.data, uvs.stride, ComponentType::Float};
+        } else if (uvs.component_type == GLTF_UNSIGNED_BYTE && uvs.normalized) {
+            source.uvs = {uvs.data, uvs.stride, ComponentType::UNorm8};
+        } else if (uvs.component_type == GLTF_UNSIGNED_SHORT && uvs.normalized) {
+            source.uvs = {uvs.data, uvs.stride, ComponentType::UNorm16};
+        } else {
+            return false;
+        }
+    }
+
+    // without indices the vertices are the triangle list
+    u32 index_accessor;
+    source.index_count = positions.count;
+    if (doc.find(object, "indices")) {
+        GltfAccessor indices;
+        if (!getIndex(doc, object, "indices", &index_accessor) ||
+            !readAccessor(doc, views, index_accessor, &indices) || indices.components != 1) {
+            return false;
+        }
+        ComponentType type;
+        if (indices.component_type == GLTF_UNSIGNED_BYTE) {
+            type = ComponentType::UInt8;
+        } else if (indices.component_type == GLTF_UNSIGNED_SHORT) {
+            type = ComponentType::UInt16;
+        } else if (indices.component_type == GLTF_UNSIGNED_INT) {
+            type = ComponentType::UInt32;
+        } else {
+            return false;
+        }
+        source.index_view = {indices.data, indices.stride, type};
+        source.index_count = indices.count;
+    }
+    if (source.index_count % 3 != 0) {
+        return false;
+    }
+
+    primitive->material = default_material;
+    if (doc.find(object, "material") &&
+        (!getIndex(doc, object, "material", &primitive->material) ||
+         primitive->material >= default_material)) {
+        return false;
+    }
+    return true;
+}
+
+// the base color image of every material, the default one last
+static bool loadMaterials(const std::string& filename, const JsonDocument& doc,
+                          const std::vector<GltfBytes>& views, GltfModel* model) {
+    const JsonValue& root = doc.getRoot();
+    const JsonValue* materials = doc.find(root, "materials");
+    const JsonValue* textures = doc.find(root, "textures");
+    const JsonValue* images = doc.find(root, "images");
+    u32 material_count = materials && materials->type == JsonType::Array ? materials->count : 0;
+    u32 image_count = images && images->type == JsonType::Array ? images->count : 0;
+    model->texture_names.assign(material_count + 1, "");
+    model->embedded_images.assign(material_count + 1, EmbeddedImage());
+
+    // several materials may share an image, data URIs are only decoded once
+    std::vector<std::string> image_names(image_count);
+    std::vector<EmbeddedImage> image_data(image_count);
+    std::vector<bool> image_loaded(image_count, false);
+    for (u32 m = 0; m < material_count; m++) {
+        const JsonValue* pbr = doc.find(*doc.get(*materials, m), "pbrMetallicRoughness");
+        const JsonValue* base_color = pbr ? doc.find(*pbr, "baseColorTexture") : nullptr;
+        u32 texture_index;
+        u32 image_index;
+        if (!base_color || !getIndex(doc, *base_color, "index", &texture_index) || !textures ||
+            !doc.get(*textures, texture_index) ||
+            !getIndex(doc, *doc.get(*textures, texture_index), "source", &image_index) ||
+            image_index >= image_count) {
+            continue;
+        }
+
+        if (!image_loaded[image_index]) {
+            image_loaded[image_index] = true;
+            const JsonValue& image = *doc.get(*images, image_index);
+            std::string embedded_name = filename + "#image" + std::to_string(image_index);
+            EmbeddedImage& data = image_data[image_index];
+            u32 view_index;
+            std::string uri = doc.getString(image, "uri");
+            std::vector<u8> decoded;
+            if (getIndex(doc, image, "bufferView", &view_index) && view_index < views.size()) {
+                data.data = views[view_index].data;
+                data.size = views[view_index].size;
+                image_names[image_index] = embedded_name;
+            } else if (decodeDataUri(uri, &decoded)) {
+                model->buffer_storage.push_back(std::move(decoded));
+                data.data = model->buffer_storage.back().data();
+                data.size = model->buffer_storage.back().size();
+                image_names[image_index] = embedded_name;
+            } else {
+                // named the way MeshModel::LoadMaterials names it
+                std::string path = decodeUri(uri);
+                size_t separator = path.find_last_of("/\\");
+                image_names[image_index] =
+                    separator == std::string::npos ? path : path.substr(separator + 1);
+            }
+            if (data.data) {
+                data.hash = fnv1a64(data.data, data.size);
+            }
+        }
+        model->texture_names[m] = image_names[image_index];
+        model->embedded_images[m] = image_data[image_index];
+    }
+    return true;
+}
+
+// transform of a node relative to its parent, from its matrix or TRS
+static glm::mat4 nodeTransform(const JsonDocument& doc, const JsonValue& node) {
+    float values[16];
+    if (getFloats(doc, node, "matrix", values, 16)) {
+        glm::mat4 matrix;
+        for (u32 c = 0; c < 4; c++) {
+            for (u32 r = 0; r < 4; r++) {
+                matrix[c][r] = values[c * 4 + r];
+            }
+        }
+        return matrix;
+    }
+    glm::mat4 transform(1.0f);
+    if (getFloats(doc, node, "translation", values, 3)) {
+        transform = glm::translate(transform, glm::vec3(values[0], values[1], values[2]));
+    }
+    if (getFloats(doc, node, "rotation", values, 4)) {
+        // stored x, y, z, w
+        transform *= glm::mat4_cast(glm::quat(values[3], values[0], values[1], values[2]));
+    }
+    if (getFloats(doc, node, "scale", values, 3)) {
+        transform = glm::scale(transform, glm::vec3(values[0], values[1], values[2]));
+    }
+    return transform;
+}
+
+bool loadGltf(const std::string& filename, AssetPack* pack, ThreadPool* pool, GltfModel* model) {
+    size_t size = 0;
+    const u8* data = pack->map(filename, &model->file, &model->storage, &size);
+    if (!data) {
+        return false;
+    }
+
+    // a GLB is a header, the JSON chunk and optionally the BIN chunk; anything else is the
+    // JSON of a .gltf
+    const char* json = reinterpret_cast<const char*>(data);
+    size_t json_size = size;
+    GltfBytes bin_chunk;
+    GlbHeader header = {};
+    if (size >= sizeof(header)) {
+        memcpy(&header, data, sizeof(header));
+    }
+    if (header.magic == GLB_MAGIC) {
+        GlbChunkHeader chunk = {};
+        size_t offset = sizeof(header);
+        if (header.version != 2 || header.length > size ||
+            header.length < offset + sizeof(chunk)) {
+            return false;
+        }
+        memcpy(&chunk, data + offset, sizeof(chunk));
+        offset += sizeof(chunk);
+        if (chunk.type != GLB_CHUNK_JSON || chunk.length > header.length - offset) {
+            return false;
+        }
+        json = reinterpret_cast<const char*>(data + offset);
+        json_size = chunk.length;
+        offset += chunk.length;
+        if (header.length - offset >= sizeof(chunk)) {
+            memcpy(&chunk, data + offset, sizeof(chunk));
+            offset += sizeof(chunk);
+            if (chunk.type == GLB_CHUNK_BIN && chunk.length <= header.length - offset) {
+                bin_chunk.data = data + offset;
+                bin_chunk.size = chunk.length;
+            }
+        }
+    }
+
+    JsonDocument doc;
+    std::vector<GltfBytes> buffers;
+    std::vector<GltfBytes> views;
+    if (!doc.parse(json, json_size) || doc.getRoot().type != JsonType::Object ||
+        !loadBuffers(filename, doc, pack, bin_chunk, model, &buffers) ||
+        !loadBufferViews(doc, buffers, &views) || !loadMaterials(filename, doc, views, model)) {
+        return false;
+    }
+    const JsonValue& root = doc.getRoot();
+    u32 default_material = static_cast<u32>(model->texture_names.size() - 1);
+
+    // every primitive of every mesh, checked and bounded in parallel; a node using a mesh
+    // gets copies of its sources, the views themselves are shared
+    const JsonValue* gltf_meshes = doc.find(root, "meshes");
+    u32 mesh_count = gltf_meshes && gltf_meshes->type == JsonType::Array ? gltf_meshes->count : 0;
+    std::vector<GltfPrimitive> primitives;
+    std::vector<u32> first_primitive(mesh_count + 1, 0);
+    for (u32 m = 0; m < mesh_count; m++) {
+        first_primitive[m] = static_cast<u32>(primitives.size());
+        const JsonValue* array = doc.find(*doc.get(*gltf_meshes, m), "primitives");
+        u32 count = array && array->type == JsonType::Array ? array->count : 0;
+        for (u32 p = 0; p < count; p++) {
+            GltfPrimitive primitive;
+            if (readPrimitive(doc, views, *doc.get(*array, p), default_material, &primitive)) {
+                primitives.push_back(primitive);
+            } else {
+                printf("%s: skipping primitive %u of mesh %u\n", filename.c_str(), p, m);
+            }
+        }
+    }
+    first_primitive[mesh_count] = static_cast<u32>(primitives.size());
+    forEach(pool, static_cast<u32>(primitives.size()), [&](u32 i) {
+        MeshSource& source = primitives[i].source;
+        for (u32 j = 0; j < source.index_count; j++) {
+            if (source.getIndex(j) >= source.vertex_count) {
+                primitives[i].valid = false;
+                return;
+            }
+        }
+        source.bounds = computeBounds(source.getVertices());
+    });
+
+    // Nodes of the default scene in depth first order under one root, like LoadScene. An
+    // explicit stack, glTF hierarchies can be as deep as the exporter likes.
+    const JsonValue* gltf_nodes = doc.find(root, "nodes");
+    u32 node_count = gltf_nodes && gltf_nodes->type == JsonType::Array ? gltf_nodes->count : 0;
+    std::vector<u32> roots;
+    u32 scene_index = 0;
+    const JsonValue* scenes = doc.find(root, "scenes");
+    if (doc.find(root, "scene")) {
+        getIndex(doc, root, "scene", &scene_index);
+    }
+    const JsonValue* scene = scenes ? doc.get(*scenes, scene_index) : nullptr;
+    const JsonValue* scene_nodes = scene ? doc.find(*scene, "nodes") : nullptr;
+    if (scene_nodes && scene_nodes->type == JsonType::Array) {
+        for (u32 i = 0; i < scene_nodes->count; i++) {
+            u32 node;
+            if (getElementIndex(doc, *scene_nodes, i, node_count, &node)) {
+                roots.push_back(node);
+            }
+        }
+    } else {
+        // no scene: every node nobody has as a child
+        std::vector<bool> is_child(node_count, false);
+        for (u32 n = 0; n < node_count; n++) {
+            const JsonValue* children = doc.find(*doc.get(*gltf_nodes, n), "children");
+            for (u32 c = 0; children && c < children->count; c++) {
+                u32 child;
+                if (getElementIndex(doc, *children, c, node_count, &child)) {
+                    is_child[child] = true;
+                }
+            }
+        }
+        for (u32 n = 0; n < node_count; n++) {
+            if (!is_child[n]) {
+                roots.push_back(n);
+            }
+        }
+    }
+
+    model->nodes.push_back({glm::mat4(1.0f), -1, 0, 0, 0});
+    std::vector<bool> visited(node_count, false);
+    std::vector<std::pair<u32, int>> stack;
+    for (size_t i = roots.size(); i-- > 0;) {
+        stack.push_back({roots[i], 0});
+    }
+    while (!stack.empty()) {
+        u32 n = stack.back().first;
+        int parent = stack.back().second;
+        stack.pop_back();
+        // a node reached twice would make the hierarchy a graph
+        if (visited[n]) {
+            continue;
+        }
+        visited[n] = true;
+        const JsonValue& node = *doc.get(*gltf_nodes, n);
+
+        SceneNode scene_node = {nodeTransform(doc, node), parent,
+                                static_cast<u32>(model->meshes.size()), 0, 0};
+        u32 mesh;
+        if (getIndex(doc, node, "mesh", &mesh) && mesh < mesh_count) {
+            for (u32 p = first_primitive[mesh]; p < first_primitive[mesh + 1]; p++) {
+                if (primitives[p].valid) {
+                    model->meshes.push_back(primitives[p].source);
+                    model->materials.push_back(primitives[p].material);
+                    scene_node.mesh_count++;
+                }
+            }
+        }
+        int index = static_cast<int>(model->nodes.size());
+        model->nodes.push_back(scene_node);
+
+        const JsonValue* children = doc.find(node, "children");
+        u32 child_count = children && children->type == JsonType::Array ? children->count : 0;
+        for (u32 c = child_count; c-- > 0;) {
+            u32 child;
+            if (getElementIndex(doc, *children, c, node_count, &child)) {
+                stack.push_back({child, index});
+            }
+        }
+    }
+
+    u32 skipped = 0;
+    for (const GltfPrimitive& primitive : primitives) {
+        skipped += primitive.valid ? 0 : 1;
+    }
+    if (skipped > 0) {
+        printf("%s: skipped %u primitives with out of range indices\n", filename.c_str(),
+               skipped);
+    }
+    return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "AssetPack.h"
+#include "MappedFile.h"
+#include "Mesh.h"
+#include "ThreadPool.h"
+#include "Utilities.h"
+
+const u32 GLB_MAGIC = 0x46546C67;      // "glTF"
+const u32 GLB_CHUNK_JSON = 0x4E4F534A; // "JSON"
+const u32 GLB_CHUNK_BIN = 0x004E4942;  // "BIN\0"
+
+// An encoded image (PNG, JPEG) inside the model's buffers, decoded from where it lies
+struct EmbeddedImage {
+    const u8* data = nullptr;
+    size_t size = 0;
+    u64 hash = 0; // fnv1a64 of the bytes, for the texture registry
+};
+
+// A glTF 2.0 model whose meshes read their accessors in place. Nothing is converted at load
+// time: the MeshSources point into the mapped .glb/.bin files (or the decoded data URIs
+// held here), and Mesh interleaves or quantizes them straight into the arena's staging
+// memory. Has to outlive every Mesh created from it and every decode of its images.
+struct GltfModel {
+    // per material, the base color map as MeshModel::LoadMaterials names it, or a name of the
+    // form "file.glb#image3" for embedded ones; the last material is the default one
+    std::vector<std::string> texture_names;
+    std::vector<EmbeddedImage> embedded_images; // per material, data null when not embedded
+    std::vector<SceneNode> nodes;
+    std::vector<MeshSource> meshes; // one per triangle primitive, bounds already computed
+    std::vector<u32> materials;     // per mesh
+
+    // what the views point into
+    MappedFile file;
+    std::vector<u8> storage;
+    std::vector<std::unique_ptr<MappedFile>> buffer_files;
+    std::vector<std::vector<u8>> buffer_storage;
+};
+
+// glTF 2.0 loader for .gltf and .glb, without Assimp:
+//  - GLB files are mapped and their BIN chunk used in place, .gltf buffers are mapped from
+//    their .bin files or decoded from base64 data URIs
+//  - each triangle primitive with float3 positions becomes a mesh over its accessors: float
+//    or normalized u8/u16 TEXCOORD_0, u8/u16/u32 or no indices
+//  - the node hierarchy keeps its matrices or TRS transforms, under one root holding the
+//    default scene
+// Normals, skins, morph targets, animations and sparse accessors are skipped. False on a
+// missing file or malformed data; primitives that can't be read are left out.
+bool loadGltf(const std::string& filename, AssetPack* pack, ThreadPool* pool, GltfModel* model);
+
+// standard base64, padding optional; false on anything else
+bool decodeBase64(const char* text, size_t size, std::vector<u8>* out);
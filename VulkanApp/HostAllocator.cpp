@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include "HostAllocator.h"
+
+const char* hostScopeName(u32 scope) {
+    switch (scope) {
+    case VK_SYSTEM_ALLOCATION_SCOPE_COMMAND:
+        return "command";
+    case VK_SYSTEM_ALLOCATION_SCOPE_OBJECT:
+        return "object";
+    case VK_SYSTEM_ALLOCATION_SCOPE_CACHE:
+        return "cache";
+    case VK_SYSTEM_ALLOCATION_SCOPE_DEVICE:
+        return "device";
+    case VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE:
+        return "instance";
+    default:
+        return "unknown";
+    }
+}
+
+static uintptr_t alignUp(uintptr_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(uintptr_t(alignment) - 1);
+}
+
+HostAllocator::HostAllocator() {}
+
+HostAllocator::~HostAllocator() {}
+
+void HostAllocator::init(bool frame_arena) {
+    vk_callbacks = {};
+    vk_callbacks.pUserData = this;
+    vk_callbacks.pfnAllocation = allocationCallback;
+    vk_callbacks.pfnReallocation = reallocationCallback;
+    vk_callbacks.pfnFree = freeCallback;
+    vk_callbacks.pfnInternalAllocation = internalAllocationCallback;
+    vk_callbacks.pfnInternalFree = internalFreeCallback;
+
+    stats = HostAllocationStats();
+    stats.arena_enabled = frame_arena;
+    if (frame_arena) {
+        arena.resize(HOST_FRAME_ARENA_SIZE);
+    }
+    arena_head = 0;
+    arena_live = 0;
+}
+
+void HostAllocator::destroy() {
+    arena.clear();
+    arena.shrink_to_fit();
+}
+
+void HostAllocator::beginFrame() {
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.frame_allocations = frame_allocations;
+    stats.frame_bytes = frame_bytes;
+    frame_allocations = 0;
+    frame_bytes = 0;
+
+    // command scope allocations end with their command, so the arena is normally empty here
+    if (arena_live == 0) {
+        arena_head = 0;
+    }
+}
+
+HostAllocationStats HostAllocator::getStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void* HostAllocator::allocate(size_t size, size_t alignment, VkSystemAllocationScope scope) {
+    if (size == 0) {
+        return nullptr;
+    }
+    alignment = std::max<size_t>(alignment, alignof(Header));
+
+    void* memory = nullptr;
+    void* raw = nullptr;
+    if (scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND && !arena.empty()) {
+        uintptr_t base = reinterpret_cast<uintptr_t>(arena.data());
+        uintptr_t start = alignUp(base + arena_head + sizeof(Header), alignment);
+        if (start + size <= base + arena.size()) {
+            memory = reinterpret_cast<void*>(start);
+            arena_head = start + size - base;
+            arena_live++;
+            stats.arena_allocations++;
+        } else {
+            stats.arena_fallbacks++;
+        }
+    }
+    if (!memory) {
+        raw = std::malloc(size + alignment + sizeof(Header));
+        if (!raw) {
+            return nullptr;
+        }
+        uintptr_t start =
+            alignUp(reinterpret_cast<uintptr_t>(raw) + sizeof(Header), alignment);
+        memory = reinterpret_cast<void*>(start);
+    }
+
+    Header* header = headerOf(memory);
+    header->raw = raw;
+    header->size = size;
+    header->scope = scope;
+    track(scope, size, true);
+    return memory;
+}
+
+void* HostAllocator::reallocate(void* original, size_t size, size_t alignment,
+                                VkSystemAllocationScope scope) {
+    if (!original) {
+        return allocate(size, alignment, scope);
+    }
+    if (size == 0) {
+        free(original);
+        return nullptr;
+    }
+    // the driver may ask for a new scope or alignment, simplest to always move
+    void* memory = allocate(size, alignment, scope);
+    if (!memory) {
+        // the original stays valid on failure
+        return nullptr;
+    }
+    memcpy(memory, original, size_t(std::min<u64>(size, headerOf(original)->size)));
+    free(original);
+    return memory;
+}
+
+void HostAllocator::free(void* memory) {
+    if (!memory) {
+        return;
+    }
+    Header* header = headerOf(memory);
+    track(header->scope, header->size, false);
+
+    if (header->raw) {
+        std::free(header->raw);
+    } else {
+        arena_live--;
+    }
+}
+
+void HostAllocator::track(u32 scope, u64 size, bool allocated) {
+    HostScopeStats& scope_stats = stats.scopes[std::min(scope, HOST_SCOPE_COUNT - 1)];
+    if (allocated) {
+        scope_stats.allocation_count++;
+        scope_stats.live_count++;
+        scope_stats.live_bytes += size;
+        scope_stats.peak_bytes = std::max(scope_stats.peak_bytes, scope_stats.live_bytes);
+        frame_allocations++;
+        frame_bytes += size;
+    } else {
+        scope_stats.live_count--;
+        scope_stats.live_bytes -= size;
+    }
+}
+
+void* VKAPI_CALL HostAllocator::allocationCallback(void* user_data, size_t size, size_t alignment,
+                                                   VkSystemAllocationScope scope) {
+    HostAllocator* host = static_cast<HostAllocator*>(user_data);
+    std::lock_guard<std::mutex> lock(host->mutex);
+    return host->allocate(size, alignment, scope);
+}
+
+void* VKAPI_CALL HostAllocator::reallocationCallback(void* user_data, void* original,
+                                                     size_t size, size_t alignment,
+                                                     VkSystemAllocationScope scope) {
+    HostAllocator* host = static_cast<HostAllocator*>(user_data);
+    std::lock_guard<std::mutex> lock(host->mutex);
+    return host->reallocate(original, size, alignment, scope);
+}
+
+void VKAPI_CALL HostAllocator::freeCallback(void* user_data, void* memory) {
+    HostAllocator* host = static_cast<HostAllocator*>(user_data);
+    std::lock_guard<std::mutex> lock(host->mutex);
+    host->free(memory);
+}
+
+void VKAPI_CALL HostAllocator::internalAllocationCallback(void* user_data, size_t size,
+                                                          VkInternalAllocationType type,
+                                                          VkSystemAllocationScope scope) {
+    HostAllocator* host = static_cast<HostAllocator*>(user_data);
+    std::lock_guard<std::mutex> lock(host->mutex);
+    host->stats.scopes[std::min<u32>(scope, HOST_SCOPE_COUNT - 1)].internal_bytes += size;
+}
+
+void VKAPI_CALL HostAllocator::internalFreeCallback(void* user_data, size_t size,
+                                                    VkInternalAllocationType type,
+                                                    VkSystemAllocationScope scope) {
+    HostAllocator* host = static_cast<HostAllocator*>(user_data);
+    std::lock_guard<std::mutex> lock(host->mutex);
+    host->stats.scopes[std::min<u32>(scope, HOST_SCOPE_COUNT - 1)].internal_bytes -= size;
+}
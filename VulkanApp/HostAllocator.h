@@ -0,0 +1,95 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <array>
+#include <mutex>
+#include <vector>
+#include <GLFW/glfw3.h>
+#include "Utilities.h"
+
+// Size of the per-frame arena serving command scope host allocations
+const size_t HOST_FRAME_ARENA_SIZE = 1024 * 1024;
+
+// VK_SYSTEM_ALLOCATION_SCOPE_COMMAND .. VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE
+const u32 HOST_SCOPE_COUNT = 5;
+
+const char* hostScopeName(u32 scope);
+
+struct HostScopeStats {
+    u64 allocation_count = 0; // allocations and reallocations so far
+    u64 live_count = 0;
+    u64 live_bytes = 0;
+    u64 peak_bytes = 0;
+    u64 internal_bytes = 0; // driver allocations it only told us about (executable memory)
+};
+
+struct HostAllocationStats {
+    std::array<HostScopeStats, HOST_SCOPE_COUNT> scopes;
+    bool arena_enabled = false;
+    u64 arena_allocations = 0; // command scope allocations served by the frame arena
+    u64 arena_fallbacks = 0;   // ... that didn't fit and went to the heap
+    u64 frame_allocations = 0; // host allocations during the last complete frame
+    u64 frame_bytes = 0;
+};
+
+// Host memory callbacks handed to every vkCreate*/vkAllocate* call. Counts allocations and
+// bytes per allocation scope, and can serve the short lived command scope allocations from a
+// bump arena reset once per frame. The driver may call in from any thread.
+class HostAllocator {
+public:
+    HostAllocator();
+    ~HostAllocator();
+
+    void init(bool frame_arena);
+    void destroy();
+
+    const VkAllocationCallbacks* callbacks() {
+        return &vk_callbacks;
+    }
+
+    // start of a frame: closes the per-frame counters and resets the arena when it's empty
+    void beginFrame();
+
+    HostAllocationStats getStats();
+
+private:
+    // in front of every allocation handed to the driver
+    struct alignas(16) Header {
+        void* raw;  // start of the malloc block, nullptr when in the arena
+        u64 size;
+        u32 scope;
+        u32 padding;
+    };
+
+    VkAllocationCallbacks vk_callbacks;
+    std::mutex mutex;
+    HostAllocationStats stats;
+    u64 frame_allocations = 0;
+    u64 frame_bytes = 0;
+
+    std::vector<u8> arena;
+    size_t arena_head = 0;
+    u64 arena_live = 0;
+
+    void* allocate(size_t size, size_t alignment, VkSystemAllocationScope scope);
+    void* reallocate(void* original, size_t size, size_t alignment,
+                     VkSystemAllocationScope scope);
+    void free(void* memory);
+    void track(u32 scope, u64 size, bool allocated);
+
+    static Header* headerOf(void* memory) {
+        return reinterpret_cast<Header*>(static_cast<u8*>(memory) - sizeof(Header));
+    }
+
+    static void* VKAPI_CALL allocationCallback(void* user_data, size_t size, size_t alignment,
+                                               VkSystemAllocationScope scope);
+    static void* VKAPI_CALL reallocationCallback(void* user_data, void* original, size_t size,
+                                                 size_t alignment, VkSystemAllocationScope scope);
+    static void VKAPI_CALL freeCallback(void* user_data, void* memory);
+    static void VKAPI_CALL internalAllocationCallback(void* user_data, size_t size,
+                                                      VkInternalAllocationType type,
+                                                      VkSystemAllocationScope scope);
+    static void VKAPI_CALL internalFreeCallback(void* user_data, size_t size,
+                                                VkInternalAllocationType type,
+                                                VkSystemAllocationScope scope);
+};
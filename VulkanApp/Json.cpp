@@ -0,0 +1,325 @@
+#include <cstdlib>
+#include <cstring>
+#include "Json.h"
+
+static bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// four hex digits at p, -1 when they aren't
+static int parseHex4(const char* p, const char* end) {
+    if (end - p < 4) {
+        return -1;
+    }
+    int code = 0;
+    for (int i = 0; i < 4; i++) {
+        int digit = hexValue(p[i]);
+        if (digit < 0) {
+            return -1;
+        }
+        code = code * 16 + digit;
+    }
+    return code;
+}
+
+static void appendUtf8(u32 code, std::string* out) {
+    if (code < 0x80) {
+        out->push_back(static_cast<char>(code));
+    } else if (code < 0x800) {
+        out->push_back(static_cast<char>(0xC0 | (code >> 6)));
+        out->push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    } else if (code < 0x10000) {
+        out->push_back(static_cast<char>(0xE0 | (code >> 12)));
+        out->push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+        out->push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    } else {
+        out->push_back(static_cast<char>(0xF0 | (code >> 18)));
+        out->push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+        out->push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+        out->push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    }
+}
+
+bool JsonDocument::parse(const char* text, size_t size) {
+    values.assign(1, JsonValue());
+    children.clear();
+    scratch.clear();
+    end = text + size;
+    const char* p = parseValue(text, 0, 0);
+    if (!p || skipSpace(p) != end) {
+        values.assign(1, JsonValue());
+        children.clear();
+        return false;
+    }
+    return true;
+}
+
+const JsonValue* JsonDocument::find(const JsonValue& object, const char* key) const {
+    if (object.type != JsonType::Object) {
+        return nullptr;
+    }
+    size_t length = strlen(key);
+    for (u32 i = 0; i < object.count; i++) {
+        const JsonValue& name = values[children[object.first + i * 2]];
+        if (name.length == length && memcmp(name.text, key, length) == 0) {
+            return &values[children[object.first + i * 2 + 1]];
+        }
+    }
+    return nullptr;
+}
+
+const JsonValue* JsonDocument::get(const JsonValue& array, u32 index) const {
+    if (array.type != JsonType::Array || index >= array.count) {
+        return nullptr;
+    }
+    return &values[children[array.first + index]];
+}
+
+std::string JsonDocument::getString(const JsonValue& value) const {
+    std::string out;
+    if (value.type != JsonType::String) {
+        return out;
+    }
+    // escapes were checked by parseString
+    const char* p = value.text;
+    const char* text_end = value.text + value.length;
+    out.reserve(value.length);
+    while (p < text_end) {
+        if (*p != '\\') {
+            out.push_back(*p++);
+            continue;
+        }
+        char escape = p[1];
+        p += 2;
+        switch (escape) {
+        case 'b':
+            out.push_back('\b');
+            break;
+        case 'f':
+            out.push_back('\f');
+            break;
+        case 'n':
+            out.push_back('\n');
+            break;
+        case 'r':
+            out.push_back('\r');
+            break;
+        case 't':
+            out.push_back('\t');
+            break;
+        case 'u': {
+            u32 code = static_cast<u32>(parseHex4(p, text_end));
+            p += 4;
+            // a surrogate pair makes one code point, a lone half becomes U+FFFD
+            if (code >= 0xD800 && code < 0xDC00 && text_end - p >= 6 && p[0] == '\\' &&
+                p[1] == 'u') {
+                int low = parseHex4(p + 2, text_end);
+                if (low >= 0xDC00 && low < 0xE000) {
+                    code = 0x10000 + ((code - 0xD800) << 10) + (u32(low) - 0xDC00);
+                    p += 6;
+                }
+            }
+            appendUtf8(code >= 0xD800 && code < 0xE000 ? 0xFFFD : code, &out);
+            break;
+        }
+        default: // '"', '\\' and '/'
+            out.push_back(escape);
+            break;
+        }
+    }
+    return out;
+}
+
+double JsonDocument::getNumber(const JsonValue& object, const char* key, double fallback) const {
+    const JsonValue* value = find(object, key);
+    return value && value->type == JsonType::Number ? value->number : fallback;
+}
+
+std::string JsonDocument::getString(const JsonValue& object, const char* key) const {
+    const JsonValue* value = find(object, key);
+    return value ? getString(*value) : std::string();
+}
+
+const char* JsonDocument::skipSpace(const char* p) const {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+        p++;
+    }
+    return p;
+}
+
+const char* JsonDocument::parseValue(const char* p, u32 index, u32 depth) {
+    p = skipSpace(p);
+    if (p == end) {
+        return nullptr;
+    }
+    JsonValue& value = values[index];
+    switch (*p) {
+    case '{':
+        return parseContainer(p, index, depth, true);
+    case '[':
+        return parseContainer(p, index, depth, false);
+    case '"':
+        return parseString(p, &value);
+    case 't':
+    case 'f':
+    case 'n': {
+        const char* literal = *p == 't' ? "true" : *p == 'f' ? "false" : "null";
+        size_t length = strlen(literal);
+        if (size_t(end - p) < length || memcmp(p, literal, length) != 0) {
+            return nullptr;
+        }
+        value.type = *p == 'n' ? JsonType::Null : JsonType::Boolean;
+        value.boolean = *p == 't';
+        return p + length;
+    }
+    default:
+        return parseNumber(p, &value);
+    }
+}
+
+const char* JsonDocument::parseString(const char* p, JsonValue* value) const {
+    if (p == end || *p != '"') {
+        return nullptr;
+    }
+    const char* start = ++p;
+    while (p < end && *p != '"') {
+        if (static_cast<u8>(*p) < 0x20) {
+            return nullptr;
+        }
+        if (*p != '\\') {
+            p++;
+            continue;
+        }
+        if (end - p < 2 || p[1] == '\0' || !strchr("\"\\/bfnrtu", p[1])) {
+            return nullptr;
+        }
+        if (p[1] == 'u' && parseHex4(p + 2, end) < 0) {
+            return nullptr;
+        }
+        p += p[1] == 'u' ? 6 : 2;
+    }
+    if (p == end) {
+        return nullptr;
+    }
+    value->type = JsonType::String;
+    value->text = start;
+    value->length = static_cast<u32>(p - start);
+    return p + 1;
+}
+
+const char* JsonDocument::parseNumber(const char* p, JsonValue* value) const {
+    // -? (0 | [1-9][0-9]*) (. [0-9]+)? ([eE] [+-]? [0-9]+)?
+    const char* start = p;
+    if (p < end && *p == '-') {
+        p++;
+    }
+    if (p == end || !isDigit(*p)) {
+        return nullptr;
+    }
+    if (*p == '0') {
+        p++;
+    } else {
+        while (p < end && isDigit(*p)) {
+            p++;
+        }
+    }
+    if (p < end && *p == '.') {
+        p++;
+        if (p == end || !isDigit(*p)) {
+            return nullptr;
+        }
+        while (p < end && isDigit(*p)) {
+            p++;
+        }
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        if (p < end && (*p == '+' || *p == '-')) {
+            p++;
+        }
+        if (p == end || !isDigit(*p)) {
+            return nullptr;
+        }
+        while (p < end && isDigit(*p)) {
+            p++;
+        }
+    }
+
+    // strtod needs a terminator the source text hasn't got
+    char buffer[64];
+    size_t length = static_cast<size_t>(p - start);
+    if (length < sizeof(buffer)) {
+        memcpy(buffer, start, length);
+        buffer[length] = '\0';
+        value->number = strtod(buffer, nullptr);
+    } else {
+        value->number = strtod(std::string(start, p).c_str(), nullptr);
+    }
+    value->type = JsonType::Number;
+    return p;
+}
+
+const char* JsonDocument::parseContainer(const char* p, u32 index, u32 depth, bool object) {
+    if (depth >= JSON_MAX_DEPTH) {
+        return nullptr;
+    }
+    char close = object ? '}' : ']';
+    size_t base = scratch.size();
+    p = skipSpace(p + 1);
+    if (p < end && *p == close) {
+        p++;
+    } else {
+        for (;;) {
+            if (object) {
+                u32 key = static_cast<u32>(values.size());
+                values.push_back(JsonValue());
+                p = parseString(skipSpace(p), &values[key]);
+                p = p ? skipSpace(p) : nullptr;
+                if (!p || p == end || *p != ':') {
+                    return nullptr;
+                }
+                p++;
+                scratch.push_back(key);
+            }
+            // values may grow under the call, nothing holds on to its elements
+            u32 element = static_cast<u32>(values.size());
+            values.push_back(JsonValue());
+            scratch.push_back(element);
+            p = parseValue(p, element, depth + 1);
+            p = p ? skipSpace(p) : nullptr;
+            if (!p || p == end) {
+                return nullptr;
+            }
+            if (*p == close) {
+                p++;
+                break;
+            }
+            if (*p != ',') {
+                return nullptr;
+            }
+            p++;
+        }
+    }
+
+    // the children are contiguous once the container is done
+    JsonValue& value = values[index];
+    value.type = object ? JsonType::Object : JsonType::Array;
+    value.first = static_cast<u32>(children.size());
+    value.count = static_cast<u32>((scratch.size() - base) / (object ? 2 : 1));
+    children.insert(children.end(), scratch.begin() + base, scratch.end());
+    scratch.resize(base);
+    return p;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Utilities.h"
+
+// Nesting deeper than this is rejected, the parser recurses once per level
+const u32 JSON_MAX_DEPTH = 64;
+
+enum class JsonType : u32 {
+    Null,
+    Boolean,
+    Number,
+    String,
+    Array,
+    Object,
+};
+
+// One value of a parsed document. Strings point into the source text as written, escapes
+// included, see JsonDocument::getString.
+struct JsonValue {
+    JsonType type = JsonType::Null;
+    bool boolean = false;
+    double number = 0.0;
+    const char* text = nullptr;
+    u32 length = 0;
+    // into the document's children: an array's elements, an object's keys and values
+    // alternating
+    u32 first = 0;
+    u32 count = 0; // elements, or members
+};
+
+// Minimal JSON (RFC 8259) reader for glTF: the whole text is parsed into a flat array of
+// values up front and read through find/get. The text is not copied, it has to outlive the
+// document.
+class JsonDocument {
+public:
+    // false on malformed text, which needn't be zero terminated
+    bool parse(const char* text, size_t size);
+
+    const JsonValue& getRoot() const {
+        return values[0];
+    }
+    // member of an object by its key as written, null when missing or not an object
+    const JsonValue* find(const JsonValue& object, const char* key) const;
+    // element of an array, null when out of range or not an array
+    const JsonValue* get(const JsonValue& array, u32 index) const;
+
+    // unescaped contents of a string, empty for anything else
+    std::string getString(const JsonValue& value) const;
+    // number member of an object, fallback when missing or not a number
+    double getNumber(const JsonValue& object, const char* key, double fallback) const;
+    std::string getString(const JsonValue& object, const char* key) const;
+
+private:
+    std::vector<JsonValue> values;
+    std::vector<u32> children;
+    std::vector<u32> scratch; // children of the containers being parsed, innermost last
+    const char* end = nullptr;
+
+    const char* skipSpace(const char* p) const;
+    // the value at p into values[index], returns its end or null
+    const char* parseValue(const char* p, u32 index, u32 depth);
+    const char* parseString(const char* p, JsonValue* value) const;
+    const char* parseNumber(const char* p, JsonValue* value) const;
+    const char* parseContainer(const char* p, u32 index, u32 depth, bool object);
+};
@@ -0,0 +1,227 @@
+#include <cstring>
+#include <fstream>
+#include "Ktx2.h"
+#include "MappedFile.h"
+#include "MipChain.h"
+#include "TextureCompressor.h"
+
+static const u8 KTX2_IDENTIFIER[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0',
+                                       0xBB, '\r', '\n', 0x1A, '\n'};
+
+// data format descriptor values (Khronos Data Format spec)
+static const u32 KHR_DF_MODEL_BC1A = 128;
+static const u32 KHR_DF_MODEL_BC3 = 130;
+static const u32 KHR_DF_MODEL_BC7 = 133;
+static const u32 KHR_DF_CHANNEL_COLOR = 0;
+static const u32 KHR_DF_CHANNEL_ALPHA = 15;
+static const u32 KHR_DF_PRIMARIES_BT709 = 1;
+static const u32 KHR_DF_TRANSFER_LINEAR = 1;
+
+struct Ktx2Header {
+    u8 identifier[12];
+    u32 vk_format;
+    u32 type_size;
+    u32 pixel_width;
+    u32 pixel_height;
+    u32 pixel_depth;
+    u32 layer_count;
+    u32 face_count;
+    u32 level_count;
+    u32 supercompression_scheme;
+    u32 dfd_byte_offset;
+    u32 dfd_byte_length;
+    u32 kvd_byte_offset;
+    u32 kvd_byte_length;
+    u64 sgd_byte_offset;
+    u64 sgd_byte_length;
+};
+
+struct Ktx2LevelIndex {
+    u64 byte_offset;
+    u64 byte_length;
+    u64 uncompressed_byte_length;
+};
+
+static bool isSupportedFormat(u32 format) {
+    return format == VK_FORMAT_BC1_RGB_UNORM_BLOCK || format == VK_FORMAT_BC1_RGBA_UNORM_BLOCK ||
+           format == VK_FORMAT_BC3_UNORM_BLOCK || format == VK_FORMAT_BC7_UNORM_BLOCK;
+}
+
+static size_t alignTo(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// basic descriptor block for the block compressed formats
+static std::vector<u32> buildDataFormatDescriptor(VkFormat format) {
+    struct Sample {
+        u32 bit_offset;
+        u32 bit_length;
+        u32 channel;
+    };
+    std::vector<Sample> samples;
+    u32 model = KHR_DF_MODEL_BC1A;
+    if (format == VK_FORMAT_BC3_UNORM_BLOCK) {
+        model = KHR_DF_MODEL_BC3;
+        samples.push_back({0, 64, KHR_DF_CHANNEL_ALPHA});
+        samples.push_back({64, 64, KHR_DF_CHANNEL_COLOR});
+    } else if (format == VK_FORMAT_BC7_UNORM_BLOCK) {
+        model = KHR_DF_MODEL_BC7;
+        samples.push_back({0, 128, KHR_DF_CHANNEL_COLOR});
+    } else {
+        samples.push_back({0, 64, KHR_DF_CHANNEL_COLOR});
+    }
+
+    u32 block_size = 24 + 16 * static_cast<u32>(samples.size());
+    std::vector<u32> dfd;
+    dfd.push_back(4 + block_size); // total size
+    dfd.push_back(0);              // vendor khronos, descriptor type basic
+    dfd.push_back(2 | (block_size << 16));
+    dfd.push_back(model | (KHR_DF_PRIMARIES_BT709 << 8) | (KHR_DF_TRANSFER_LINEAR << 16));
+    dfd.push_back(3 | (3 << 8)); // 4x4 texel blocks, stored as size - 1
+    dfd.push_back(blockBytes(format));
+    dfd.push_back(0);
+    for (const Sample& sample : samples) {
+        dfd.push_back(sample.bit_offset | ((sample.bit_length - 1) << 16) | (sample.channel << 24));
+        dfd.push_back(0);
+        dfd.push_back(0);
+        dfd.push_back(0xFFFFFFFF);
+    }
+    return dfd;
+}
+
+bool parseKtx2(const u8* data, size_t size, Ktx2Image* image, std::vector<const u8*>* levels) {
+    if (size < sizeof(Ktx2Header)) {
+        return false;
+    }
+    Ktx2Header header;
+    memcpy(&header, data, sizeof(header));
+
+    u32 level_count = std::max(header.level_count, 1u);
+    if (memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0 ||
+        !isSupportedFormat(header.vk_format) || header.pixel_width == 0 ||
+        header.pixel_height == 0 || header.pixel_depth > 1 || header.layer_count > 1 ||
+        header.face_count != 1 || header.supercompression_scheme != 0 ||
+        level_count > mipLevelCount(header.pixel_width, header.pixel_height)) {
+        return false;
+    }
+    size_t index_end = sizeof(Ktx2Header) + sizeof(Ktx2LevelIndex) * level_count;
+    if (index_end > size) {
+        return false;
+    }
+
+    image->format = static_cast<VkFormat>(header.vk_format);
+    image->width = header.pixel_width;
+    image->height = header.pixel_height;
+    image->level_count = level_count;
+    image->data.clear();
+    levels->clear();
+
+    for (u32 level = 0; level < level_count; level++) {
+        Ktx2LevelIndex index;
+        memcpy(&index, data + sizeof(Ktx2Header) + sizeof(Ktx2LevelIndex) * level,
+               sizeof(index));
+        VkDeviceSize expected = mipLevelSize(image->format, mipExtent(image->width, level),
+                                             mipExtent(image->height, level));
+        if (index.byte_length != expected || index.byte_offset > size ||
+            index.byte_length > size - index.byte_offset) {
+            return false;
+        }
+        levels->push_back(data + index.byte_offset);
+    }
+    return true;
+}
+
+bool readKtx2(const std::string& filename, Ktx2Image* image) {
+    MappedFile file;
+    std::vector<const u8*> levels;
+    if (!file.open(filename) || !parseKtx2(file.getData(), file.getSize(), image, &levels)) {
+        return false;
+    }
+    for (u32 level = 0; level < image->level_count; level++) {
+        size_t level_size = static_cast<size_t>(mipLevelSize(
+            image->format, mipExtent(image->width, level), mipExtent(image->height, level)));
+        image->data.insert(image->data.end(), levels[level], levels[level] + level_size);
+    }
+    return true;
+}
+
+bool writeKtx2(const std::string& filename, const Ktx2Image& image) {
+    if (!isSupportedFormat(image.format)) {
+        return false;
+    }
+
+    std::vector<u32> dfd = buildDataFormatDescriptor(image.format);
+
+    // a single KTXwriter entry: length, then "key\0value\0", padded to 4 bytes
+    static const char WRITER[] = "KTXwriter\0VulkanApp";
+    std::vector<u8> kvd(4);
+    u32 entry_length = sizeof(WRITER);
+    memcpy(kvd.data(), &entry_length, 4);
+    kvd.insert(kvd.end(), WRITER, WRITER + sizeof(WRITER));
+    kvd.resize(alignTo(kvd.size(), 4), 0);
+
+    Ktx2Header header = {};
+    memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+    header.vk_format = image.format;
+    header.type_size = 1;
+    header.pixel_width = image.width;
+    header.pixel_height = image.height;
+    header.face_count = 1;
+    header.level_count = image.level_count;
+    header.dfd_byte_offset = static_cast<u32>(sizeof(Ktx2Header) +
+                                              sizeof(Ktx2LevelIndex) * image.level_count);
+    header.dfd_byte_length = static_cast<u32>(dfd.size() * 4);
+    header.kvd_byte_offset = header.dfd_byte_offset + header.dfd_byte_length;
+    header.kvd_byte_length = static_cast<u32>(kvd.size());
+
+    // levels are stored smallest first, each aligned to the block size
+    size_t alignment = blockBytes(image.format);
+    std::vector<Ktx2LevelIndex> levels(image.level_count);
+    std::vector<size_t> source_offsets(image.level_count);
+    size_t source_offset = 0;
+    for (u32 level = 0; level < image.level_count; level++) {
+        source_offsets[level] = source_offset;
+        levels[level].byte_length = mipLevelSize(image.format, mipExtent(image.width, level),
+                                                 mipExtent(image.height, level));
+        levels[level].uncompressed_byte_length = levels[level].byte_length;
+        source_offset += static_cast<size_t>(levels[level].byte_length);
+    }
+    if (source_offset != image.data.size()) {
+        return false;
+    }
+    size_t file_offset = header.kvd_byte_offset + header.kvd_byte_length;
+    for (u32 level = image.level_count; level-- > 0;) {
+        file_offset = alignTo(file_offset, alignment);
+        levels[level].byte_offset = file_offset;
+        file_offset += static_cast<size_t>(levels[level].byte_length);
+    }
+
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        return false;
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(levels.data()),
+              sizeof(Ktx2LevelIndex) * levels.size());
+    out.write(reinterpret_cast<const char*>(dfd.data()), dfd.size() * 4);
+    out.write(reinterpret_cast<const char*>(kvd.data()), kvd.size());
+
+    size_t written = header.kvd_byte_offset + header.kvd_byte_length;
+    static const char PADDING[16] = {};
+    for (u32 level = image.level_count; level-- > 0;) {
+        out.write(PADDING, levels[level].byte_offset - written);
+        out.write(reinterpret_cast<const char*>(image.data.data() + source_offsets[level]),
+                  levels[level].byte_length);
+        written = levels[level].byte_offset + levels[level].byte_length;
+    }
+    return out.good();
+}
+
+std::string ktx2Name(const std::string& texture_name) {
+    size_t dot = texture_name.find_last_of('.');
+    size_t slash = texture_name.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return texture_name + KTX2_EXTENSION;
+    }
+    return texture_name.substr(0, dot) + KTX2_EXTENSION;
+}
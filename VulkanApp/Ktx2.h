@@ -0,0 +1,29 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <string>
+#include <vector>
+#include <GLFW/glfw3.h>
+#include "Utilities.h"
+
+// Compressed textures sit next to their source with this extension in place of its own
+const char* const KTX2_EXTENSION = ".ktx2";
+
+// A 2D, single layer KTX2 texture without supercompression
+struct Ktx2Image {
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    u32 width = 0;
+    u32 height = 0;
+    u32 level_count = 0;
+    std::vector<u8> data; // every level, level 0 first, packed back to back
+};
+
+// Only the block compressed formats the compressor writes are accepted
+bool readKtx2(const std::string& filename, Ktx2Image* image);
+// A KTX2 file already in memory, read in place: image gets everything but data, levels the
+// start of every level inside it, level 0 first
+bool parseKtx2(const u8* data, size_t size, Ktx2Image* image, std::vector<const u8*>* levels);
+bool writeKtx2(const std::string& filename, const Ktx2Image& image);
+
+// "stx_hada.png" -> "stx_hada.ktx2"
+std::string ktx2Name(const std::string& texture_name);
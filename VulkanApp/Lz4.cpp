@@ -0,0 +1,153 @@
+#include <cstring>
+#include "Lz4.h"
+
+static const size_t MIN_MATCH = 4;
+// the format wants the last 5 bytes as literals and no match starting in the last 12
+static const size_t LAST_LITERALS = 5;
+static const size_t MATCH_LIMIT = 12;
+static const size_t MAX_OFFSET = 65535;
+static const u32 HASH_BITS = 16;
+static const u32 NO_POSITION = ~0u;
+
+static u32 read32(const u8* p) {
+    u32 value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static u32 hashSequence(u32 sequence) {
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// lengths past a token nibble continue in bytes of 255 and a final remainder
+static void writeLength(std::vector<u8>* out, size_t length) {
+    for (; length >= 255; length -= 255) {
+        out->push_back(255);
+    }
+    out->push_back(static_cast<u8>(length));
+}
+
+static bool readLength(const u8* src, size_t src_size, size_t* ip, size_t* length) {
+    u8 byte;
+    do {
+        if (*ip >= src_size) {
+            return false;
+        }
+        byte = src[(*ip)++];
+        *length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+static void writeSequence(std::vector<u8>* out, const u8* literals, size_t literal_count,
+                          size_t offset, size_t match_length) {
+    size_t match_code = match_length - MIN_MATCH;
+    u8 token = static_cast<u8>((literal_count < 15 ? literal_count : 15) << 4);
+    if (match_length > 0) {
+        token |= static_cast<u8>(match_code < 15 ? match_code : 15);
+    }
+    out->push_back(token);
+    if (literal_count >= 15) {
+        writeLength(out, literal_count - 15);
+    }
+    out->insert(out->end(), literals, literals + literal_count);
+    if (match_length == 0) {
+        return;
+    }
+    out->push_back(static_cast<u8>(offset & 0xFF));
+    out->push_back(static_cast<u8>(offset >> 8));
+    if (match_code >= 15) {
+        writeLength(out, match_code - 15);
+    }
+}
+
+size_t lz4CompressBound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+std::vector<u8> lz4Compress(const u8* src, size_t size) {
+    std::vector<u8> out;
+    out.reserve(lz4CompressBound(size));
+
+    size_t anchor = 0;
+    if (size > MATCH_LIMIT) {
+        std::vector<u32> table(size_t(1) << HASH_BITS, NO_POSITION);
+        size_t limit = size - MATCH_LIMIT;
+        size_t ip = 0;
+        while (ip < limit) {
+            u32 sequence = read32(src + ip);
+            u32& slot = table[hashSequence(sequence)];
+            size_t candidate = slot;
+            slot = static_cast<u32>(ip);
+            if (candidate == NO_POSITION || ip - candidate > MAX_OFFSET ||
+                read32(src + candidate) != sequence) {
+                // skip ahead faster the longer nothing matched
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            size_t length = MIN_MATCH;
+            size_t match_end = size - LAST_LITERALS;
+            while (ip + length < match_end && src[candidate + length] == src[ip + length]) {
+                length++;
+            }
+            writeSequence(&out, src + anchor, ip - anchor, ip - candidate, length);
+            ip += length;
+            anchor = ip;
+            if (ip - 2 < limit) {
+                table[hashSequence(read32(src + ip - 2))] = static_cast<u32>(ip - 2);
+            }
+        }
+    }
+    // the last sequence is literals only
+    writeSequence(&out, src + anchor, size - anchor, 0, 0);
+    return out;
+}
+
+bool lz4Decompress(const u8* src, size_t src_size, u8* dst, size_t dst_size) {
+    size_t ip = 0;
+    size_t op = 0;
+    while (ip < src_size) {
+        u8 token = src[ip++];
+        size_t literal_count = token >> 4;
+        if (literal_count == 15 && !readLength(src, src_size, &ip, &literal_count)) {
+            return false;
+        }
+        if (literal_count > src_size - ip || literal_count > dst_size - op) {
+            return false;
+        }
+        if (literal_count > 0) {
+            memcpy(dst + op, src + ip, literal_count);
+        }
+        ip += literal_count;
+        op += literal_count;
+        if (ip == src_size) {
+            break;
+        }
+
+        if (src_size - ip < 2) {
+            return false;
+        }
+        size_t offset = src[ip] | (size_t(src[ip + 1]) << 8);
+        ip += 2;
+        size_t length = token & 15;
+        if (length == 15 && !readLength(src, src_size, &ip, &length)) {
+            return false;
+        }
+        length += MIN_MATCH;
+        if (offset == 0 || offset > op || length > dst_size - op) {
+            return false;
+        }
+        // overlapping matches repeat the bytes they just wrote
+        const u8* match = dst + op - offset;
+        if (offset >= length) {
+            memcpy(dst + op, match, length);
+        } else {
+            for (size_t i = 0; i < length; i++) {
+                dst[op + i] = match[i];
+            }
+        }
+        op += length;
+    }
+    return op == dst_size;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <vector>
+#include "Utilities.h"
+
+// Raw LZ4 block format (no frame), readable by any LZ4 implementation
+
+// Worst case size of a compressed block, incompressible input grows by a little
+size_t lz4CompressBound(size_t size);
+
+// Greedy compressor with a single hash probe per position, fast rather than tight
+std::vector<u8> lz4Compress(const u8* src, size_t size);
+
+// Decodes a block into exactly dst_size bytes. False on malformed input or a size mismatch,
+// never reads or writes out of bounds.
+bool lz4Decompress(const u8* src, size_t src_size, u8* dst, size_t dst_size);
@@ -7,6 +7,7 @@
 #include <glm/glm.hpp>
 #include <glm/mat4x4.hpp>
 
+#include <cstdlib>
 #include <iostream>
 #include <stdexcept>
 #include <vector>
@@ -16,6 +17,13 @@
 GLFWwindow* window;
 VulkanRenderer vk_renderer;
 
+void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    // M writes a device memory report next to the executable
+    if (key == GLFW_KEY_M && action == GLFW_PRESS) {
+        vk_renderer.dumpMemoryReport("memory_report.json");
+    }
+}
+
 void initWindow(std::string wName = "Test Window", const int width = 1800,
                 const int height = 1600) {
     // initialize glfw
@@ -26,9 +34,51 @@ void initWindow(std::string wName = "Test Window", const int width = 1800,
     glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
 
     window = glfwCreateWindow(width, height, wName.c_str(), nullptr, nullptr);
+    glfwSetKeyCallback(window, keyCallback);
 }
 
-int main() {
+int main(int argc, char** argv) {
+    // --compress-textures <bc1|bc3|bc7|auto> <texture>...: writes a KTX2 next to each texture
+    // in Textures/ and quits, no device needed
+    if (argc > 2 && std::string(argv[1]) == "--compress-textures") {
+        int failed = 0;
+        for (int i = 3; i < argc; i++) {
+            std::string name = argv[i];
+            if (!compressTextureFile("Textures/" + name, "Textures/" + ktx2Name(name), argv[2])) {
+                std::cout << "Failed to compress " << name << std::endl;
+                failed++;
+            }
+        }
+        return failed == 0 ? 0 : EXIT_FAILURE;
+    }
+
+    // --pack [file]: archives Models/, Textures/ and shaders/ into an asset pack and quits
+    if (argc > 1 && std::string(argv[1]) == "--pack") {
+        std::string pack_name = argc > 2 ? argv[2] : ASSET_PACK_FILENAME;
+        if (!AssetPack::build(pack_name, {"Models", "Textures", "shaders"})) {
+            std::cout << "Failed to write " << pack_name << std::endl;
+            return EXIT_FAILURE;
+        }
+        return 0;
+    }
+
+    // --bench-meshlets: time meshlet generation over the test model and quit
+    if (argc > 1 && std::string(argv[1]) == "--bench-meshlets") {
+        VulkanRenderer::benchmarkMeshlets("Models/sonic.obj", 20);
+        return 0;
+    }
+
+    // --bench-import [depth]: time flattening a deep generated node hierarchy and quit
+    if (argc > 1 && std::string(argv[1]) == "--bench-import") {
+        VulkanRenderer::benchmarkImport(argc > 2 ? std::atoi(argv[2]) : 2000, 20);
+        return 0;
+    }
+
+    // --bench-obj [file]: time the native OBJ loader against Assimp and quit
+    if (argc > 1 && std::string(argv[1]) == "--bench-obj") {
+        VulkanRenderer::benchmarkObj(argc > 2 ? argv[2] : "Models/sonic.obj", 10);
+        return 0;
+    }
 
     // create window
     initWindow();
@@ -36,10 +86,43 @@ int main() {
         return EXIT_FAILURE;
     }
 
+    // --bench-uploads: compare the geometry upload paths and quit
+    if (argc > 1 && std::string(argv[1]) == "--bench-uploads") {
+        vk_renderer.benchmarkUploads("Models/sonic.obj", 50);
+        vk_renderer.cleanup();
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return 0;
+    }
+
+    // --no-optimize-meshes: keep imported triangles and vertices in file order
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--no-optimize-meshes") {
+            vk_renderer.setMeshOptimization(false);
+        }
+        // --full-precision-geometry: float vertices and 32-bit indices for every mesh
+        if (std::string(argv[i]) == "--full-precision-geometry") {
+            vk_renderer.setCompactGeometry(false);
+        }
+        // --no-lod: draw every mesh at full detail regardless of its size on screen
+        if (std::string(argv[i]) == "--no-lod") {
+            vk_renderer.setLodSelection(false);
+        }
+        // --assimp-obj: import OBJ files through Assimp like every other format
+        if (std::string(argv[i]) == "--assimp-obj") {
+            vk_renderer.setNativeObj(false);
+        }
+        // --assimp-gltf: import glTF/GLB files through Assimp too
+        if (std::string(argv[i]) == "--assimp-gltf") {
+            vk_renderer.setNativeGltf(false);
+        }
+    }
+
     float angle = 0.0f;
     float delta_time = 0.0f;
     float last_time = 0.0f;
-    vk_renderer.createMeshModel("Models/sonic.obj");
+    // streams in while the loop below already runs
+    int sonic = vk_renderer.loadMeshModel("Models/sonic.obj");
 
     while (!glfwWindowShouldClose(window)) {
         glfwPollEvents();
@@ -54,7 +137,7 @@ int main() {
 
         glm::mat4 testMat =
             glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-        vk_renderer.updateModel(0, testMat);
+        vk_renderer.updateModel(sonic, testMat);
         // vk_renderer.updateModel(glm::rotate(glm::mat4(1.0f), glm::radians(angle),
         // glm::vec3(0.0f, 1.0f, 0.0f)));
 
@@ -0,0 +1,102 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() {}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& filename) {
+    close();
+
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        return false;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    file_handle = file;
+    mapping_handle = mapping;
+    data = static_cast<const u8*>(view);
+    size = static_cast<size_t>(file_size.QuadPart);
+    return true;
+}
+
+void MappedFile::close() {
+    if (data) {
+        UnmapViewOfFile(data);
+        CloseHandle(mapping_handle);
+        CloseHandle(file_handle);
+    }
+    data = nullptr;
+    size = 0;
+    file_handle = nullptr;
+    mapping_handle = nullptr;
+}
+
+#else
+
+bool MappedFile::open(const std::string& filename) {
+    close();
+
+    int file = ::open(filename.c_str(), O_RDONLY);
+    if (file < 0) {
+        return false;
+    }
+    struct stat file_stat;
+    if (fstat(file, &file_stat) != 0 || file_stat.st_size == 0) {
+        ::close(file);
+        return false;
+    }
+    void* view = mmap(nullptr, size_t(file_stat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    if (view == MAP_FAILED) {
+        ::close(file);
+        return false;
+    }
+
+    fd = file;
+    data = static_cast<const u8*>(view);
+    size = size_t(file_stat.st_size);
+    return true;
+}
+
+void MappedFile::close() {
+    if (data) {
+        munmap(const_cast<u8*>(data), size);
+        ::close(fd);
+    }
+    data = nullptr;
+    size = 0;
+    fd = -1;
+}
+
+#endif
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include "Utilities.h"
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& filename);
+    void close();
+
+    bool isOpen() {
+        return data != nullptr;
+    }
+    const u8* getData() {
+        return data;
+    }
+    size_t getSize() {
+        return size;
+    }
+
+private:
+    const u8* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    void* file_handle = nullptr;
+    void* mapping_handle = nullptr;
+#else
+    int fd = -1;
+#endif
+};
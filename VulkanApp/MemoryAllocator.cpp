@@ -0,0 +1,718 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include "MemoryAllocator.h"
+
+// share of a heap assumed to be ours when the driver can't tell (no VK_EXT_memory_budget)
+const VkDeviceSize FALLBACK_BUDGET_PERCENT = 80;
+
+const char* memoryCategoryName(MemoryCategory category) {
+    switch (category) {
+    case MemoryCategory::Geometry:
+        return "geometry";
+    case MemoryCategory::Texture:
+        return "texture";
+    case MemoryCategory::Attachment:
+        return "attachment";
+    case MemoryCategory::Uniform:
+        return "uniform";
+    case MemoryCategory::Staging:
+        return "staging";
+    default:
+        return "untagged";
+    }
+}
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// Two resources of a different kind must not share a bufferImageGranularity page
+static bool kindsConflict(ResourceKind a, ResourceKind b) {
+    return a != ResourceKind::Free && b != ResourceKind::Free && a != b;
+}
+
+static bool onSamePage(VkDeviceSize a_last_byte, VkDeviceSize b_first_byte,
+                       VkDeviceSize page_size) {
+    return (a_last_byte & ~(page_size - 1)) == (b_first_byte & ~(page_size - 1));
+}
+
+using CategoryStatsArray = std::array<MemoryCategoryStats, MEMORY_CATEGORY_COUNT>;
+
+static void writeCategoriesJson(std::ostream& out, const CategoryStatsArray& cats) {
+    out << "{";
+    for (u32 i = 0; i < MEMORY_CATEGORY_COUNT; i++) {
+        out << (i ? ", " : "") << "\"" << memoryCategoryName(static_cast<MemoryCategory>(i))
+            << "\": {\"count\": " << cats[i].allocation_count << ", \"bytes\": " << cats[i].bytes
+            << "}";
+    }
+    out << "}";
+}
+
+MemoryAllocator::MemoryAllocator() {}
+
+MemoryAllocator::~MemoryAllocator() {}
+
+void MemoryAllocator::init(VkInstance instance, VkDev new_dev, bool memory_budget,
+                           bool new_dedicated_allocation, HostAllocator* new_host) {
+    dev = new_dev;
+    host = new_host;
+    dedicated_allocation = new_dedicated_allocation;
+    vkGetPhysicalDeviceMemoryProperties(dev.physical_device, &memprops);
+
+    get_memory_properties2 = nullptr;
+    if (memory_budget) {
+        get_memory_properties2 = (PFN_vkGetPhysicalDeviceMemoryProperties2KHR)vkGetInstanceProcAddr(
+            instance, "vkGetPhysicalDeviceMemoryProperties2KHR");
+    }
+
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(dev.physical_device, &props);
+    buffer_image_granularity = std::max<VkDeviceSize>(props.limits.bufferImageGranularity, 1);
+    max_allocation_count = props.limits.maxMemoryAllocationCount;
+
+    dedicated_count.assign(memprops.memoryTypeCount, 0);
+    dedicated_bytes.assign(memprops.memoryTypeCount, 0);
+    device_allocation_count = 0;
+    heap_reserved_bytes.assign(memprops.memoryHeapCount, 0);
+    category_stats.assign(memprops.memoryHeapCount, {});
+
+    const VkMemoryPropertyFlags direct_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+                                               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                               VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    direct_write_types = 0;
+    for (u32 i = 0; i < memprops.memoryTypeCount; i++) {
+        const VkMemoryType& type = memprops.memoryTypes[i];
+        if ((type.propertyFlags & direct_flags) == direct_flags &&
+            memprops.memoryHeaps[type.heapIndex].size >= DIRECT_WRITE_MIN_HEAP_SIZE) {
+            direct_write_types |= 1u << i;
+        }
+    }
+}
+
+void MemoryAllocator::destroy() {
+    // anything still alive here was never freed by its owner
+    for (u32 heap = 0; heap < category_stats.size(); heap++) {
+        for (u32 i = 0; i < MEMORY_CATEGORY_COUNT; i++) {
+            const MemoryCategoryStats& leaked = category_stats[heap][i];
+            if (leaked.allocation_count > 0) {
+                std::cout << "[MemoryAllocator] leaked " << leaked.allocation_count << " "
+                          << memoryCategoryName(static_cast<MemoryCategory>(i))
+                          << " allocations (" << leaked.bytes << " bytes) on heap " << heap
+                          << std::endl;
+            }
+        }
+    }
+
+    for (auto& block : blocks) {
+        if (block.memory == VK_NULL_HANDLE) {
+            continue;
+        }
+        if (block.allocation_count > 0) {
+            std::cout << "[MemoryAllocator] block of type " << block.memory_type << " still has "
+                      << block.allocation_count << " live allocations" << std::endl;
+        }
+        freeDeviceMemory(block.memory, block.size, block.memory_type);
+    }
+    blocks.clear();
+    free_block_slots.clear();
+}
+
+MemoryAllocation MemoryAllocator::allocate(const VkMemoryRequirements& memreqs,
+                                           VkMemoryPropertyFlags properties, ResourceKind kind,
+                                           MemoryCategory category, VkBuffer buffer,
+                                           VkImage image) {
+    u32 memory_type = findMemoryTypeIndex(memprops, memreqs.memoryTypeBits, properties);
+
+    MemoryAllocation allocation;
+    allocation.memory_type = memory_type;
+    allocation.size = memreqs.size;
+    allocation.category = category;
+
+    // Large resources would waste most of a block, give them their own memory
+    VkDeviceSize block_size = blockSizeFor(memory_type);
+    if (memreqs.size >= std::min(DEDICATED_ALLOCATION_THRESHOLD, block_size / 2)) {
+        // tells the driver the memory only ever backs this resource
+        VkMemoryDedicatedAllocateInfo dedicated_info = {};
+        dedicated_info.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+        dedicated_info.buffer = buffer;
+        dedicated_info.image = image;
+        bool chain = dedicated_allocation &&
+                     (buffer != VK_NULL_HANDLE) != (image != VK_NULL_HANDLE);
+        allocation.memory = allocateDeviceMemory(memreqs.size, memory_type, &allocation.mapped,
+                                                 chain ? &dedicated_info : nullptr);
+        allocation.offset = 0;
+        allocation.block = -1;
+        dedicated_count[memory_type]++;
+        dedicated_bytes[memory_type] += memreqs.size;
+        trackAllocation(allocation, true);
+        return allocation;
+    }
+
+    for (size_t i = 0; i < blocks.size(); i++) {
+        if (blocks[i].memory == VK_NULL_HANDLE || blocks[i].memory_type != memory_type ||
+            blocks[i].size - blocks[i].used < memreqs.size) {
+            continue;
+        }
+        if (allocateFromBlock(static_cast<int>(i), memreqs.size, memreqs.alignment, kind,
+                              &allocation)) {
+            trackAllocation(allocation, true);
+            return allocation;
+        }
+    }
+
+    int block_idx = createBlock(memory_type, memreqs.size);
+    if (!allocateFromBlock(block_idx, memreqs.size, memreqs.alignment, kind, &allocation)) {
+        throw std::runtime_error("Failed to sub-allocate from a fresh memory block");
+    }
+    trackAllocation(allocation, true);
+    return allocation;
+}
+
+void MemoryAllocator::free(MemoryAllocation& allocation) {
+    if (allocation.memory == VK_NULL_HANDLE) {
+        return;
+    }
+    trackAllocation(allocation, false);
+
+    if (allocation.block < 0) {
+        dedicated_count[allocation.memory_type]--;
+        dedicated_bytes[allocation.memory_type] -= allocation.size;
+        freeDeviceMemory(allocation.memory, allocation.size, allocation.memory_type);
+        allocation = {};
+        return;
+    }
+
+    MemoryBlock& block = blocks[allocation.block];
+
+    // find the suballocation containing this allocation's offset
+    auto it = std::upper_bound(
+        block.suballocs.begin(), block.suballocs.end(), allocation.offset,
+        [](VkDeviceSize offset, const Suballocation& sub) { return offset < sub.offset; });
+    size_t idx = (it - block.suballocs.begin()) - 1;
+
+    Suballocation& sub = block.suballocs[idx];
+    ASSERT(sub.kind != ResourceKind::Free);
+    sub.kind = ResourceKind::Free;
+    block.used -= sub.size;
+    block.allocation_count--;
+
+    // merge with free neighbours
+    if (idx + 1 < block.suballocs.size() &&
+        block.suballocs[idx + 1].kind == ResourceKind::Free) {
+        sub.size += block.suballocs[idx + 1].size;
+        block.suballocs.erase(block.suballocs.begin() + idx + 1);
+    }
+    if (idx > 0 && block.suballocs[idx - 1].kind == ResourceKind::Free) {
+        block.suballocs[idx - 1].size += block.suballocs[idx].size;
+        block.suballocs.erase(block.suballocs.begin() + idx);
+    }
+
+    // Give empty blocks back, but keep one around per memory type to avoid thrashing
+    if (block.allocation_count == 0) {
+        bool has_other_block = false;
+        for (size_t i = 0; i < blocks.size(); i++) {
+            if (static_cast<int>(i) != allocation.block && blocks[i].memory != VK_NULL_HANDLE &&
+                blocks[i].memory_type == block.memory_type) {
+                has_other_block = true;
+                break;
+            }
+        }
+        if (has_other_block) {
+            freeDeviceMemory(block.memory, block.size, block.memory_type);
+            block = MemoryBlock();
+            free_block_slots.push_back(allocation.block);
+        }
+    }
+
+    allocation = {};
+}
+
+void MemoryAllocator::createBuffer(VkDeviceSize buffer_size, VkBufferUsageFlags buffer_usage,
+                                   VkMemoryPropertyFlags properties, MemoryCategory category,
+                                   VkBuffer* buffer, MemoryAllocation* allocation) {
+    VkBufferCreateInfo buffer_info = {};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = buffer_size;
+    buffer_info.usage = buffer_usage;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VKRes(vkCreateBuffer(dev.logical_device, &buffer_info, hostCallbacks(), buffer));
+
+    // Get buffer memory reqs
+    VkMemoryRequirements memreqs;
+    vkGetBufferMemoryRequirements(dev.logical_device, *buffer, &memreqs);
+
+    *allocation = allocate(memreqs, properties, ResourceKind::Linear, category, *buffer);
+
+    VKRes(vkBindBufferMemory(dev.logical_device, *buffer, allocation->memory, allocation->offset));
+}
+
+void MemoryAllocator::createDeviceBuffer(VkDeviceSize buffer_size, VkBufferUsageFlags buffer_usage,
+                                         MemoryCategory category, VkBuffer* buffer,
+                                         MemoryAllocation* allocation) {
+    VkBufferCreateInfo buffer_info = {};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = buffer_size;
+    buffer_info.usage = buffer_usage;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VKRes(vkCreateBuffer(dev.logical_device, &buffer_info, hostCallbacks(), buffer));
+
+    VkMemoryRequirements memreqs;
+    vkGetBufferMemoryRequirements(dev.logical_device, *buffer, &memreqs);
+
+    VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    if (direct_writes && (memreqs.memoryTypeBits & direct_write_types)) {
+        // only the large heap types, not a small BAR window with the same flags
+        memreqs.memoryTypeBits &= direct_write_types;
+        properties |= VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    }
+    *allocation = allocate(memreqs, properties, ResourceKind::Linear, category, *buffer);
+
+    VKRes(vkBindBufferMemory(dev.logical_device, *buffer, allocation->memory, allocation->offset));
+}
+
+void MemoryAllocator::destroyBuffer(VkBuffer buffer, MemoryAllocation& allocation) {
+    vkDestroyBuffer(dev.logical_device, buffer, hostCallbacks());
+    free(allocation);
+}
+
+MemoryAllocation MemoryAllocator::allocateImage(VkImage image, VkMemoryPropertyFlags properties,
+                                                VkImageTiling tiling, MemoryCategory category) {
+    VkMemoryRequirements memreqs;
+    vkGetImageMemoryRequirements(dev.logical_device, image, &memreqs);
+
+    ResourceKind kind =
+        tiling == VK_IMAGE_TILING_LINEAR ? ResourceKind::Linear : ResourceKind::Optimal;
+    MemoryAllocation allocation =
+        allocate(memreqs, properties, kind, category, VK_NULL_HANDLE, image);
+
+    VKRes(vkBindImageMemory(dev.logical_device, image, allocation.memory, allocation.offset));
+    return allocation;
+}
+
+bool MemoryAllocator::isRelocationCandidate(const MemoryAllocation& allocation) {
+    if (allocation.memory == VK_NULL_HANDLE || allocation.block < 0) {
+        return false;
+    }
+    const MemoryBlock& source = blocks[allocation.block];
+    if (source.used * 2 > source.size) {
+        return false;
+    }
+    for (size_t i = 0; i < blocks.size(); i++) {
+        const MemoryBlock& block = blocks[i];
+        // only ever move into fuller blocks, so two sparse blocks can't trade resources forever
+        if (static_cast<int>(i) != allocation.block && block.memory != VK_NULL_HANDLE &&
+            block.memory_type == source.memory_type && block.used > source.used &&
+            block.size - block.used >= allocation.size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+MemoryAllocation MemoryAllocator::relocate(const MemoryAllocation& allocation,
+                                           const VkMemoryRequirements& memreqs,
+                                           ResourceKind kind) {
+    MemoryAllocation moved;
+    if (allocation.block < 0) {
+        return moved;
+    }
+    moved.memory_type = allocation.memory_type;
+    moved.size = memreqs.size;
+    moved.category = allocation.category;
+
+    // fullest blocks first, packing them tighter
+    const VkDeviceSize source_used = blocks[allocation.block].used;
+    std::vector<int> targets;
+    for (size_t i = 0; i < blocks.size(); i++) {
+        const MemoryBlock& block = blocks[i];
+        if (static_cast<int>(i) != allocation.block && block.memory != VK_NULL_HANDLE &&
+            block.memory_type == allocation.memory_type && block.used > source_used &&
+            block.size - block.used >= memreqs.size &&
+            (memreqs.memoryTypeBits & (1u << block.memory_type))) {
+            targets.push_back(static_cast<int>(i));
+        }
+    }
+    std::sort(targets.begin(), targets.end(),
+              [this](int a, int b) { return blocks[a].used > blocks[b].used; });
+
+    for (int target : targets) {
+        if (allocateFromBlock(target, memreqs.size, memreqs.alignment, kind, &moved)) {
+            trackAllocation(moved, true);
+            return moved;
+        }
+    }
+    return MemoryAllocation();
+}
+
+MemoryAllocation MemoryAllocator::relocateImage(VkImage new_image,
+                                                const MemoryAllocation& allocation,
+                                                VkImageTiling tiling) {
+    VkMemoryRequirements memreqs;
+    vkGetImageMemoryRequirements(dev.logical_device, new_image, &memreqs);
+
+    ResourceKind kind =
+        tiling == VK_IMAGE_TILING_LINEAR ? ResourceKind::Linear : ResourceKind::Optimal;
+    MemoryAllocation moved = relocate(allocation, memreqs, kind);
+    if (moved.memory != VK_NULL_HANDLE) {
+        VKRes(vkBindImageMemory(dev.logical_device, new_image, moved.memory, moved.offset));
+    }
+    return moved;
+}
+
+bool MemoryAllocator::hasMemoryType(u32 allowed, VkMemoryPropertyFlags properties) {
+    for (u32 i = 0; i < memprops.memoryTypeCount; i++) {
+        if ((allowed & (1u << i)) &&
+            (memprops.memoryTypes[i].propertyFlags & properties) == properties) {
+            return true;
+        }
+    }
+    return false;
+}
+
+MemoryStats MemoryAllocator::getStats() {
+    MemoryStats stats;
+    stats.types.resize(memprops.memoryTypeCount);
+    stats.device_allocation_count = device_allocation_count;
+    stats.max_allocation_count = max_allocation_count;
+
+    for (const auto& block : blocks) {
+        if (block.memory == VK_NULL_HANDLE) {
+            continue;
+        }
+        MemoryTypeStats& type_stats = stats.types[block.memory_type];
+        type_stats.block_count++;
+        type_stats.allocation_count += block.allocation_count;
+        type_stats.reserved_bytes += block.size;
+        type_stats.used_bytes += block.used;
+    }
+    for (u32 i = 0; i < memprops.memoryTypeCount; i++) {
+        MemoryTypeStats& type_stats = stats.types[i];
+        type_stats.dedicated_count = dedicated_count[i];
+        type_stats.allocation_count += dedicated_count[i];
+        type_stats.reserved_bytes += dedicated_bytes[i];
+        type_stats.used_bytes += dedicated_bytes[i];
+
+        stats.total.block_count += type_stats.block_count;
+        stats.total.dedicated_count += type_stats.dedicated_count;
+        stats.total.allocation_count += type_stats.allocation_count;
+        stats.total.reserved_bytes += type_stats.reserved_bytes;
+        stats.total.used_bytes += type_stats.used_bytes;
+    }
+
+    stats.heaps.resize(memprops.memoryHeapCount);
+    for (u32 i = 0; i < memprops.memoryHeapCount; i++) {
+        MemoryHeapStats& heap = stats.heaps[i];
+        heap.size = memprops.memoryHeaps[i].size;
+        heap.device_local = memprops.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+        heap.categories = category_stats[i];
+
+        for (u32 c = 0; c < MEMORY_CATEGORY_COUNT; c++) {
+            stats.categories[c].allocation_count += heap.categories[c].allocation_count;
+            stats.categories[c].bytes += heap.categories[c].bytes;
+        }
+    }
+    for (u32 i = 0; i < memprops.memoryTypeCount; i++) {
+        MemoryHeapStats& heap = stats.heaps[memprops.memoryTypes[i].heapIndex];
+        heap.reserved_bytes += stats.types[i].reserved_bytes;
+        heap.used_bytes += stats.types[i].used_bytes;
+    }
+
+    queryBudget(stats.heaps);
+    stats.budget_available = get_memory_properties2 != nullptr;
+
+    if (host) {
+        stats.host = host->getStats();
+        stats.host_tracked = true;
+    }
+    return stats;
+}
+
+void MemoryAllocator::printStats() {
+    MemoryStats stats = getStats();
+    std::cout << "[MemoryAllocator] " << stats.device_allocation_count << "/"
+              << stats.max_allocation_count << " device allocations, "
+              << stats.total.allocation_count << " resources, " << stats.total.used_bytes
+              << " of " << stats.total.reserved_bytes << " bytes used" << std::endl;
+    for (size_t i = 0; i < stats.types.size(); i++) {
+        const MemoryTypeStats& type_stats = stats.types[i];
+        if (type_stats.reserved_bytes == 0) {
+            continue;
+        }
+        std::cout << "  type " << i << ": " << type_stats.block_count << " blocks, "
+                  << type_stats.dedicated_count << " dedicated, " << type_stats.allocation_count
+                  << " resources, " << type_stats.used_bytes << "/" << type_stats.reserved_bytes
+                  << " bytes" << std::endl;
+    }
+    for (size_t i = 0; i < stats.heaps.size(); i++) {
+        const MemoryHeapStats& heap = stats.heaps[i];
+        std::cout << "  heap " << i << (heap.device_local ? " (device local)" : "") << ": "
+                  << heap.usage << "/" << heap.budget << " bytes of budget"
+                  << (stats.budget_available ? "" : " (estimated)") << std::endl;
+    }
+    for (u32 i = 0; i < MEMORY_CATEGORY_COUNT; i++) {
+        std::cout << "  " << memoryCategoryName(static_cast<MemoryCategory>(i)) << ": "
+                  << stats.categories[i].allocation_count << " resources, "
+                  << stats.categories[i].bytes << " bytes" << std::endl;
+    }
+    if (!stats.host_tracked) {
+        return;
+    }
+    std::cout << "  host: " << stats.host.frame_allocations << " allocations, "
+              << stats.host.frame_bytes << " bytes last frame" << std::endl;
+    for (u32 i = 0; i < HOST_SCOPE_COUNT; i++) {
+        const HostScopeStats& scope = stats.host.scopes[i];
+        std::cout << "  host " << hostScopeName(i) << ": " << scope.live_count << " live, "
+                  << scope.live_bytes << " bytes (peak " << scope.peak_bytes << "), "
+                  << scope.allocation_count << " allocations so far" << std::endl;
+    }
+    if (stats.host.arena_enabled) {
+        std::cout << "  host frame arena: " << stats.host.arena_allocations << " served, "
+                  << stats.host.arena_fallbacks << " fell back to the heap" << std::endl;
+    }
+}
+
+void MemoryAllocator::writeJson(std::ostream& out) {
+    MemoryStats stats = getStats();
+
+    out << "{\n";
+    out << "  \"budget_available\": " << (stats.budget_available ? "true" : "false") << ",\n";
+    out << "  \"device_allocations\": " << stats.device_allocation_count << ",\n";
+    out << "  \"max_device_allocations\": " << stats.max_allocation_count << ",\n";
+    out << "  \"resources\": " << stats.total.allocation_count << ",\n";
+    out << "  \"used_bytes\": " << stats.total.used_bytes << ",\n";
+    out << "  \"reserved_bytes\": " << stats.total.reserved_bytes << ",\n";
+    out << "  \"categories\": ";
+    writeCategoriesJson(out, stats.categories);
+    out << ",\n";
+
+    out << "  \"heaps\": [\n";
+    for (size_t i = 0; i < stats.heaps.size(); i++) {
+        const MemoryHeapStats& heap = stats.heaps[i];
+        out << "    {\"index\": " << i << ", \"size\": " << heap.size
+            << ", \"device_local\": " << (heap.device_local ? "true" : "false")
+            << ", \"budget\": " << heap.budget << ", \"usage\": " << heap.usage
+            << ", \"reserved_bytes\": " << heap.reserved_bytes
+            << ", \"used_bytes\": " << heap.used_bytes << ", \"categories\": ";
+        writeCategoriesJson(out, heap.categories);
+        out << "}" << (i + 1 < stats.heaps.size() ? "," : "") << "\n";
+    }
+    out << "  ],\n";
+
+    out << "  \"types\": [\n";
+    for (size_t i = 0; i < stats.types.size(); i++) {
+        const MemoryTypeStats& type_stats = stats.types[i];
+        out << "    {\"index\": " << i << ", \"heap\": " << memprops.memoryTypes[i].heapIndex
+            << ", \"flags\": " << memprops.memoryTypes[i].propertyFlags
+            << ", \"blocks\": " << type_stats.block_count
+            << ", \"dedicated\": " << type_stats.dedicated_count
+            << ", \"resources\": " << type_stats.allocation_count
+            << ", \"used_bytes\": " << type_stats.used_bytes
+            << ", \"reserved_bytes\": " << type_stats.reserved_bytes << "}"
+            << (i + 1 < stats.types.size() ? "," : "") << "\n";
+    }
+    out << "  ]";
+
+    if (stats.host_tracked) {
+        out << ",\n  \"host\": {\"frame_allocations\": " << stats.host.frame_allocations
+            << ", \"frame_bytes\": " << stats.host.frame_bytes
+            << ", \"arena_enabled\": " << (stats.host.arena_enabled ? "true" : "false")
+            << ", \"arena_allocations\": " << stats.host.arena_allocations
+            << ", \"arena_fallbacks\": " << stats.host.arena_fallbacks << ", \"scopes\": {";
+        for (u32 i = 0; i < HOST_SCOPE_COUNT; i++) {
+            const HostScopeStats& scope = stats.host.scopes[i];
+            out << (i ? ", " : "") << "\"" << hostScopeName(i)
+                << "\": {\"allocations\": " << scope.allocation_count
+                << ", \"live\": " << scope.live_count << ", \"live_bytes\": " << scope.live_bytes
+                << ", \"peak_bytes\": " << scope.peak_bytes
+                << ", \"internal_bytes\": " << scope.internal_bytes << "}";
+        }
+        out << "}}";
+    }
+    out << "\n}\n";
+}
+
+bool MemoryAllocator::dumpJson(const std::string& filename) {
+    std::ofstream file(filename);
+    if (!file.is_open()) {
+        return false;
+    }
+    writeJson(file);
+    return true;
+}
+
+void MemoryAllocator::queryBudget(std::vector<MemoryHeapStats>& heaps) {
+    if (get_memory_properties2) {
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_props = {};
+        budget_props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+        VkPhysicalDeviceMemoryProperties2 memprops2 = {};
+        memprops2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        memprops2.pNext = &budget_props;
+
+        get_memory_properties2(dev.physical_device, &memprops2);
+
+        for (size_t i = 0; i < heaps.size(); i++) {
+            heaps[i].budget = budget_props.heapBudget[i];
+            heaps[i].usage = budget_props.heapUsage[i];
+        }
+        return;
+    }
+    for (size_t i = 0; i < heaps.size(); i++) {
+        heaps[i].budget = heaps[i].size * FALLBACK_BUDGET_PERCENT / 100;
+        heaps[i].usage = heaps[i].reserved_bytes;
+    }
+}
+
+void MemoryAllocator::queryHeapBudget(u32 heap_index, VkDeviceSize* budget, VkDeviceSize* usage) {
+    if (get_memory_properties2) {
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_props = {};
+        budget_props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+        VkPhysicalDeviceMemoryProperties2 memprops2 = {};
+        memprops2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        memprops2.pNext = &budget_props;
+
+        get_memory_properties2(dev.physical_device, &memprops2);
+        *budget = budget_props.heapBudget[heap_index];
+        *usage = budget_props.heapUsage[heap_index];
+        return;
+    }
+    *budget = memprops.memoryHeaps[heap_index].size * FALLBACK_BUDGET_PERCENT / 100;
+    *usage = heap_reserved_bytes[heap_index];
+}
+
+void MemoryAllocator::trackAllocation(const MemoryAllocation& allocation, bool allocated) {
+    if (allocation.category == MemoryCategory::Count) {
+        return;
+    }
+    u32 heap = memprops.memoryTypes[allocation.memory_type].heapIndex;
+    MemoryCategoryStats& cat = category_stats[heap][static_cast<u32>(allocation.category)];
+    if (allocated) {
+        cat.allocation_count++;
+        cat.bytes += allocation.size;
+    } else {
+        cat.allocation_count--;
+        cat.bytes -= allocation.size;
+    }
+}
+
+VkDeviceSize MemoryAllocator::blockSizeFor(u32 memory_type) {
+    // Small heaps (e.g. the 256MB BAR window) get proportionally smaller blocks
+    VkDeviceSize heap_size = memprops.memoryHeaps[memprops.memoryTypes[memory_type].heapIndex].size;
+    if (heap_size <= 1024ull * 1024 * 1024) {
+        return std::min(DEFAULT_BLOCK_SIZE, alignUp(heap_size / 8, 32));
+    }
+    return DEFAULT_BLOCK_SIZE;
+}
+
+VkDeviceMemory MemoryAllocator::allocateDeviceMemory(VkDeviceSize size, u32 memory_type,
+                                                     void** mapped, const void* next) {
+    // not fatal, the driver may still page, but going over budget is worth knowing about
+    u32 heap_index = memprops.memoryTypes[memory_type].heapIndex;
+    VkDeviceSize budget;
+    VkDeviceSize usage;
+    queryHeapBudget(heap_index, &budget, &usage);
+    if (usage + size > budget) {
+        std::cout << "[MemoryAllocator] allocating " << size << " bytes puts heap " << heap_index
+                  << " over budget (" << usage << "/" << budget << ")" << std::endl;
+    }
+
+    VkMemoryAllocateInfo memalloc_info = {};
+    memalloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    memalloc_info.pNext = next;
+    memalloc_info.allocationSize = size;
+    memalloc_info.memoryTypeIndex = memory_type;
+
+    VkDeviceMemory memory;
+    VKRes(vkAllocateMemory(dev.logical_device, &memalloc_info, hostCallbacks(), &memory));
+    device_allocation_count++;
+    heap_reserved_bytes[memprops.memoryTypes[memory_type].heapIndex] += size;
+
+    // host visible memory stays mapped for its whole lifetime
+    *mapped = nullptr;
+    if (memprops.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        VKRes(vkMapMemory(dev.logical_device, memory, 0, VK_WHOLE_SIZE, 0, mapped));
+    }
+    return memory;
+}
+
+void MemoryAllocator::freeDeviceMemory(VkDeviceMemory memory, VkDeviceSize size,
+                                       u32 memory_type) {
+    vkFreeMemory(dev.logical_device, memory, hostCallbacks());
+    device_allocation_count--;
+    heap_reserved_bytes[memprops.memoryTypes[memory_type].heapIndex] -= size;
+}
+
+bool MemoryAllocator::allocateFromBlock(int block_idx, VkDeviceSize size, VkDeviceSize alignment,
+                                        ResourceKind kind, MemoryAllocation* allocation) {
+    MemoryBlock& block = blocks[block_idx];
+    const VkDeviceSize granularity = buffer_image_granularity;
+
+    for (size_t i = 0; i < block.suballocs.size(); i++) {
+        const Suballocation& free_range = block.suballocs[i];
+        if (free_range.kind != ResourceKind::Free || free_range.size < size) {
+            continue;
+        }
+
+        VkDeviceSize offset = alignUp(free_range.offset, alignment);
+        if (granularity > 1 && i > 0) {
+            const Suballocation& prev = block.suballocs[i - 1];
+            if (kindsConflict(prev.kind, kind) &&
+                onSamePage(prev.offset + prev.size - 1, offset, granularity)) {
+                offset = alignUp(offset, granularity);
+            }
+        }
+
+        VkDeviceSize end = offset + size;
+        if (end > free_range.offset + free_range.size) {
+            continue;
+        }
+        if (granularity > 1 && i + 1 < block.suballocs.size()) {
+            const Suballocation& next = block.suballocs[i + 1];
+            if (kindsConflict(kind, next.kind) && onSamePage(end - 1, next.offset, granularity)) {
+                continue;
+            }
+        }
+
+        // the used range absorbs the alignment padding in front of it
+        Suballocation used = {free_range.offset, end - free_range.offset, kind};
+        Suballocation remainder = {end, free_range.offset + free_range.size - end,
+                                   ResourceKind::Free};
+
+        block.suballocs[i] = used;
+        if (remainder.size > 0) {
+            block.suballocs.insert(block.suballocs.begin() + i + 1, remainder);
+        }
+        block.used += used.size;
+        block.allocation_count++;
+
+        allocation->memory = block.memory;
+        allocation->offset = offset;
+        allocation->block = block_idx;
+        allocation->mapped =
+            block.mapped ? static_cast<u8*>(block.mapped) + offset : nullptr;
+        return true;
+    }
+    return false;
+}
+
+int MemoryAllocator::createBlock(u32 memory_type, VkDeviceSize min_size) {
+    MemoryBlock block;
+    block.size = std::max(blockSizeFor(memory_type), min_size);
+    block.memory_type = memory_type;
+    block.memory = allocateDeviceMemory(block.size, memory_type, &block.mapped);
+    block.suballocs.push_back({0, block.size, ResourceKind::Free});
+
+    if (!free_block_slots.empty()) {
+        int slot = free_block_slots.back();
+        free_block_slots.pop_back();
+        blocks[slot] = block;
+        return slot;
+    }
+    blocks.push_back(block);
+    return static_cast<int>(blocks.size()) - 1;
+}
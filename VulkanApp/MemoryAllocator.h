@@ -0,0 +1,221 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <array>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <GLFW/glfw3.h>
+#include "HostAllocator.h"
+#include "Utilities.h"
+
+// Size of a regular device memory block. Resources are carved out of these.
+const VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+// Resources at least this big get their own VkDeviceMemory, a driver-dedicated one when
+// VK_KHR_dedicated_allocation is enabled.
+const VkDeviceSize DEDICATED_ALLOCATION_THRESHOLD = DEFAULT_BLOCK_SIZE / 2;
+// Host visible device local heaps at least this big (resizable BAR, UMA) take CPU written
+// resources directly. The classic 256MB BAR window is too small to spend on geometry.
+const VkDeviceSize DIRECT_WRITE_MIN_HEAP_SIZE = 1024ull * 1024 * 1024;
+
+// Whether a resource is linear (buffers, linear images) or optimal tiled.
+// Used to keep the two apart by bufferImageGranularity inside a block.
+enum class ResourceKind : u8 {
+    Free,
+    Linear,
+    Optimal,
+};
+
+// What an allocation is used for, for the per-category accounting
+enum class MemoryCategory : u8 {
+    Geometry,
+    Texture,
+    Attachment,
+    Uniform,
+    Staging,
+    Count,
+};
+
+const u32 MEMORY_CATEGORY_COUNT = static_cast<u32>(MemoryCategory::Count);
+
+const char* memoryCategoryName(MemoryCategory category);
+
+struct MemoryAllocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    u32 memory_type = 0;
+    MemoryCategory category = MemoryCategory::Count;
+    // index of the owning block, or -1 for dedicated allocations
+    int block = -1;
+    // host pointer to the start of this allocation when host visible
+    void* mapped = nullptr;
+};
+
+struct MemoryTypeStats {
+    u32 block_count = 0;
+    u32 dedicated_count = 0;
+    u32 allocation_count = 0;
+    VkDeviceSize reserved_bytes = 0; // bytes obtained from vkAllocateMemory
+    VkDeviceSize used_bytes = 0;     // bytes handed out to resources
+};
+
+struct MemoryCategoryStats {
+    u32 allocation_count = 0;
+    VkDeviceSize bytes = 0;
+};
+
+struct MemoryHeapStats {
+    VkDeviceSize size = 0;
+    bool device_local = false;
+    // what the process may use and is using according to the driver (VK_EXT_memory_budget).
+    // Without the extension the budget is a fixed share of the heap and usage is our own.
+    VkDeviceSize budget = 0;
+    VkDeviceSize usage = 0;
+    VkDeviceSize reserved_bytes = 0;
+    VkDeviceSize used_bytes = 0;
+    std::array<MemoryCategoryStats, MEMORY_CATEGORY_COUNT> categories;
+};
+
+struct MemoryStats {
+    std::vector<MemoryTypeStats> types;
+    std::vector<MemoryHeapStats> heaps;
+    std::array<MemoryCategoryStats, MEMORY_CATEGORY_COUNT> categories;
+    MemoryTypeStats total;
+    u32 device_allocation_count = 0; // live vkAllocateMemory calls
+    u32 max_allocation_count = 0;    // maxMemoryAllocationCount
+    bool budget_available = false;   // heap budget/usage come from VK_EXT_memory_budget
+    HostAllocationStats host;        // driver host allocations, when a HostAllocator is set
+    bool host_tracked = false;
+};
+
+class MemoryAllocator {
+public:
+    MemoryAllocator();
+    ~MemoryAllocator();
+
+    // memory_budget: VK_EXT_memory_budget is enabled on the device (and properties2 on instance)
+    // dedicated_allocation: VK_KHR_dedicated_allocation is enabled on the device
+    // host: callbacks for the allocator's own Vulkan calls and host stats, may be null
+    void init(VkInstance instance, VkDev dev, bool memory_budget, bool dedicated_allocation,
+              HostAllocator* host);
+    void destroy();
+
+    // buffer/image: the resource the memory is for, when it is a single one; resources big
+    // enough for their own memory then get it dedicated to them
+    MemoryAllocation allocate(const VkMemoryRequirements& memreqs, VkMemoryPropertyFlags properties,
+                              ResourceKind kind, MemoryCategory category,
+                              VkBuffer buffer = VK_NULL_HANDLE, VkImage image = VK_NULL_HANDLE);
+    void free(MemoryAllocation& allocation);
+
+    void createBuffer(VkDeviceSize buffer_size, VkBufferUsageFlags buffer_usage,
+                      VkMemoryPropertyFlags properties, MemoryCategory category, VkBuffer* buffer,
+                      MemoryAllocation* allocation);
+    void destroyBuffer(VkBuffer buffer, MemoryAllocation& allocation);
+
+    // Device local buffer with CPU written contents. Placed in a large host visible device
+    // local heap when there is one and the buffer may live there, allocation->mapped is then
+    // set and the CPU writes in place. Otherwise it is plain device local, filled by copies.
+    void createDeviceBuffer(VkDeviceSize buffer_size, VkBufferUsageFlags buffer_usage,
+                            MemoryCategory category, VkBuffer* buffer,
+                            MemoryAllocation* allocation);
+    bool directWritesAvailable() {
+        return direct_write_types != 0;
+    }
+    // off forces createDeviceBuffer onto the copy path, for comparisons
+    void setDirectWrites(bool enabled) {
+        direct_writes = enabled;
+    }
+    bool directWritesEnabled() {
+        return direct_writes;
+    }
+
+    MemoryAllocation allocateImage(VkImage image, VkMemoryPropertyFlags properties,
+                                   VkImageTiling tiling, MemoryCategory category);
+
+    // Defragmentation. An allocation is worth moving when its block is at most half used and
+    // a fuller block of the same type has room, so emptying the block lets it be given back.
+    bool isRelocationCandidate(const MemoryAllocation& allocation);
+    // Space for the moved resource in a fuller block of the same type, never a new block.
+    // Returns an allocation without memory when nothing fits.
+    MemoryAllocation relocate(const MemoryAllocation& allocation,
+                              const VkMemoryRequirements& memreqs, ResourceKind kind);
+    // relocate() for a fresh copy of an image, bound on success
+    MemoryAllocation relocateImage(VkImage new_image, const MemoryAllocation& allocation,
+                                   VkImageTiling tiling);
+
+    // runtime query, heap budgets are refreshed from the driver on every call
+    MemoryStats getStats();
+    void printStats();
+    void writeJson(std::ostream& out);
+    bool dumpJson(const std::string& filename);
+
+    // some type in allowed has all of properties
+    bool hasMemoryType(u32 allowed, VkMemoryPropertyFlags properties);
+
+    const VkAllocationCallbacks* hostCallbacks() {
+        return host ? host->callbacks() : nullptr;
+    }
+
+    const VkPhysicalDeviceMemoryProperties& getMemoryProperties() {
+        return memprops;
+    }
+
+private:
+    struct Suballocation {
+        VkDeviceSize offset;
+        VkDeviceSize size;
+        ResourceKind kind;
+    };
+
+    // A single VkDeviceMemory. suballocs covers the whole block in offset order,
+    // free ranges included, and neighbouring free ranges are always merged.
+    struct MemoryBlock {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        VkDeviceSize used = 0;
+        u32 memory_type = 0;
+        u32 allocation_count = 0;
+        void* mapped = nullptr;
+        std::vector<Suballocation> suballocs;
+    };
+
+    VkDev dev;
+    HostAllocator* host;
+    VkPhysicalDeviceMemoryProperties memprops;
+    PFN_vkGetPhysicalDeviceMemoryProperties2KHR get_memory_properties2;
+    VkDeviceSize buffer_image_granularity;
+    u32 max_allocation_count;
+    // memory types createDeviceBuffer may write directly, worked out once in init
+    u32 direct_write_types;
+    bool direct_writes = true;
+    bool dedicated_allocation = false;
+
+    std::vector<MemoryBlock> blocks;
+    std::vector<int> free_block_slots;
+
+    // dedicated allocations, per memory type
+    std::vector<u32> dedicated_count;
+    std::vector<VkDeviceSize> dedicated_bytes;
+    u32 device_allocation_count;
+    // bytes obtained from vkAllocateMemory per heap, blocks and dedicated
+    std::vector<VkDeviceSize> heap_reserved_bytes;
+
+    // live resources per heap and category
+    std::vector<std::array<MemoryCategoryStats, MEMORY_CATEGORY_COUNT>> category_stats;
+
+    void queryBudget(std::vector<MemoryHeapStats>& heaps);
+    // one heap, for the check on every vkAllocateMemory without a full getStats
+    void queryHeapBudget(u32 heap_index, VkDeviceSize* budget, VkDeviceSize* usage);
+    void trackAllocation(const MemoryAllocation& allocation, bool allocated);
+
+    VkDeviceSize blockSizeFor(u32 memory_type);
+    // next: chained into VkMemoryAllocateInfo, e.g. a VkMemoryDedicatedAllocateInfo
+    VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, u32 memory_type, void** mapped,
+                                        const void* next = nullptr);
+    void freeDeviceMemory(VkDeviceMemory memory, VkDeviceSize size, u32 memory_type);
+
+    bool allocateFromBlock(int block_idx, VkDeviceSize size, VkDeviceSize alignment,
+                           ResourceKind kind, MemoryAllocation* allocation);
+    int createBlock(u32 memory_type, VkDeviceSize min_size);
+};
@@ -1,42 +1,210 @@
+#include <algorithm>
+#include <cstring>
 #include "Mesh.h"
 
+static MeshSource sourceOf(const Vertex* vertices, u32 vertex_count, const u32* indices,
+                           u32 index_count) {
+    MeshSource source;
+    source.vertices = vertices;
+    source.vertex_count = vertex_count;
+    source.indices = indices;
+    source.index_count = index_count;
+    return source;
+}
+
+VertexSource MeshSource::getVertices() const {
+    VertexSource source(vertices, vertex_count);
+    source.positions = positions;
+    source.uvs = uvs;
+    return source;
+}
+
+u32 MeshSource::getIndex(u32 i) const {
+    if (indices) {
+        return indices[i];
+    }
+    if (!index_view.data) {
+        return i;
+    }
+    const u8* index = index_view.data + size_t(index_view.stride) * i;
+    switch (index_view.type) {
+    case ComponentType::UInt8:
+        return *index;
+    case ComponentType::UInt16: {
+        u16 value;
+        memcpy(&value, index, sizeof(value));
+        return value;
+    }
+    default: {
+        u32 value;
+        memcpy(&value, index, sizeof(value));
+        return value;
+    }
+    }
+}
+
+glm::vec4 computeBounds(const VertexSource& source) {
+    if (source.count == 0) {
+        return glm::vec4(0.0f);
+    }
+    // box center, then the furthest vertex from it
+    glm::vec3 low = source.get(0).pos;
+    glm::vec3 high = low;
+    for (u32 i = 1; i < source.count; i++) {
+        glm::vec3 pos = source.get(i).pos;
+        low = glm::min(low, pos);
+        high = glm::max(high, pos);
+    }
+    glm::vec3 center = (low + high) * 0.5f;
+    float radius = 0.0f;
+    for (u32 i = 0; i < source.count; i++) {
+        radius = std::max(radius, glm::length(source.get(i).pos - center));
+    }
+    return glm::vec4(center, radius);
+}
+
+glm::vec4 computeBounds(const Vertex* vertices, u32 vertex_count) {
+    return computeBounds(VertexSource(vertices, vertex_count));
+}
+
+// the full detail indices then the LOD ones, converted to the arena's index type on the way
+template <typename T>
+static void writeIndices(const MeshSource& source, T* out) {
+    if (source.indices && sizeof(T) == sizeof(u32)) {
+        memcpy(out, source.indices, sizeof(u32) * source.index_count);
+    } else if (!source.indices && source.index_view.data &&
+               source.index_view.stride == sizeof(T) &&
+               source.index_view.type ==
+                   (sizeof(T) == sizeof(u16) ? ComponentType::UInt16 : ComponentType::UInt32)) {
+        memcpy(out, source.index_view.data, sizeof(T) * source.index_count);
+    } else {
+        for (u32 i = 0; i < source.index_count; i++) {
+            out[i] = static_cast<T>(source.getIndex(i));
+        }
+    }
+    out += source.index_count;
+    for (u32 i = 0; i < source.lod_index_count; i++) {
+        out[i] = static_cast<T>(source.lod_indices[i]);
+    }
+}
+
 Mesh::Mesh() {}
 
-Mesh::Mesh(VkPhysicalDevice new_physical_device, VkDevice new_device, VkQueue transfer_queue,
-           VkCommandPool transfer_cmd_pool, std::vector<Vertex>* vertices,
-           std::vector<u32>* indices, int new_texid) {
-    vertex_count = vertices->size();
-    index_count = indices->size();
-    physical_device = new_physical_device;
-    device = new_device;
-    createVertexBuffer(transfer_queue, transfer_cmd_pool, vertices);
-    createIndexBuffer(transfer_queue, transfer_cmd_pool, indices);
+Mesh::Mesh(GeometryArena* new_arena, std::vector<Vertex>* vertices, std::vector<u32>* indices,
+           int new_texid, bool compact)
+    : Mesh(new_arena, vertices->data(), static_cast<u32>(vertices->size()), indices->data(),
+           static_cast<u32>(indices->size()), new_texid, compact) {}
+
+Mesh::Mesh(GeometryArena* new_arena, const Vertex* vertices, u32 vertex_count, const u32* indices,
+           u32 index_count, int new_texid, bool compact)
+    : Mesh(new_arena, sourceOf(vertices, vertex_count, indices, index_count), new_texid,
+           compact) {}
+
+Mesh::Mesh(GeometryArena* new_arena, const MeshSource& source, int new_texid, bool compact) {
+    arena = new_arena;
+    VertexSource vertices = source.getVertices();
+    u32 vertex_count = source.vertex_count;
+
+    // converted straight into the arena's staging memory, no intermediate copy
+    CompactMesh compact_mesh;
+    if (compact && compactVertices(vertices, &compact_mesh)) {
+        vertex_format = compact_mesh.format;
+        dequantize = compact_mesh.dequantize;
+        vertex_range =
+            arena->allocate(GeometryPool::CompactVertices, vertex_count, [&](void* dst) {
+                writeCompactVertices(vertices, compact_mesh, static_cast<CompactVertex*>(dst));
+            });
+        color_range = arena->allocate(GeometryPool::Colors, &compact_mesh.color, 1);
+    } else {
+        vertex_range = arena->allocate(GeometryPool::Vertices, vertex_count, [&](void* dst) {
+            writeVertices(vertices, static_cast<Vertex*>(dst));
+        });
+    }
+
+    // full detail first, every LOD after it in one allocation
+    lods.push_back({0, source.index_count, 0.0f});
+    for (u32 i = 0; i < source.lod_count; i++) {
+        const MeshLod& lod = source.lods[i];
+        if (u64(lod.first_index) + lod.index_count <= source.lod_index_count) {
+            lods.push_back({source.index_count + lod.first_index, lod.index_count, lod.error});
+        }
+    }
+    u32 index_count = source.index_count + source.lod_index_count;
+    if (compact && vertex_count <= MAX_INDEX16_VERTICES) {
+        index_type = VK_INDEX_TYPE_UINT16;
+        index_range = arena->allocate(GeometryPool::Indices16, index_count, [&](void* dst) {
+            writeIndices(source, static_cast<u16*>(dst));
+        });
+    } else {
+        index_range = arena->allocate(GeometryPool::Indices, index_count, [&](void* dst) {
+            writeIndices(source, static_cast<u32*>(dst));
+        });
+    }
+
+    // imports compute it on the loader threads, anything else here
+    bounds = source.bounds.w >= 0.0f ? source.bounds : computeBounds(vertices);
 
     model.model = glm::mat4(1.0f);
     tex_id = new_texid;
 }
 
 int Mesh::getVertexCount() {
-    return vertex_count;
+    return vertex_range.count;
 }
 
-VkBuffer Mesh::getVertexBuffer() {
-    return vertex_buffer;
+int Mesh::getVertexOffset() {
+    return vertex_range.offset;
 }
 
 int Mesh::getIndexCount() {
-    return index_count;
+    return index_range.count;
+}
+
+int Mesh::getFirstIndex() {
+    return index_range.offset;
+}
+
+MeshLod Mesh::selectLod(float pixels_per_unit) {
+    if (lods.empty()) {
+        return {index_range.offset, index_range.count, 0.0f};
+    }
+    size_t level = 0;
+    while (level + 1 < lods.size() && lods[level + 1].error * pixels_per_unit <= LOD_PIXEL_ERROR) {
+        level++;
+    }
+    MeshLod lod = lods[level];
+    lod.first_index += index_range.offset;
+    return lod;
 }
 
-VkBuffer Mesh::getIndexBuffer() {
-    return index_buffer;
+u32 Mesh::getFirstInstance() {
+    return color_range.offset;
+}
+
+VkDeviceSize Mesh::getGeometryBytes() {
+    VkDeviceSize index_size = index_type == VK_INDEX_TYPE_UINT16 ? sizeof(u16) : sizeof(u32);
+    return vertex_range.count * vertexStride(vertex_format) + index_range.count * index_size +
+           color_range.count * sizeof(u32);
 }
 
 void Mesh::destroyBuffers() {
-    vkDestroyBuffer(device, vertex_buffer, nullptr);
-    vkFreeMemory(device, vertex_buffer_memory, nullptr);
-    vkDestroyBuffer(device, index_buffer, nullptr);
-    vkFreeMemory(device, index_buffer_memory, nullptr);
+    arena->release(vertexPool(), vertex_range);
+    arena->release(indexPool(), index_range);
+    arena->release(GeometryPool::Colors, color_range);
+}
+
+void Mesh::applyMove(const GeometryMove& move) {
+    GeometryRange* range = nullptr;
+    if (move.pool == vertexPool()) {
+        range = &vertex_range;
+    } else if (move.pool == indexPool()) {
+        range = &index_range;
+    } else if (move.pool == GeometryPool::Colors) {
+        range = &color_range;
+    }
+    if (range && range->count > 0 && range->offset == move.old_offset) {
+        range->offset = move.new_offset;
+    }
 }
 
 int Mesh::getTexId() {
@@ -45,65 +213,18 @@ int Mesh::getTexId() {
 
 void Mesh::setModel(glm::mat4 new_model) {
     model.model = new_model;
+    model_scale = std::max({glm::length(glm::vec3(new_model[0])),
+                            glm::length(glm::vec3(new_model[1])),
+                            glm::length(glm::vec3(new_model[2]))});
 }
 
 Mesh::~Mesh() {}
 
-void Mesh::createVertexBuffer(VkQueue transfer_queue, VkCommandPool transfer_cmd_pool,
-                              std::vector<Vertex>* vertices) {
-
-    VkDeviceSize buffer_size = ((size_t)sizeof(Vertex)) * vertices->size();
-
-    // staging buffer to "stage" vertex data before transferring to GPU
-    VkBuffer staging_buffer;
-    VkDeviceMemory staging_buffer_memory;
-
-    createBuffer(physical_device, device, buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                 &staging_buffer, &staging_buffer_memory);
-
-    void* data;
-    vkMapMemory(device, staging_buffer_memory, 0, buffer_size, 0, &data);
-    memcpy(data, vertices->data(), size_t(buffer_size));
-    vkUnmapMemory(device, staging_buffer_memory);
-
-    // TRANSFER_DST bit to trasnfer to GPU, as vertex buffer.
-    // memory is local only to the GPU
-    createBuffer(physical_device, device, buffer_size,
-                 VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vertex_buffer, &vertex_buffer_memory);
-
-    copyBuffer(device, transfer_queue, transfer_cmd_pool, staging_buffer, vertex_buffer,
-               buffer_size);
-
-    vkDestroyBuffer(device, staging_buffer, nullptr);
-    vkFreeMemory(device, staging_buffer_memory, nullptr);
+GeometryPool Mesh::vertexPool() {
+    return vertex_format == VertexFormat::Float ? GeometryPool::Vertices
+                                                : GeometryPool::CompactVertices;
 }
 
-void Mesh::createIndexBuffer(VkQueue transfer_queue, VkCommandPool transfer_cmd_pool,
-                             std::vector<u32>* indices) {
-    VkDeviceSize buffer_size = ((size_t)sizeof(u32)) * indices->size();
-
-    // staging buffer to "stage" vertex data before transferring to GPU
-    VkBuffer staging_buffer;
-    VkDeviceMemory staging_buffer_memory;
-
-    createBuffer(physical_device, device, buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                 &staging_buffer, &staging_buffer_memory);
-
-    void* data;
-    vkMapMemory(device, staging_buffer_memory, 0, buffer_size, 0, &data);
-    memcpy(data, indices->data(), size_t(buffer_size));
-    vkUnmapMemory(device, staging_buffer_memory);
-
-    createBuffer(physical_device, device, buffer_size,
-                 VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &index_buffer, &index_buffer_memory);
-
-    copyBuffer(device, transfer_queue, transfer_cmd_pool, staging_buffer, index_buffer,
-               buffer_size);
-
-    vkDestroyBuffer(device, staging_buffer, nullptr);
-    vkFreeMemory(device, staging_buffer_memory, nullptr);
+GeometryPool Mesh::indexPool() {
+    return index_type == VK_INDEX_TYPE_UINT16 ? GeometryPool::Indices16 : GeometryPool::Indices;
 }
@@ -3,52 +3,161 @@
 #define GLFW_INCLUDE_VULKAN
 #include <vector>
 #include <GLFW/glfw3.h>
+#include "GeometryArena.h"
+#include "Meshlets.h"
 #include "Utilities.h"
 
 struct Model {
     glm::mat4 model;
 };
 
+// A LOD picks the coarsest level whose error stays below this on screen
+const float LOD_PIXEL_ERROR = 1.0f;
+
+// One level of detail: an index list over the full mesh's vertices
+struct MeshLod {
+    u32 first_index; // into MeshData::lod_indices, or the mesh's index range once created
+    u32 index_count;
+    float error; // furthest the surface moved from full detail, in mesh units
+};
+
+// CPU side geometry of one mesh, as imported and before it goes to the arena
+struct MeshData {
+    std::vector<Vertex> vertices;
+    std::vector<u32> indices;
+    u32 material = 0;
+    MeshletData meshlets; // built from the final index order, see buildMeshlets
+    // coarser levels, finest first, see buildMeshLods
+    std::vector<MeshLod> lods;
+    std::vector<u32> lod_indices;
+    glm::vec4 bounds = glm::vec4(0.0f, 0.0f, 0.0f, -1.0f); // negative radius until computed
+};
+
+// What a Mesh is created from, over MeshData or straight over a mapped mesh cache or glTF
+// file. Without vertices the positions/uvs views are read instead, and without indices the
+// index_view (UInt8/16/32) or, when that is unset too, 0..index_count-1. Both are converted
+// while they are written into the arena.
+struct MeshSource {
+    const Vertex* vertices = nullptr;
+    AttributeView positions;
+    AttributeView uvs;
+    u32 vertex_count = 0;
+    const u32* indices = nullptr;
+    AttributeView index_view;
+    u32 index_count = 0;
+    const MeshLod* lods = nullptr;
+    u32 lod_count = 0;
+    const u32* lod_indices = nullptr;
+    u32 lod_index_count = 0;
+    glm::vec4 bounds = glm::vec4(0.0f, 0.0f, 0.0f, -1.0f); // computed from the vertices if unset
+
+    MeshSource() {}
+    MeshSource(const MeshData& data)
+        : vertices(data.vertices.data()), vertex_count(static_cast<u32>(data.vertices.size())),
+          indices(data.indices.data()), index_count(static_cast<u32>(data.indices.size())),
+          lods(data.lods.data()), lod_count(static_cast<u32>(data.lods.size())),
+          lod_indices(data.lod_indices.data()),
+          lod_index_count(static_cast<u32>(data.lod_indices.size())), bounds(data.bounds) {}
+
+    VertexSource getVertices() const;
+    u32 getIndex(u32 i) const;
+};
+
+// Bounding sphere of the vertices, xyz center and w radius
+glm::vec4 computeBounds(const VertexSource& source);
+glm::vec4 computeBounds(const Vertex* vertices, u32 vertex_count);
+
+// One node of an imported scene. Parents come before their children and a node's meshes are
+// a contiguous run of the model's meshes.
+struct SceneNode {
+    glm::mat4 transform; // relative to the parent
+    int parent;          // -1 for the root
+    u32 first_mesh;
+    u32 mesh_count;
+    u32 padding;
+};
+
 class Mesh {
 public:
     Mesh();
-    Mesh(VkPhysicalDevice physical_device, VkDevice device, VkQueue transfer_queue,
-         VkCommandPool transfer_cmd_pool, std::vector<Vertex>* vertices, std::vector<u32>* indices,
-         int new_texid);
+    Mesh(GeometryArena* arena, std::vector<Vertex>* vertices, std::vector<u32>* indices,
+         int new_texid, bool compact = false);
+    // compact: store the mesh in a compact vertex format and with 16-bit indices when it
+    // fits them, see compactVertices
+    Mesh(GeometryArena* arena, const Vertex* vertices, u32 vertex_count, const u32* indices,
+         u32 index_count, int new_texid, bool compact = false);
+    // the LOD index lists go into the same index range, after the full detail ones
+    Mesh(GeometryArena* arena, const MeshSource& source, int new_texid, bool compact = false);
 
     int getVertexCount();
-    VkBuffer getVertexBuffer();
+    int getVertexOffset();
 
     int getIndexCount();
-    VkBuffer getIndexBuffer();
+    int getFirstIndex();
+    // selects the mesh color in compact formats
+    u32 getFirstInstance();
     void destroyBuffers();
 
+    VertexFormat getVertexFormat() {
+        return vertex_format;
+    }
+    VkIndexType getIndexType() {
+        return index_type;
+    }
+    // maps the stored positions to mesh space, goes in front of the model matrix
+    const glm::mat4& getDequantize() {
+        return dequantize;
+    }
+    // bytes the mesh takes up in the arena
+    VkDeviceSize getGeometryBytes();
+
+    u32 getLodCount() {
+        return static_cast<u32>(lods.size());
+    }
+    // The coarsest level that is still within LOD_PIXEL_ERROR at this many pixels per mesh
+    // unit, first_index is absolute. Level 0 is full detail.
+    MeshLod selectLod(float pixels_per_unit);
+    // bounding sphere in mesh space, xyz center and w radius
+    const glm::vec4& getBounds() {
+        return bounds;
+    }
+
+    // follow a range moved by the arena defragmenter
+    void applyMove(const GeometryMove& move);
+
     int getTexId();
 
+    // world transform of the scene node the mesh hangs off, in front of the dequantize
     void setModel(glm::mat4 new_model);
     Model getModel() {
         return model;
     }
+    // largest axis scale of the node transform, LOD errors are in mesh units
+    float getModelScale() {
+        return model_scale;
+    }
 
     ~Mesh();
 
 private:
     Model model;
-    int vertex_count;
-    VkBuffer vertex_buffer;
-    VkDeviceMemory vertex_buffer_memory;
+    float model_scale = 1.0f;
+    GeometryRange vertex_range;
+    GeometryRange index_range;
+    GeometryRange color_range;
+
+    VertexFormat vertex_format = VertexFormat::Float;
+    VkIndexType index_type = VK_INDEX_TYPE_UINT32;
+    glm::mat4 dequantize = glm::mat4(1.0f);
 
-    int index_count;
-    VkBuffer index_buffer;
-    VkDeviceMemory index_buffer_memory;
+    // first_index relative to index_range, level 0 is the full mesh
+    std::vector<MeshLod> lods;
+    glm::vec4 bounds = glm::vec4(0.0f);
 
     int tex_id;
 
-    VkPhysicalDevice physical_device;
-    VkDevice device;
+    GeometryArena* arena;
 
-    void createVertexBuffer(VkQueue transfer_queue, VkCommandPool transfer_cmd_pool,
-                            std::vector<Vertex>* vertices);
-    void createIndexBuffer(VkQueue transfer_queue, VkCommandPool transfer_cmd_pool,
-                           std::vector<u32>* indices);
+    GeometryPool vertexPool();
+    GeometryPool indexPool();
 };
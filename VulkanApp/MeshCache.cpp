@@ -0,0 +1,262 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include "MeshCache.h"
+
+static size_t padTo4(size_t size) {
+    return (size + 3) & ~size_t(3);
+}
+
+MeshCache::MeshCache() {}
+
+MeshCache::~MeshCache() {}
+
+bool MeshCache::open(const std::string& filename, u64 source_hash, u32 import_flags,
+                     u32 mesh_options) {
+    close();
+    if (!file.open(filename) || file.getSize() < sizeof(MeshCacheHeader)) {
+        close();
+        return false;
+    }
+
+    const u8* data = file.getData();
+    header = reinterpret_cast<const MeshCacheHeader*>(data);
+    if (header->magic != MESH_CACHE_MAGIC || header->version != MESH_CACHE_VERSION ||
+        header->source_hash != source_hash || header->import_flags != import_flags ||
+        header->mesh_options != mesh_options) {
+        close();
+        return false;
+    }
+
+    // the sections have to add up to the file size exactly
+    size_t strings_offset = sizeof(MeshCacheHeader);
+    size_t nodes_offset = strings_offset + header->string_bytes;
+    size_t entries_offset = nodes_offset + sizeof(SceneNode) * size_t(header->node_count);
+    size_t vertices_offset = entries_offset + sizeof(MeshCacheEntry) * header->mesh_count;
+    size_t indices_offset = vertices_offset + sizeof(Vertex) * size_t(header->vertex_count);
+    size_t meshlets_offset = indices_offset + sizeof(u32) * size_t(header->index_count);
+    size_t bounds_offset = meshlets_offset + sizeof(Meshlet) * size_t(header->meshlet_count);
+    size_t meshlet_vertices_offset =
+        bounds_offset + sizeof(MeshletBounds) * size_t(header->meshlet_count);
+    size_t meshlet_triangles_offset =
+        meshlet_vertices_offset + sizeof(u32) * size_t(header->meshlet_vertex_count);
+    size_t lods_offset = meshlet_triangles_offset + size_t(header->meshlet_triangle_bytes);
+    size_t lod_indices_offset = lods_offset + sizeof(MeshLod) * size_t(header->lod_count);
+    size_t end = lod_indices_offset + sizeof(u32) * size_t(header->lod_index_count);
+    if (header->string_bytes % 4 != 0 || header->meshlet_triangle_bytes % 4 != 0 ||
+        end != file.getSize()) {
+        close();
+        return false;
+    }
+
+    const char* strings = reinterpret_cast<const char*>(data + strings_offset);
+    const char* strings_end = strings + header->string_bytes;
+    for (u32 i = 0; i < header->material_count; i++) {
+        const char* name_end = std::find(strings, strings_end, '\0');
+        if (name_end == strings_end) {
+            close();
+            return false;
+        }
+        materials.push_back(std::string(strings, name_end));
+        strings = name_end + 1;
+    }
+
+    nodes = reinterpret_cast<const SceneNode*>(data + nodes_offset);
+    entries = reinterpret_cast<const MeshCacheEntry*>(data + entries_offset);
+    vertices = reinterpret_cast<const Vertex*>(data + vertices_offset);
+    indices = reinterpret_cast<const u32*>(data + indices_offset);
+    meshlets = reinterpret_cast<const Meshlet*>(data + meshlets_offset);
+    meshlet_bounds = reinterpret_cast<const MeshletBounds*>(data + bounds_offset);
+    meshlet_vertices = reinterpret_cast<const u32*>(data + meshlet_vertices_offset);
+    meshlet_triangles = data + meshlet_triangles_offset;
+    lods = reinterpret_cast<const MeshLod*>(data + lods_offset);
+    lod_indices = reinterpret_cast<const u32*>(data + lod_indices_offset);
+
+    // parents before children, meshes inside the table
+    for (u32 i = 0; i < header->node_count; i++) {
+        const SceneNode& node = nodes[i];
+        if (node.parent < -1 || node.parent >= static_cast<int>(i) ||
+            u64(node.first_mesh) + node.mesh_count > header->mesh_count) {
+            close();
+            return false;
+        }
+    }
+    for (u32 i = 0; i < header->mesh_count; i++) {
+        const MeshCacheEntry& entry = entries[i];
+        if (u64(entry.first_vertex) + entry.vertex_count > header->vertex_count ||
+            u64(entry.first_index) + entry.index_count > header->index_count ||
+            entry.material >= header->material_count ||
+            u64(entry.first_meshlet) + entry.meshlet_count > header->meshlet_count ||
+            u64(entry.first_meshlet_vertex) + entry.meshlet_vertex_count >
+                header->meshlet_vertex_count ||
+            u64(entry.first_meshlet_triangle) + entry.meshlet_triangle_bytes >
+                header->meshlet_triangle_bytes ||
+            u64(entry.first_lod) + entry.lod_count > header->lod_count ||
+            u64(entry.first_lod_index) + entry.lod_index_count > header->lod_index_count) {
+            close();
+            return false;
+        }
+        for (u32 l = 0; l < entry.lod_count; l++) {
+            const MeshLod& lod = lods[entry.first_lod + l];
+            if (u64(lod.first_index) + lod.index_count > entry.lod_index_count) {
+                close();
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void MeshCache::close() {
+    file.close();
+    header = nullptr;
+    nodes = nullptr;
+    entries = nullptr;
+    vertices = nullptr;
+    indices = nullptr;
+    meshlets = nullptr;
+    meshlet_bounds = nullptr;
+    meshlet_vertices = nullptr;
+    meshlet_triangles = nullptr;
+    lods = nullptr;
+    lod_indices = nullptr;
+    materials.clear();
+}
+
+MeshletView MeshCache::getMeshlets(const MeshCacheEntry& entry) {
+    MeshletView view;
+    view.meshlets = meshlets + entry.first_meshlet;
+    view.bounds = meshlet_bounds + entry.first_meshlet;
+    view.meshlet_count = entry.meshlet_count;
+    view.vertices = meshlet_vertices + entry.first_meshlet_vertex;
+    view.triangles = meshlet_triangles + entry.first_meshlet_triangle;
+    return view;
+}
+
+MeshSource MeshCache::getSource(const MeshCacheEntry& entry) {
+    MeshSource source;
+    source.vertices = vertices + entry.first_vertex;
+    source.vertex_count = entry.vertex_count;
+    source.indices = indices + entry.first_index;
+    source.index_count = entry.index_count;
+    source.lods = lods + entry.first_lod;
+    source.lod_count = entry.lod_count;
+    source.lod_indices = lod_indices + entry.first_lod_index;
+    source.lod_index_count = entry.lod_index_count;
+    source.bounds = entry.bounds;
+    return source;
+}
+
+bool MeshCache::write(const std::string& filename, u64 source_hash, u32 import_flags,
+                      u32 mesh_options, const std::vector<std::string>& materials,
+                      const std::vector<SceneNode>& nodes, const std::vector<MeshData>& meshes) {
+    std::string strings;
+    for (const std::string& name : materials) {
+        strings += name;
+        strings.push_back('\0');
+    }
+    strings.resize(padTo4(strings.size()), '\0');
+
+    MeshCacheHeader header = {};
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.source_hash = source_hash;
+    header.import_flags = import_flags;
+    header.mesh_options = mesh_options;
+    header.material_count = static_cast<u32>(materials.size());
+    header.mesh_count = static_cast<u32>(meshes.size());
+    header.string_bytes = static_cast<u32>(strings.size());
+    header.node_count = static_cast<u32>(nodes.size());
+
+    std::vector<MeshCacheEntry> entries(meshes.size());
+    for (size_t i = 0; i < meshes.size(); i++) {
+        entries[i].first_vertex = static_cast<u32>(header.vertex_count);
+        entries[i].vertex_count = static_cast<u32>(meshes[i].vertices.size());
+        entries[i].first_index = static_cast<u32>(header.index_count);
+        entries[i].index_count = static_cast<u32>(meshes[i].indices.size());
+        entries[i].material = meshes[i].material;
+        header.vertex_count += meshes[i].vertices.size();
+        header.index_count += meshes[i].indices.size();
+
+        const MeshletData& meshlets = meshes[i].meshlets;
+        entries[i].first_meshlet = static_cast<u32>(header.meshlet_count);
+        entries[i].meshlet_count = static_cast<u32>(meshlets.meshlets.size());
+        entries[i].first_meshlet_vertex = static_cast<u32>(header.meshlet_vertex_count);
+        entries[i].meshlet_vertex_count = static_cast<u32>(meshlets.vertices.size());
+        entries[i].first_meshlet_triangle = static_cast<u32>(header.meshlet_triangle_bytes);
+        entries[i].meshlet_triangle_bytes = static_cast<u32>(meshlets.triangles.size());
+        header.meshlet_count += meshlets.meshlets.size();
+        header.meshlet_vertex_count += meshlets.vertices.size();
+        header.meshlet_triangle_bytes += meshlets.triangles.size();
+
+        entries[i].first_lod = static_cast<u32>(header.lod_count);
+        entries[i].lod_count = static_cast<u32>(meshes[i].lods.size());
+        entries[i].first_lod_index = static_cast<u32>(header.lod_index_count);
+        entries[i].lod_index_count = static_cast<u32>(meshes[i].lod_indices.size());
+        entries[i].bounds = meshes[i].bounds;
+        header.lod_count += meshes[i].lods.size();
+        header.lod_index_count += meshes[i].lod_indices.size();
+    }
+
+    // write aside and swap in, a crash mid-write must not leave a truncated cache behind
+    std::string temp_name = filename + ".tmp";
+    {
+        std::ofstream out(temp_name, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(strings.data(), strings.size());
+        out.write(reinterpret_cast<const char*>(nodes.data()), sizeof(SceneNode) * nodes.size());
+        out.write(reinterpret_cast<const char*>(entries.data()),
+                  sizeof(MeshCacheEntry) * entries.size());
+        for (const MeshData& mesh : meshes) {
+            out.write(reinterpret_cast<const char*>(mesh.vertices.data()),
+                      sizeof(Vertex) * mesh.vertices.size());
+        }
+        for (const MeshData& mesh : meshes) {
+            out.write(reinterpret_cast<const char*>(mesh.indices.data()),
+                      sizeof(u32) * mesh.indices.size());
+        }
+        for (const MeshData& mesh : meshes) {
+            out.write(reinterpret_cast<const char*>(mesh.meshlets.meshlets.data()),
+                      sizeof(Meshlet) * mesh.meshlets.meshlets.size());
+        }
+        for (const MeshData& mesh : meshes) {
+            out.write(reinterpret_cast<const char*>(mesh.meshlets.bounds.data()),
+                      sizeof(MeshletBounds) * mesh.meshlets.bounds.size());
+        }
+        for (const MeshData& mesh : meshes) {
+            out.write(reinterpret_cast<const char*>(mesh.meshlets.vertices.data()),
+                      sizeof(u32) * mesh.meshlets.vertices.size());
+        }
+        for (const MeshData& mesh : meshes) {
+            out.write(reinterpret_cast<const char*>(mesh.meshlets.triangles.data()),
+                      mesh.meshlets.triangles.size());
+        }
+        for (const MeshData& mesh : meshes) {
+            out.write(reinterpret_cast<const char*>(mesh.lods.data()),
+                      sizeof(MeshLod) * mesh.lods.size());
+        }
+        for (const MeshData& mesh : meshes) {
+            out.write(reinterpret_cast<const char*>(mesh.lod_indices.data()),
+                      sizeof(u32) * mesh.lod_indices.size());
+        }
+        if (!out.good()) {
+            out.close();
+            std::remove(temp_name.c_str());
+            return false;
+        }
+    }
+
+    std::remove(filename.c_str());
+    return std::rename(temp_name.c_str(), filename.c_str()) == 0;
+}
+
+u64 MeshCache::hashFile(const std::string& filename) {
+    MappedFile source;
+    if (!source.open(filename)) {
+        return 0;
+    }
+    return fnv1a64(source.getData(), source.getSize());
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+#include "Mesh.h"
+#include "Utilities.h"
+
+// Written next to the source model
+const char* const MESH_CACHE_EXTENSION = ".meshcache";
+const u32 MESH_CACHE_MAGIC = 0x434d4b56; // "VKMC"
+// bump whenever the layout or the imported geometry changes
+const u32 MESH_CACHE_VERSION = 6;
+
+// Processing applied to the geometry after import, part of the cache key
+const u32 MESH_OPTION_OPTIMIZED = 1 << 0;  // optimizeMesh() ran on every mesh
+const u32 MESH_OPTION_NATIVE_OBJ = 1 << 1; // an OBJ imported through loadObj, not Assimp
+
+struct MeshCacheHeader {
+    u32 magic;
+    u32 version;
+    u64 source_hash; // FNV-1a of the source file
+    u32 import_flags;
+    u32 mesh_options;
+    u32 material_count;
+    u32 mesh_count;
+    u32 string_bytes; // material names, zero terminated, padded to 4 bytes
+    u32 node_count;
+    u64 vertex_count;
+    u64 index_count;
+    u64 meshlet_count;
+    u64 meshlet_vertex_count;
+    u64 meshlet_triangle_bytes;
+    u64 lod_count;
+    u64 lod_index_count;
+};
+
+struct MeshCacheEntry {
+    u32 first_vertex;
+    u32 vertex_count;
+    u32 first_index;
+    u32 index_count;
+    u32 material;
+    // meshlet offsets are relative to the mesh's own slices of the meshlet arrays
+    u32 first_meshlet;
+    u32 meshlet_count;
+    u32 first_meshlet_vertex;
+    u32 meshlet_vertex_count;
+    u32 first_meshlet_triangle; // bytes
+    u32 meshlet_triangle_bytes;
+    // LOD offsets are relative to the mesh's own slice of the LOD indices
+    u32 first_lod;
+    u32 lod_count;
+    u32 first_lod_index;
+    u32 lod_index_count;
+    glm::vec4 bounds; // see computeBounds
+};
+
+// Final vertex/index arrays, meshlets and node hierarchy of an imported model, so warm starts
+// skip the importer. Layout: header, material names, scene nodes, mesh table, every vertex,
+// every index, then the meshlets, their bounds, meshlet vertices and meshlet triangles, then
+// the LODs and their indices of every mesh. The file is memory-mapped and uploads copy
+// straight out of the mapping. It is keyed by the source content hash, import flags and mesh
+// options; edits to files the source references (e.g. .mtl) are not tracked.
+class MeshCache {
+public:
+    MeshCache();
+    ~MeshCache();
+
+    // false when the cache is missing, stale or malformed
+    bool open(const std::string& filename, u64 source_hash, u32 import_flags, u32 mesh_options);
+    void close();
+
+    const std::vector<std::string>& getMaterials() {
+        return materials;
+    }
+    u32 getMeshCount() {
+        return header->mesh_count;
+    }
+    // the node hierarchy, see SceneNode
+    std::vector<SceneNode> getNodes() {
+        return std::vector<SceneNode>(nodes, nodes + header->node_count);
+    }
+    const MeshCacheEntry& getMesh(u32 index) {
+        return entries[index];
+    }
+    const Vertex* getVertices(const MeshCacheEntry& entry) {
+        return vertices + entry.first_vertex;
+    }
+    const u32* getIndices(const MeshCacheEntry& entry) {
+        return indices + entry.first_index;
+    }
+    MeshletView getMeshlets(const MeshCacheEntry& entry);
+    // everything a Mesh is created from
+    MeshSource getSource(const MeshCacheEntry& entry);
+
+    static bool write(const std::string& filename, u64 source_hash, u32 import_flags,
+                      u32 mesh_options, const std::vector<std::string>& materials,
+                      const std::vector<SceneNode>& nodes, const std::vector<MeshData>& meshes);
+
+    // content hash of a source file, 0 when it can't be read
+    static u64 hashFile(const std::string& filename);
+
+private:
+    MappedFile file;
+    const MeshCacheHeader* header = nullptr;
+    const SceneNode* nodes = nullptr;
+    const MeshCacheEntry* entries = nullptr;
+    const Vertex* vertices = nullptr;
+    const u32* indices = nullptr;
+    const Meshlet* meshlets = nullptr;
+    const MeshletBounds* meshlet_bounds = nullptr;
+    const u32* meshlet_vertices = nullptr;
+    const u8* meshlet_triangles = nullptr;
+    const MeshLod* lods = nullptr;
+    const u32* lod_indices = nullptr;
+    std::vector<std::string> materials;
+};
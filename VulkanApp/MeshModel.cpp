@@ -1,13 +1,63 @@
+#include <algorithm>
+#include <cfloat>
 #include "MeshModel.h"
 
-MeshModel::MeshModel(std::vector<Mesh> meshlist) {
+static glm::mat4 toGlm(const aiMatrix4x4& m) {
+    // assimp is row major, glm column major
+    return glm::mat4(m.a1, m.b1, m.c1, m.d1, m.a2, m.b2, m.c2, m.d2, m.a3, m.b3, m.c3, m.d3, m.a4,
+                     m.b4, m.c4, m.d4);
+}
+
+static float maxScale(const glm::mat4& transform) {
+    return std::max({glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])),
+                     glm::length(glm::vec3(transform[2]))});
+}
+
+MeshModel::MeshModel(std::vector<Mesh> meshlist, const std::vector<SceneNode>& node_list) {
     meshes = meshlist;
+    nodes = node_list;
     model = glm::mat4(1.0f);
+
+    // parents come first, so one pass composes every world transform
+    std::vector<glm::mat4> world(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++) {
+        const SceneNode& node = nodes[i];
+        world[i] = node.parent < 0 ? node.transform : world[node.parent] * node.transform;
+        for (u32 m = 0; m < node.mesh_count && node.first_mesh + m < meshes.size(); m++) {
+            meshes[node.first_mesh + m].setModel(world[i]);
+        }
+    }
+
+    // a sphere around every mesh's sphere, centered on their box
+    if (meshes.empty()) {
+        return;
+    }
+    std::vector<glm::vec4> spheres(meshes.size());
+    for (size_t i = 0; i < meshes.size(); i++) {
+        const glm::vec4& sphere = meshes[i].getBounds();
+        glm::mat4 transform = meshes[i].getModel().model;
+        spheres[i] = glm::vec4(glm::vec3(transform * glm::vec4(glm::vec3(sphere), 1.0f)),
+                               sphere.w * maxScale(transform));
+    }
+    glm::vec3 low(FLT_MAX);
+    glm::vec3 high(-FLT_MAX);
+    for (const glm::vec4& sphere : spheres) {
+        low = glm::min(low, glm::vec3(sphere) - sphere.w);
+        high = glm::max(high, glm::vec3(sphere) + sphere.w);
+    }
+    glm::vec3 center = (low + high) * 0.5f;
+    float radius = 0.0f;
+    for (const glm::vec4& sphere : spheres) {
+        radius = std::max(radius, glm::length(glm::vec3(sphere) - center) + sphere.w);
+    }
+    bounds = glm::vec4(center, radius);
 }
 
 MeshModel::~MeshModel() {}
 
-MeshModel::MeshModel() {}
+MeshModel::MeshModel() {
+    model = glm::mat4(1.0f);
+}
 
 size_t MeshModel::getMeshCount() {
     return meshes.size();
@@ -47,54 +97,134 @@ std::vector<std::string> MeshModel::LoadMaterials(const aiScene* scene) {
     return textures;
 }
 
-std::vector<Mesh> MeshModel::LoadNode(VkDev dev, VkQueue transfer_queue,
-                                      VkCommandPool transfer_cmd_pool, aiNode* node,
-                                      const aiScene* scene, std::vector<int> mat_to_tex) {
-    std::vector<Mesh> meshes;
-    for (size_t i = 0; i < node->mNumMeshes; i++) {
-        meshes.push_back(LoadMesh(dev, transfer_queue, transfer_cmd_pool,
-                                  scene->mMeshes[node->mMeshes[i]], scene, mat_to_tex));
+void MeshModel::LoadScene(const aiScene* scene, std::vector<SceneNode>* nodes,
+                          std::vector<MeshData>* meshes, ThreadPool* pool) {
+    nodes->clear();
+    meshes->clear();
+    if (!scene->mRootNode) {
+        return;
     }
-    for (size_t i = 0; i < node->mNumChildren; i++) {
-        std::vector<Mesh> childmeshes;
-        childmeshes =
-            LoadNode(dev, transfer_queue, transfer_cmd_pool, node->mChildren[i], scene, mat_to_tex);
-        meshes.insert(meshes.end(), childmeshes.begin(), childmeshes.end());
-    }
-    return meshes;
-}
 
-Mesh MeshModel::LoadMesh(VkDev dev, VkQueue transfer_queue, VkCommandPool transfer_cmd_pool,
-                         aiMesh* mesh, const aiScene* scene, std::vector<int> mat_to_tex) {
-    std::vector<Vertex> vertices;
-    std::vector<u32> indices;
+    // first pass only counts; it walks in the same order as the second, so the stack already
+    // has all the room that one needs
+    std::vector<std::pair<const aiNode*, int>> stack;
+    stack.reserve(64);
+    size_t node_count = 0;
+    size_t mesh_count = 0;
+    stack.push_back({scene->mRootNode, -1});
+    while (!stack.empty()) {
+        const aiNode* node = stack.back().first;
+        stack.pop_back();
+        node_count++;
+        mesh_count += node->mNumMeshes;
+        for (u32 i = node->mNumChildren; i-- > 0;) {
+            stack.push_back({node->mChildren[i], -1});
+        }
+    }
+    nodes->resize(node_count);
+    meshes->resize(mesh_count);
+    std::vector<const aiMesh*> sources(mesh_count);
+
+    // children go on the stack last to first, so they come off in file order and the meshes
+    // keep the order a recursive walk gives them
+    int next_node = 0;
+    u32 next_mesh = 0;
+    stack.push_back({scene->mRootNode, -1});
+    while (!stack.empty()) {
+        const aiNode* node = stack.back().first;
+        int parent = stack.back().second;
+        stack.pop_back();
+
+        int index = next_node++;
+        SceneNode& out = (*nodes)[index];
+        out.transform = toGlm(node->mTransformation);
+        out.parent = parent;
+        out.first_mesh = next_mesh;
+        out.mesh_count = node->mNumMeshes;
+        out.padding = 0;
+        for (u32 i = 0; i < node->mNumMeshes; i++) {
+            sources[next_mesh++] = scene->mMeshes[node->mMeshes[i]];
+        }
+        for (u32 i = node->mNumChildren; i-- > 0;) {
+            stack.push_back({node->mChildren[i], index});
+        }
+    }
 
-    vertices.resize(mesh->mNumVertices);
+    // the walk is cheap, converting the meshes is what takes the time
+    auto convert = [&sources, meshes](u32 i) { LoadMeshData(sources[i], &(*meshes)[i]); };
+    if (pool) {
+        pool->parallelFor(static_cast<u32>(mesh_count), convert);
+    } else {
+        for (u32 i = 0; i < mesh_count; i++) {
+            convert(i);
+        }
+    }
+}
 
-    for (size_t i = 0; i < mesh->mNumVertices; i++) {
-        vertices[i].pos = {mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z};
+std::vector<Mesh> MeshModel::CreateMeshes(GeometryArena* arena,
+                                          const std::vector<MeshData>& mesh_data,
+                                          const std::vector<int>& mat_to_tex, bool compact) {
+    std::vector<Mesh> meshes;
+    meshes.reserve(mesh_data.size());
+    for (const MeshData& data : mesh_data) {
+        meshes.push_back(Mesh(arena, MeshSource(data), mat_to_tex[data.material], compact));
+    }
+    return meshes;
+}
 
-        if (mesh->mTextureCoords[0]) {
-            vertices[i].tex = {mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y};
-        } else {
-            vertices[i].tex = {0.0f, 0.0f};
+void MeshModel::LoadMeshData(const aiMesh* mesh, MeshData* data) {
+    // one branch-free loop per attribute over presized arrays, so they vectorise
+    std::vector<Vertex>& vertices = data->vertices;
+    u32 vertex_count = mesh->mNumVertices;
+    vertices.resize(vertex_count);
+    Vertex* out = vertices.data();
+
+    const aiVector3D* positions = mesh->mVertices;
+    for (u32 i = 0; i < vertex_count; i++) {
+        out[i].pos = glm::vec3(positions[i].x, positions[i].y, positions[i].z);
+        out[i].col = glm::vec3(1.0f);
+    }
+    const aiVector3D* uvs = mesh->mTextureCoords[0];
+    if (uvs) {
+        for (u32 i = 0; i < vertex_count; i++) {
+            out[i].tex = glm::vec2(uvs[i].x, uvs[i].y);
+        }
+    } else {
+        for (u32 i = 0; i < vertex_count; i++) {
+            out[i].tex = glm::vec2(0.0f);
         }
-        vertices[i].col = {1.0f, 1.0f, 1.0f};
     }
-    for (size_t i = 0; i < mesh->mNumFaces; i++) {
-        aiFace face = mesh->mFaces[i];
-        for (size_t j = 0; j < face.mNumIndices; j++) {
-            indices.push_back(face.mIndices[j]);
+
+    // sized up front: triangulated faces have three indices, but point and line faces
+    // survive aiProcess_Triangulate
+    std::vector<u32>& indices = data->indices;
+    size_t index_count = 0;
+    for (u32 i = 0; i < mesh->mNumFaces; i++) {
+        index_count += mesh->mFaces[i].mNumIndices;
+    }
+    indices.resize(index_count);
+    u32* index = indices.data();
+    for (u32 i = 0; i < mesh->mNumFaces; i++) {
+        const aiFace& face = mesh->mFaces[i];
+        for (u32 j = 0; j < face.mNumIndices; j++) {
+            *index++ = face.mIndices[j];
         }
     }
 
-    Mesh newmesh = Mesh(dev.physical_device, dev.logical_device, transfer_queue, transfer_cmd_pool,
-                        &vertices, &indices, mat_to_tex[mesh->mMaterialIndex]);
-    return newmesh;
+    data->material = mesh->mMaterialIndex;
+}
+
+void MeshModel::applyMoves(const std::vector<GeometryMove>& moves) {
+    for (const GeometryMove& move : moves) {
+        for (auto& mesh : meshes) {
+            mesh.applyMove(move);
+        }
+    }
 }
 
 void MeshModel::destroyMeshModel() {
-    for (auto model : meshes) {
-        model.destroyBuffers();
+    for (auto& mesh : meshes) {
+        mesh.destroyBuffers();
     }
+    meshes.clear();
 }
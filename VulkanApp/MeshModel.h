@@ -3,12 +3,15 @@
 #include <assimp/scene.h>
 #include <glm/glm.hpp>
 #include "Mesh.h"
+#include "ThreadPool.h"
 #include "Utilities.h"
 
 class MeshModel {
 
 public:
-    MeshModel(std::vector<Mesh> meshlist);
+    // nodes place the meshes, see SceneNode; without any every mesh sits at the origin
+    MeshModel(std::vector<Mesh> meshlist,
+              const std::vector<SceneNode>& node_list = std::vector<SceneNode>());
     ~MeshModel();
     MeshModel();
 
@@ -17,18 +20,35 @@ public:
 
     glm::mat4 getModel();
     void setModel(glm::mat4 newmodel);
+    const std::vector<SceneNode>& getNodes() {
+        return nodes;
+    }
+    // bounding sphere of every mesh in model space, xyz center and w radius
+    const glm::vec4& getBounds() {
+        return bounds;
+    }
 
     static std::vector<std::string> LoadMaterials(const aiScene* scene);
-    static std::vector<Mesh> LoadNode(VkDev dev, VkQueue transfer_queue,
-                                      VkCommandPool transfer_cmd_pool, aiNode* node,
-                                      const aiScene* scene, std::vector<int> mat_to_tex);
 
-    static Mesh LoadMesh(VkDev dev, VkQueue transfer_queue, VkCommandPool transfer_cmd_pool,
-                         aiMesh* mesh, const aiScene* scene, std::vector<int> mat_to_tex);
+    // Flattens the node tree without recursion. A first pass sizes nodes and meshes, the
+    // second writes them in place depth first, children in file order. A mesh referenced by
+    // several nodes is imported once per reference. With a pool the meshes convert in
+    // parallel, each into its own slot.
+    static void LoadScene(const aiScene* scene, std::vector<SceneNode>* nodes,
+                          std::vector<MeshData>* meshes, ThreadPool* pool = nullptr);
+    static void LoadMeshData(const aiMesh* mesh, MeshData* data);
+    static std::vector<Mesh> CreateMeshes(GeometryArena* arena,
+                                          const std::vector<MeshData>& mesh_data,
+                                          const std::vector<int>& mat_to_tex,
+                                          bool compact = false);
+
+    void applyMoves(const std::vector<GeometryMove>& moves);
 
     void destroyMeshModel();
 
 private:
     std::vector<Mesh> meshes;
+    std::vector<SceneNode> nodes;
     glm::mat4 model;
+    glm::vec4 bounds = glm::vec4(0.0f);
 };
@@ -0,0 +1,289 @@
+#include <algorithm>
+#include "MeshOptimizer.h"
+
+// FIFO cache modelled with timestamps: a vertex is cached while fewer than cache_size misses
+// happened since its own. Bumping the clock by cache_size + 1 empties it.
+struct VertexCache {
+    std::vector<u32> stamps;
+    u32 time;
+    u32 size;
+
+    VertexCache(u32 vertex_count, u32 cache_size)
+        : stamps(vertex_count, 0), time(cache_size + 1), size(cache_size) {}
+
+    // true on a miss
+    bool access(u32 vertex) {
+        if (time - stamps[vertex] > size) {
+            stamps[vertex] = time++;
+            return true;
+        }
+        return false;
+    }
+    void flush() {
+        time += size + 1;
+    }
+};
+
+VertexCacheStats analyzeVertexCache(const std::vector<u32>& indices, u32 vertex_count,
+                                    u32 cache_size) {
+    VertexCacheStats stats;
+    stats.triangles = indices.size() / 3;
+
+    VertexCache cache(vertex_count, cache_size);
+    std::vector<u8> seen(vertex_count, 0);
+    for (u32 index : indices) {
+        stats.transformed += cache.access(index);
+        if (!seen[index]) {
+            seen[index] = 1;
+            stats.vertices++;
+        }
+    }
+    return stats;
+}
+
+// Triangles in Tipsify order. hard_boundaries gets the first triangle of every run that
+// started from a dead end, the order is only locally coherent inside a run.
+static std::vector<u32> tipsify(const std::vector<u32>& indices, u32 vertex_count, u32 cache_size,
+                                std::vector<u32>* hard_boundaries) {
+    size_t triangle_count = indices.size() / 3;
+
+    // triangles around each vertex, compressed rows
+    std::vector<u32> live(vertex_count, 0);
+    for (u32 index : indices) {
+        live[index]++;
+    }
+    std::vector<u32> offsets(vertex_count + 1, 0);
+    for (u32 v = 0; v < vertex_count; v++) {
+        offsets[v + 1] = offsets[v] + live[v];
+    }
+    std::vector<u32> adjacency(indices.size());
+    std::vector<u32> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++) {
+        adjacency[fill[indices[i]]++] = static_cast<u32>(i / 3);
+    }
+
+    VertexCache cache(vertex_count, cache_size);
+    std::vector<u8> emitted(triangle_count, 0);
+    std::vector<u32> dead_ends;
+    std::vector<u32> candidates;
+    std::vector<u32> result;
+    result.reserve(indices.size());
+    dead_ends.reserve(indices.size());
+
+    // next vertex with triangles left, from the dead end stack or else in input order
+    u32 scan = 0;
+    auto skipDeadEnd = [&]() -> int {
+        while (!dead_ends.empty()) {
+            u32 v = dead_ends.back();
+            dead_ends.pop_back();
+            if (live[v] > 0) {
+                return static_cast<int>(v);
+            }
+        }
+        for (; scan < vertex_count; scan++) {
+            if (live[scan] > 0) {
+                return static_cast<int>(scan);
+            }
+        }
+        return -1;
+    };
+
+    hard_boundaries->assign(1, 0);
+    int fan = skipDeadEnd();
+    while (fan >= 0) {
+        // emit every remaining triangle around the fanning vertex
+        candidates.clear();
+        for (u32 k = offsets[fan]; k < offsets[fan + 1]; k++) {
+            u32 triangle = adjacency[k];
+            if (emitted[triangle]) {
+                continue;
+            }
+            emitted[triangle] = 1;
+            for (u32 c = 0; c < 3; c++) {
+                u32 v = indices[triangle * 3 + c];
+                result.push_back(v);
+                dead_ends.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                cache.access(v);
+            }
+        }
+
+        // the candidate that will still be cached after its own triangles went out and that
+        // entered the cache earliest
+        int next = -1;
+        int best_priority = -1;
+        for (u32 v : candidates) {
+            if (live[v] == 0) {
+                continue;
+            }
+            int priority = 0;
+            u32 age = cache.time - cache.stamps[v];
+            if (age + 2 * live[v] <= cache_size) {
+                priority = static_cast<int>(age);
+            }
+            if (priority > best_priority) {
+                best_priority = priority;
+                next = static_cast<int>(v);
+            }
+        }
+        if (next < 0) {
+            next = skipDeadEnd();
+            if (next >= 0) {
+                hard_boundaries->push_back(static_cast<u32>(result.size() / 3));
+            }
+        }
+        fan = next;
+    }
+    return result;
+}
+
+// Splits each hard run where the triangles so far already reach the run's own cache
+// efficiency (within threshold), so the pieces can be reordered without losing much reuse.
+static std::vector<u32> softBoundaries(const std::vector<u32>& indices, u32 vertex_count,
+                                       const std::vector<u32>& hard_boundaries, u32 cache_size,
+                                       float threshold) {
+    u32 triangle_count = static_cast<u32>(indices.size() / 3);
+    VertexCache cache(vertex_count, cache_size);
+    std::vector<u32> boundaries;
+
+    for (size_t h = 0; h < hard_boundaries.size(); h++) {
+        u32 start = hard_boundaries[h];
+        u32 end = h + 1 < hard_boundaries.size() ? hard_boundaries[h + 1] : triangle_count;
+
+        cache.flush();
+        u32 run_misses = 0;
+        for (u32 i = start * 3; i < end * 3; i++) {
+            run_misses += cache.access(indices[i]);
+        }
+        float run_acmr = float(run_misses) / float(end - start);
+
+        cache.flush();
+        boundaries.push_back(start);
+        u32 cluster_start = start;
+        u32 cluster_misses = 0;
+        for (u32 t = start; t < end; t++) {
+            for (u32 c = 0; c < 3; c++) {
+                cluster_misses += cache.access(indices[t * 3 + c]);
+            }
+            float cluster_acmr = float(cluster_misses) / float(t + 1 - cluster_start);
+            if (t + 1 < end && cluster_acmr <= run_acmr * threshold) {
+                boundaries.push_back(t + 1);
+                cluster_start = t + 1;
+                cluster_misses = 0;
+                cache.flush();
+            }
+        }
+    }
+    return boundaries;
+}
+
+// Orders clusters so the ones facing away from the mesh centre come first. Those are the
+// likeliest to occlude the rest (Sander et al. 2007, section 4).
+static std::vector<u32> sortClustersForOverdraw(const std::vector<u32>& indices,
+                                                const std::vector<Vertex>& vertices,
+                                                const std::vector<u32>& boundaries) {
+    u32 triangle_count = static_cast<u32>(indices.size() / 3);
+    size_t cluster_count = boundaries.size();
+
+    std::vector<glm::vec3> centroids(cluster_count, glm::vec3(0.0f));
+    std::vector<glm::vec3> normals(cluster_count, glm::vec3(0.0f));
+    std::vector<float> areas(cluster_count, 0.0f);
+    glm::vec3 mesh_centroid(0.0f);
+    float mesh_area = 0.0f;
+
+    for (size_t c = 0; c < cluster_count; c++) {
+        u32 end = c + 1 < cluster_count ? boundaries[c + 1] : triangle_count;
+        for (u32 t = boundaries[c]; t < end; t++) {
+            const glm::vec3& p0 = vertices[indices[t * 3 + 0]].pos;
+            const glm::vec3& p1 = vertices[indices[t * 3 + 1]].pos;
+            const glm::vec3& p2 = vertices[indices[t * 3 + 2]].pos;
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            float area = glm::length(normal);
+
+            centroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+            normals[c] += normal;
+            areas[c] += area;
+        }
+        mesh_centroid += centroids[c];
+        mesh_area += areas[c];
+    }
+    if (mesh_area > 0.0f) {
+        mesh_centroid /= mesh_area;
+    }
+
+    std::vector<float> keys(cluster_count, 0.0f);
+    for (size_t c = 0; c < cluster_count; c++) {
+        float normal_length = glm::length(normals[c]);
+        if (areas[c] > 0.0f && normal_length > 0.0f) {
+            glm::vec3 centroid = centroids[c] / areas[c];
+            keys[c] = glm::dot(centroid - mesh_centroid, normals[c] / normal_length);
+        }
+    }
+
+    std::vector<u32> order(cluster_count);
+    for (size_t c = 0; c < cluster_count; c++) {
+        order[c] = static_cast<u32>(c);
+    }
+    // stable, ties keep the cache order and the result stays deterministic
+    std::stable_sort(order.begin(), order.end(),
+                     [&keys](u32 a, u32 b) { return keys[a] > keys[b]; });
+
+    std::vector<u32> result;
+    result.reserve(indices.size());
+    for (u32 c : order) {
+        u32 end = c + 1 < cluster_count ? boundaries[c + 1] : triangle_count;
+        result.insert(result.end(), indices.begin() + boundaries[c] * 3, indices.begin() + end * 3);
+    }
+    return result;
+}
+
+// Vertices renumbered in the order the indices first reach them
+static void remapForFetch(MeshData* mesh) {
+    const u32 unassigned = ~0u;
+    std::vector<u32> remap(mesh->vertices.size(), unassigned);
+    std::vector<Vertex> vertices;
+    vertices.reserve(mesh->vertices.size());
+
+    for (u32& index : mesh->indices) {
+        if (remap[index] == unassigned) {
+            remap[index] = static_cast<u32>(vertices.size());
+            vertices.push_back(mesh->vertices[index]);
+        }
+        index = remap[index];
+    }
+    mesh->vertices.swap(vertices);
+}
+
+void optimizeMesh(MeshData* mesh) {
+    u32 vertex_count = static_cast<u32>(mesh->vertices.size());
+    if (mesh->indices.size() < 3 || mesh->indices.size() % 3 != 0) {
+        return;
+    }
+    for (u32 index : mesh->indices) {
+        if (index >= vertex_count) {
+            return;
+        }
+    }
+
+    std::vector<u32> hard_boundaries;
+    std::vector<u32> indices = tipsify(mesh->indices, vertex_count, VERTEX_CACHE_SIZE,
+                                       &hard_boundaries);
+    std::vector<u32> boundaries = softBoundaries(indices, vertex_count, hard_boundaries,
+                                                 VERTEX_CACHE_SIZE, OVERDRAW_CACHE_THRESHOLD);
+    mesh->indices = sortClustersForOverdraw(indices, mesh->vertices, boundaries);
+    remapForFetch(mesh);
+}
+
+std::vector<u32> optimizeVertexCache(const std::vector<u32>& indices, u32 vertex_count) {
+    if (indices.size() < 3 || indices.size() % 3 != 0) {
+        return indices;
+    }
+    for (u32 index : indices) {
+        if (index >= vertex_count) {
+            return indices;
+        }
+    }
+    std::vector<u32> hard_boundaries;
+    return tipsify(indices, vertex_count, VERTEX_CACHE_SIZE, &hard_boundaries);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+#include "Mesh.h"
+#include "Utilities.h"
+
+// Entries of the FIFO post-transform cache the optimiser targets and the statistics model
+const u32 VERTEX_CACHE_SIZE = 16;
+// overdraw clusters are cut where their cache efficiency is within this factor of the
+// unsplit order, higher trades vertex reuse for finer overdraw sorting
+const float OVERDRAW_CACHE_THRESHOLD = 1.05f;
+
+// Simulated post-transform cache behaviour of an index order
+struct VertexCacheStats {
+    u64 triangles = 0;
+    u64 transformed = 0; // cache misses
+    u64 vertices = 0;    // distinct vertices referenced
+
+    // average cache miss ratio: transformed vertices per triangle, 0.5 at best
+    float acmr() {
+        return triangles ? float(transformed) / float(triangles) : 0.0f;
+    }
+    // average transform to vertex ratio: 1 when every vertex is transformed once
+    float atvr() {
+        return vertices ? float(transformed) / float(vertices) : 0.0f;
+    }
+    void add(const VertexCacheStats& other) {
+        triangles += other.triangles;
+        transformed += other.transformed;
+        vertices += other.vertices;
+    }
+};
+
+VertexCacheStats analyzeVertexCache(const std::vector<u32>& indices, u32 vertex_count,
+                                    u32 cache_size = VERTEX_CACHE_SIZE);
+
+// Reorders a mesh for the GPU in three linear-ish passes:
+//  - triangles in Tipsify order (Sander et al. 2007) for post-transform cache hits
+//  - clusters of that order sorted outermost first, so less is shaded then hidden
+//  - vertices renumbered in first use order for fetch locality, unreferenced ones dropped
+// The result depends only on the input, so it can be cached.
+void optimizeMesh(MeshData* mesh);
+
+// Only the Tipsify pass, for extra index lists over vertices optimizeMesh already ordered
+std::vector<u32> optimizeVertexCache(const std::vector<u32>& indices, u32 vertex_count);
@@ -0,0 +1,433 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+
+// weight of the planes holding open borders in place, relative to the surface ones
+static const double BORDER_WEIGHT = 10.0;
+// a collapse may tilt a surviving triangle by up to ~75 degrees, past that it counts as a flip
+static const double FLIP_THRESHOLD = 0.25;
+static const u32 NO_VERTEX = ~0u;
+
+struct Quadric {
+    double a2 = 0.0, b2 = 0.0, c2 = 0.0;
+    double ab = 0.0, ac = 0.0, bc = 0.0;
+    double ad = 0.0, bd = 0.0, cd = 0.0;
+    double d2 = 0.0;
+    double w = 0.0; // sum of the plane weights
+
+    // plane dot(n, p) + d = 0, n unit length
+    void addPlane(const glm::dvec3& n, double d, double weight) {
+        a2 += n.x * n.x * weight;
+        b2 += n.y * n.y * weight;
+        c2 += n.z * n.z * weight;
+        ab += n.x * n.y * weight;
+        ac += n.x * n.z * weight;
+        bc += n.y * n.z * weight;
+        ad += n.x * d * weight;
+        bd += n.y * d * weight;
+        cd += n.z * d * weight;
+        d2 += d * d * weight;
+        w += weight;
+    }
+    void add(const Quadric& q) {
+        a2 += q.a2;
+        b2 += q.b2;
+        c2 += q.c2;
+        ab += q.ab;
+        ac += q.ac;
+        bc += q.bc;
+        ad += q.ad;
+        bd += q.bd;
+        cd += q.cd;
+        d2 += q.d2;
+        w += q.w;
+    }
+    // weighted mean squared distance of p to the planes
+    double error(const glm::dvec3& p) const {
+        double r = a2 * p.x * p.x + b2 * p.y * p.y + c2 * p.z * p.z +
+                   2.0 * (ab * p.x * p.y + ac * p.x * p.z + bc * p.y * p.z) +
+                   2.0 * (ad * p.x + bd * p.y + cd * p.z) + d2;
+        return w > 0.0 ? std::fabs(r) / w : 0.0;
+    }
+};
+
+enum class VertexKind : u8 {
+    Manifold, // closed fan, any collapse
+    Border,   // on an open edge, only collapses along it
+    Locked,   // non-manifold, never collapses
+};
+
+// from and to are welded vertices, see weldPositions
+struct Collapse {
+    u32 from;
+    u32 to;
+    double cost;
+};
+
+struct PositionKey {
+    u32 bits[3];
+
+    bool operator==(const PositionKey& other) const {
+        return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2];
+    }
+};
+
+struct PositionHash {
+    size_t operator()(const PositionKey& key) const {
+        return size_t(key.bits[0] * 73856093u ^ key.bits[1] * 19349663u ^ key.bits[2] * 83492791u);
+    }
+};
+
+// weld[v]: first vertex at v's position. wedges links the vertices sharing a position in a
+// ring, the copies a uv seam leaves behind.
+static void weldPositions(const Vertex* vertices, u32 vertex_count, std::vector<u32>* weld,
+                          std::vector<u32>* wedges) {
+    std::unordered_map<PositionKey, u32, PositionHash> first;
+    first.reserve(vertex_count);
+    weld->resize(vertex_count);
+    wedges->resize(vertex_count);
+
+    for (u32 v = 0; v < vertex_count; v++) {
+        PositionKey key;
+        memcpy(key.bits, &vertices[v].pos, sizeof(key.bits));
+        for (u32& bits : key.bits) {
+            bits = bits == 0x80000000 ? 0 : bits; // -0 is 0
+        }
+        auto found = first.insert(std::make_pair(key, v));
+        u32 root = found.first->second;
+        (*weld)[v] = root;
+        // insert after the root in its ring
+        (*wedges)[v] = v == root ? v : (*wedges)[root];
+        if (v != root) {
+            (*wedges)[root] = v;
+        }
+    }
+}
+
+static bool rowContains(const std::vector<u32>& offsets, const std::vector<u32>& rows, u32 row,
+                        u32 value) {
+    for (u32 k = offsets[row]; k < offsets[row + 1]; k++) {
+        if (rows[k] == value) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Rows of an index per key: offsets[key]..offsets[key + 1] in rows
+static void buildRows(u32 key_count, const std::vector<u32>& keys,
+                      const std::vector<u32>& values, std::vector<u32>* offsets,
+                      std::vector<u32>* rows) {
+    offsets->assign(key_count + 1, 0);
+    for (u32 key : keys) {
+        (*offsets)[key + 1]++;
+    }
+    for (u32 k = 0; k < key_count; k++) {
+        (*offsets)[k + 1] += (*offsets)[k];
+    }
+    rows->resize(keys.size());
+    std::vector<u32> fill(offsets->begin(), offsets->end() - 1);
+    for (size_t i = 0; i < keys.size(); i++) {
+        (*rows)[fill[keys[i]]++] = values[i];
+    }
+}
+
+std::vector<u32> simplifyMesh(const Vertex* vertices, u32 vertex_count, const u32* indices,
+                              u32 index_count, u32 target_index_count, float max_error,
+                              float* error) {
+    *error = 0.0f;
+    std::vector<u32> result(indices, indices + index_count);
+    if (index_count % 3 != 0) {
+        return result;
+    }
+    for (u32 i = 0; i < index_count; i++) {
+        if (indices[i] >= vertex_count) {
+            return result;
+        }
+    }
+    target_index_count -= target_index_count % 3;
+
+    std::vector<u32> weld, wedges;
+    weldPositions(vertices, vertex_count, &weld, &wedges);
+    auto position = [&](u32 v) { return glm::dvec3(vertices[v].pos); };
+
+    // triangles with two corners at one position have no area and no edges worth keeping
+    size_t kept = 0;
+    for (size_t t = 0; t < index_count / 3; t++) {
+        u32 a = result[t * 3 + 0];
+        u32 b = result[t * 3 + 1];
+        u32 c = result[t * 3 + 2];
+        if (weld[a] != weld[b] && weld[b] != weld[c] && weld[a] != weld[c]) {
+            result[kept++] = a;
+            result[kept++] = b;
+            result[kept++] = c;
+        }
+    }
+    result.resize(kept);
+
+    // surface quadrics from the original triangles, area weighted
+    std::vector<Quadric> quadrics(vertex_count);
+    for (u32 t = 0; t < result.size() / 3; t++) {
+        u32 a = weld[result[t * 3 + 0]];
+        u32 b = weld[result[t * 3 + 1]];
+        u32 c = weld[result[t * 3 + 2]];
+        glm::dvec3 normal = glm::cross(position(b) - position(a), position(c) - position(a));
+        double length = glm::length(normal);
+        if (length > 0.0) {
+            normal /= length;
+            double d = -glm::dot(normal, position(a));
+            quadrics[a].addPlane(normal, d, length * 0.5);
+            quadrics[b].addPlane(normal, d, length * 0.5);
+            quadrics[c].addPlane(normal, d, length * 0.5);
+        }
+    }
+
+    double max_cost = double(max_error) * double(max_error);
+    double result_cost = 0.0;
+    std::vector<VertexKind> kinds(vertex_count);
+    std::vector<u32> remap(vertex_count);
+    std::vector<u8> touched(vertex_count);
+    std::vector<u32> keys, values;
+    std::vector<u32> edge_offsets, edge_rows;
+    std::vector<u32> triangle_offsets, triangle_rows;
+    std::vector<Collapse> collapses;
+    std::vector<std::pair<u32, u32>> pending;
+
+    for (bool first_pass = true; result.size() > target_index_count; first_pass = false) {
+        u32 triangle_count = static_cast<u32>(result.size() / 3);
+
+        // welded half-edges by source vertex
+        keys.clear();
+        values.clear();
+        for (u32 i = 0; i < result.size(); i++) {
+            u32 next = i % 3 == 2 ? i - 2 : i + 1;
+            keys.push_back(weld[result[i]]);
+            values.push_back(weld[result[next]]);
+        }
+        buildRows(vertex_count, keys, values, &edge_offsets, &edge_rows);
+
+        // triangles around every vertex copy
+        values.clear();
+        for (u32 i = 0; i < result.size(); i++) {
+            values.push_back(i / 3);
+        }
+        buildRows(vertex_count, result, values, &triangle_offsets, &triangle_rows);
+
+        // an edge without its twin is open, one used twice in a direction is non-manifold
+        std::fill(kinds.begin(), kinds.end(), VertexKind::Manifold);
+        for (u32 w = 0; w < vertex_count; w++) {
+            for (u32 k = edge_offsets[w]; k < edge_offsets[w + 1]; k++) {
+                u32 to = edge_rows[k];
+                bool twice = std::find(&edge_rows[0] + k + 1, &edge_rows[0] + edge_offsets[w + 1],
+                                       to) != &edge_rows[0] + edge_offsets[w + 1];
+                if (twice) {
+                    kinds[w] = VertexKind::Locked;
+                    kinds[to] = VertexKind::Locked;
+                } else if (!rowContains(edge_offsets, edge_rows, to, w)) {
+                    if (kinds[w] != VertexKind::Locked) {
+                        kinds[w] = VertexKind::Border;
+                    }
+                    if (kinds[to] != VertexKind::Locked) {
+                        kinds[to] = VertexKind::Border;
+                    }
+                }
+            }
+        }
+
+        // Planes through the open edges, perpendicular to their triangle, keep the border
+        // where it is. Only from the original mesh, like the surface quadrics.
+        if (first_pass) {
+            for (u32 i = 0; i < result.size(); i++) {
+                u32 t = i / 3;
+                u32 a = weld[result[i]];
+                u32 b = weld[result[i % 3 == 2 ? i - 2 : i + 1]];
+                if (rowContains(edge_offsets, edge_rows, b, a)) {
+                    continue;
+                }
+                glm::dvec3 p0 = position(weld[result[t * 3 + 0]]);
+                glm::dvec3 p1 = position(weld[result[t * 3 + 1]]);
+                glm::dvec3 p2 = position(weld[result[t * 3 + 2]]);
+                glm::dvec3 edge = position(b) - position(a);
+                glm::dvec3 normal = glm::cross(edge, glm::cross(p1 - p0, p2 - p0));
+                double length = glm::length(normal);
+                if (length > 0.0) {
+                    normal /= length;
+                    double d = -glm::dot(normal, position(a));
+                    double weight = glm::dot(edge, edge) * BORDER_WEIGHT;
+                    quadrics[a].addPlane(normal, d, weight);
+                    quadrics[b].addPlane(normal, d, weight);
+                }
+            }
+        }
+
+        // the cheaper allowed direction of every edge
+        collapses.clear();
+        for (u32 i = 0; i < result.size(); i++) {
+            u32 a = weld[result[i]];
+            u32 b = weld[result[i % 3 == 2 ? i - 2 : i + 1]];
+            bool open = !rowContains(edge_offsets, edge_rows, b, a);
+            // a closed edge is seen from both sides, take it once
+            if (!open && a > b) {
+                continue;
+            }
+            auto allowed = [&](u32 from) {
+                return kinds[from] == VertexKind::Manifold ||
+                       (kinds[from] == VertexKind::Border && open);
+            };
+            Collapse best = {NO_VERTEX, NO_VERTEX, 0.0};
+            if (allowed(a)) {
+                best = {a, b, quadrics[a].error(position(b))};
+            }
+            if (allowed(b)) {
+                double cost = quadrics[b].error(position(a));
+                if (best.from == NO_VERTEX || cost < best.cost) {
+                    best = {b, a, cost};
+                }
+            }
+            if (best.from != NO_VERTEX) {
+                collapses.push_back(best);
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(),
+                  [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+        // Cheapest first, each vertex takes part in one collapse per pass so the costs stay
+        // valid. A manifold collapse removes two triangles.
+        for (u32 v = 0; v < vertex_count; v++) {
+            remap[v] = v;
+        }
+        std::fill(touched.begin(), touched.end(), 0);
+        u32 goal = (triangle_count - target_index_count / 3) / 2 + 1;
+        u32 performed = 0;
+        for (const Collapse& collapse : collapses) {
+            if (collapse.cost > max_cost || performed >= goal) {
+                break;
+            }
+            if (touched[collapse.from] || touched[collapse.to]) {
+                continue;
+            }
+
+            // every copy of the vertex goes to the copy of the target it shares a triangle
+            // with. A copy without one sits across a seam the edge isn't on.
+            bool valid = true;
+            pending.clear();
+            u32 copy = collapse.from;
+            do {
+                u32 partner = NO_VERTEX;
+                for (u32 k = triangle_offsets[copy]; k < triangle_offsets[copy + 1]; k++) {
+                    for (u32 c = 0; c < 3; c++) {
+                        u32 v = remap[result[triangle_rows[k] * 3 + c]];
+                        if (weld[v] == collapse.to) {
+                            partner = v;
+                        }
+                    }
+                }
+                if (partner == NO_VERTEX && triangle_offsets[copy] != triangle_offsets[copy + 1]) {
+                    valid = false;
+                    break;
+                }
+                if (partner != NO_VERTEX) {
+                    pending.push_back(std::make_pair(copy, partner));
+                }
+                copy = wedges[copy];
+            } while (copy != collapse.from);
+
+            // no triangle that survives may turn over
+            glm::dvec3 target = position(collapse.to);
+            for (size_t p = 0; p < pending.size() && valid; p++) {
+                u32 from = pending[p].first;
+                for (u32 k = triangle_offsets[from]; k < triangle_offsets[from + 1]; k++) {
+                    u32 t = triangle_rows[k];
+                    glm::dvec3 corners[3];
+                    bool collapsing = false;
+                    int moved = -1;
+                    for (u32 c = 0; c < 3; c++) {
+                        u32 v = remap[result[t * 3 + c]];
+                        collapsing = collapsing || weld[v] == collapse.to;
+                        moved = v == from ? int(c) : moved;
+                        corners[c] = position(weld[v]);
+                    }
+                    if (collapsing || moved < 0) {
+                        continue;
+                    }
+                    glm::dvec3 before =
+                        glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+                    corners[moved] = target;
+                    glm::dvec3 after =
+                        glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+                    if (glm::dot(before, after) <=
+                        FLIP_THRESHOLD * glm::length(before) * glm::length(after)) {
+                        valid = false;
+                        break;
+                    }
+                }
+            }
+            if (!valid) {
+                continue;
+            }
+
+            for (const std::pair<u32, u32>& move : pending) {
+                remap[move.first] = move.second;
+            }
+            touched[collapse.from] = 1;
+            touched[collapse.to] = 1;
+            quadrics[collapse.to].add(quadrics[collapse.from]);
+            result_cost = std::max(result_cost, collapse.cost);
+            performed++;
+        }
+        if (performed == 0) {
+            break;
+        }
+
+        // drop the triangles that collapsed
+        kept = 0;
+        for (size_t t = 0; t < result.size() / 3; t++) {
+            u32 a = remap[result[t * 3 + 0]];
+            u32 b = remap[result[t * 3 + 1]];
+            u32 c = remap[result[t * 3 + 2]];
+            if (weld[a] != weld[b] && weld[b] != weld[c] && weld[a] != weld[c]) {
+                result[kept++] = a;
+                result[kept++] = b;
+                result[kept++] = c;
+            }
+        }
+        result.resize(kept);
+    }
+
+    *error = static_cast<float>(std::sqrt(result_cost));
+    return result;
+}
+
+void buildMeshLods(MeshData* mesh) {
+    mesh->lods.clear();
+    mesh->lod_indices.clear();
+
+    u32 vertex_count = static_cast<u32>(mesh->vertices.size());
+    std::vector<u32> level = mesh->indices;
+    float error = 0.0f;
+    for (u32 l = 1; l < MESH_LOD_COUNT; l++) {
+        u32 index_count = static_cast<u32>(level.size());
+        if (index_count / 3 < MESH_LOD_MIN_TRIANGLES * 2) {
+            break;
+        }
+        u32 target = static_cast<u32>(index_count / 3 * MESH_LOD_REDUCTION) * 3;
+        float level_error = 0.0f;
+        std::vector<u32> coarser = simplifyMesh(mesh->vertices.data(), vertex_count,
+                                                level.data(), index_count, target, FLT_MAX,
+                                                &level_error);
+        if (coarser.empty() || coarser.size() > index_count * MESH_LOD_MIN_REDUCTION) {
+            break;
+        }
+
+        error += level_error;
+        level = optimizeVertexCache(coarser, vertex_count);
+        MeshLod lod = {static_cast<u32>(mesh->lod_indices.size()),
+                       static_cast<u32>(level.size()), error};
+        mesh->lods.push_back(lod);
+        mesh->lod_indices.insert(mesh->lod_indices.end(), level.begin(), level.end());
+    }
+}
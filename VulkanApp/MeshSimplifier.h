@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+#include "Mesh.h"
+#include "Utilities.h"
+
+// Levels per mesh including full detail, each one aims for this fraction of the triangles of
+// the level before. The chain stops early once a level no longer gets smaller.
+const u32 MESH_LOD_COUNT = 4;
+const float MESH_LOD_REDUCTION = 0.5f;
+// no level goes below this many triangles, past that the savings stop mattering
+const u32 MESH_LOD_MIN_TRIANGLES = 128;
+// a level that keeps more than this fraction of the one before is dropped
+const float MESH_LOD_MIN_REDUCTION = 0.85f;
+
+// Quadric error metric (Garland & Heckbert 1997) half-edge collapse. Vertices never move, so
+// the result indexes the same vertex buffer and a whole LOD chain shares it.
+//  - vertices sharing a position (uv seams) only collapse along the seam, every copy with it
+//  - open borders only collapse along themselves and carry extra quadrics to stay in place
+//  - non-manifold vertices stay
+//  - collapses that would flip a triangle are skipped
+// Stops at target_index_count or before a collapse would move the surface by more than
+// max_error (mesh units). *error gets the largest deviation it caused.
+std::vector<u32> simplifyMesh(const Vertex* vertices, u32 vertex_count, const u32* indices,
+                              u32 index_count, u32 target_index_count, float max_error,
+                              float* error);
+
+// Fills lods and lod_indices with up to MESH_LOD_COUNT - 1 levels, each simplified from the
+// one before and put in vertex cache order. Errors add up along the chain, so each one is an
+// upper bound against full detail.
+void buildMeshLods(MeshData* mesh);
@@ -0,0 +1,295 @@
+#include <algorithm>
+#include <cmath>
+#include "Meshlets.h"
+
+static const u8 NOT_IN_MESHLET = 0xFF;
+
+void MeshletStats::add(const MeshletView& view) {
+    for (u32 i = 0; i < view.meshlet_count; i++) {
+        meshlets++;
+        vertices += view.meshlets[i].vertex_count;
+        triangles += view.meshlets[i].triangle_count;
+        cones += view.bounds[i].cone_cutoff < 1.0f;
+    }
+}
+
+static glm::vec3 normalizeOrZero(const glm::vec3& v) {
+    float length = glm::length(v);
+    return length > 0.0f ? v / length : glm::vec3(0.0f);
+}
+
+// Ritter's sphere: the most distant pair of axis extremes, grown until it covers every point
+static void boundingSphere(const std::vector<glm::vec3>& points, glm::vec3* center,
+                           float* radius) {
+    u32 low[3] = {0, 0, 0};
+    u32 high[3] = {0, 0, 0};
+    for (u32 i = 0; i < points.size(); i++) {
+        for (u32 axis = 0; axis < 3; axis++) {
+            if (points[i][axis] < points[low[axis]][axis]) {
+                low[axis] = i;
+            }
+            if (points[i][axis] > points[high[axis]][axis]) {
+                high[axis] = i;
+            }
+        }
+    }
+    u32 widest = 0;
+    float widest_distance = -1.0f;
+    for (u32 axis = 0; axis < 3; axis++) {
+        glm::vec3 span = points[high[axis]] - points[low[axis]];
+        float distance = glm::dot(span, span);
+        if (distance > widest_distance) {
+            widest_distance = distance;
+            widest = axis;
+        }
+    }
+
+    glm::vec3 c = (points[low[widest]] + points[high[widest]]) * 0.5f;
+    float r = std::sqrt(widest_distance) * 0.5f;
+    for (const glm::vec3& point : points) {
+        float distance = glm::length(point - c);
+        if (distance > r) {
+            float grown = (r + distance) * 0.5f;
+            c += (point - c) * ((grown - r) / distance);
+            r = grown;
+        }
+    }
+    *center = c;
+    *radius = r;
+}
+
+static MeshletBounds computeBounds(const Vertex* vertices, const Meshlet& meshlet,
+                                   const u32* meshlet_vertices, const u8* triangles) {
+    MeshletBounds bounds = {};
+
+    std::vector<glm::vec3> points(meshlet.vertex_count);
+    for (u32 i = 0; i < meshlet.vertex_count; i++) {
+        points[i] = vertices[meshlet_vertices[i]].pos;
+    }
+    boundingSphere(points, &bounds.center, &bounds.radius);
+
+    // the cone axis is the average facing, the cutoff comes from the normal furthest off it
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec3> corners;
+    glm::vec3 normal_sum(0.0f);
+    for (u32 t = 0; t < meshlet.triangle_count; t++) {
+        const glm::vec3& p0 = points[triangles[t * 3 + 0]];
+        const glm::vec3& p1 = points[triangles[t * 3 + 1]];
+        const glm::vec3& p2 = points[triangles[t * 3 + 2]];
+        glm::vec3 normal = normalizeOrZero(glm::cross(p1 - p0, p2 - p0));
+        if (normal != glm::vec3(0.0f)) {
+            normals.push_back(normal);
+            corners.push_back(p0);
+            normal_sum += normal;
+        }
+    }
+    bounds.cone_apex = bounds.center;
+    bounds.cone_axis = normalizeOrZero(normal_sum);
+    bounds.cone_cutoff = 1.0f;
+    if (bounds.cone_axis == glm::vec3(0.0f)) {
+        return bounds;
+    }
+
+    float min_dot = 1.0f;
+    for (const glm::vec3& normal : normals) {
+        min_dot = std::min(min_dot, glm::dot(normal, bounds.cone_axis));
+    }
+    // past ~84 degrees the apex runs off to infinity and the cone never culls anyway
+    if (min_dot <= 0.1f) {
+        return bounds;
+    }
+
+    // apex far enough back along the axis to be behind every triangle's plane
+    float max_t = 0.0f;
+    for (size_t i = 0; i < normals.size(); i++) {
+        float t = glm::dot(bounds.center - corners[i], normals[i]) /
+                  glm::dot(bounds.cone_axis, normals[i]);
+        max_t = std::max(max_t, t);
+    }
+    bounds.cone_apex = bounds.center - bounds.cone_axis * max_t;
+    bounds.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+    return bounds;
+}
+
+void buildMeshlets(const Vertex* vertices, u32 vertex_count, const u32* indices, u32 index_count,
+                   MeshletData* meshlets) {
+    meshlets->meshlets.clear();
+    meshlets->bounds.clear();
+    meshlets->vertices.clear();
+    meshlets->triangles.clear();
+
+    u32 triangle_count = index_count / 3;
+    if (triangle_count == 0) {
+        return;
+    }
+    for (u32 i = 0; i < triangle_count * 3; i++) {
+        if (indices[i] >= vertex_count) {
+            return;
+        }
+    }
+
+    // triangles around each vertex, compressed rows; the first live[v] entries of a row are
+    // the triangles not in a meshlet yet
+    std::vector<u32> live(vertex_count, 0);
+    for (u32 i = 0; i < triangle_count * 3; i++) {
+        live[indices[i]]++;
+    }
+    std::vector<u32> offsets(vertex_count + 1, 0);
+    for (u32 v = 0; v < vertex_count; v++) {
+        offsets[v + 1] = offsets[v] + live[v];
+    }
+    std::vector<u32> adjacency(triangle_count * 3);
+    std::vector<u32> fill(offsets.begin(), offsets.end() - 1);
+    for (u32 i = 0; i < triangle_count * 3; i++) {
+        adjacency[fill[indices[i]]++] = i / 3;
+    }
+
+    std::vector<glm::vec3> centroids(triangle_count);
+    std::vector<glm::vec3> normals(triangle_count);
+    for (u32 t = 0; t < triangle_count; t++) {
+        const glm::vec3& p0 = vertices[indices[t * 3 + 0]].pos;
+        const glm::vec3& p1 = vertices[indices[t * 3 + 1]].pos;
+        const glm::vec3& p2 = vertices[indices[t * 3 + 2]].pos;
+        centroids[t] = (p0 + p1 + p2) / 3.0f;
+        normals[t] = normalizeOrZero(glm::cross(p1 - p0, p2 - p0));
+    }
+
+    std::vector<u8> emitted(triangle_count, 0);
+    std::vector<u8> local(vertex_count, NOT_IN_MESHLET);
+    Meshlet current = {0, 0, 0, 0};
+    glm::vec3 centroid_sum(0.0f);
+    glm::vec3 normal_sum(0.0f);
+
+    auto flush = [&]() {
+        // every meshlet's index list starts 4 byte aligned
+        while (meshlets->triangles.size() % 4 != 0) {
+            meshlets->triangles.push_back(0);
+        }
+        meshlets->bounds.push_back(computeBounds(vertices, current,
+                                                 &meshlets->vertices[current.vertex_offset],
+                                                 &meshlets->triangles[current.triangle_offset]));
+        meshlets->meshlets.push_back(current);
+
+        for (u32 i = 0; i < current.vertex_count; i++) {
+            local[meshlets->vertices[current.vertex_offset + i]] = NOT_IN_MESHLET;
+        }
+        current.vertex_offset = static_cast<u32>(meshlets->vertices.size());
+        current.triangle_offset = static_cast<u32>(meshlets->triangles.size());
+        current.vertex_count = 0;
+        current.triangle_count = 0;
+        centroid_sum = glm::vec3(0.0f);
+        normal_sum = glm::vec3(0.0f);
+    };
+
+    // vertices a triangle would add to the current meshlet
+    auto extraVertices = [&](u32 t) {
+        u32 a = indices[t * 3 + 0];
+        u32 b = indices[t * 3 + 1];
+        u32 c = indices[t * 3 + 2];
+        u32 extra = (local[a] == NOT_IN_MESHLET) + (local[b] == NOT_IN_MESHLET && b != a) +
+                    (local[c] == NOT_IN_MESHLET && c != a && c != b);
+        return extra;
+    };
+
+    // Seeds come from the borders of the last few meshlets, the triangle with the fewest live
+    // neighbours first. That closes up corners before they become scraps of a few triangles.
+    auto seedTriangle = [&]() {
+        int seed = -1;
+        u32 seed_live = ~0u;
+        size_t count = meshlets->meshlets.size();
+        for (size_t m = count; m-- > 0 && m + MESHLET_SEED_LOOKBACK >= count && seed < 0;) {
+            const Meshlet& border = meshlets->meshlets[m];
+            for (u32 i = 0; i < border.vertex_count; i++) {
+                u32 v = meshlets->vertices[border.vertex_offset + i];
+                for (u32 k = offsets[v]; k < offsets[v] + live[v]; k++) {
+                    u32 t = adjacency[k];
+                    u32 neighbours = live[indices[t * 3 + 0]] + live[indices[t * 3 + 1]] +
+                                     live[indices[t * 3 + 2]];
+                    if (neighbours < seed_live) {
+                        seed = static_cast<int>(t);
+                        seed_live = neighbours;
+                    }
+                }
+            }
+        }
+        return seed;
+    };
+
+    u32 scan = 0;
+    for (u32 emitted_count = 0; emitted_count < triangle_count; emitted_count++) {
+        // the best live neighbour of the meshlet: fewest new vertices, then closest to its
+        // centre and facing its way
+        int best = -1;
+        u32 best_extra = 4;
+        float best_score = 0.0f;
+        bool connected = false;
+        if (current.triangle_count > 0) {
+            glm::vec3 center = centroid_sum / float(current.triangle_count);
+            glm::vec3 axis = normalizeOrZero(normal_sum);
+            for (u32 i = 0; i < current.vertex_count; i++) {
+                u32 v = meshlets->vertices[current.vertex_offset + i];
+                for (u32 k = offsets[v]; k < offsets[v] + live[v]; k++) {
+                    u32 t = adjacency[k];
+                    u32 extra = extraVertices(t);
+                    connected = true;
+                    if (current.vertex_count + extra > MESHLET_MAX_VERTICES ||
+                        extra > best_extra) {
+                        continue;
+                    }
+                    float facing = 1.0f - glm::dot(normals[t], axis);
+                    float score = glm::length(centroids[t] - center) *
+                                  (1.0f + MESHLET_CONE_WEIGHT * facing);
+                    if (extra < best_extra || score < best_score) {
+                        best = static_cast<int>(t);
+                        best_extra = extra;
+                        best_score = score;
+                    }
+                }
+            }
+        }
+        // Nothing connected fits. A meshlet that is full gets flushed, one that ran out of
+        // neighbours takes in the seed as well when it has room, rather than leaving a scrap.
+        if (best < 0) {
+            best = seedTriangle();
+            if (current.triangle_count > 0 &&
+                (connected || best < 0 || current.vertex_count + 3 > MESHLET_MAX_VERTICES)) {
+                flush();
+            }
+        }
+        if (best < 0) {
+            while (emitted[scan]) {
+                scan++;
+            }
+            best = static_cast<int>(scan);
+        }
+
+        u32 t = static_cast<u32>(best);
+        emitted[t] = 1;
+        for (u32 c = 0; c < 3; c++) {
+            u32 v = indices[t * 3 + c];
+            if (local[v] == NOT_IN_MESHLET) {
+                local[v] = static_cast<u8>(current.vertex_count++);
+                meshlets->vertices.push_back(v);
+            }
+            meshlets->triangles.push_back(local[v]);
+
+            // swap the triangle out of the live part of the vertex's row
+            u32 row = offsets[v];
+            u32 last = row + live[v] - 1;
+            u32 k = static_cast<u32>(std::find(&adjacency[row], &adjacency[last] + 1, t) -
+                                     &adjacency[0]);
+            std::swap(adjacency[k], adjacency[last]);
+            live[v]--;
+        }
+        centroid_sum += centroids[t];
+        normal_sum += normals[t];
+        current.triangle_count++;
+
+        if (current.triangle_count == MESHLET_MAX_TRIANGLES) {
+            flush();
+        }
+    }
+    if (current.triangle_count > 0) {
+        flush();
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vector>
+#include "Utilities.h"
+
+// Limits of one meshlet, the usual mesh shader sweet spot: 64 vertices and a triangle count
+// that keeps the local index list a multiple of 4 bytes
+const u32 MESHLET_MAX_VERTICES = 64;
+const u32 MESHLET_MAX_TRIANGLES = 124;
+// how much the normal cone weighs against spatial compactness when growing a meshlet
+const float MESHLET_CONE_WEIGHT = 0.25f;
+// new meshlets are seeded from the borders of this many previous ones
+const u32 MESHLET_SEED_LOOKBACK = 8;
+
+// The arrays below are laid out for std430 storage buffers, they can be uploaded as they are.
+struct Meshlet {
+    u32 vertex_offset;   // into MeshletData::vertices
+    u32 triangle_offset; // into MeshletData::triangles, in bytes, always a multiple of 4
+    u32 vertex_count;
+    u32 triangle_count;
+};
+
+// Bounds for cluster culling. The sphere is for frustum/occlusion tests. The meshlet is
+// entirely back facing when dot(normalize(cone_apex - camera), cone_axis) >= cone_cutoff;
+// cone_cutoff is 1 when the normals spread too far for a useful cone.
+struct MeshletBounds {
+    glm::vec3 center;
+    float radius;
+    glm::vec3 cone_apex;
+    float cone_cutoff;
+    glm::vec3 cone_axis;
+    float padding;
+};
+
+// Meshlets of one mesh
+struct MeshletData {
+    std::vector<Meshlet> meshlets;
+    std::vector<MeshletBounds> bounds; // one per meshlet
+    std::vector<u32> vertices;         // mesh vertex of each meshlet local vertex
+    std::vector<u8> triangles;         // 3 local vertices per triangle
+};
+
+// Read-only view of meshlets, over MeshletData or straight over a mapped mesh cache
+struct MeshletView {
+    const Meshlet* meshlets = nullptr;
+    const MeshletBounds* bounds = nullptr;
+    u32 meshlet_count = 0;
+    const u32* vertices = nullptr;
+    const u8* triangles = nullptr;
+
+    MeshletView() {}
+    MeshletView(const MeshletData& data)
+        : meshlets(data.meshlets.data()), bounds(data.bounds.data()),
+          meshlet_count(static_cast<u32>(data.meshlets.size())), vertices(data.vertices.data()),
+          triangles(data.triangles.data()) {}
+};
+
+// How well the meshlets use their limits, 1 is every meshlet full
+struct MeshletStats {
+    u64 meshlets = 0;
+    u64 vertices = 0;
+    u64 triangles = 0;
+    u64 cones = 0; // meshlets with a usable normal cone
+
+    float vertexFill() {
+        return meshlets ? float(vertices) / float(meshlets * MESHLET_MAX_VERTICES) : 0.0f;
+    }
+    float triangleFill() {
+        return meshlets ? float(triangles) / float(meshlets * MESHLET_MAX_TRIANGLES) : 0.0f;
+    }
+    void add(const MeshletView& view);
+};
+
+// Splits a triangle list into meshlets. Each one grows from a seed triangle over its
+// neighbours, preferring triangles that need no new vertex, then ones close to the meshlet
+// and facing its way. Triangles are visited in index order, so run optimizeMesh first for
+// better locality. Deterministic.
+void buildMeshlets(const Vertex* vertices, u32 vertex_count, const u32* indices, u32 index_count,
+                   MeshletData* meshlets);
@@ -0,0 +1,102 @@
+#include "MipChain.h"
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MIP_CHAIN_SSE2
+#endif
+
+#ifdef MIP_CHAIN_SSE2
+// vertical sums of two texels in 16 bits, one texel per 64 bits
+static __m128i sumRowsLow(__m128i a, __m128i b) {
+    const __m128i zero = _mm_setzero_si128();
+    return _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+}
+
+static __m128i sumRowsHigh(__m128i a, __m128i b) {
+    const __m128i zero = _mm_setzero_si128();
+    return _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+}
+
+// texel 0 + texel 1 of both sums, rounded and divided by 4
+static __m128i averagePairs(__m128i s0, __m128i s1) {
+    __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(s0, s1), _mm_unpackhi_epi64(s0, s1));
+    return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+}
+#endif
+
+u32 mipLevelCount(u32 width, u32 height) {
+    u32 levels = 1;
+    for (u32 extent = std::max(width, height); extent > 1; extent >>= 1) {
+        levels++;
+    }
+    return levels;
+}
+
+// average of the 2x2 block at (x, y), clamped at the last row/column of 1 texel wide images
+static void boxTexel(const u8* src, u32 src_width, u32 src_height, u32 x, u32 y, u8* dst) {
+    u32 x0 = x * 2;
+    u32 y0 = y * 2;
+    u32 x1 = std::min(x0 + 1, src_width - 1);
+    u32 y1 = std::min(y0 + 1, src_height - 1);
+    const u8* a = src + (size_t(y0) * src_width + x0) * 4;
+    const u8* b = src + (size_t(y0) * src_width + x1) * 4;
+    const u8* c = src + (size_t(y1) * src_width + x0) * 4;
+    const u8* d = src + (size_t(y1) * src_width + x1) * 4;
+    for (u32 channel = 0; channel < 4; channel++) {
+        u32 sum = a[channel] + b[channel] + c[channel] + d[channel];
+        dst[channel] = static_cast<u8>((sum + 2) >> 2);
+    }
+}
+
+void downsampleRGBA8(const u8* src, u32 src_width, u32 src_height, u8* dst) {
+    u32 width = mipExtent(src_width, 1);
+    u32 height = mipExtent(src_height, 1);
+
+    for (u32 y = 0; y < height; y++) {
+        u32 x = 0;
+#ifdef MIP_CHAIN_SSE2
+        // four output texels from two rows of eight, summed in 16 bits
+        if (src_width >= 2 && src_height >= 2) {
+            const u8* row0 = src + size_t(y) * 2 * src_width * 4;
+            const u8* row1 = row0 + size_t(src_width) * 4;
+            u8* out = dst + size_t(y) * width * 4;
+            for (; x + 4 <= width; x += 4) {
+                const __m128i* top = reinterpret_cast<const __m128i*>(row0 + x * 8);
+                const __m128i* bottom = reinterpret_cast<const __m128i*>(row1 + x * 8);
+                __m128i a0 = _mm_loadu_si128(top);
+                __m128i a1 = _mm_loadu_si128(top + 1);
+                __m128i b0 = _mm_loadu_si128(bottom);
+                __m128i b1 = _mm_loadu_si128(bottom + 1);
+
+                __m128i t01 = averagePairs(sumRowsLow(a0, b0), sumRowsHigh(a0, b0));
+                __m128i t23 = averagePairs(sumRowsLow(a1, b1), sumRowsHigh(a1, b1));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4),
+                                 _mm_packus_epi16(t01, t23));
+            }
+        }
+#endif
+        for (; x < width; x++) {
+            boxTexel(src, src_width, src_height, x, y, dst + (size_t(y) * width + x) * 4);
+        }
+    }
+}
+
+std::vector<u8> buildMipChain(const u8* pixels, u32 width, u32 height) {
+    u32 levels = mipLevelCount(width, height);
+
+    size_t total = 0;
+    for (u32 level = 1; level < levels; level++) {
+        total += size_t(mipExtent(width, level)) * mipExtent(height, level) * 4;
+    }
+
+    std::vector<u8> chain(total);
+    const u8* src = pixels;
+    size_t offset = 0;
+    for (u32 level = 1; level < levels; level++) {
+        downsampleRGBA8(src, mipExtent(width, level - 1), mipExtent(height, level - 1),
+                        chain.data() + offset);
+        src = chain.data() + offset;
+        offset += size_t(mipExtent(width, level)) * mipExtent(height, level) * 4;
+    }
+    return chain;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include "Utilities.h"
+
+// Levels in a full chain down to 1x1
+u32 mipLevelCount(u32 width, u32 height);
+
+// Extent of a level, never below 1
+inline u32 mipExtent(u32 extent, u32 level) {
+    return std::max(extent >> level, 1u);
+}
+
+// 2x2 box filter of an RGBA8 image into one half its size (rounded down, at least 1)
+void downsampleRGBA8(const u8* src, u32 src_width, u32 src_height, u8* dst);
+
+// Every level below the first, filtered on the CPU and packed back to back in level order.
+// For devices that can't blit, and for baking chains into cached assets.
+std::vector<u8> buildMipChain(const u8* pixels, u32 width, u32 height);
@@ -0,0 +1,581 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <map>
+#include "ObjLoader.h"
+
+// position and uv index of a triangle corner as written, resolved once every chunk's counts
+// are known: absolute (0-based) or, with the flag, relative to the chunk's first element
+struct ObjCorner {
+    int position;
+    int uv; // -1 without one
+    u32 flags;
+};
+const u32 OBJ_RELATIVE_POSITION = 1 << 0;
+const u32 OBJ_RELATIVE_UV = 1 << 1;
+
+// usemtl, o or g, taking effect at a corner
+struct ObjEvent {
+    size_t corner;
+    bool material;
+    std::string name;
+};
+
+struct ObjChunk {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> uvs;
+    std::vector<ObjCorner> corners; // three per triangle
+    std::vector<ObjEvent> events;
+    std::vector<std::string> material_libraries;
+    bool failed = false;
+};
+
+// the corners of one mesh, as ranges of the chunks' corners
+struct ObjRange {
+    u32 chunk;
+    size_t first;
+    size_t end;
+};
+struct ObjMeshRuns {
+    u32 material;
+    std::vector<ObjRange> ranges;
+    size_t corner_count = 0;
+};
+
+static void forEach(ThreadPool* pool, u32 count, const std::function<void(u32)>& body) {
+    if (pool) {
+        pool->parallelFor(count, body);
+        return;
+    }
+    for (u32 i = 0; i < count; i++) {
+        body(i);
+    }
+}
+
+static bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char* skipSpace(const char* p, const char* end) {
+    while (p < end && isSpace(*p)) {
+        p++;
+    }
+    return p;
+}
+
+// the rest of the line without surrounding whitespace
+static std::string restOfLine(const char* p, const char* end) {
+    p = skipSpace(p, end);
+    while (end > p && isSpace(end[-1])) {
+        end--;
+    }
+    return std::string(p, end);
+}
+
+static bool isEightDigits(u64 chunk) {
+    return (((chunk + 0x4646464646464646ull) | (chunk - 0x3030303030303030ull)) &
+            0x8080808080808080ull) == 0;
+}
+
+// eight ASCII digits, first one in the lowest byte (Lemire)
+static u32 parseEightDigits(u64 chunk) {
+    const u64 mask = 0x000000ff000000ffull;
+    const u64 mul1 = 100 + (1000000ull << 32);
+    const u64 mul2 = 1 + (10000ull << 32);
+    chunk -= 0x3030303030303030ull;
+    chunk = chunk * 10 + (chunk >> 8);
+    chunk = (((chunk & mask) * mul1) + (((chunk >> 16) & mask) * mul2)) >> 32;
+    return static_cast<u32>(chunk);
+}
+
+static u64 loadEightBytes(const char* p) {
+    u64 chunk;
+    memcpy(&chunk, p, sizeof(chunk));
+    return chunk;
+}
+
+static const double POWERS_OF_TEN[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                       1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                       1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+// doubles hold every integer power of ten up to here exactly
+const int MAX_EXACT_POWER = 22;
+// digits past this many are dropped, the mantissa stays within 64 bits
+const int MAX_MANTISSA_DIGITS = 19;
+
+// digits into mantissa, counting those kept; dropped ones count in ignored
+static const char* parseDigits(const char* p, const char* end, u64* mantissa, int* digits,
+                               int* ignored) {
+    while (end - p >= 8 && *digits + 8 <= MAX_MANTISSA_DIGITS) {
+        u64 chunk = loadEightBytes(p);
+        if (!isEightDigits(chunk)) {
+            break;
+        }
+        *mantissa = *mantissa * 100000000 + parseEightDigits(chunk);
+        if (*mantissa != 0) {
+            *digits += 8;
+        }
+        p += 8;
+    }
+    while (p < end && *p >= '0' && *p <= '9') {
+        if (*digits < MAX_MANTISSA_DIGITS) {
+            *mantissa = *mantissa * 10 + static_cast<u64>(*p - '0');
+            // leading zeros don't use up precision
+            if (*mantissa != 0) {
+                (*digits)++;
+            }
+        } else {
+            (*ignored)++;
+        }
+        p++;
+    }
+    return p;
+}
+
+const char* parseObjFloat(const char* p, const char* end, float* value) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    u64 mantissa = 0;
+    int digits = 0;
+    const char* start = p;
+    int ignored = 0;
+    p = parseDigits(p, end, &mantissa, &digits, &ignored);
+    // integer digits past the precision still scale it
+    int exponent = ignored;
+    bool any = p > start;
+    if (p < end && *p == '.') {
+        p++;
+        const char* fraction = p;
+        ignored = 0;
+        p = parseDigits(p, end, &mantissa, &digits, &ignored);
+        // every fraction digit that made it into the mantissa moves the point, leading
+        // zeros included
+        exponent -= static_cast<int>(p - fraction) - ignored;
+        any = any || p > fraction;
+    }
+    if (!any) {
+        return nullptr;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* e = p + 1;
+        bool negative_exponent = false;
+        if (e < end && (*e == '-' || *e == '+')) {
+            negative_exponent = *e == '-';
+            e++;
+        }
+        if (e < end && *e >= '0' && *e <= '9') {
+            int power = 0;
+            while (e < end && *e >= '0' && *e <= '9') {
+                power = std::min(power * 10 + (*e - '0'), 10000);
+                e++;
+            }
+            exponent += negative_exponent ? -power : power;
+            p = e;
+        }
+    }
+
+    double result = static_cast<double>(mantissa);
+    if (mantissa != 0) {
+        while (exponent > MAX_EXACT_POWER) {
+            result *= POWERS_OF_TEN[MAX_EXACT_POWER];
+            exponent -= MAX_EXACT_POWER;
+        }
+        while (exponent < -MAX_EXACT_POWER) {
+            result /= POWERS_OF_TEN[MAX_EXACT_POWER];
+            exponent += MAX_EXACT_POWER;
+        }
+        result = exponent >= 0 ? result * POWERS_OF_TEN[exponent]
+                               : result / POWERS_OF_TEN[-exponent];
+    }
+    *value = static_cast<float>(negative ? -result : result);
+    return p;
+}
+
+static const char* parseInt(const char* p, const char* end, int* value) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+    const char* start = p;
+    int result = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        // anything this big is out of range anyway, it just must not overflow
+        if (result < (1 << 27)) {
+            result = result * 10 + (*p - '0');
+        }
+        p++;
+    }
+    if (p == start) {
+        return nullptr;
+    }
+    *value = negative ? -result : result;
+    return p;
+}
+
+// 1-based or negative OBJ index to an ObjCorner one, false for 0
+static bool resolveIndex(int index, size_t local_count, int* out, u32* flags, u32 flag) {
+    if (index > 0) {
+        *out = index - 1;
+        return true;
+    }
+    if (index < 0) {
+        *out = static_cast<int>(local_count) + index;
+        *flags |= flag;
+        return true;
+    }
+    return false;
+}
+
+// v/vt/vn, v//vn, v/vt or v
+static const char* parseCorner(const char* p, const char* end, ObjChunk* chunk, ObjCorner* corner) {
+    int index;
+    corner->uv = -1;
+    corner->flags = 0;
+    p = parseInt(p, end, &index);
+    if (!p || !resolveIndex(index, chunk->positions.size(), &corner->position, &corner->flags,
+                            OBJ_RELATIVE_POSITION)) {
+        return nullptr;
+    }
+    if (p < end && *p == '/') {
+        p++;
+        if (p < end && *p != '/') {
+            p = parseInt(p, end, &index);
+            if (!p || !resolveIndex(index, chunk->uvs.size(), &corner->uv, &corner->flags,
+                                    OBJ_RELATIVE_UV)) {
+                return nullptr;
+            }
+        }
+        if (p < end && *p == '/') {
+            p = parseInt(p + 1, end, &index); // the normal, unused
+            if (!p) {
+                return nullptr;
+            }
+        }
+    }
+    return p < end && !isSpace(*p) ? nullptr : p;
+}
+
+static bool keywordIs(const char* p, const char* keyword_end, const char* keyword) {
+    size_t length = strlen(keyword);
+    return static_cast<size_t>(keyword_end - p) == length && memcmp(p, keyword, length) == 0;
+}
+
+static void parseLine(const char* p, const char* end, ObjChunk* chunk) {
+    p = skipSpace(p, end);
+    const char* keyword = p;
+    while (p < end && !isSpace(*p)) {
+        p++;
+    }
+    if (p == keyword || *keyword == '#') {
+        return;
+    }
+
+    if (keywordIs(keyword, p, "v")) {
+        glm::vec3 position;
+        for (int i = 0; i < 3; i++) {
+            p = parseObjFloat(skipSpace(p, end), end, &position[i]);
+            if (!p) {
+                chunk->failed = true;
+                return;
+            }
+        }
+        chunk->positions.push_back(position);
+    } else if (keywordIs(keyword, p, "vt")) {
+        glm::vec2 uv(0.0f);
+        p = parseObjFloat(skipSpace(p, end), end, &uv.x);
+        if (!p) {
+            chunk->failed = true;
+            return;
+        }
+        // v is optional
+        const char* v = parseObjFloat(skipSpace(p, end), end, &uv.y);
+        // aiProcess_FlipUVs
+        uv.y = 1.0f - (v ? uv.y : 0.0f);
+        chunk->uvs.push_back(uv);
+    } else if (keywordIs(keyword, p, "f")) {
+        // fanned from the first corner, like aiProcess_Triangulate does for convex faces
+        ObjCorner first = {};
+        ObjCorner previous = {};
+        int count = 0;
+        while ((p = skipSpace(p, end)) < end) {
+            ObjCorner corner;
+            p = parseCorner(p, end, chunk, &corner);
+            if (!p) {
+                chunk->failed = true;
+                return;
+            }
+            if (count == 0) {
+                first = corner;
+            } else if (count >= 2) {
+                chunk->corners.push_back(first);
+                chunk->corners.push_back(previous);
+                chunk->corners.push_back(corner);
+            }
+            previous = corner;
+            count++;
+        }
+    } else if (keywordIs(keyword, p, "usemtl")) {
+        chunk->events.push_back({chunk->corners.size(), true, restOfLine(p, end)});
+    } else if (keywordIs(keyword, p, "o") || keywordIs(keyword, p, "g")) {
+        chunk->events.push_back({chunk->corners.size(), false, restOfLine(p, end)});
+    } else if (keywordIs(keyword, p, "mtllib")) {
+        chunk->material_libraries.push_back(restOfLine(p, end));
+    }
+    // vn, s, l, p and anything else: nothing the renderer uses
+}
+
+static void parseChunk(const char* p, const char* end, ObjChunk* chunk) {
+    while (p < end && !chunk->failed) {
+        const char* line_end = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!line_end) {
+            line_end = end;
+        }
+        parseLine(p, line_end, chunk);
+        p = line_end + 1;
+    }
+}
+
+// materials in definition order after the default one, each with its diffuse map
+static void parseMtl(const char* p, const char* end, std::vector<std::string>* texture_names,
+                     std::map<std::string, u32>* material_ids) {
+    u32 current = 0;
+    while (p < end) {
+        const char* line_end = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!line_end) {
+            line_end = end;
+        }
+        const char* keyword = skipSpace(p, line_end);
+        const char* rest = keyword;
+        while (rest < line_end && !isSpace(*rest)) {
+            rest++;
+        }
+        if (keywordIs(keyword, rest, "newmtl")) {
+            std::string name = restOfLine(rest, line_end);
+            auto found = material_ids->find(name);
+            if (found == material_ids->end()) {
+                current = static_cast<u32>(texture_names->size());
+                (*material_ids)[name] = current;
+                texture_names->push_back("");
+            } else {
+                current = found->second;
+            }
+        } else if (keywordIs(keyword, rest, "map_Kd") && current != 0) {
+            // options come before the path, which is the last thing on the line
+            std::string path = restOfLine(rest, line_end);
+            size_t space = path.find_last_of(" \t");
+            if (space != std::string::npos) {
+                path = path.substr(space + 1);
+            }
+            // named the way MeshModel::LoadMaterials names it
+            size_t separator = path.rfind("\\");
+            (*texture_names)[current] =
+                separator == std::string::npos ? path : path.substr(separator + 1);
+        }
+        p = line_end + 1;
+    }
+}
+
+const u64 OBJ_EMPTY_KEY = ~0ull;
+
+// Open addressing from a position/uv index pair to a vertex, sized for every corner up front
+class ObjVertexMap {
+public:
+    ObjVertexMap(size_t corner_count) {
+        size_t capacity = 16;
+        while (capacity < corner_count * 2) {
+            capacity *= 2;
+        }
+        keys.assign(capacity, OBJ_EMPTY_KEY);
+        values.resize(capacity);
+        mask = capacity - 1;
+    }
+
+    // the vertex of key, or next_vertex after storing it there
+    u32 find(u64 key, u32 next_vertex, bool* inserted) {
+        size_t slot = static_cast<size_t>((key * 0x9e3779b97f4a7c15ull) >> 32) & mask;
+        while (keys[slot] != OBJ_EMPTY_KEY) {
+            if (keys[slot] == key) {
+                *inserted = false;
+                return values[slot];
+            }
+            slot = (slot + 1) & mask;
+        }
+        keys[slot] = key;
+        values[slot] = next_vertex;
+        *inserted = true;
+        return next_vertex;
+    }
+
+private:
+    std::vector<u64> keys;
+    std::vector<u32> values;
+    size_t mask;
+};
+
+bool loadObj(const std::string& filename, AssetPack* pack, ThreadPool* pool, ObjModel* model) {
+    MappedFile file;
+    std::vector<u8> storage;
+    size_t size = 0;
+    const char* text = reinterpret_cast<const char*>(pack->map(filename, &file, &storage, &size));
+    if (!text) {
+        return false;
+    }
+    const char* text_end = text + size;
+
+    // chunk boundaries just past a line end, each chunk parses on its own
+    u32 chunk_count = static_cast<u32>(std::max<size_t>(size / OBJ_CHUNK_BYTES, 1));
+    std::vector<const char*> bounds(chunk_count + 1, text_end);
+    bounds[0] = text;
+    for (u32 i = 1; i < chunk_count; i++) {
+        const char* p = std::max(text + size / chunk_count * i, bounds[i - 1]);
+        const char* line_end = static_cast<const char*>(memchr(p, '\n', text_end - p));
+        bounds[i] = line_end ? line_end + 1 : text_end;
+    }
+    std::vector<ObjChunk> chunks(chunk_count);
+    forEach(pool, chunk_count,
+            [&](u32 i) { parseChunk(bounds[i], bounds[i + 1], &chunks[i]); });
+
+    // where each chunk's positions and uvs start, relative indices resolve against it
+    std::vector<size_t> position_base(chunk_count);
+    std::vector<size_t> uv_base(chunk_count);
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> uvs;
+    size_t position_count = 0;
+    size_t uv_count = 0;
+    for (u32 i = 0; i < chunk_count; i++) {
+        if (chunks[i].failed) {
+            return false;
+        }
+        position_base[i] = position_count;
+        uv_base[i] = uv_count;
+        position_count += chunks[i].positions.size();
+        uv_count += chunks[i].uvs.size();
+    }
+    positions.reserve(position_count);
+    uvs.reserve(uv_count);
+    for (ObjChunk& chunk : chunks) {
+        positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+        uvs.insert(uvs.end(), chunk.uvs.begin(), chunk.uvs.end());
+        std::vector<glm::vec3>().swap(chunk.positions);
+        std::vector<glm::vec2>().swap(chunk.uvs);
+    }
+
+    // materials, the MTL paths are relative to the OBJ
+    model->texture_names.assign(1, "");
+    std::map<std::string, u32> material_ids;
+    size_t separator = filename.find_last_of("/\\");
+    std::string directory = separator == std::string::npos ? "" : filename.substr(0, separator + 1);
+    for (ObjChunk& chunk : chunks) {
+        for (const std::string& library : chunk.material_libraries) {
+            MappedFile mtl_file;
+            std::vector<u8> mtl_storage;
+            size_t mtl_size = 0;
+            const char* mtl = reinterpret_cast<const char*>(
+                pack->map(directory + library, &mtl_file, &mtl_storage, &mtl_size));
+            if (!mtl) {
+                printf("%s: material library %s not found\n", filename.c_str(),
+                       library.c_str());
+                continue;
+            }
+            parseMtl(mtl, mtl + mtl_size, &model->texture_names, &material_ids);
+        }
+    }
+
+    // split the corners into meshes in file order, one per object/group and material
+    std::vector<ObjMeshRuns> runs;
+    std::map<std::pair<std::string, u32>, u32> mesh_ids;
+    std::string group;
+    u32 material = 0;
+    auto addRange = [&](u32 chunk, size_t first, size_t end) {
+        if (first == end) {
+            return;
+        }
+        auto key = std::make_pair(group, material);
+        auto found = mesh_ids.find(key);
+        if (found == mesh_ids.end()) {
+            found = mesh_ids.insert({key, static_cast<u32>(runs.size())}).first;
+            runs.push_back(ObjMeshRuns());
+            runs.back().material = material;
+        }
+        ObjMeshRuns& run = runs[found->second];
+        run.ranges.push_back({chunk, first, end});
+        run.corner_count += end - first;
+    };
+    for (u32 c = 0; c < chunk_count; c++) {
+        size_t first = 0;
+        for (const ObjEvent& event : chunks[c].events) {
+            addRange(c, first, event.corner);
+            first = event.corner;
+            if (event.material) {
+                auto found = material_ids.find(event.name);
+                material = found != material_ids.end() ? found->second : 0;
+            } else {
+                group = event.name;
+            }
+        }
+        addRange(c, first, chunks[c].corners.size());
+    }
+
+    // every mesh joins its own vertices in parallel
+    u32 mesh_count = static_cast<u32>(runs.size());
+    model->meshes.clear();
+    model->meshes.resize(mesh_count);
+    std::vector<u8> valid(mesh_count, 1);
+    forEach(pool, mesh_count, [&](u32 m) {
+        const ObjMeshRuns& run = runs[m];
+        MeshData& mesh = model->meshes[m];
+        mesh.material = run.material;
+        mesh.indices.resize(run.corner_count);
+        ObjVertexMap vertex_map(run.corner_count);
+        size_t next = 0;
+        for (const ObjRange& range : run.ranges) {
+            const std::vector<ObjCorner>& corners = chunks[range.chunk].corners;
+            for (size_t i = range.first; i < range.end; i++) {
+                const ObjCorner& corner = corners[i];
+                bool has_uv = corner.uv >= 0 || (corner.flags & OBJ_RELATIVE_UV);
+                std::int64_t position = corner.position;
+                std::int64_t uv = corner.uv;
+                if (corner.flags & OBJ_RELATIVE_POSITION) {
+                    position += position_base[range.chunk];
+                }
+                if (corner.flags & OBJ_RELATIVE_UV) {
+                    uv += uv_base[range.chunk];
+                }
+                if (position < 0 || position >= static_cast<std::int64_t>(position_count) ||
+                    (has_uv && (uv < 0 || uv >= static_cast<std::int64_t>(uv_count)))) {
+                    valid[m] = 0;
+                    return;
+                }
+
+                u64 key = (u64(position) << 32) | u32(has_uv ? uv + 1 : 0);
+                bool inserted;
+                u32 vertex = vertex_map.find(key, static_cast<u32>(mesh.vertices.size()),
+                                             &inserted);
+                if (inserted) {
+                    Vertex out;
+                    out.pos = positions[static_cast<size_t>(position)];
+                    out.col = glm::vec3(1.0f);
+                    out.tex = has_uv ? uvs[static_cast<size_t>(uv)] : glm::vec2(0.0f);
+                    mesh.vertices.push_back(out);
+                }
+                mesh.indices[next++] = vertex;
+            }
+        }
+    });
+    if (std::find(valid.begin(), valid.end(), 0) != valid.end()) {
+        return false;
+    }
+
+    SceneNode root = {};
+    root.transform = glm::mat4(1.0f);
+    root.parent = -1;
+    root.mesh_count = mesh_count;
+    model->nodes.assign(1, root);
+    return true;
+}
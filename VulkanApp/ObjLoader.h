@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "AssetPack.h"
+#include "Mesh.h"
+#include "ThreadPool.h"
+#include "Utilities.h"
+
+// The OBJ text is cut into chunks of about this size at line ends and parsed in parallel
+const size_t OBJ_CHUNK_BYTES = 256 * 1024;
+
+// An OBJ with its materials, laid out like the Assimp import of it
+struct ObjModel {
+    // per material, the diffuse map as MeshModel::LoadMaterials names it; material 0 is the
+    // default one faces before any usemtl get
+    std::vector<std::string> texture_names;
+    std::vector<SceneNode> nodes; // a single root holding every mesh
+    std::vector<MeshData> meshes;
+};
+
+// Wavefront OBJ/MTL loader for the importer's job on our content, without Assimp:
+//  - the file is mapped (or read in place out of the pack) and its chunks parsed in parallel
+//  - polygons are fanned into triangles and texture v is flipped, like aiProcess_Triangulate
+//    and aiProcess_FlipUVs
+//  - one mesh per object/group and material; vertices sharing a position and uv index are
+//    joined through a hash table, like aiProcess_JoinIdenticalVertices
+// Normals, vertex colors, points and lines are skipped, the renderer has no use for them.
+// False on a missing file or malformed data; a missing MTL only loses the textures.
+bool loadObj(const std::string& filename, AssetPack* pack, ThreadPool* pool, ObjModel* model);
+
+// Decimal float at p, like strtof within an ulp: [sign] digits [. digits] [e [sign] digits].
+// Runs of eight digits are converted at once (SWAR). Returns the end of the number, or null
+// when there is none.
+const char* parseObjFloat(const char* p, const char* end, float* value);
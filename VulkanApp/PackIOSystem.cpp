@@ -0,0 +1,33 @@
+#include <cstring>
+#include <assimp/MemoryIOWrapper.h>
+#include "PackIOSystem.h"
+
+PackIOSystem::PackIOSystem(AssetPack* new_pack) : pack(new_pack) {}
+
+PackIOSystem::~PackIOSystem() {}
+
+bool PackIOSystem::Exists(const char* file) const {
+    return pack->find(file) != nullptr || loose.Exists(file);
+}
+
+Assimp::IOStream* PackIOSystem::Open(const char* file, const char* mode) {
+    const AssetPackEntry* entry = strchr(mode, 'w') ? nullptr : pack->find(file);
+    if (!entry) {
+        return loose.Open(file, mode);
+    }
+    size_t size = static_cast<size_t>(entry->size);
+    if (entry->compression == PackCompression::None) {
+        return new Assimp::MemoryIOStream(pack->getStored(*entry), size);
+    }
+    // the stream owns the decompressed copy
+    u8* contents = new u8[size > 0 ? size : 1];
+    if (!pack->readInto(*entry, contents)) {
+        delete[] contents;
+        return nullptr;
+    }
+    return new Assimp::MemoryIOStream(contents, size, true);
+}
+
+void PackIOSystem::Close(Assimp::IOStream* stream) {
+    delete stream;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <assimp/DefaultIOSystem.h>
+#include <assimp/IOSystem.hpp>
+#include "AssetPack.h"
+
+// Assimp file access out of the asset pack, so a model and the files it references (.mtl)
+// are read from the mapping. Anything the pack doesn't have comes from loose files.
+class PackIOSystem : public Assimp::IOSystem {
+public:
+    explicit PackIOSystem(AssetPack* pack);
+    ~PackIOSystem();
+
+    bool Exists(const char* file) const override;
+    char getOsSeparator() const override {
+        return '/';
+    }
+    Assimp::IOStream* Open(const char* file, const char* mode = "rb") override;
+    void Close(Assimp::IOStream* stream) override;
+
+private:
+    AssetPack* pack;
+    Assimp::DefaultIOSystem loose;
+};
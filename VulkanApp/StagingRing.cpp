@@ -0,0 +1,327 @@
+#include <limits>
+#include "StagingRing.h"
+
+StagingRing::StagingRing() {}
+
+StagingRing::~StagingRing() {}
+
+void StagingRing::init(MemoryAllocator* new_allocator, VkDevice new_device,
+                       const QueueFamilyIndices& indices, VkQueue new_transfer_queue,
+                       VkCommandPool new_transfer_cmd_pool) {
+    allocator = new_allocator;
+    device = new_device;
+    transfer_queue = new_transfer_queue;
+    transfer_cmd_pool = new_transfer_cmd_pool;
+    transfer_family = static_cast<u32>(indices.transfer_family);
+    graphics_family = static_cast<u32>(indices.graphics_family);
+
+    allocator->createBuffer(STAGING_RING_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                            MemoryCategory::Staging, &ring_buffer, &ring_memory);
+
+    std::array<VkCommandBuffer, STAGING_BATCH_COUNT> cmd_buffers;
+
+    VkCommandBufferAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandPool = transfer_cmd_pool;
+    alloc_info.commandBufferCount = STAGING_BATCH_COUNT;
+
+    VKRes(vkAllocateCommandBuffers(device, &alloc_info, cmd_buffers.data()));
+
+    VkFenceCreateInfo fence_info = {};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    for (u32 i = 0; i < STAGING_BATCH_COUNT; i++) {
+        batches[i].cmd_buffer = cmd_buffers[i];
+        VKRes(vkCreateFence(device, &fence_info, allocator->hostCallbacks(), &batches[i].fence));
+    }
+}
+
+void StagingRing::destroy() {
+    while (in_flight_count > 0) {
+        retireOldest();
+    }
+    for (Batch& batch : batches) {
+        for (TempBuffer& temp : batch.temp_buffers) {
+            allocator->destroyBuffer(temp.buffer, temp.memory);
+        }
+        batch.temp_buffers.clear();
+        vkFreeCommandBuffers(device, transfer_cmd_pool, 1, &batch.cmd_buffer);
+        vkDestroyFence(device, batch.fence, allocator->hostCallbacks());
+    }
+    allocator->destroyBuffer(ring_buffer, ring_memory);
+    ring_buffer = VK_NULL_HANDLE;
+}
+
+StagingRegion StagingRing::allocate(VkDeviceSize size, VkDeviceSize alignment) {
+    StagingRegion region;
+
+    if (size > STAGING_RING_SIZE) {
+        TempBuffer temp;
+        allocator->createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                MemoryCategory::Staging, &temp.buffer, &temp.memory);
+        batches[current].temp_buffers.push_back(temp);
+
+        region.buffer = temp.buffer;
+        region.mapped = temp.memory.mapped;
+        return region;
+    }
+
+    VkDeviceSize offset;
+    if (!tryAllocate(size, alignment, &offset)) {
+        retireCompleted();
+        while (!tryAllocate(size, alignment, &offset)) {
+            if (in_flight_count == 0) {
+                // the rest of the ring belongs to the batch being recorded
+                flush();
+            }
+            retireOldest();
+        }
+    }
+
+    region.buffer = ring_buffer;
+    region.offset = offset;
+    region.mapped = static_cast<u8*>(ring_memory.mapped) + offset;
+    return region;
+}
+
+VkCommandBuffer StagingRing::commandBuffer() {
+    Batch& batch = batches[current];
+    if (!batch.recording) {
+        VkCommandBufferBeginInfo begin_info = {};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        VKRes(vkBeginCommandBuffer(batch.cmd_buffer, &begin_info));
+        batch.recording = true;
+    }
+    return batch.cmd_buffer;
+}
+
+void StagingRing::releaseBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size,
+                                VkAccessFlags dst_access, VkPipelineStageFlags dst_stage) {
+    // on a single family the memory barrier at the end of the batch covers buffers
+    if (!separateFamilies()) {
+        return;
+    }
+
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = dst_access;
+    barrier.srcQueueFamilyIndex = transfer_family;
+    barrier.dstQueueFamilyIndex = graphics_family;
+    barrier.buffer = buffer;
+    barrier.offset = offset;
+    barrier.size = size;
+
+    Batch& batch = batches[current];
+    batch.buffer_barriers.push_back(barrier);
+    batch.dst_stages |= dst_stage;
+}
+
+void StagingRing::releaseImage(VkImage image, VkImageLayout old_layout, VkImageLayout new_layout,
+                               VkAccessFlags dst_access, VkPipelineStageFlags dst_stage) {
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = dst_access;
+    barrier.oldLayout = old_layout;
+    barrier.newLayout = new_layout;
+    // a plain layout transition when both queues are the same family
+    barrier.srcQueueFamilyIndex = separateFamilies() ? transfer_family : VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = separateFamilies() ? graphics_family : VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+
+    Batch& batch = batches[current];
+    batch.image_barriers.push_back(barrier);
+    batch.dst_stages |= dst_stage;
+}
+
+u64 StagingRing::flush() {
+    Batch& batch = batches[current];
+    if (!batch.recording && batch.ring_bytes == 0 && batch.temp_buffers.empty()) {
+        return next_ticket - 1;
+    }
+
+    VkCommandBuffer cmd_buffer = commandBuffer();
+
+    if (separateFamilies()) {
+        // release half of the ownership transfers, the access on the graphics side is ignored
+        std::vector<VkBufferMemoryBarrier> buffer_releases = batch.buffer_barriers;
+        std::vector<VkImageMemoryBarrier> image_releases = batch.image_barriers;
+        for (VkBufferMemoryBarrier& barrier : buffer_releases) {
+            barrier.dstAccessMask = 0;
+        }
+        for (VkImageMemoryBarrier& barrier : image_releases) {
+            barrier.dstAccessMask = 0;
+        }
+
+        if (!buffer_releases.empty() || !image_releases.empty()) {
+            vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                 VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr,
+                                 static_cast<u32>(buffer_releases.size()), buffer_releases.data(),
+                                 static_cast<u32>(image_releases.size()), image_releases.data());
+        }
+    } else {
+        // make every copy in the batch visible to whatever reads the data afterwards
+        VkMemoryBarrier mem_barrier = {};
+        mem_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        mem_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        mem_barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT |
+                                    VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT |
+                                    VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+        vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+                                 VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                                 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                                 VK_PIPELINE_STAGE_TRANSFER_BIT | batch.dst_stages,
+                             0, 1, &mem_barrier, 0, nullptr,
+                             static_cast<u32>(batch.image_barriers.size()),
+                             batch.image_barriers.data());
+        batch.image_barriers.clear();
+        batch.dst_stages = 0;
+    }
+
+    VKRes(vkEndCommandBuffer(cmd_buffer));
+    batch.recording = false;
+
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &cmd_buffer;
+
+    VKRes(vkResetFences(device, 1, &batch.fence));
+    VKRes(vkQueueSubmit(transfer_queue, 1, &submit_info, batch.fence));
+
+    batch.ticket = next_ticket++;
+    batch.in_flight = true;
+    in_flight_count++;
+
+    // move on to the next batch slot, it may still be in flight from the previous lap
+    current = (current + 1) % STAGING_BATCH_COUNT;
+    if (batches[current].in_flight) {
+        retireOldest();
+    }
+    return batch.ticket;
+}
+
+void StagingRing::wait(u64 ticket) {
+    while (completed_ticket < ticket && in_flight_count > 0) {
+        retireOldest();
+    }
+}
+
+bool StagingRing::isComplete(u64 ticket) {
+    retireCompleted();
+    return completed_ticket >= ticket;
+}
+
+void StagingRing::recordAcquires(VkCommandBuffer cmd_buffer) {
+    retireCompleted();
+
+    if (!pending_buffer_acquires.empty() || !pending_image_acquires.empty()) {
+        // the release already finished on the CPU side (fence), so nothing to wait on here
+        vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                             pending_dst_stages | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr,
+                             static_cast<u32>(pending_buffer_acquires.size()),
+                             pending_buffer_acquires.data(),
+                             static_cast<u32>(pending_image_acquires.size()),
+                             pending_image_acquires.data());
+
+        pending_buffer_acquires.clear();
+        pending_image_acquires.clear();
+        pending_dst_stages = 0;
+    }
+    acquired_ticket = completed_ticket;
+}
+
+bool StagingRing::tryAllocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset) {
+    if (used == 0) {
+        head = tail = 0;
+    }
+
+    VkDeviceSize start = (head + alignment - 1) / alignment * alignment;
+    bool full = used > 0 && head == tail;
+
+    if (full) {
+        return false;
+    } else if (head >= tail) {
+        // free space is [head, end) followed by [0, tail)
+        if (start + size > STAGING_RING_SIZE) {
+            if (size > tail) {
+                return false;
+            }
+            start = 0;
+        }
+    } else if (start + size > tail) {
+        return false;
+    }
+
+    // wrapping around wastes the end of the ring, charge it to this batch
+    VkDeviceSize consumed = start >= head ? start - head + size : STAGING_RING_SIZE - head + size;
+
+    head = start + size;
+    used += consumed;
+
+    Batch& batch = batches[current];
+    batch.ring_bytes += consumed;
+    batch.ring_end = head;
+
+    *offset = start;
+    return true;
+}
+
+void StagingRing::retireOldest() {
+    Batch& batch = batches[oldest];
+
+    VKRes(vkWaitForFences(device, 1, &batch.fence, VK_TRUE, std::numeric_limits<u64>::max()));
+
+    for (TempBuffer& temp : batch.temp_buffers) {
+        allocator->destroyBuffer(temp.buffer, temp.memory);
+    }
+    batch.temp_buffers.clear();
+
+    // the graphics side of the ownership transfers can be recorded from now on
+    for (VkBufferMemoryBarrier& barrier : batch.buffer_barriers) {
+        // buffers may also be copied around on the graphics queue (arena growth)
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask |= VK_ACCESS_TRANSFER_READ_BIT;
+        pending_buffer_acquires.push_back(barrier);
+    }
+    for (VkImageMemoryBarrier& barrier : batch.image_barriers) {
+        barrier.srcAccessMask = 0;
+        pending_image_acquires.push_back(barrier);
+    }
+    pending_dst_stages |= batch.dst_stages;
+    batch.buffer_barriers.clear();
+    batch.image_barriers.clear();
+    batch.dst_stages = 0;
+
+    if (batch.ring_bytes > 0) {
+        tail = batch.ring_end;
+        used -= batch.ring_bytes;
+        batch.ring_bytes = 0;
+    }
+
+    completed_ticket = batch.ticket;
+    batch.in_flight = false;
+    in_flight_count--;
+    oldest = (oldest + 1) % STAGING_BATCH_COUNT;
+}
+
+void StagingRing::retireCompleted() {
+    while (in_flight_count > 0 && vkGetFenceStatus(device, batches[oldest].fence) == VK_SUCCESS) {
+        retireOldest();
+    }
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <array>
+#include <vector>
+#include <GLFW/glfw3.h>
+#include "MemoryAllocator.h"
+#include "Utilities.h"
+
+// Size of the persistently mapped upload ring
+const VkDeviceSize STAGING_RING_SIZE = 32ull * 1024 * 1024;
+// Number of transfer batches that can be in flight at once
+const u32 STAGING_BATCH_COUNT = 3;
+
+// A piece of staging memory the caller writes into before recording a copy from it
+struct StagingRegion {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    void* mapped = nullptr;
+};
+
+// Uploads are written into one persistently mapped ring buffer and their copies are
+// recorded into a shared command buffer. flush() submits the whole batch at once and
+// returns a ticket; fences tell when a batch has finished and its ring space can be reused.
+//
+// Batches run on the transfer queue. When that is a different family from graphics, every
+// uploaded resource is released at the end of its batch and acquired by the graphics queue
+// once the batch fence has signalled (see recordAcquires).
+class StagingRing {
+public:
+    StagingRing();
+    ~StagingRing();
+
+    void init(MemoryAllocator* allocator, VkDevice device, const QueueFamilyIndices& indices,
+              VkQueue transfer_queue, VkCommandPool transfer_cmd_pool);
+    void destroy();
+
+    // room for size bytes, valid until the batch it was recorded in has completed.
+    // Requests larger than the ring get a temporary buffer freed along with the batch.
+    StagingRegion allocate(VkDeviceSize size, VkDeviceSize alignment = 16);
+
+    // command buffer of the batch currently being recorded
+    VkCommandBuffer commandBuffer();
+
+    // hand a written range/image over to the graphics queue at the end of the batch
+    void releaseBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size,
+                       VkAccessFlags dst_access, VkPipelineStageFlags dst_stage);
+    void releaseImage(VkImage image, VkImageLayout old_layout, VkImageLayout new_layout,
+                      VkAccessFlags dst_access, VkPipelineStageFlags dst_stage);
+
+    // submit the current batch, returns its ticket (or the last one if nothing was recorded)
+    u64 flush();
+    void wait(u64 ticket);
+    bool isComplete(u64 ticket);
+
+    // record the acquire half of every finished batch, before the render pass
+    void recordAcquires(VkCommandBuffer cmd_buffer);
+    // resources of a ticket can be used on the graphics queue after its acquires are recorded
+    bool isReady(u64 ticket) {
+        return ticket <= acquired_ticket;
+    }
+    // nothing recorded, in flight or waiting to be acquired: every uploaded resource is owned
+    // by the graphics queue, so it can be moved around there
+    bool isIdle() {
+        return !batches[current].recording && acquired_ticket + 1 == next_ticket;
+    }
+
+    // batches run on a dedicated transfer family, which can only copy (no blits)
+    bool separateFamilies() {
+        return transfer_family != graphics_family;
+    }
+
+private:
+    struct TempBuffer {
+        VkBuffer buffer;
+        MemoryAllocation memory;
+    };
+
+    struct Batch {
+        VkCommandBuffer cmd_buffer = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        u64 ticket = 0;
+        bool recording = false;
+        bool in_flight = false;
+        // ring bytes used by this batch, padding included, and where they end
+        VkDeviceSize ring_bytes = 0;
+        VkDeviceSize ring_end = 0;
+        std::vector<TempBuffer> temp_buffers;
+        std::vector<VkBufferMemoryBarrier> buffer_barriers;
+        std::vector<VkImageMemoryBarrier> image_barriers;
+        VkPipelineStageFlags dst_stages = 0;
+    };
+
+    MemoryAllocator* allocator;
+    VkDevice device;
+    VkQueue transfer_queue;
+    VkCommandPool transfer_cmd_pool;
+    u32 transfer_family;
+    u32 graphics_family;
+
+    VkBuffer ring_buffer = VK_NULL_HANDLE;
+    MemoryAllocation ring_memory;
+    VkDeviceSize head = 0;
+    VkDeviceSize tail = 0;
+    VkDeviceSize used = 0;
+
+    std::array<Batch, STAGING_BATCH_COUNT> batches;
+    u32 current = 0;
+    u32 oldest = 0;
+    u32 in_flight_count = 0;
+    u64 next_ticket = 1;
+    u64 completed_ticket = 0;
+    u64 acquired_ticket = 0;
+
+    // acquire barriers of finished batches not yet recorded on the graphics queue
+    std::vector<VkBufferMemoryBarrier> pending_buffer_acquires;
+    std::vector<VkImageMemoryBarrier> pending_image_acquires;
+    VkPipelineStageFlags pending_dst_stages = 0;
+
+    bool tryAllocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset);
+    void retireOldest();
+    void retireCompleted();
+};
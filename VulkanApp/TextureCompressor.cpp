@@ -0,0 +1,476 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "Ktx2.h"
+#include "MipChain.h"
+#include "TextureCompressor.h"
+#include "stb_image.h"
+
+static const u32 BLOCK_TEXELS = 16;
+
+// BC7 4 bit index weights, out of 64
+static const u32 BC7_WEIGHTS[16] = {0,  4,  9,  13, 17, 21, 26, 30,
+                                    34, 38, 43, 47, 51, 55, 60, 64};
+
+// Endpoints of the line best fitting the block, from the principal axis of its texels.
+// Only the first channels components are looked at.
+static void principalEndpoints(const u8* texels, u32 channels, float* e0, float* e1) {
+    float mean[4] = {};
+    for (u32 i = 0; i < BLOCK_TEXELS; i++) {
+        for (u32 c = 0; c < channels; c++) {
+            mean[c] += texels[i * 4 + c];
+        }
+    }
+    for (u32 c = 0; c < channels; c++) {
+        mean[c] /= BLOCK_TEXELS;
+    }
+
+    float cov[4][4] = {};
+    for (u32 i = 0; i < BLOCK_TEXELS; i++) {
+        for (u32 a = 0; a < channels; a++) {
+            for (u32 b = 0; b < channels; b++) {
+                cov[a][b] += (texels[i * 4 + a] - mean[a]) * (texels[i * 4 + b] - mean[b]);
+            }
+        }
+    }
+
+    // power iteration, converges quickly for the 3-4 dimensions here
+    float axis[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+    for (u32 iteration = 0; iteration < 8; iteration++) {
+        float next[4] = {};
+        float length = 0.0f;
+        for (u32 a = 0; a < channels; a++) {
+            for (u32 b = 0; b < channels; b++) {
+                next[a] += cov[a][b] * axis[b];
+            }
+            length = std::max(length, std::fabs(next[a]));
+        }
+        if (length < 1e-6f) {
+            break; // flat block, any axis does
+        }
+        for (u32 c = 0; c < channels; c++) {
+            axis[c] = next[c] / length;
+        }
+    }
+    float axis_length_sq = 0.0f;
+    for (u32 c = 0; c < channels; c++) {
+        axis_length_sq += axis[c] * axis[c];
+    }
+
+    float t_min = 0.0f;
+    float t_max = 0.0f;
+    for (u32 i = 0; i < BLOCK_TEXELS; i++) {
+        float t = 0.0f;
+        for (u32 c = 0; c < channels; c++) {
+            t += (texels[i * 4 + c] - mean[c]) * axis[c];
+        }
+        t /= axis_length_sq;
+        t_min = std::min(t_min, t);
+        t_max = std::max(t_max, t);
+    }
+    for (u32 c = 0; c < channels; c++) {
+        e0[c] = std::min(std::max(mean[c] + axis[c] * t_min, 0.0f), 255.0f);
+        e1[c] = std::min(std::max(mean[c] + axis[c] * t_max, 0.0f), 255.0f);
+    }
+}
+
+// Least squares endpoints for fixed interpolation weights (0 = e0, 1 = e1) per texel.
+// Leaves the endpoints alone when every texel uses the same weight.
+static void refitEndpoints(const u8* texels, u32 channels, const float* weights, float* e0,
+                           float* e1) {
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[4] = {};
+    float bx[4] = {};
+    for (u32 i = 0; i < BLOCK_TEXELS; i++) {
+        float b = weights[i];
+        float a = 1.0f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (u32 c = 0; c < channels; c++) {
+            ax[c] += a * texels[i * 4 + c];
+            bx[c] += b * texels[i * 4 + c];
+        }
+    }
+    float det = aa * bb - ab * ab;
+    if (std::fabs(det) < 1e-6f) {
+        return;
+    }
+    for (u32 c = 0; c < channels; c++) {
+        e0[c] = std::min(std::max((ax[c] * bb - bx[c] * ab) / det, 0.0f), 255.0f);
+        e1[c] = std::min(std::max((bx[c] * aa - ax[c] * ab) / det, 0.0f), 255.0f);
+    }
+}
+
+static u32 squaredError(const u8* a, const u8* b, u32 channels) {
+    u32 error = 0;
+    for (u32 c = 0; c < channels; c++) {
+        int d = int(a[c]) - int(b[c]);
+        error += u32(d * d);
+    }
+    return error;
+}
+
+// Nearest palette entry for every texel, returns the total squared error
+static u32 pickIndices(const u8* texels, u32 channels, const u8 (*palette)[4], u32 palette_size,
+                       u8* indices) {
+    u32 total = 0;
+    for (u32 i = 0; i < BLOCK_TEXELS; i++) {
+        u32 best = ~0u;
+        for (u32 p = 0; p < palette_size; p++) {
+            u32 error = squaredError(texels + i * 4, palette[p], channels);
+            if (error < best) {
+                best = error;
+                indices[i] = static_cast<u8>(p);
+            }
+        }
+        total += best;
+    }
+    return total;
+}
+
+static u16 packRGB565(const float* color) {
+    u32 r = u32(color[0] * 31.0f / 255.0f + 0.5f);
+    u32 g = u32(color[1] * 63.0f / 255.0f + 0.5f);
+    u32 b = u32(color[2] * 31.0f / 255.0f + 0.5f);
+    return static_cast<u16>((r << 11) | (g << 5) | b);
+}
+
+static void unpackRGB565(u16 packed, u8* color) {
+    u32 r = (packed >> 11) & 31;
+    u32 g = (packed >> 5) & 63;
+    u32 b = packed & 31;
+    color[0] = static_cast<u8>((r << 3) | (r >> 2));
+    color[1] = static_cast<u8>((g << 2) | (g >> 4));
+    color[2] = static_cast<u8>((b << 3) | (b >> 2));
+    color[3] = 255;
+}
+
+// colour half of BC1/BC3, always in 4 colour mode (color0 > color1)
+struct ColorBlock {
+    u16 color0;
+    u16 color1;
+    u8 indices[BLOCK_TEXELS];
+    u32 error;
+};
+
+static ColorBlock fitColorBlock(const u8* texels, const float* e0, const float* e1) {
+    ColorBlock result = {};
+    u16 a = packRGB565(e0);
+    u16 b = packRGB565(e1);
+    result.color0 = std::max(a, b);
+    result.color1 = std::min(a, b);
+    if (result.color0 == result.color1) {
+        // a single colour, every index picks color0
+        u8 color[4];
+        unpackRGB565(result.color0, color);
+        for (u32 i = 0; i < BLOCK_TEXELS; i++) {
+            result.error += squaredError(texels + i * 4, color, 3);
+        }
+        return result;
+    }
+
+    u8 palette[4][4];
+    unpackRGB565(result.color0, palette[0]);
+    unpackRGB565(result.color1, palette[1]);
+    for (u32 c = 0; c < 4; c++) {
+        palette[2][c] = static_cast<u8>((2 * palette[0][c] + palette[1][c]) / 3);
+        palette[3][c] = static_cast<u8>((palette[0][c] + 2 * palette[1][c]) / 3);
+    }
+    result.error = pickIndices(texels, 3, palette, 4, result.indices);
+    return result;
+}
+
+static void encodeColor(const u8* texels, u8* block) {
+    float e0[4], e1[4];
+    principalEndpoints(texels, 3, e0, e1);
+    ColorBlock best = fitColorBlock(texels, e0, e1);
+
+    // one least squares pass on the chosen indices, kept when it helps
+    if (best.color0 != best.color1 && best.error > 0) {
+        static const float INDEX_WEIGHTS[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+        float weights[BLOCK_TEXELS];
+        for (u32 i = 0; i < BLOCK_TEXELS; i++) {
+            weights[i] = INDEX_WEIGHTS[best.indices[i]];
+        }
+        refitEndpoints(texels, 3, weights, e0, e1);
+        ColorBlock refit = fitColorBlock(texels, e0, e1);
+        if (refit.error < best.error) {
+            best = refit;
+        }
+    }
+
+    u32 index_bits = 0;
+    for (u32 i = 0; i < BLOCK_TEXELS; i++) {
+        index_bits |= u32(best.indices[i]) << (i * 2);
+    }
+    memcpy(block, &best.color0, 2);
+    memcpy(block + 2, &best.color1, 2);
+    memcpy(block + 4, &index_bits, 4);
+}
+
+static void encodeAlpha(const u8* texels, u8* block) {
+    u8 alpha_max = 0;
+    u8 alpha_min = 255;
+    for (u32 i = 0; i < BLOCK_TEXELS; i++) {
+        alpha_max = std::max(alpha_max, texels[i * 4 + 3]);
+        alpha_min = std::min(alpha_min, texels[i * 4 + 3]);
+    }
+    block[0] = alpha_max;
+    block[1] = alpha_min;
+    memset(block + 2, 0, 6);
+    if (alpha_max == alpha_min) {
+        return;
+    }
+
+    // alpha0 > alpha1 selects the 8 value mode
+    u8 palette[8];
+    palette[0] = alpha_max;
+    palette[1] = alpha_min;
+    for (u32 i = 2; i < 8; i++) {
+        palette[i] = static_cast<u8>(((8 - i) * alpha_max + (i - 1) * alpha_min) / 7);
+    }
+
+    u64 index_bits = 0;
+    for (u32 i = 0; i < BLOCK_TEXELS; i++) {
+        u8 alpha = texels[i * 4 + 3];
+        u32 best = 0;
+        int best_error = 256;
+        for (u32 p = 0; p < 8; p++) {
+            int error = std::abs(int(palette[p]) - int(alpha));
+            if (error < best_error) {
+                best_error = error;
+                best = p;
+            }
+        }
+        index_bits |= u64(best) << (i * 3);
+    }
+    for (u32 i = 0; i < 6; i++) {
+        block[2 + i] = static_cast<u8>(index_bits >> (i * 8));
+    }
+}
+
+void encodeBC1Block(const u8* texels, u8* block) {
+    encodeColor(texels, block);
+}
+
+void encodeBC3Block(const u8* texels, u8* block) {
+    encodeAlpha(texels, block);
+    encodeColor(texels, block + 8);
+}
+
+// mode 6 endpoint: 7 bits per channel plus a p-bit shared by the channels
+struct BC7Endpoint {
+    u8 channels[4];
+    u8 p_bit;
+};
+
+// best of both p-bits for a float endpoint
+static BC7Endpoint quantizeBC7Endpoint(const float* color) {
+    BC7Endpoint best = {};
+    float best_error = -1.0f;
+    for (u8 p = 0; p < 2; p++) {
+        BC7Endpoint candidate = {};
+        candidate.p_bit = p;
+        float error = 0.0f;
+        for (u32 c = 0; c < 4; c++) {
+            int q = int(std::floor((color[c] - p) / 2.0f + 0.5f));
+            q = std::min(std::max(q, 0), 127);
+            candidate.channels[c] = static_cast<u8>(q);
+            float d = float((q << 1) | p) - color[c];
+            error += d * d;
+        }
+        if (best_error < 0.0f || error < best_error) {
+            best_error = error;
+            best = candidate;
+        }
+    }
+    return best;
+}
+
+struct BC7Block {
+    BC7Endpoint endpoints[2];
+    u8 indices[BLOCK_TEXELS];
+    u32 error;
+};
+
+static BC7Block fitBC7Block(const u8* texels, const float* e0, const float* e1) {
+    BC7Block result;
+    result.endpoints[0] = quantizeBC7Endpoint(e0);
+    result.endpoints[1] = quantizeBC7Endpoint(e1);
+
+    u8 ends[2][4];
+    for (u32 e = 0; e < 2; e++) {
+        for (u32 c = 0; c < 4; c++) {
+            ends[e][c] =
+                static_cast<u8>((result.endpoints[e].channels[c] << 1) | result.endpoints[e].p_bit);
+        }
+    }
+    u8 palette[16][4];
+    for (u32 i = 0; i < 16; i++) {
+        for (u32 c = 0; c < 4; c++) {
+            u32 w = BC7_WEIGHTS[i];
+            palette[i][c] = static_cast<u8>(((64 - w) * ends[0][c] + w * ends[1][c] + 32) >> 6);
+        }
+    }
+    result.error = pickIndices(texels, 4, palette, 16, result.indices);
+    return result;
+}
+
+// little endian bit stream of one 128 bit block
+struct BlockBits {
+    u8* block;
+    u32 position;
+
+    void write(u32 value, u32 bits) {
+        for (u32 i = 0; i < bits; i++, position++) {
+            if ((value >> i) & 1) {
+                block[position / 8] |= static_cast<u8>(1 << (position % 8));
+            }
+        }
+    }
+};
+
+void encodeBC7Block(const u8* texels, u8* block) {
+    float e0[4], e1[4];
+    principalEndpoints(texels, 4, e0, e1);
+    BC7Block best = fitBC7Block(texels, e0, e1);
+
+    if (best.error > 0) {
+        float weights[BLOCK_TEXELS];
+        for (u32 i = 0; i < BLOCK_TEXELS; i++) {
+            weights[i] = BC7_WEIGHTS[best.indices[i]] / 64.0f;
+        }
+        refitEndpoints(texels, 4, weights, e0, e1);
+        BC7Block refit = fitBC7Block(texels, e0, e1);
+        if (refit.error < best.error) {
+            best = refit;
+        }
+    }
+
+    // the anchor (first) index is stored without its top bit, so it has to be below 8
+    if (best.indices[0] >= 8) {
+        std::swap(best.endpoints[0], best.endpoints[1]);
+        for (u32 i = 0; i < BLOCK_TEXELS; i++) {
+            best.indices[i] = static_cast<u8>(15 - best.indices[i]);
+        }
+    }
+
+    memset(block, 0, 16);
+    BlockBits bits = {block, 0};
+    bits.write(1 << 6, 7); // mode 6
+    for (u32 c = 0; c < 4; c++) {
+        bits.write(best.endpoints[0].channels[c], 7);
+        bits.write(best.endpoints[1].channels[c], 7);
+    }
+    bits.write(best.endpoints[0].p_bit, 1);
+    bits.write(best.endpoints[1].p_bit, 1);
+    bits.write(best.indices[0], 3);
+    for (u32 i = 1; i < BLOCK_TEXELS; i++) {
+        bits.write(best.indices[i], 4);
+    }
+}
+
+u32 blockBytes(VkFormat format) {
+    switch (format) {
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        return 8;
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+VkDeviceSize mipLevelSize(VkFormat format, u32 width, u32 height) {
+    u32 block_bytes = blockBytes(format);
+    if (block_bytes == 0) {
+        return VkDeviceSize(width) * height * 4;
+    }
+    return VkDeviceSize((width + 3) / 4) * ((height + 3) / 4) * block_bytes;
+}
+
+std::vector<u8> compressMipChain(const u8* pixels, u32 width, u32 height, VkFormat format) {
+    u32 levels = mipLevelCount(width, height);
+    std::vector<u8> chain = buildMipChain(pixels, width, height);
+
+    VkDeviceSize total = 0;
+    for (u32 level = 0; level < levels; level++) {
+        total += mipLevelSize(format, mipExtent(width, level), mipExtent(height, level));
+    }
+    std::vector<u8> compressed(static_cast<size_t>(total));
+
+    u32 block_bytes = blockBytes(format);
+    const u8* level_pixels = pixels;
+    u8* out = compressed.data();
+    for (u32 level = 0; level < levels; level++) {
+        u32 level_width = mipExtent(width, level);
+        u32 level_height = mipExtent(height, level);
+
+        for (u32 by = 0; by < level_height; by += 4) {
+            for (u32 bx = 0; bx < level_width; bx += 4) {
+                u8 texels[BLOCK_TEXELS * 4];
+                for (u32 y = 0; y < 4; y++) {
+                    for (u32 x = 0; x < 4; x++) {
+                        u32 sx = std::min(bx + x, level_width - 1);
+                        u32 sy = std::min(by + y, level_height - 1);
+                        memcpy(texels + (y * 4 + x) * 4,
+                               level_pixels + (size_t(sy) * level_width + sx) * 4, 4);
+                    }
+                }
+                if (format == VK_FORMAT_BC7_UNORM_BLOCK) {
+                    encodeBC7Block(texels, out);
+                } else if (format == VK_FORMAT_BC3_UNORM_BLOCK) {
+                    encodeBC3Block(texels, out);
+                } else {
+                    encodeBC1Block(texels, out);
+                }
+                out += block_bytes;
+            }
+        }
+
+        // the next level follows this one in the CPU chain
+        level_pixels = level == 0 ? chain.data() : level_pixels + size_t(level_width) *
+                                                                      level_height * 4;
+    }
+    return compressed;
+}
+
+bool compressTextureFile(const std::string& source, const std::string& destination,
+                         const std::string& format_name) {
+    int width, height, channels;
+    stbi_uc* pixels = stbi_load(source.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if (!pixels) {
+        return false;
+    }
+
+    VkFormat format = VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+    if (format_name == "bc7") {
+        format = VK_FORMAT_BC7_UNORM_BLOCK;
+    } else if (format_name == "bc3") {
+        format = VK_FORMAT_BC3_UNORM_BLOCK;
+    } else if (format_name == "auto") {
+        size_t texel_count = size_t(width) * height;
+        for (size_t i = 0; i < texel_count; i++) {
+            if (pixels[i * 4 + 3] != 255) {
+                format = VK_FORMAT_BC3_UNORM_BLOCK;
+                break;
+            }
+        }
+    } else if (format_name != "bc1") {
+        stbi_image_free(pixels);
+        return false;
+    }
+
+    Ktx2Image image;
+    image.format = format;
+    image.width = static_cast<u32>(width);
+    image.height = static_cast<u32>(height);
+    image.level_count = mipLevelCount(image.width, image.height);
+    image.data = compressMipChain(pixels, image.width, image.height, format);
+    stbi_image_free(pixels);
+
+    return writeKtx2(destination, image);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <string>
+#include <vector>
+#include <GLFW/glfw3.h>
+#include "Utilities.h"
+
+// Block encoders take the 4x4 texels of one block as RGBA8, row by row (64 bytes)
+// BC1, 4 colour mode only, alpha is dropped (8 bytes)
+void encodeBC1Block(const u8* texels, u8* block);
+// BC3: BC1 style colour plus an 8 value alpha block (16 bytes)
+void encodeBC3Block(const u8* texels, u8* block);
+// BC7 mode 6: one subset, RGBA 7.7.7.7 endpoints with p-bits, 4 bit indices (16 bytes)
+void encodeBC7Block(const u8* texels, u8* block);
+
+// Bytes per 4x4 block of a block compressed format, 0 for anything else
+u32 blockBytes(VkFormat format);
+
+// Bytes of one level of an RGBA8 or block compressed image
+VkDeviceSize mipLevelSize(VkFormat format, u32 width, u32 height);
+
+// Every level of an RGBA8 image and its mip chain, compressed and packed level 0 first.
+// Partial blocks at the edges repeat the last row/column.
+std::vector<u8> compressMipChain(const u8* pixels, u32 width, u32 height, VkFormat format);
+
+// Offline tool: loads a PNG/JPG, builds its mips and writes them block compressed as KTX2.
+// format_name is "bc1", "bc3", "bc7" or "auto" (bc1 when opaque, bc3 otherwise).
+bool compressTextureFile(const std::string& source, const std::string& destination,
+                         const std::string& format_name);
@@ -0,0 +1,63 @@
+#include <vector>
+#include "TextureRegistry.h"
+
+TextureRegistry::TextureRegistry() {}
+
+TextureRegistry::~TextureRegistry() {}
+
+int TextureRegistry::acquire(const std::string& path, u64 content_hash) {
+    auto found = textures.find(Key(path, content_hash));
+    if (found == textures.end()) {
+        return -1;
+    }
+    found->second.references++;
+    return found->second.tex_id;
+}
+
+void TextureRegistry::add(const std::string& path, u64 content_hash, int tex_id) {
+    Key key(path, content_hash);
+    textures[key] = {tex_id, 1};
+    keys[tex_id] = key;
+}
+
+bool TextureRegistry::release(int tex_id) {
+    auto key = keys.find(tex_id);
+    if (key == keys.end()) {
+        return false;
+    }
+    auto found = textures.find(key->second);
+    if (--found->second.references > 0) {
+        return false;
+    }
+    textures.erase(found);
+    keys.erase(key);
+    return true;
+}
+
+std::string TextureRegistry::resolvePath(const std::string& name) {
+    // .mtl files written on windows use backslashes and relative segments
+    std::vector<std::string> parts = {"Textures"};
+    std::string part;
+    for (size_t i = 0; i <= name.size(); i++) {
+        char c = i < name.size() ? name[i] : '/';
+        if (c != '/' && c != '\\') {
+            part.push_back(c);
+            continue;
+        }
+        if (part == ".." && parts.size() > 1 && parts.back() != "..") {
+            parts.pop_back();
+        } else if (!part.empty() && part != ".") {
+            parts.push_back(part);
+        }
+        part.clear();
+    }
+
+    std::string path;
+    for (const std::string& p : parts) {
+        if (!path.empty()) {
+            path.push_back('/');
+        }
+        path += p;
+    }
+    return path;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <utility>
+#include "Utilities.h"
+
+// Textures shared between materials and models. An image is keyed by its resolved path and
+// the hash of the file's contents, so a file edited on disk loads as a new texture while the
+// old one lives on until its last user goes away. Only bookkeeping, the renderer owns the
+// Vulkan objects behind the ids.
+class TextureRegistry {
+public:
+    TextureRegistry();
+    ~TextureRegistry();
+
+    // texture already loaded for this file, with a reference taken; -1 when there is none
+    int acquire(const std::string& path, u64 content_hash);
+    // registers a freshly created texture holding one reference
+    void add(const std::string& path, u64 content_hash, int tex_id);
+    // drops a reference, true when it was the last one and the texture can go
+    bool release(int tex_id);
+
+    u32 getTextureCount() {
+        return static_cast<u32>(textures.size());
+    }
+
+    // "Textures/" + name with separators normalised, the same file always gives the same key
+    static std::string resolvePath(const std::string& name);
+
+private:
+    using Key = std::pair<std::string, u64>;
+
+    struct Entry {
+        int tex_id;
+        u32 references;
+    };
+
+    std::map<Key, Entry> textures;
+    std::map<int, Key> keys; // tex_id -> key, for release
+};
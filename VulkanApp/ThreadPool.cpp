@@ -0,0 +1,99 @@
+#include <algorithm>
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool() {}
+
+ThreadPool::~ThreadPool() {
+    destroy();
+}
+
+void ThreadPool::init(u32 thread_count) {
+    destroy();
+    if (thread_count == 0) {
+        // hardware_concurrency may report 0 when it can't tell
+        thread_count = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+    }
+
+    stopping = false;
+    for (u32 i = 0; i < thread_count; i++) {
+        workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+    }
+}
+
+void ThreadPool::destroy() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]() { return stopping || !tasks.empty(); });
+            if (tasks.empty()) {
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+void ThreadPool::parallelFor(u32 count, const std::function<void(u32)>& body) {
+    if (count == 0) {
+        return;
+    }
+    // helpers that only get to run after the caller finished find nothing left; they hold
+    // the state, never body's captures
+    auto state = std::make_shared<ParallelFor>();
+    state->body = body;
+    state->count = count;
+    u32 helpers = std::min(static_cast<u32>(workers.size()), count - 1);
+    if (helpers > 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (u32 i = 0; i < helpers; i++) {
+            tasks.push_back([state]() { runParallelFor(state.get()); });
+        }
+    }
+    for (u32 i = 0; i < helpers; i++) {
+        wake.notify_one();
+    }
+
+    runParallelFor(state.get());
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->finished.wait(lock, [&state]() { return state->completed == state->count; });
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+}
+
+void ThreadPool::runParallelFor(ParallelFor* state) {
+    u32 done = 0;
+    for (u32 i = state->next++; i < state->count; i = state->next++) {
+        try {
+            state->body(i);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (!state->error) {
+                state->error = std::current_exception();
+            }
+        }
+        done++;
+    }
+    if (done > 0) {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->completed += done;
+        if (state->completed == state->count) {
+            state->finished.notify_all();
+        }
+    }
+}
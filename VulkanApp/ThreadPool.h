@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "Utilities.h"
+
+// Fixed set of worker threads pulling tasks off one queue. Used for the CPU heavy parts of
+// asset loading (decoding, mesh processing); nothing on a worker may touch Vulkan.
+class ThreadPool {
+public:
+    ThreadPool();
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // 0 picks one thread per hardware thread, less the one the caller runs on
+    void init(u32 thread_count = 0);
+    // runs what is already queued, then joins the workers
+    void destroy();
+
+    u32 getThreadCount() {
+        return static_cast<u32>(workers.size());
+    }
+
+    // exceptions thrown by the task come out of the future's get()
+    template <typename Task>
+    std::future<decltype(std::declval<Task&>()())> submit(Task task) {
+        using Result = decltype(std::declval<Task&>()());
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::move(task));
+        std::future<Result> result = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back([packaged]() { (*packaged)(); });
+        }
+        wake.notify_one();
+        return result;
+    }
+
+    // Runs body(0) .. body(count - 1) over the workers and the calling thread, which takes
+    // indices too and returns once all of them are done. It never waits on a helper that
+    // hasn't started, so tasks can call it without tying up the pool. Indices are handed out
+    // in order; the first exception a body throws is rethrown here.
+    void parallelFor(u32 count, const std::function<void(u32)>& body);
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    struct ParallelFor {
+        std::function<void(u32)> body;
+        u32 count = 0;
+        std::atomic<u32> next{0};
+        std::mutex mutex;
+        std::condition_variable finished;
+        u32 completed = 0;
+        std::exception_ptr error;
+    };
+
+    void workerLoop();
+    static void runParallelFor(ParallelFor* state);
+};
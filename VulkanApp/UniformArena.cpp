@@ -0,0 +1,44 @@
+#include <algorithm>
+#include "UniformArena.h"
+
+UniformArena::UniformArena() {}
+
+UniformArena::~UniformArena() {}
+
+void UniformArena::init(MemoryAllocator* new_allocator, VkDeviceSize min_alignment,
+                        VkDeviceSize new_frame_size) {
+    allocator = new_allocator;
+    alignment = std::max<VkDeviceSize>(min_alignment, 1);
+    frame_size = (new_frame_size + alignment - 1) / alignment * alignment;
+
+    allocator->createBuffer(frame_size * MAX_FRAME_DRAWS, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                            MemoryCategory::Uniform, &buffer, &memory);
+    beginFrame(0);
+}
+
+void UniformArena::destroy() {
+    if (buffer != VK_NULL_HANDLE) {
+        allocator->destroyBuffer(buffer, memory);
+        buffer = VK_NULL_HANDLE;
+    }
+}
+
+void UniformArena::beginFrame(u32 frame) {
+    frame_begin = frame_size * frame;
+    head = frame_begin;
+}
+
+UniformAllocation UniformArena::allocate(VkDeviceSize size) {
+    VkDeviceSize offset = (head + alignment - 1) / alignment * alignment;
+    if (offset + size > frame_begin + frame_size) {
+        throw std::runtime_error("Uniform arena is out of space for this frame");
+    }
+    head = offset + size;
+
+    UniformAllocation allocation;
+    allocation.mapped = static_cast<u8*>(memory.mapped) + offset;
+    allocation.offset = static_cast<u32>(offset);
+    return allocation;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <cstring>
+#include <vector>
+#include <GLFW/glfw3.h>
+#include "MemoryAllocator.h"
+#include "Utilities.h"
+
+// Uniform space available to each frame in flight
+const VkDeviceSize UNIFORM_ARENA_FRAME_SIZE = 1024 * 1024;
+
+struct UniformAllocation {
+    void* mapped = nullptr;
+    u32 offset = 0; // dynamic offset to bind the data with
+};
+
+// One persistently mapped uniform buffer split into a region per frame in flight.
+// Each frame bump-allocates from its own region, which is reset once the frame's fence
+// has signalled, so nothing is mapped or unmapped on the hot path.
+class UniformArena {
+public:
+    UniformArena();
+    ~UniformArena();
+
+    void init(MemoryAllocator* allocator, VkDeviceSize min_alignment,
+              VkDeviceSize frame_size = UNIFORM_ARENA_FRAME_SIZE);
+    void destroy();
+
+    // start filling the region of frame, only after its fence has been waited on
+    void beginFrame(u32 frame);
+    UniformAllocation allocate(VkDeviceSize size);
+
+    // copy data into the current frame, returns its dynamic offset
+    template <typename T>
+    u32 push(const T& data) {
+        UniformAllocation allocation = allocate(sizeof(T));
+        memcpy(allocation.mapped, &data, sizeof(T));
+        return allocation.offset;
+    }
+
+    VkBuffer getBuffer() {
+        return buffer;
+    }
+
+private:
+    MemoryAllocator* allocator;
+
+    VkBuffer buffer = VK_NULL_HANDLE;
+    MemoryAllocation memory;
+    VkDeviceSize alignment = 0;
+    VkDeviceSize frame_size = 0;
+
+    VkDeviceSize frame_begin = 0;
+    VkDeviceSize head = 0;
+};
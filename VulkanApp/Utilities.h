@@ -2,6 +2,8 @@
 
 #include <fstream>
 #include <iostream>
+#include <stdexcept>
+#include <vector>
 #include <glm/glm.hpp>
 
 #define GLFW_INCLUDE_VULKAN
@@ -45,6 +47,7 @@ typedef struct VkDev {
 struct QueueFamilyIndices {
     int graphics_family = -1;
     int presentation_family = -1;
+    int transfer_family = -1; // graphics_family when there is no separate transfer family
 
     bool isValid() {
         return graphics_family >= 0 && presentation_family >= 0;
@@ -77,107 +80,51 @@ static std::vector<char> readFile(const std::string& filename) {
     return file_buffer;
 }
 
-static uint32_t findMemoryTypeIndex(VkPhysicalDevice physcial_device, uint32_t allowed_types,
-                                    VkMemoryPropertyFlags properties) {
-    VkPhysicalDeviceMemoryProperties memprops;
-    vkGetPhysicalDeviceMemoryProperties(physcial_device, &memprops);
+// 64-bit FNV-1a, chain calls by passing the previous hash
+const u64 FNV1A_OFFSET_BASIS = 0xcbf29ce484222325ull;
+const u64 FNV1A_PRIME = 0x100000001b3ull;
 
+static u64 fnv1a64(const void* data, size_t size, u64 hash = FNV1A_OFFSET_BASIS) {
+    const u8* bytes = static_cast<const u8*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= FNV1A_PRIME;
+    }
+    return hash;
+}
+
+static uint32_t findMemoryTypeIndex(const VkPhysicalDeviceMemoryProperties& memprops,
+                                    uint32_t allowed_types, VkMemoryPropertyFlags properties) {
     for (u32 i = 0; i < memprops.memoryTypeCount; i++) {
         if ((allowed_types & (1 << i)) &&
             (memprops.memoryTypes[i].propertyFlags & properties) == properties) {
             return i;
         }
     }
+    throw std::runtime_error("Failed to find a suitable memory type");
 }
 
-static void createBuffer(VkPhysicalDevice physcial_device, VkDevice device,
-                         VkDeviceSize buffer_size, VkBufferUsageFlags buffer_usage,
-                         VkMemoryPropertyFlags properties, VkBuffer* buffer,
-                         VkDeviceMemory* buffermem) {
-    VkBufferCreateInfo buffer_info = {};
-    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    buffer_info.size = buffer_size;
-    buffer_info.usage = buffer_usage;
-    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-    VKRes(vkCreateBuffer(device, &buffer_info, nullptr, buffer));
-
-    // Get buffer memory reqs
-    VkMemoryRequirements memreqs;
-    vkGetBufferMemoryRequirements(device, *buffer, &memreqs);
-
-    VkMemoryAllocateInfo memalloc_info = {};
-    memalloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    memalloc_info.allocationSize = memreqs.size;
-    memalloc_info.memoryTypeIndex =
-        findMemoryTypeIndex(physcial_device, memreqs.memoryTypeBits, properties);
-
-    VKRes(vkAllocateMemory(device, &memalloc_info, nullptr, buffermem));
-
-    vkBindBufferMemory(device, *buffer, *buffermem, 0);
-}
-
-static VkCommandBuffer beginCommandBuffer(VkDevice device, VkCommandPool command_pool) {
-    VkCommandBuffer cmd_buffer;
-
-    VkCommandBufferAllocateInfo alloc_info = {};
-    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    alloc_info.commandPool = command_pool;
-    alloc_info.commandBufferCount = 1;
-
-    vkAllocateCommandBuffers(device, &alloc_info, &cmd_buffer);
-
-    VkCommandBufferBeginInfo begin_info = {};
-    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-    vkBeginCommandBuffer(cmd_buffer, &begin_info);
-    return cmd_buffer;
-}
-
-static void endCommandBuffer(VkDevice device, VkCommandPool command_pool, VkQueue queue,
-                             VkCommandBuffer command_buffer) {
-    vkEndCommandBuffer(command_buffer);
-
-    VkSubmitInfo submit_info = {};
-    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &command_buffer;
-
-    vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE);
-    vkQueueWaitIdle(queue);
-
-    vkFreeCommandBuffers(device, command_pool, 1, &command_buffer);
-}
-
-static void copyBuffer(VkDevice device, VkQueue transfer_queue, VkCommandPool transfer_cmd_pool,
-                       VkBuffer src, VkBuffer dst, VkDeviceSize buffer_size) {
-
-    VkCommandBuffer transfer_cmd_buffer = beginCommandBuffer(device, transfer_cmd_pool);
-
+// The copy helpers only record, the caller decides when the command buffer is submitted
+static void copyBuffer(VkCommandBuffer transfer_cmd_buffer, VkBuffer src, VkBuffer dst,
+                       VkDeviceSize buffer_size, VkDeviceSize src_offset = 0,
+                       VkDeviceSize dst_offset = 0) {
     VkBufferCopy buffer_copy_region = {};
-    buffer_copy_region.srcOffset = 0;
-    buffer_copy_region.dstOffset = 0;
+    buffer_copy_region.srcOffset = src_offset;
+    buffer_copy_region.dstOffset = dst_offset;
     buffer_copy_region.size = buffer_size;
 
     vkCmdCopyBuffer(transfer_cmd_buffer, src, dst, 1, &buffer_copy_region);
-
-    endCommandBuffer(device, transfer_cmd_pool, transfer_queue, transfer_cmd_buffer);
 }
 
-static void copyImageBuffer(VkDevice device, VkQueue transfer_queue,
-                            VkCommandPool transfer_cmd_pool, VkBuffer src, VkImage dst, u32 width,
-                            u32 height) {
-
-    VkCommandBuffer transfer_cmd_buffer = beginCommandBuffer(device, transfer_cmd_pool);
-
+static void copyImageBuffer(VkCommandBuffer transfer_cmd_buffer, VkBuffer src,
+                            VkDeviceSize src_offset, VkImage dst, u32 width, u32 height,
+                            u32 mip_level = 0) {
     VkBufferImageCopy img_region = {};
-    img_region.bufferOffset = 0;
+    img_region.bufferOffset = src_offset;
     img_region.bufferRowLength = 0;
     img_region.bufferImageHeight = 0;
     img_region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    img_region.imageSubresource.mipLevel = 0;
+    img_region.imageSubresource.mipLevel = mip_level;
     img_region.imageSubresource.baseArrayLayer = 0;
     img_region.imageSubresource.layerCount = 1;
     img_region.imageOffset = {0, 0, 0};
@@ -185,15 +132,11 @@ static void copyImageBuffer(VkDevice device, VkQueue transfer_queue,
 
     vkCmdCopyBufferToImage(transfer_cmd_buffer, src, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
                            &img_region);
-
-    endCommandBuffer(device, transfer_cmd_pool, transfer_queue, transfer_cmd_buffer);
 }
 
-static void transitionImageLayout(VkDevice device, VkQueue queue, VkCommandPool command_pool,
-                                  VkImage image, VkImageLayout old_layout,
-                                  VkImageLayout new_layout) {
-    VkCommandBuffer cmd_buffer = beginCommandBuffer(device, command_pool);
-
+static void transitionImageLayout(VkCommandBuffer cmd_buffer, VkImage image,
+                                  VkImageLayout old_layout, VkImageLayout new_layout,
+                                  u32 mip_levels = 1) {
     VkImageMemoryBarrier mem_barrier = {};
     mem_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
     mem_barrier.oldLayout = old_layout;
@@ -203,7 +146,7 @@ static void transitionImageLayout(VkDevice device, VkQueue queue, VkCommandPool
     mem_barrier.image = image;
     mem_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     mem_barrier.subresourceRange.baseMipLevel = 0;
-    mem_barrier.subresourceRange.levelCount = 1;
+    mem_barrier.subresourceRange.levelCount = mip_levels;
     mem_barrier.subresourceRange.baseArrayLayer = 0;
     mem_barrier.subresourceRange.layerCount = 1;
 
@@ -229,6 +172,58 @@ static void transitionImageLayout(VkDevice device, VkQueue queue, VkCommandPool
 
     vkCmdPipelineBarrier(cmd_buffer, src_stage, dst_stage, 0, 0, nullptr, 0, nullptr, 1,
                          &mem_barrier);
+}
+
+// Fills levels 1.. of an image whose level 0 was just written (all levels in TRANSFER_DST),
+// each one blitted from the one above. Needs a graphics queue and a format with linear
+// blit support. Every level ends up in TRANSFER_SRC.
+static void recordMipmapBlits(VkCommandBuffer cmd_buffer, VkImage image, u32 width, u32 height,
+                              u32 mip_levels) {
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    int32_t level_width = static_cast<int32_t>(width);
+    int32_t level_height = static_cast<int32_t>(height);
+    for (u32 level = 1; level < mip_levels; level++) {
+        // the level above is done being written, read from it next
+        barrier.subresourceRange.baseMipLevel = level - 1;
+        vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                             &barrier);
+
+        int32_t next_width = level_width > 1 ? level_width / 2 : 1;
+        int32_t next_height = level_height > 1 ? level_height / 2 : 1;
+
+        VkImageBlit blit = {};
+        blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.srcSubresource.mipLevel = level - 1;
+        blit.srcSubresource.baseArrayLayer = 0;
+        blit.srcSubresource.layerCount = 1;
+        blit.srcOffsets[1] = {level_width, level_height, 1};
+        blit.dstSubresource = blit.srcSubresource;
+        blit.dstSubresource.mipLevel = level;
+        blit.dstOffsets[1] = {next_width, next_height, 1};
+
+        vkCmdBlitImage(cmd_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image,
+                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+        level_width = next_width;
+        level_height = next_height;
+    }
 
-    endCommandBuffer(device, command_pool, queue, cmd_buffer);
+    // the last level was only written
+    barrier.subresourceRange.baseMipLevel = mip_levels - 1;
+    vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
 }
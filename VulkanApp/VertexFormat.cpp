@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "VertexFormat.h"
+
+static u16 quantizeUnorm16(float value) {
+    float clamped = std::min(std::max(value, 0.0f), 1.0f);
+    return static_cast<u16>(clamped * 65535.0f + 0.5f);
+}
+
+u16 floatToHalf(float value) {
+    u32 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    u32 sign = (bits >> 16) & 0x8000;
+    u32 magnitude = bits & 0x7FFFFFFF;
+
+    // inf and nan keep their class
+    if (magnitude >= 0x7F800000) {
+        return static_cast<u16>(sign | 0x7C00 | (magnitude > 0x7F800000 ? 0x200 : 0));
+    }
+    // 65520 and up round to infinity
+    if (magnitude >= 0x477FF000) {
+        return static_cast<u16>(sign | 0x7C00);
+    }
+    // below the smallest normal half: a denormal in units of 2^-24, rounded to even
+    if (magnitude < 0x38800000) {
+        if (magnitude < 0x33000000) {
+            return static_cast<u16>(sign);
+        }
+        u32 exponent = magnitude >> 23;
+        u32 mantissa = (magnitude & 0x7FFFFF) | 0x800000;
+        u32 shift = 126 - exponent;
+        u32 result = mantissa >> shift;
+        u32 remainder = mantissa & ((1u << shift) - 1);
+        u32 halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (result & 1))) {
+            result++;
+        }
+        return static_cast<u16>(sign | result);
+    }
+    // rebias the exponent, round the 13 dropped mantissa bits to even
+    u32 rebiased = magnitude - 0x38000000;
+    return static_cast<u16>(sign | ((rebiased + 0xFFF + ((rebiased >> 13) & 1)) >> 13));
+}
+
+static float readComponent(const u8* element, u32 c, ComponentType type) {
+    switch (type) {
+    case ComponentType::UNorm8:
+        return element[c] / 255.0f;
+    case ComponentType::UNorm16: {
+        u16 value;
+        memcpy(&value, element + c * sizeof(u16), sizeof(value));
+        return value / 65535.0f;
+    }
+    default: {
+        float value;
+        memcpy(&value, element + c * sizeof(float), sizeof(value));
+        return value;
+    }
+    }
+}
+
+Vertex VertexSource::get(u32 i) const {
+    if (vertices) {
+        return vertices[i];
+    }
+    Vertex vertex;
+    const u8* position = positions.data + size_t(positions.stride) * i;
+    for (u32 c = 0; c < 3; c++) {
+        vertex.pos[c] = readComponent(position, c, ComponentType::Float);
+    }
+    vertex.col = glm::vec3(1.0f);
+    vertex.tex = glm::vec2(0.0f);
+    if (uvs.data) {
+        const u8* uv = uvs.data + size_t(uvs.stride) * i;
+        vertex.tex = glm::vec2(readComponent(uv, 0, uvs.type), readComponent(uv, 1, uvs.type));
+    }
+    return vertex;
+}
+
+bool compactVertices(const VertexSource& source, CompactMesh* mesh) {
+    u32 count = source.count;
+    if (count == 0) {
+        return false;
+    }
+
+    // one color for the whole mesh, LoadMeshData writes white everywhere
+    glm::vec3 color = source.get(0).col;
+    for (u32 c = 0; c < 3; c++) {
+        if (!(color[c] >= 0.0f && color[c] <= 1.0f)) {
+            return false;
+        }
+    }
+    glm::vec3 low = source.get(0).pos;
+    glm::vec3 high = low;
+    bool unorm_uv = true;
+    for (u32 i = 0; i < count; i++) {
+        Vertex vertex = source.get(i);
+        if (vertex.col != color) {
+            return false;
+        }
+        low = glm::min(low, vertex.pos);
+        high = glm::max(high, vertex.pos);
+        for (u32 c = 0; c < 2; c++) {
+            float uv = vertex.tex[c];
+            if (!(std::fabs(uv) <= HALF_UV_RANGE)) {
+                return false;
+            }
+            unorm_uv = unorm_uv && uv >= 0.0f && uv <= 1.0f;
+        }
+    }
+    for (u32 c = 0; c < 3; c++) {
+        if (!std::isfinite(low[c]) || !std::isfinite(high[c])) {
+            return false;
+        }
+    }
+
+    // a flat axis keeps scale 1, every vertex quantizes to 0 on it
+    glm::vec3 extent = high - low;
+    for (u32 c = 0; c < 3; c++) {
+        mesh->scale[c] = extent[c] > 0.0f ? extent[c] : 1.0f;
+    }
+    mesh->low = low;
+    mesh->format = unorm_uv ? VertexFormat::Quantized : VertexFormat::QuantizedHalfUV;
+
+    mesh->dequantize = glm::mat4(1.0f);
+    mesh->dequantize[0][0] = mesh->scale.x;
+    mesh->dequantize[1][1] = mesh->scale.y;
+    mesh->dequantize[2][2] = mesh->scale.z;
+    mesh->dequantize[3] = glm::vec4(low, 1.0f);
+
+    mesh->color = 0xFF000000;
+    for (u32 c = 0; c < 3; c++) {
+        mesh->color |= u32(color[c] * 255.0f + 0.5f) << (c * 8);
+    }
+    return true;
+}
+
+void writeCompactVertices(const VertexSource& source, const CompactMesh& mesh,
+                          CompactVertex* out) {
+    bool unorm_uv = mesh.format == VertexFormat::Quantized;
+    for (u32 i = 0; i < source.count; i++) {
+        Vertex vertex = source.get(i);
+        // built on the stack and stored whole, out may be write-combined memory
+        CompactVertex compact;
+        glm::vec3 normalized = (vertex.pos - mesh.low) / mesh.scale;
+        for (u32 c = 0; c < 3; c++) {
+            compact.pos[c] = quantizeUnorm16(normalized[c]);
+        }
+        compact.pos[3] = 0;
+        for (u32 c = 0; c < 2; c++) {
+            compact.tex[c] = unorm_uv ? quantizeUnorm16(vertex.tex[c]) : floatToHalf(vertex.tex[c]);
+        }
+        out[i] = compact;
+    }
+}
+
+void writeVertices(const VertexSource& source, Vertex* out) {
+    if (source.vertices) {
+        memcpy(out, source.vertices, sizeof(Vertex) * source.count);
+        return;
+    }
+    for (u32 i = 0; i < source.count; i++) {
+        out[i] = source.get(i);
+    }
+}
+
+VkDeviceSize vertexStride(VertexFormat format) {
+    return format == VertexFormat::Float ? sizeof(Vertex) : sizeof(CompactVertex);
+}
+
+void describeVertexFormat(VertexFormat format,
+                          std::vector<VkVertexInputBindingDescription>* bindings,
+                          std::vector<VkVertexInputAttributeDescription>* attributes) {
+    bindings->clear();
+    attributes->clear();
+
+    // data for a single vertex as a whole
+    VkVertexInputBindingDescription binding_desc = {};
+    binding_desc.binding = 0;
+    binding_desc.stride = static_cast<u32>(vertexStride(format));
+    binding_desc.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    bindings->push_back(binding_desc);
+
+    // how data for an attibute is defined within a vertex: position, color, texture
+    if (format == VertexFormat::Float) {
+        attributes->push_back({0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, pos)});
+        attributes->push_back({1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, col)});
+        attributes->push_back({2, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, tex)});
+        return;
+    }
+
+    // the mesh color, one element per draw
+    binding_desc.binding = 1;
+    binding_desc.stride = sizeof(u32);
+    binding_desc.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+    bindings->push_back(binding_desc);
+
+    VkFormat tex_format = format == VertexFormat::Quantized ? VK_FORMAT_R16G16_UNORM
+                                                            : VK_FORMAT_R16G16_SFLOAT;
+    attributes->push_back({0, 0, VK_FORMAT_R16G16B16A16_UNORM, offsetof(CompactVertex, pos)});
+    attributes->push_back({1, 1, VK_FORMAT_R8G8B8A8_UNORM, 0});
+    attributes->push_back({2, 0, tex_format, offsetof(CompactVertex, tex)});
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <vector>
+#include <GLFW/glfw3.h>
+#include "Utilities.h"
+
+// Layouts a mesh can sit in on the GPU, each one gets its own pipeline
+enum class VertexFormat : u32 {
+    Float,           // Vertex, 32 bytes
+    Quantized,       // CompactVertex, unorm16 position and unorm16 uv
+    QuantizedHalfUV, // CompactVertex, unorm16 position and half float uv
+};
+const u32 VERTEX_FORMAT_COUNT = 3;
+
+// Half float uvs are only used inside [-range, range], they lose about a texel of a 1024
+// texture at the edges. Larger uvs keep the float format.
+const float HALF_UV_RANGE = 2.0f;
+
+// Meshes with at most this many vertices get 16-bit indices
+const u32 MAX_INDEX16_VERTICES = 1 << 16;
+
+// 12 bytes: position quantized over the mesh bounds (w unused) and uv as unorm16 or half.
+// The color is the same for the whole mesh and lives in a separate one element range.
+struct CompactVertex {
+    u16 pos[4];
+    u16 tex[2];
+};
+
+// Component types of attributes read in place, as glTF stores them
+enum class ComponentType : u32 {
+    Float,
+    UNorm8,  // normalized to [0, 1]
+    UNorm16, // normalized to [0, 1]
+    UInt8,
+    UInt16,
+    UInt32,
+};
+
+// A strided array in someone else's memory, e.g. a glTF accessor in a mapped file: element i
+// starts at data + i * stride
+struct AttributeView {
+    const u8* data = nullptr;
+    u32 stride = 0;
+    ComponentType type = ComponentType::Float;
+};
+
+// The vertices of a mesh, either as Vertex or as attribute views read in place: float3
+// positions and optionally float, unorm8 or unorm16 uvs; those are white
+struct VertexSource {
+    const Vertex* vertices = nullptr;
+    AttributeView positions;
+    AttributeView uvs;
+    u32 count = 0;
+
+    VertexSource() {}
+    VertexSource(const Vertex* new_vertices, u32 new_count)
+        : vertices(new_vertices), count(new_count) {}
+
+    Vertex get(u32 i) const;
+};
+
+// How a mesh packs into a compact format; the vertices themselves are written straight to
+// where they go with writeCompactVertices
+struct CompactMesh {
+    VertexFormat format = VertexFormat::Float;
+    glm::vec3 low = glm::vec3(0.0f);
+    glm::vec3 scale = glm::vec3(1.0f);
+    glm::mat4 dequantize = glm::mat4(1.0f); // unorm16 position -> mesh space
+    u32 color = 0;                          // RGBA8
+};
+
+// Fails when the mesh has no compact form: colors that vary or leave [0, 1], or uvs outside
+// the half float range
+bool compactVertices(const VertexSource& source, CompactMesh* mesh);
+void writeCompactVertices(const VertexSource& source, const CompactMesh& mesh,
+                          CompactVertex* out);
+// interleaves the source into Vertex, a plain copy when it already is; out is only written
+void writeVertices(const VertexSource& source, Vertex* out);
+
+u16 floatToHalf(float value);
+
+VkDeviceSize vertexStride(VertexFormat format);
+
+// Vertex input state of a format. Binding 0 carries the vertices, compact formats read the
+// color from binding 1 at instance rate, so a draw selects it with firstInstance.
+void describeVertexFormat(VertexFormat format,
+                          std::vector<VkVertexInputBindingDescription>* bindings,
+                          std::vector<VkVertexInputAttributeDescription>* attributes);
@@ -1,7 +1,31 @@
 #include <array>
+#include <cctype>
+#include <cfloat>
+#include <chrono>
 #include <iostream>
 #include "VulkanRenderer.h"
 
+// Assimp post-processing for every model, part of the mesh cache key
+static const u32 MODEL_IMPORT_FLAGS =
+    aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices;
+
+// lowercase extension without the dot
+static std::string fileExtension(const std::string& filename) {
+    std::string extension = filename.substr(filename.find_last_of('.') + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](char c) { return static_cast<char>(std::tolower(c)); });
+    return extension;
+}
+
+static bool isObjFile(const std::string& filename) {
+    return fileExtension(filename) == "obj";
+}
+
+static bool isGltfFile(const std::string& filename) {
+    std::string extension = fileExtension(filename);
+    return extension == "gltf" || extension == "glb";
+}
+
 VulkanRenderer::VulkanRenderer() {}
 
 VulkanRenderer::~VulkanRenderer() {}
@@ -10,12 +34,21 @@ int VulkanRenderer::init(GLFWwindow* newWindow) {
     window = newWindow;
 
     try {
+        // before the instance, everything Vulkan allocates on the host goes through it
+        host_allocator.init(true);
+        host_callbacks = host_allocator.callbacks();
+        loader_pool.init();
+        // optional, everything it doesn't have is read from loose files
+        asset_pack.open(ASSET_PACK_FILENAME);
+
         createInstance();
         createDebugMessenger();
 
         createSurface();
         getPhysicalDevice();
         createLogicalDevice();
+        allocator.init(instance, mainDevice, memory_budget_enabled, dedicated_allocation_enabled,
+                       &host_allocator);
         createSwapchain();
         createRenderPass();
         createDescriptorSetLayout();
@@ -29,6 +62,13 @@ int VulkanRenderer::init(GLFWwindow* newWindow) {
         createFramebuffers();
         createCommandPool();
         createCommandBuffers();
+        staging.init(&allocator, mainDevice.logical_device,
+                     getQueueFamilies(mainDevice.physical_device), transfer_queue,
+                     transfer_command_pool);
+        geometry.init(&allocator, mainDevice.logical_device, &staging);
+        // a dedicated transfer queue can't blit, the chains are built on the CPU instead
+        blit_mipmaps = !staging.separateFamilies() && supportsLinearBlit(VK_FORMAT_R8G8B8A8_UNORM);
+        findCompressedFormats();
         createTextureSampler();
         // allocateDynamicBufferTransferSpace();
         createUniformBuffers();
@@ -45,6 +85,7 @@ int VulkanRenderer::init(GLFWwindow* newWindow) {
         ubo_view_proj.projection[1][1] *= -1;
 
         createTexture("plain.png"); // default missing texture
+        staging.flush();
 
     } catch (const std::runtime_error& e) {
         printf("Error: %s\n", e.what());
@@ -61,20 +102,32 @@ void VulkanRenderer::updateModel(int id, glm::mat4 new_model) {
 }
 
 void VulkanRenderer::draw() {
+    // models loading in the background get this frame's share of uploads
+    streamModelLoads(MODEL_UPLOAD_BYTES_PER_FRAME, false);
+    // submit uploads recorded since the last frame ahead of the frame that reads them
+    staging.flush();
+
     // 1. get next available image, signal that it's ready to draw (semaphore)
 
     vkWaitForFences(mainDevice.logical_device, 1, &draw_fences[current_frame], VK_TRUE,
                     std::numeric_limits<uint64_t>::max());
     vkResetFences(mainDevice.logical_device, 1, &draw_fences[current_frame]);
 
+    // the GPU is done with this frame's uniforms
+    uniforms.beginFrame(current_frame);
+    host_allocator.beginFrame();
+    // and with everything retired MAX_FRAME_DRAWS frames ago
+    geometry.beginFrame(frame_number);
+    releaseRetiredTextures(frame_number);
+
     uint32_t img_index;
     vkAcquireNextImageKHR(mainDevice.logical_device, swapchain,
                           std::numeric_limits<uint64_t>::max(), image_available[current_frame],
                           VK_NULL_HANDLE, &img_index);
 
-    recordCommands(img_index);
+    updateUniformBuffers();
 
-    updateUniformBuffers(img_index);
+    recordCommands(img_index);
 
     // 2. submit cmd buffer to queue for exec, waits for image to be signalled as
     // available. signal when done
@@ -105,79 +158,89 @@ void VulkanRenderer::draw() {
     VKRes(vkQueuePresentKHR(presentation_queue, &pres_info));
 
     current_frame = (current_frame + 1) % MAX_FRAME_DRAWS;
+    frame_number++;
 }
 
 void VulkanRenderer::cleanup() {
 
     vkDeviceWaitIdle(mainDevice.logical_device);
+    loader_pool.destroy();
+    // the arena and texture teardown below take what half loaded models uploaded
+    for (ModelLoad& load : model_loads) {
+        discardTextures(&load.textures);
+    }
+    model_loads.clear();
 
     for (size_t i = 0; i < models.size(); i++) {
         models[i].destroyMeshModel();
     }
+    geometry.destroy();
+    staging.destroy();
+    releaseRetiredTextures(std::numeric_limits<u64>::max());
 
     //_aligned_free(model_transfer_space);
-    vkDestroyDescriptorPool(mainDevice.logical_device, sampler_descriptor_pool, nullptr);
-    vkDestroyDescriptorPool(mainDevice.logical_device, input_descriptor_pool, nullptr);
-    vkDestroyDescriptorSetLayout(mainDevice.logical_device, sampler_set_layout, nullptr);
+    vkDestroyDescriptorPool(mainDevice.logical_device, sampler_descriptor_pool, host_callbacks);
+    vkDestroyDescriptorPool(mainDevice.logical_device, input_descriptor_pool, host_callbacks);
+    vkDestroyDescriptorSetLayout(mainDevice.logical_device, sampler_set_layout, host_callbacks);
 
-    vkDestroySampler(mainDevice.logical_device, texture_sampler, nullptr);
+    vkDestroySampler(mainDevice.logical_device, texture_sampler, host_callbacks);
 
     for (size_t i = 0; i < texture_images.size(); ++i) {
-        vkDestroyImageView(mainDevice.logical_device, texture_image_views[i], nullptr);
-        vkDestroyImage(mainDevice.logical_device, texture_images[i], nullptr);
-        vkFreeMemory(mainDevice.logical_device, texture_image_memory[i], nullptr);
+        vkDestroyImageView(mainDevice.logical_device, texture_image_views[i], host_callbacks);
+        vkDestroyImage(mainDevice.logical_device, texture_images[i], host_callbacks);
+        allocator.free(texture_image_memory[i]);
     }
     for (size_t i = 0; i < depth_image.size(); i++) {
-        vkDestroyImageView(mainDevice.logical_device, depth_image_view[i], nullptr);
-        vkDestroyImage(mainDevice.logical_device, depth_image[i], nullptr);
-        vkFreeMemory(mainDevice.logical_device, depth_image_memory[i], nullptr);
+        vkDestroyImageView(mainDevice.logical_device, depth_image_view[i], host_callbacks);
+        vkDestroyImage(mainDevice.logical_device, depth_image[i], host_callbacks);
+        allocator.free(depth_image_memory[i]);
     }
     for (size_t i = 0; i < color_image.size(); i++) {
-        vkDestroyImageView(mainDevice.logical_device, color_image_view[i], nullptr);
-        vkDestroyImage(mainDevice.logical_device, color_image[i], nullptr);
-        vkFreeMemory(mainDevice.logical_device, color_image_memory[i], nullptr);
+        vkDestroyImageView(mainDevice.logical_device, color_image_view[i], host_callbacks);
+        vkDestroyImage(mainDevice.logical_device, color_image[i], host_callbacks);
+        allocator.free(color_image_memory[i]);
     }
-    vkDestroyDescriptorPool(mainDevice.logical_device, descriptor_pool, nullptr);
+    vkDestroyDescriptorPool(mainDevice.logical_device, descriptor_pool, host_callbacks);
 
-    vkDestroyDescriptorSetLayout(mainDevice.logical_device, input_set_layout, nullptr);
+    vkDestroyDescriptorSetLayout(mainDevice.logical_device, input_set_layout, host_callbacks);
 
-    vkDestroyDescriptorSetLayout(mainDevice.logical_device, descriptor_set_layout, nullptr);
+    vkDestroyDescriptorSetLayout(mainDevice.logical_device, descriptor_set_layout, host_callbacks);
+    uniforms.destroy();
     for (size_t i = 0; i < swapchain_images.size(); i++) {
-        vkDestroyBuffer(mainDevice.logical_device, vp_uniform_buffer[i], nullptr);
-        vkFreeMemory(mainDevice.logical_device, vp_uniform_buffer_memory[i], nullptr);
         // vkDestroyBuffer(mainDevice.logical_device, model_uniform_buffer[i],
         // nullptr); vkFreeMemory(mainDevice.logical_device,
         // model_uniform_buffer_memory[i], nullptr);
     }
-    for (auto mesh : meshes) {
-        mesh.destroyBuffers();
-    }
-
     for (size_t i = 0; i < MAX_FRAME_DRAWS; i++) {
-        vkDestroySemaphore(mainDevice.logical_device, render_finished[i], nullptr);
-        vkDestroySemaphore(mainDevice.logical_device, image_available[i], nullptr);
-        vkDestroyFence(mainDevice.logical_device, draw_fences[i], nullptr);
+        vkDestroySemaphore(mainDevice.logical_device, render_finished[i], host_callbacks);
+        vkDestroySemaphore(mainDevice.logical_device, image_available[i], host_callbacks);
+        vkDestroyFence(mainDevice.logical_device, draw_fences[i], host_callbacks);
     }
-    vkDestroyCommandPool(mainDevice.logical_device, graphics_command_pool, nullptr);
+    vkDestroyCommandPool(mainDevice.logical_device, transfer_command_pool, host_callbacks);
+    vkDestroyCommandPool(mainDevice.logical_device, graphics_command_pool, host_callbacks);
     for (auto fb : swapchain_framebuffers) {
-        vkDestroyFramebuffer(mainDevice.logical_device, fb, nullptr);
+        vkDestroyFramebuffer(mainDevice.logical_device, fb, host_callbacks);
     }
 
-    vkDestroyPipeline(mainDevice.logical_device, second_pipeline, nullptr);
-    vkDestroyPipelineLayout(mainDevice.logical_device, second_layout, nullptr);
-    vkDestroyPipeline(mainDevice.logical_device, graphics_pipeline, nullptr);
-    vkDestroyPipelineLayout(mainDevice.logical_device, pipeline_layout, nullptr);
-    vkDestroyRenderPass(mainDevice.logical_device, render_pass, nullptr);
+    vkDestroyPipeline(mainDevice.logical_device, second_pipeline, host_callbacks);
+    vkDestroyPipelineLayout(mainDevice.logical_device, second_layout, host_callbacks);
+    for (VkPipeline pipeline : graphics_pipelines) {
+        vkDestroyPipeline(mainDevice.logical_device, pipeline, host_callbacks);
+    }
+    vkDestroyPipelineLayout(mainDevice.logical_device, pipeline_layout, host_callbacks);
+    vkDestroyRenderPass(mainDevice.logical_device, render_pass, host_callbacks);
     for (auto img : swapchain_images) {
-        vkDestroyImageView(mainDevice.logical_device, img.image_view, nullptr);
+        vkDestroyImageView(mainDevice.logical_device, img.image_view, host_callbacks);
     }
-    vkDestroySwapchainKHR(mainDevice.logical_device, swapchain, nullptr);
-    vkDestroySurfaceKHR(instance, surface, nullptr);
-    vkDestroyDevice(mainDevice.logical_device, nullptr);
+    vkDestroySwapchainKHR(mainDevice.logical_device, swapchain, host_callbacks);
+    vkDestroySurfaceKHR(instance, surface, host_callbacks);
+    allocator.destroy();
+    vkDestroyDevice(mainDevice.logical_device, host_callbacks);
     if (enableValidationLayers) {
-        DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
+        DestroyDebugUtilsMessengerEXT(instance, debugMessenger, host_callbacks);
     }
-    vkDestroyInstance(instance, nullptr);
+    vkDestroyInstance(instance, host_callbacks);
+    host_allocator.destroy();
 }
 
 void VulkanRenderer::getPhysicalDevice() {
@@ -200,7 +263,7 @@ void VulkanRenderer::getPhysicalDevice() {
     VkPhysicalDeviceProperties props;
     vkGetPhysicalDeviceProperties(mainDevice.physical_device, &props);
 
-    // min_uniform_buff_offset = props.limits.minUniformBufferOffsetAlignment;
+    min_uniform_buff_offset = props.limits.minUniformBufferOffsetAlignment;
 }
 
 void VulkanRenderer::createInstance() {
@@ -227,6 +290,14 @@ void VulkanRenderer::createInstance() {
         throw std::runtime_error("Vk Instance does not support required extensions :(");
     }
 
+    // optional, needed to query VK_EXT_memory_budget on a 1.0 instance
+    std::vector<const char*> properties2_ext = {
+        VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME};
+    has_properties2 = checkInstanceExtensionsSupport(&properties2_ext);
+    if (has_properties2) {
+        instanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+    }
+
     if (enableValidationLayers && !checkValidationLayerSupport()) {
         throw std::runtime_error("validation layers requested, but not available!");
     }
@@ -246,14 +317,15 @@ void VulkanRenderer::createInstance() {
         createInfo.pNext = nullptr;
     }
 
-    VKRes(vkCreateInstance(&createInfo, nullptr, &instance));
+    VKRes(vkCreateInstance(&createInfo, host_callbacks, &instance));
 }
 
 void VulkanRenderer::createLogicalDevice() {
     QueueFamilyIndices indices = getQueueFamilies(mainDevice.physical_device);
 
     std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
-    std::set<int> queue_family_indices = {indices.graphics_family, indices.presentation_family};
+    std::set<int> queue_family_indices = {indices.graphics_family, indices.presentation_family,
+                                          indices.transfer_family};
 
     for (int index : queue_family_indices) {
         VkDeviceQueueCreateInfo queue_create_info = {};
@@ -266,25 +338,50 @@ void VulkanRenderer::createLogicalDevice() {
         queue_create_infos.push_back(queue_create_info);
     }
 
+    // required extensions plus the optional ones the device has
+    std::vector<const char*> enabled_extensions = device_extensions;
+    memory_budget_enabled = has_properties2 && checkDeviceExtensionSupport(
+        mainDevice.physical_device, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if (memory_budget_enabled) {
+        enabled_extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
+    // core in 1.1, the allocator chains it for resources that get memory of their own
+    dedicated_allocation_enabled =
+        checkDeviceExtensionSupport(mainDevice.physical_device,
+                                    VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME) &&
+        checkDeviceExtensionSupport(mainDevice.physical_device,
+                                    VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME);
+    if (dedicated_allocation_enabled) {
+        enabled_extensions.push_back(VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME);
+        enabled_extensions.push_back(VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME);
+    }
+
     VkDeviceCreateInfo device_create_info = {};
     device_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     device_create_info.queueCreateInfoCount = static_cast<uint32_t>(queue_create_infos.size());
     device_create_info.pQueueCreateInfos = queue_create_infos.data();
     device_create_info.enabledExtensionCount =
-        static_cast<uint32_t>(device_extensions.size()); // Logical device extensions
-    device_create_info.ppEnabledExtensionNames = device_extensions.data();
+        static_cast<uint32_t>(enabled_extensions.size()); // Logical device extensions
+    device_create_info.ppEnabledExtensionNames = enabled_extensions.data();
+
+    VkPhysicalDeviceFeatures supported_features;
+    vkGetPhysicalDeviceFeatures(mainDevice.physical_device, &supported_features);
 
     VkPhysicalDeviceFeatures device_features = {};
     device_features.samplerAnisotropy = VK_TRUE;
+    // optional, KTX2 textures fall back to their source image without it
+    bc_compression_enabled = supported_features.textureCompressionBC == VK_TRUE;
+    device_features.textureCompressionBC = supported_features.textureCompressionBC;
     device_create_info.pEnabledFeatures = &device_features;
 
-    VKRes(vkCreateDevice(mainDevice.physical_device, &device_create_info, nullptr,
+    VKRes(vkCreateDevice(mainDevice.physical_device, &device_create_info, host_callbacks,
                          &mainDevice.logical_device));
 
     // Queues created with device
     vkGetDeviceQueue(mainDevice.logical_device, indices.graphics_family, 0, &graphics_queue);
     vkGetDeviceQueue(mainDevice.logical_device, indices.presentation_family, 0,
                      &presentation_queue);
+    vkGetDeviceQueue(mainDevice.logical_device, indices.transfer_family, 0, &transfer_queue);
 }
 
 void VulkanRenderer::createDebugMessenger() {
@@ -294,14 +391,14 @@ void VulkanRenderer::createDebugMessenger() {
     VkDebugUtilsMessengerCreateInfoEXT createInfo;
     populateDebugMessengerCreateInfo(createInfo);
 
-    if (CreateDebugUtilsMessengerEXT(instance, &createInfo, nullptr, &debugMessenger) !=
+    if (CreateDebugUtilsMessengerEXT(instance, &createInfo, host_callbacks, &debugMessenger) !=
         VK_SUCCESS) {
         throw std::runtime_error("failed to set up debug messenger!");
     }
 }
 
 void VulkanRenderer::createSurface() {
-    VKRes(glfwCreateWindowSurface(instance, window, nullptr, &surface));
+    VKRes(glfwCreateWindowSurface(instance, window, host_callbacks, &surface));
 }
 
 void VulkanRenderer::createSwapchain() {
@@ -346,7 +443,8 @@ void VulkanRenderer::createSwapchain() {
     }
     sc_create_info.oldSwapchain = VK_NULL_HANDLE;
 
-    VKRes(vkCreateSwapchainKHR(mainDevice.logical_device, &sc_create_info, nullptr, &swapchain));
+    VKRes(vkCreateSwapchainKHR(mainDevice.logical_device, &sc_create_info, host_callbacks,
+                               &swapchain));
 
     sc_img_format = format.format;
     sc_extent = extent;
@@ -508,46 +606,74 @@ void VulkanRenderer::createRenderPass() {
     render_pass_info.dependencyCount = static_cast<uint32_t>(subpass_deps.size());
     render_pass_info.pDependencies = subpass_deps.data();
 
-    VKRes(vkCreateRenderPass(mainDevice.logical_device, &render_pass_info, nullptr, &render_pass));
+    VKRes(vkCreateRenderPass(mainDevice.logical_device, &render_pass_info, host_callbacks,
+                             &render_pass));
 }
 
+// The color and depth attachments only live inside the render pass (stored as DONT_CARE,
+// read back as input attachments), so one set per frame in flight is enough.
 void VulkanRenderer::createColorBufferImage() {
-    color_image.resize(swapchain_images.size());
-    color_image_memory.resize(swapchain_images.size());
-    color_image_view.resize(swapchain_images.size());
+    color_image.resize(MAX_FRAME_DRAWS);
+    color_image_memory.resize(MAX_FRAME_DRAWS);
+    color_image_view.resize(MAX_FRAME_DRAWS);
 
-    for (size_t i = 0; i < swapchain_images.size(); i++) {
-        color_image[i] =
-            createImage(sc_extent.width, sc_extent.height, color_fmt, VK_IMAGE_TILING_OPTIMAL,
-                        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT,
-                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &color_image_memory[i]);
+    for (size_t i = 0; i < MAX_FRAME_DRAWS; i++) {
+        color_image[i] = createAttachmentImage(
+            color_fmt, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT,
+            &color_image_memory[i]);
 
         color_image_view[i] = createIMageView(color_image[i], color_fmt, VK_IMAGE_ASPECT_COLOR_BIT);
     }
 }
 
 void VulkanRenderer::createDepthBufferImage() {
-    depth_image.resize(swapchain_images.size());
-    depth_image_memory.resize(swapchain_images.size());
-    depth_image_view.resize(swapchain_images.size());
+    depth_image.resize(MAX_FRAME_DRAWS);
+    depth_image_memory.resize(MAX_FRAME_DRAWS);
+    depth_image_view.resize(MAX_FRAME_DRAWS);
 
-    for (size_t i = 0; i < swapchain_images.size(); i++) {
-        depth_image[i] = createImage(
-            sc_extent.width, sc_extent.height, depth_fmt, VK_IMAGE_TILING_OPTIMAL,
+    for (size_t i = 0; i < MAX_FRAME_DRAWS; i++) {
+        depth_image[i] = createAttachmentImage(
+            depth_fmt,
             VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &depth_image_memory[i]);
+            &depth_image_memory[i]);
 
         depth_image_view[i] = createIMageView(depth_image[i], depth_fmt, VK_IMAGE_ASPECT_DEPTH_BIT);
     }
 }
 
+VkImage VulkanRenderer::createAttachmentImage(VkFormat format, VkImageUsageFlags flags,
+                                              MemoryAllocation* imagemem) {
+    VkImage img = createImageObject(sc_extent.width, sc_extent.height, format,
+                                    VK_IMAGE_TILING_OPTIMAL,
+                                    flags | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT);
+
+    VkMemoryRequirements memreqs;
+    vkGetImageMemoryRequirements(mainDevice.logical_device, img, &memreqs);
+
+    // tilers can keep transient attachments in tile memory and never back them at all
+    VkMemoryPropertyFlags propflags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    VkMemoryPropertyFlags lazy_flags =
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+    if (allocator.hasMemoryType(memreqs.memoryTypeBits, lazy_flags)) {
+        propflags = lazy_flags;
+    }
+
+    *imagemem = allocator.allocateImage(img, propflags, VK_IMAGE_TILING_OPTIMAL,
+                                        MemoryCategory::Attachment);
+    return img;
+}
+
 void VulkanRenderer::createFramebuffers() {
-    swapchain_framebuffers.resize(swapchain_images.size());
+    // one per frame in flight and swapchain image, pairing the frame's attachments with the
+    // image acquired for it
+    swapchain_framebuffers.resize(MAX_FRAME_DRAWS * swapchain_images.size());
     for (size_t i = 0; i < swapchain_framebuffers.size(); i++) {
+        size_t frame = i / swapchain_images.size();
+        size_t image = i % swapchain_images.size();
         std::array<VkImageView, 3> attachments = {
-            swapchain_images[i].image_view,
-            color_image_view[i],
-            depth_image_view[i],
+            swapchain_images[image].image_view,
+            color_image_view[frame],
+            depth_image_view[frame],
         };
 
         VkFramebufferCreateInfo fb_info = {};
@@ -559,7 +685,7 @@ void VulkanRenderer::createFramebuffers() {
         fb_info.height = sc_extent.height;
         fb_info.layers = 1;
 
-        VKRes(vkCreateFramebuffer(mainDevice.logical_device, &fb_info, nullptr,
+        VKRes(vkCreateFramebuffer(mainDevice.logical_device, &fb_info, host_callbacks,
                                   &swapchain_framebuffers[i]));
     }
 }
@@ -572,12 +698,17 @@ void VulkanRenderer::createCommandPool() {
     pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
     pool_info.queueFamilyIndex = indices.graphics_family;
 
-    VKRes(vkCreateCommandPool(mainDevice.logical_device, &pool_info, nullptr,
+    VKRes(vkCreateCommandPool(mainDevice.logical_device, &pool_info, host_callbacks,
                               &graphics_command_pool));
+
+    // uploads are recorded here, same family as graphics when there is no transfer-only one
+    pool_info.queueFamilyIndex = indices.transfer_family;
+    VKRes(vkCreateCommandPool(mainDevice.logical_device, &pool_info, host_callbacks,
+                              &transfer_command_pool));
 }
 
 void VulkanRenderer::createCommandBuffers() {
-    command_buffers.resize(swapchain_framebuffers.size());
+    command_buffers.resize(swapchain_images.size());
 
     VkCommandBufferAllocateInfo cb_alloc_info = {};
     cb_alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -594,7 +725,7 @@ void VulkanRenderer::createCommandBuffers() {
 void VulkanRenderer::createDescriptorSetLayout() {
     VkDescriptorSetLayoutBinding vp_binding = {};
     vp_binding.binding = 0;
-    vp_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    vp_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     vp_binding.descriptorCount = 1;
     vp_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
     vp_binding.pImmutableSamplers = nullptr;
@@ -613,7 +744,7 @@ void VulkanRenderer::createDescriptorSetLayout() {
     layout_info.bindingCount = static_cast<u32>(layout_bindings.size());
     layout_info.pBindings = layout_bindings.data();
 
-    VKRes(vkCreateDescriptorSetLayout(mainDevice.logical_device, &layout_info, nullptr,
+    VKRes(vkCreateDescriptorSetLayout(mainDevice.logical_device, &layout_info, host_callbacks,
                                       &descriptor_set_layout));
 
     VkDescriptorSetLayoutBinding sampler_binding = {};
@@ -630,7 +761,7 @@ void VulkanRenderer::createDescriptorSetLayout() {
     texlayout_info.pBindings = &sampler_binding;
 
     // Create Descriptor Set Layout
-    VKRes(vkCreateDescriptorSetLayout(mainDevice.logical_device, &texlayout_info, nullptr,
+    VKRes(vkCreateDescriptorSetLayout(mainDevice.logical_device, &texlayout_info, host_callbacks,
                                       &sampler_set_layout));
 
     // Input Attachment image set layout
@@ -654,39 +785,21 @@ void VulkanRenderer::createDescriptorSetLayout() {
     input_layout_info.bindingCount = static_cast<u32>(input_bindings.size());
     input_layout_info.pBindings = input_bindings.data();
 
-    VKRes(vkCreateDescriptorSetLayout(mainDevice.logical_device, &input_layout_info, nullptr,
+    VKRes(vkCreateDescriptorSetLayout(mainDevice.logical_device, &input_layout_info, host_callbacks,
                                       &input_set_layout));
 }
 
 void VulkanRenderer::createUniformBuffers() {
-    VkDeviceSize buffersize = sizeof(UboViewProjection);
+    uniforms.init(&allocator, min_uniform_buff_offset);
 
     // VkDeviceSize model_buffersize = model_uniform_alignment * MAX_OBJECTS;
-
-    vp_uniform_buffer.resize(swapchain_images.size());
-    vp_uniform_buffer_memory.resize(swapchain_images.size());
-
-    // model_uniform_buffer.resize(swapchain_images.size());
-    // model_uniform_buffer_memory.resize(swapchain_images.size());
-
-    for (size_t i = 0; i < swapchain_images.size(); i++) {
-        createBuffer(mainDevice.physical_device, mainDevice.logical_device, buffersize,
-                     VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                     &vp_uniform_buffer[i], &vp_uniform_buffer_memory[i]);
-        // createBuffer(mainDevice.physical_device, mainDevice.logical_device,
-        // model_buffersize, 	VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-        // 	VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-        // VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 	&model_uniform_buffer[i],
-        // &model_uniform_buffer_memory[i]);
-    }
 }
 
 void VulkanRenderer::createDescriptorPool() {
 
     VkDescriptorPoolSize vp_poolsize = {};
-    vp_poolsize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    vp_poolsize.descriptorCount = static_cast<u32>(vp_uniform_buffer.size());
+    vp_poolsize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    vp_poolsize.descriptorCount = 1;
 
     // VkDescriptorPoolSize model_poolsize = {};
     // model_poolsize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
@@ -697,12 +810,12 @@ void VulkanRenderer::createDescriptorPool() {
 
     VkDescriptorPoolCreateInfo pool_info = {};
     pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    pool_info.maxSets = static_cast<u32>(swapchain_images.size());
+    pool_info.maxSets = 1;
     pool_info.poolSizeCount = static_cast<u32>(pool_sizes.size());
-    ;
     pool_info.pPoolSizes = pool_sizes.data();
 
-    VKRes(vkCreateDescriptorPool(mainDevice.logical_device, &pool_info, nullptr, &descriptor_pool));
+    VKRes(vkCreateDescriptorPool(mainDevice.logical_device, &pool_info, host_callbacks,
+                                 &descriptor_pool));
 
     // CREATE SAMPLER POOL
     VkDescriptorPoolSize sampler_poolsize = {};
@@ -711,11 +824,13 @@ void VulkanRenderer::createDescriptorPool() {
 
     VkDescriptorPoolCreateInfo sampler_info = {};
     sampler_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    // sets of unloaded and relocated textures are given back one by one
+    sampler_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
     sampler_info.maxSets = MAX_OBJECTS;
     sampler_info.poolSizeCount = 1;
     sampler_info.pPoolSizes = &sampler_poolsize;
 
-    VKRes(vkCreateDescriptorPool(mainDevice.logical_device, &sampler_info, nullptr,
+    VKRes(vkCreateDescriptorPool(mainDevice.logical_device, &sampler_info, host_callbacks,
                                  &sampler_descriptor_pool));
 
     // CREATE INPUT POOL
@@ -730,63 +845,58 @@ void VulkanRenderer::createDescriptorPool() {
 
     VkDescriptorPoolCreateInfo input_info = {};
     input_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    input_info.maxSets = swapchain_images.size();
+    input_info.maxSets = MAX_FRAME_DRAWS;
     input_info.poolSizeCount = static_cast<u32>(input_sizes.size());
     input_info.pPoolSizes = input_sizes.data();
-    VKRes(vkCreateDescriptorPool(mainDevice.logical_device, &input_info, nullptr,
+    VKRes(vkCreateDescriptorPool(mainDevice.logical_device, &input_info, host_callbacks,
                                  &input_descriptor_pool));
 }
 
 void VulkanRenderer::createDescriptorSets() {
-    descriptor_sets.resize(swapchain_images.size());
-
-    std::vector<VkDescriptorSetLayout> setlayouts(swapchain_images.size(), descriptor_set_layout);
-
+    // a single set serves every frame, the frame's data is picked by dynamic offset
     VkDescriptorSetAllocateInfo set_alloc_info = {};
     set_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     set_alloc_info.descriptorPool = descriptor_pool;
-    set_alloc_info.descriptorSetCount = static_cast<u32>(swapchain_images.size());
-    set_alloc_info.pSetLayouts = setlayouts.data();
+    set_alloc_info.descriptorSetCount = 1;
+    set_alloc_info.pSetLayouts = &descriptor_set_layout;
 
     VKRes(vkAllocateDescriptorSets(mainDevice.logical_device, &set_alloc_info,
-                                   descriptor_sets.data()));
+                                   &uniform_descriptor_set));
+
+    // View Proj
+    VkDescriptorBufferInfo vp_buff_info = {};
+    vp_buff_info.buffer = uniforms.getBuffer();
+    vp_buff_info.offset = 0;
+    vp_buff_info.range = sizeof(UboViewProjection);
+
+    VkWriteDescriptorSet vp_write = {};
+    vp_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    vp_write.dstSet = uniform_descriptor_set;
+    vp_write.dstBinding = 0;
+    vp_write.dstArrayElement = 0;
+    vp_write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    vp_write.descriptorCount = 1;
+    vp_write.pBufferInfo = &vp_buff_info;
+
+    // Model descriptor
+    // VkDescriptorBufferInfo model_buff_info = {};
+    // model_buff_info.buffer = model_uniform_buffer[i];
+    // model_buff_info.offset = 0;
+    // model_buff_info.range = model_uniform_alignment;
+    //
+    // VkWriteDescriptorSet model_write = {};
+    // model_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    // model_write.dstSet = uniform_descriptor_set;
+    // model_write.dstBinding = 1;
+    // model_write.dstArrayElement = 0;
+    // model_write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    // model_write.descriptorCount = 1;
+    // model_write.pBufferInfo = &model_buff_info;
 
-    for (size_t i = 0; i < swapchain_images.size(); i++) {
-        // View Proj
-        VkDescriptorBufferInfo vp_buff_info = {};
-        vp_buff_info.buffer = vp_uniform_buffer[i];
-        vp_buff_info.offset = 0;
-        vp_buff_info.range = sizeof(UboViewProjection);
-
-        VkWriteDescriptorSet vp_write = {};
-        vp_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        vp_write.dstSet = descriptor_sets[i];
-        vp_write.dstBinding = 0;
-        vp_write.dstArrayElement = 0;
-        vp_write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        vp_write.descriptorCount = 1;
-        vp_write.pBufferInfo = &vp_buff_info;
-
-        // Model descriptor
-        // VkDescriptorBufferInfo model_buff_info = {};
-        // model_buff_info.buffer = model_uniform_buffer[i];
-        // model_buff_info.offset = 0;
-        // model_buff_info.range = model_uniform_alignment;
-        //
-        // VkWriteDescriptorSet model_write = {};
-        // model_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        // model_write.dstSet = descriptor_sets[i];
-        // model_write.dstBinding = 1;
-        // model_write.dstArrayElement = 0;
-        // model_write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-        // model_write.descriptorCount = 1;
-        // model_write.pBufferInfo = &model_buff_info;
-
-        std::vector<VkWriteDescriptorSet> set_writes = {vp_write};
+    std::vector<VkWriteDescriptorSet> set_writes = {vp_write};
 
-        vkUpdateDescriptorSets(mainDevice.logical_device, static_cast<u32>(set_writes.size()),
-                               set_writes.data(), 0, nullptr);
-    }
+    vkUpdateDescriptorSets(mainDevice.logical_device, static_cast<u32>(set_writes.size()),
+                           set_writes.data(), 0, nullptr);
 
     // TEXTURE SET LAYOUT
     VkDescriptorSetLayoutBinding sampler_binding = {};
@@ -801,24 +911,25 @@ void VulkanRenderer::createDescriptorSets() {
     layout_info.bindingCount = 1;
     layout_info.pBindings = &sampler_binding;
 
-    VKRes(vkCreateDescriptorSetLayout(mainDevice.logical_device, &layout_info, nullptr,
+    VKRes(vkCreateDescriptorSetLayout(mainDevice.logical_device, &layout_info, host_callbacks,
                                       &sampler_set_layout));
 }
 
 void VulkanRenderer::createInputDescriptorSets() {
-    input_descriptor_sets.resize(swapchain_images.size());
+    // one per frame in flight, like the attachments they read
+    input_descriptor_sets.resize(MAX_FRAME_DRAWS);
 
-    std::vector<VkDescriptorSetLayout> layouts(swapchain_images.size(), input_set_layout);
+    std::vector<VkDescriptorSetLayout> layouts(MAX_FRAME_DRAWS, input_set_layout);
 
     VkDescriptorSetAllocateInfo set_alloc_info = {};
     set_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     set_alloc_info.descriptorPool = input_descriptor_pool;
-    set_alloc_info.descriptorSetCount = static_cast<u32>(swapchain_images.size());
+    set_alloc_info.descriptorSetCount = MAX_FRAME_DRAWS;
     set_alloc_info.pSetLayouts = layouts.data();
 
     VKRes(vkAllocateDescriptorSets(mainDevice.logical_device, &set_alloc_info,
                                    input_descriptor_sets.data()));
-    for (size_t i = 0; i < swapchain_images.size(); i++) {
+    for (size_t i = 0; i < MAX_FRAME_DRAWS; i++) {
         VkDescriptorImageInfo color_img_info = {};
         color_img_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
         color_img_info.imageView = color_image_view[i];
@@ -854,12 +965,8 @@ void VulkanRenderer::createInputDescriptorSets() {
     }
 }
 
-void VulkanRenderer::updateUniformBuffers(u32 img_idx) {
-    void* data;
-    vkMapMemory(mainDevice.logical_device, vp_uniform_buffer_memory[img_idx], 0,
-                sizeof(UboViewProjection), 0, &data);
-    memcpy(data, &ubo_view_proj, sizeof(UboViewProjection));
-    vkUnmapMemory(mainDevice.logical_device, vp_uniform_buffer_memory[img_idx]);
+void VulkanRenderer::updateUniformBuffers() {
+    vp_uniform_offset = uniforms.push(ubo_view_proj);
 
     // for (size_t i = 0; i < meshes.size(); i++) {
     // 	Model* model = (Model*)((u64)model_transfer_space + (i *
@@ -894,44 +1001,76 @@ void VulkanRenderer::recordCommands(u32 curr_img) {
     rp_begin_info.pClearValues = clear_values.data();
     rp_begin_info.clearValueCount = static_cast<u32>(clear_values.size());
 
-    rp_begin_info.framebuffer = swapchain_framebuffers[curr_img];
+    rp_begin_info.framebuffer =
+        swapchain_framebuffers[current_frame * swapchain_images.size() + curr_img];
 
     // Start recording commands to cmd buff
     VKRes(vkBeginCommandBuffer(command_buffers[curr_img], &buff_begin_info));
 
+    // take ownership of everything the transfer queue finished since the last frame
+    staging.recordAcquires(command_buffers[curr_img]);
+    // then carry over what grown geometry pools held, now that the uploads into them landed
+    geometry.recordGrowCopies(command_buffers[curr_img]);
+
+    // compact the geometry and texture heaps a bit every frame while nothing streams in,
+    // before any draw reads them
+    if (staging.isIdle()) {
+        defragmentGeometry(command_buffers[curr_img]);
+        defragmentTextures(command_buffers[curr_img]);
+    }
+
     vkCmdBeginRenderPass(command_buffers[curr_img], &rp_begin_info, VK_SUBPASS_CONTENTS_INLINE);
 
-    vkCmdBindPipeline(command_buffers[curr_img], VK_PIPELINE_BIND_POINT_GRAPHICS,
-                      graphics_pipeline);
+    // every mesh lives in the shared geometry buffers, the pipeline and buffers only change
+    // with the mesh's vertex format and index type
+    int bound_format = -1;
+    int bound_index_type = -1;
 
     for (size_t j = 0; j < models.size(); j++) {
-        MeshModel curr_model = models[j];
-
-        vkCmdPushConstants(command_buffers[curr_img], pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT,
-                           0, sizeof(Model), &curr_model.getModel());
+        // still streaming in, keep drawing everything else meanwhile
+        if (!staging.isReady(model_upload_tickets[j])) {
+            continue;
+        }
+        MeshModel& curr_model = models[j];
+        float pixels_per_unit = lodPixelsPerUnit(curr_model);
 
         for (size_t k = 0; k < curr_model.getMeshCount(); k++) {
+            Mesh* mesh = curr_model.getMesh(k);
+
+            int format = static_cast<int>(mesh->getVertexFormat());
+            if (format != bound_format) {
+                vkCmdBindPipeline(command_buffers[curr_img], VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                  graphics_pipelines[format]);
+                geometry.bindVertices(command_buffers[curr_img], mesh->getVertexFormat());
+                bound_format = format;
+            }
+            if (mesh->getIndexType() != bound_index_type) {
+                geometry.bindIndices(command_buffers[curr_img], mesh->getIndexType());
+                bound_index_type = mesh->getIndexType();
+            }
 
-            VkBuffer vertex_buffers[] = {curr_model.getMesh(k)->getVertexBuffer()};
-            VkDeviceSize offsets[] = {0};
-            vkCmdBindVertexBuffers(command_buffers[curr_img], 0, 1, vertex_buffers, offsets);
-
-            vkCmdBindIndexBuffer(command_buffers[curr_img], curr_model.getMesh(k)->getIndexBuffer(),
-                                 0, VK_INDEX_TYPE_UINT32);
+            // quantized positions are scaled back to mesh space, then placed by the scene node
+            // and the model transform
+            Model mesh_model;
+            mesh_model.model =
+                curr_model.getModel() * mesh->getModel().model * mesh->getDequantize();
+            vkCmdPushConstants(command_buffers[curr_img], pipeline_layout,
+                               VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Model), &mesh_model);
 
             // u32 dynamic_offset = static_cast<u32>(model_uniform_alignment) * j;
 
-            std::array<VkDescriptorSet, 2> sets = {
-                descriptor_sets[curr_img],
-                sampler_descriptor_sets[curr_model.getMesh(k)->getTexId()]};
+            std::array<VkDescriptorSet, 2> sets = {uniform_descriptor_set,
+                                                   sampler_descriptor_sets[mesh->getTexId()]};
 
             vkCmdBindDescriptorSets(command_buffers[curr_img], VK_PIPELINE_BIND_POINT_GRAPHICS,
                                     pipeline_layout, 0, static_cast<u32>(sets.size()), sets.data(),
-                                    0, nullptr);
+                                    1, &vp_uniform_offset);
 
             // vkCmdDraw(command_buffers[i], first_mesh.getVertexCount(), 1, 0, 0);
-            vkCmdDrawIndexed(command_buffers[curr_img], curr_model.getMesh(k)->getIndexCount(), 1,
-                             0, 0, 0);
+            MeshLod lod =
+                mesh->selectLod(std::min(pixels_per_unit * mesh->getModelScale(), FLT_MAX));
+            vkCmdDrawIndexed(command_buffers[curr_img], lod.index_count, 1, lod.first_index,
+                             mesh->getVertexOffset(), mesh->getFirstInstance());
         }
     }
 
@@ -939,7 +1078,8 @@ void VulkanRenderer::recordCommands(u32 curr_img) {
 
     vkCmdBindPipeline(command_buffers[curr_img], VK_PIPELINE_BIND_POINT_GRAPHICS, second_pipeline);
     vkCmdBindDescriptorSets(command_buffers[curr_img], VK_PIPELINE_BIND_POINT_GRAPHICS,
-                            second_layout, 0, 1, &input_descriptor_sets[curr_img], 0, nullptr);
+                            second_layout, 0, 1, &input_descriptor_sets[current_frame], 0,
+                            nullptr);
     vkCmdDraw(command_buffers[curr_img], 3, 1, 0, 0);
 
     vkCmdEndRenderPass(command_buffers[curr_img]);
@@ -962,11 +1102,12 @@ void VulkanRenderer::createSynchronisation() {
     fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
     for (size_t i = 0; i < MAX_FRAME_DRAWS; i++) {
-        VKRes(
-            vkCreateSemaphore(mainDevice.logical_device, &sem_info, nullptr, &image_available[i]));
-        VKRes(
-            vkCreateSemaphore(mainDevice.logical_device, &sem_info, nullptr, &render_finished[i]));
-        VKRes(vkCreateFence(mainDevice.logical_device, &fence_info, nullptr, &draw_fences[i]));
+        VKRes(vkCreateSemaphore(mainDevice.logical_device, &sem_info, host_callbacks,
+                                &image_available[i]));
+        VKRes(vkCreateSemaphore(mainDevice.logical_device, &sem_info, host_callbacks,
+                                &render_finished[i]));
+        VKRes(vkCreateFence(mainDevice.logical_device, &fence_info, host_callbacks,
+                            &draw_fences[i]));
     }
 }
 
@@ -983,16 +1124,16 @@ void VulkanRenderer::createTextureSampler() {
     info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
     info.mipLodBias = 0.0f;
     info.minLod = 0.0f;
-    info.maxLod = 0.0f;
+    info.maxLod = VK_LOD_CLAMP_NONE;
     info.anisotropyEnable = VK_TRUE;
     info.maxAnisotropy = 16;
 
-    VKRes(vkCreateSampler(mainDevice.logical_device, &info, nullptr, &texture_sampler));
+    VKRes(vkCreateSampler(mainDevice.logical_device, &info, host_callbacks, &texture_sampler));
 }
 
 void VulkanRenderer::createGraphicsPipeline() {
-    auto vertex_shader_code = readFile("shaders/vert.spv");
-    auto fragment_shader_code = readFile("shaders/frag.spv");
+    auto vertex_shader_code = readAsset("shaders/vert.spv");
+    auto fragment_shader_code = readAsset("shaders/frag.spv");
 
     VkShaderModule vertex_shader = createShaderModule(vertex_shader_code);
     VkShaderModule fragment_shader = createShaderModule(fragment_shader_code);
@@ -1013,40 +1154,9 @@ void VulkanRenderer::createGraphicsPipeline() {
 
     // create pipeline
 
-    // vertex creation
-    // data for a single vertex as a whole
-    VkVertexInputBindingDescription binding_desc = {};
-    binding_desc.binding = 0;
-    binding_desc.stride = sizeof(Vertex);
-    binding_desc.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-    // how data for an attibute is defined within a vertex
-    std::array<VkVertexInputAttributeDescription, 3> attrib_descs;
-    attrib_descs[0].binding = 0;
-    attrib_descs[0].location = 0;
-    attrib_descs[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-    attrib_descs[0].offset = offsetof(Vertex, pos);
-
-    // colors
-    attrib_descs[1].binding = 0;
-    attrib_descs[1].location = 1;
-    attrib_descs[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-    attrib_descs[1].offset = offsetof(Vertex, col);
-
-    // texture
-    attrib_descs[2].binding = 0;
-    attrib_descs[2].location = 2;
-    attrib_descs[2].format = VK_FORMAT_R32G32_SFLOAT;
-    attrib_descs[2].offset = offsetof(Vertex, tex);
-
+    // vertex creation, the input state of every vertex format is filled in further down
     VkPipelineVertexInputStateCreateInfo vertex_in_info = {};
     vertex_in_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertex_in_info.vertexBindingDescriptionCount = 1;
-    vertex_in_info.pVertexBindingDescriptions =
-        &binding_desc; //(binding desc (data spacing/stride, etc.)
-    vertex_in_info.vertexAttributeDescriptionCount = static_cast<uint32_t>(attrib_descs.size());
-    vertex_in_info.pVertexAttributeDescriptions =
-        attrib_descs.data(); // data format, where to bind to/from
 
     VkPipelineInputAssemblyStateCreateInfo input_assembly = {};
     input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -1154,7 +1264,7 @@ void VulkanRenderer::createGraphicsPipeline() {
     pipeline_layout_info.pPushConstantRanges = &push_constant_range;
 
     // Create Pipeline Layout
-    VKRes(vkCreatePipelineLayout(mainDevice.logical_device, &pipeline_layout_info, nullptr,
+    VKRes(vkCreatePipelineLayout(mainDevice.logical_device, &pipeline_layout_info, host_callbacks,
                                  &pipeline_layout));
 
     // -- DEPTH STENCIL TESTING --
@@ -1191,17 +1301,42 @@ void VulkanRenderer::createGraphicsPipeline() {
     pipeline_create_info.basePipelineIndex = -1; // or index of pipeline being created to derive
                                                  // from (in case creating multiple at once)
 
-    // Create Graphics Pipeline
-    VKRes(vkCreateGraphicsPipelines(mainDevice.logical_device, VK_NULL_HANDLE, 1,
-                                    &pipeline_create_info, nullptr, &graphics_pipeline));
+    // Create Graphics Pipelines, one per vertex format the device can fetch. They only differ
+    // in the vertex input state.
+    std::vector<VkVertexInputBindingDescription> binding_descs;
+    std::vector<VkVertexInputAttributeDescription> attrib_descs;
+    for (u32 i = 0; i < VERTEX_FORMAT_COUNT; i++) {
+        VertexFormat format = static_cast<VertexFormat>(i);
+        if (!supportsVertexFormat(format)) {
+            continue;
+        }
+        describeVertexFormat(format, &binding_descs, &attrib_descs);
+        vertex_in_info.vertexBindingDescriptionCount = static_cast<u32>(binding_descs.size());
+        vertex_in_info.pVertexBindingDescriptions =
+            binding_descs.data(); //(binding desc (data spacing/stride, etc.)
+        vertex_in_info.vertexAttributeDescriptionCount = static_cast<u32>(attrib_descs.size());
+        vertex_in_info.pVertexAttributeDescriptions =
+            attrib_descs.data(); // data format, where to bind to/from
+
+        VKRes(vkCreateGraphicsPipelines(mainDevice.logical_device, VK_NULL_HANDLE, 1,
+                                        &pipeline_create_info, host_callbacks,
+                                        &graphics_pipelines[i]));
+    }
+    if (graphics_pipelines[static_cast<u32>(VertexFormat::Float)] == VK_NULL_HANDLE) {
+        throw std::runtime_error("Device can't fetch float vertices");
+    }
+    // compactVertices picks between the two by the uvs, so both must be there
+    compact_vertices_supported =
+        graphics_pipelines[static_cast<u32>(VertexFormat::Quantized)] != VK_NULL_HANDLE &&
+        graphics_pipelines[static_cast<u32>(VertexFormat::QuantizedHalfUV)] != VK_NULL_HANDLE;
 
     // destroy shader modules after pipeline has been created.
-    vkDestroyShaderModule(mainDevice.logical_device, vertex_shader, nullptr);
-    vkDestroyShaderModule(mainDevice.logical_device, fragment_shader, nullptr);
+    vkDestroyShaderModule(mainDevice.logical_device, vertex_shader, host_callbacks);
+    vkDestroyShaderModule(mainDevice.logical_device, fragment_shader, host_callbacks);
 
     // SECOND PASS PIPELINE
-    auto second_vertex_shader_code = readFile("shaders/second_vert.spv");
-    auto second_fragment_shader_code = readFile("shaders/second_frag.spv");
+    auto second_vertex_shader_code = readAsset("shaders/second_vert.spv");
+    auto second_fragment_shader_code = readAsset("shaders/second_frag.spv");
 
     VkShaderModule second_vertex_shader = createShaderModule(second_vertex_shader_code);
     VkShaderModule second_fragment_shader = createShaderModule(second_fragment_shader_code);
@@ -1226,7 +1361,7 @@ void VulkanRenderer::createGraphicsPipeline() {
     pipeline2_layout_info.pPushConstantRanges = nullptr;
 
     // Create Pipeline Layout
-    VKRes(vkCreatePipelineLayout(mainDevice.logical_device, &pipeline2_layout_info, nullptr,
+    VKRes(vkCreatePipelineLayout(mainDevice.logical_device, &pipeline2_layout_info, host_callbacks,
                                  &second_layout));
 
     pipeline_create_info.pStages = second_shader_stages;
@@ -1235,11 +1370,11 @@ void VulkanRenderer::createGraphicsPipeline() {
 
     // Create Graphics Pipeline
     VKRes(vkCreateGraphicsPipelines(mainDevice.logical_device, VK_NULL_HANDLE, 1,
-                                    &pipeline_create_info, nullptr, &second_pipeline));
+                                    &pipeline_create_info, host_callbacks, &second_pipeline));
 
     // destroy shader modules after pipeline has been created.
-    vkDestroyShaderModule(mainDevice.logical_device, second_vertex_shader, nullptr);
-    vkDestroyShaderModule(mainDevice.logical_device, second_fragment_shader, nullptr);
+    vkDestroyShaderModule(mainDevice.logical_device, second_vertex_shader, host_callbacks);
+    vkDestroyShaderModule(mainDevice.logical_device, second_fragment_shader, host_callbacks);
 }
 
 bool VulkanRenderer::checkInstanceExtensionsSupport(std::vector<const char*>* checkExtenstions) {
@@ -1268,6 +1403,21 @@ bool VulkanRenderer::checkInstanceExtensionsSupport(std::vector<const char*>* ch
     return true;
 }
 
+bool VulkanRenderer::checkDeviceExtensionSupport(VkPhysicalDevice device, const char* extension) {
+    uint32_t ext_cnt = 0;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &ext_cnt, nullptr);
+
+    std::vector<VkExtensionProperties> extensions(ext_cnt);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &ext_cnt, extensions.data());
+
+    for (const auto& ext : extensions) {
+        if (strcmp(extension, ext.extensionName) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
 bool VulkanRenderer::checkDeviceInstanceExtensionsSupport(VkPhysicalDevice device) {
     uint32_t ext_cnt = 0;
     vkEnumerateDeviceExtensionProperties(device, nullptr, &ext_cnt, nullptr);
@@ -1344,25 +1494,41 @@ QueueFamilyIndices VulkanRenderer::getQueueFamilies(VkPhysicalDevice device) {
     std::vector<VkQueueFamilyProperties> queue_family_list(queue_family_cnt);
     vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_cnt, queue_family_list.data());
     int i = 0;
+    int compute_transfer_family = -1;
     for (const auto& family : queue_family_list) {
-        if (family.queueCount > 0 && family.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-            indices.graphics_family = i;
-        }
+        if (!indices.isValid()) {
+            if (family.queueCount > 0 && family.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+                indices.graphics_family = i;
+            }
 
-        VkBool32 presentation_support = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentation_support);
+            VkBool32 presentation_support = false;
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentation_support);
 
-        if (family.queueCount > 0 && presentation_support) {
-            indices.presentation_family = i;
+            if (family.queueCount > 0 && presentation_support) {
+                indices.presentation_family = i;
+            }
         }
 
-        if (indices.isValid()) {
-            break;
+        // prefer a transfer-only family (DMA engine), then an async compute one
+        if (family.queueCount > 0 && family.queueFlags & VK_QUEUE_TRANSFER_BIT &&
+            !(family.queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+            if (!(family.queueFlags & VK_QUEUE_COMPUTE_BIT)) {
+                if (indices.transfer_family < 0) {
+                    indices.transfer_family = i;
+                }
+            } else if (compute_transfer_family < 0) {
+                compute_transfer_family = i;
+            }
         }
 
         i++;
     }
 
+    if (indices.transfer_family < 0) {
+        indices.transfer_family =
+            compute_transfer_family >= 0 ? compute_transfer_family : indices.graphics_family;
+    }
+
     return indices;
 }
 
@@ -1514,14 +1680,25 @@ void VulkanRenderer::DestroyDebugUtilsMessengerEXT(VkInstance instance,
 
 VkImage VulkanRenderer::createImage(u32 width, u32 height, VkFormat format, VkImageTiling tiling,
                                     VkImageUsageFlags flags, VkMemoryPropertyFlags propflags,
-                                    VkDeviceMemory* imagemem) {
+                                    MemoryCategory category, MemoryAllocation* imagemem,
+                                    u32 mip_levels) {
+    VkImage img = createImageObject(width, height, format, tiling, flags, mip_levels);
+
+    *imagemem = allocator.allocateImage(img, propflags, tiling, category);
+
+    return img;
+}
+
+VkImage VulkanRenderer::createImageObject(u32 width, u32 height, VkFormat format,
+                                          VkImageTiling tiling, VkImageUsageFlags flags,
+                                          u32 mip_levels) {
     VkImageCreateInfo img_info = {};
     img_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     img_info.imageType = VK_IMAGE_TYPE_2D;
     img_info.extent.width = width;
     img_info.extent.height = height;
     img_info.extent.depth = 1;
-    img_info.mipLevels = 1;
+    img_info.mipLevels = mip_levels;
     img_info.arrayLayers = 1;
     img_info.format = format;
     img_info.tiling = tiling;
@@ -1531,26 +1708,12 @@ VkImage VulkanRenderer::createImage(u32 width, u32 height, VkFormat format, VkIm
     img_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
     VkImage img;
-    VKRes(vkCreateImage(mainDevice.logical_device, &img_info, nullptr, &img));
-
-    VkMemoryRequirements memreqs;
-    vkGetImageMemoryRequirements(mainDevice.logical_device, img, &memreqs);
-
-    VkMemoryAllocateInfo memalloc_info = {};
-    memalloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    memalloc_info.allocationSize = memreqs.size;
-    memalloc_info.memoryTypeIndex =
-        findMemoryTypeIndex(mainDevice.physical_device, memreqs.memoryTypeBits, propflags);
-
-    VKRes(vkAllocateMemory(mainDevice.logical_device, &memalloc_info, nullptr, imagemem));
-
-    vkBindImageMemory(mainDevice.logical_device, img, *imagemem, 0);
-
+    VKRes(vkCreateImage(mainDevice.logical_device, &img_info, host_callbacks, &img));
     return img;
 }
 
 VkImageView VulkanRenderer::createIMageView(VkImage image, VkFormat format,
-                                            VkImageAspectFlags flags) {
+                                            VkImageAspectFlags flags, u32 mip_levels) {
     VkImageViewCreateInfo view_info = {};
 
     view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -1565,15 +1728,56 @@ VkImageView VulkanRenderer::createIMageView(VkImage image, VkFormat format,
 
     view_info.subresourceRange.aspectMask = flags;
     view_info.subresourceRange.baseMipLevel = 0;
-    view_info.subresourceRange.levelCount = 1;
+    view_info.subresourceRange.levelCount = mip_levels;
     view_info.subresourceRange.baseArrayLayer = 0;
     view_info.subresourceRange.layerCount = 1;
 
     VkImageView img_view;
-    VKRes(vkCreateImageView(mainDevice.logical_device, &view_info, nullptr, &img_view));
+    VKRes(vkCreateImageView(mainDevice.logical_device, &view_info, host_callbacks, &img_view));
     return img_view;
 }
 
+void VulkanRenderer::findCompressedFormats() {
+    compressed_formats.clear();
+    if (!bc_compression_enabled) {
+        return;
+    }
+    const VkFormat candidates[] = {VK_FORMAT_BC1_RGB_UNORM_BLOCK, VK_FORMAT_BC1_RGBA_UNORM_BLOCK,
+                                   VK_FORMAT_BC3_UNORM_BLOCK, VK_FORMAT_BC7_UNORM_BLOCK};
+    for (VkFormat format : candidates) {
+        VkFormatProperties props;
+        vkGetPhysicalDeviceFormatProperties(mainDevice.physical_device, format, &props);
+        if (props.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) {
+            compressed_formats.insert(format);
+        }
+    }
+}
+
+bool VulkanRenderer::supportsLinearBlit(VkFormat format) {
+    VkFormatProperties props;
+    vkGetPhysicalDeviceFormatProperties(mainDevice.physical_device, format, &props);
+
+    VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_BLIT_SRC_BIT |
+                                  VK_FORMAT_FEATURE_BLIT_DST_BIT |
+                                  VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (props.optimalTilingFeatures & needed) == needed;
+}
+
+bool VulkanRenderer::supportsVertexFormat(VertexFormat format) {
+    std::vector<VkVertexInputBindingDescription> bindings;
+    std::vector<VkVertexInputAttributeDescription> attributes;
+    describeVertexFormat(format, &bindings, &attributes);
+
+    for (const VkVertexInputAttributeDescription& attribute : attributes) {
+        VkFormatProperties props;
+        vkGetPhysicalDeviceFormatProperties(mainDevice.physical_device, attribute.format, &props);
+        if (!(props.bufferFeatures & VK_FORMAT_FEATURE_VERTEX_BUFFER_BIT)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 VkShaderModule VulkanRenderer::createShaderModule(const std::vector<char>& code) {
     VkShaderModuleCreateInfo shader_info = {};
     shader_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
@@ -1581,7 +1785,8 @@ VkShaderModule VulkanRenderer::createShaderModule(const std::vector<char>& code)
     shader_info.pCode = reinterpret_cast<const uint32_t*>(code.data());
 
     VkShaderModule shader_module;
-    VKRes(vkCreateShaderModule(mainDevice.logical_device, &shader_info, nullptr, &shader_module));
+    VKRes(vkCreateShaderModule(mainDevice.logical_device, &shader_info, host_callbacks,
+                               &shader_module));
 
     return shader_module;
 }
@@ -1590,7 +1795,18 @@ stbi_uc* VulkanRenderer::loadTextureFile(std::string filename, int* width, int*
                                          VkDeviceSize* imgsize) {
     int channels;
     std::string fileloc = "Textures/" + filename;
-    stbi_uc* image = stbi_load(fileloc.c_str(), width, height, &channels, STBI_rgb_alpha);
+    stbi_uc* image = nullptr;
+    const AssetPackEntry* entry = asset_pack.find(fileloc);
+    if (entry) {
+        std::vector<u8> storage;
+        const u8* contents = asset_pack.read(*entry, &storage);
+        if (contents) {
+            image = stbi_load_from_memory(contents, static_cast<int>(entry->size), width, height,
+                                          &channels, STBI_rgb_alpha);
+        }
+    } else {
+        image = stbi_load(fileloc.c_str(), width, height, &channels, STBI_rgb_alpha);
+    }
 
     if (!image) {
         throw std::runtime_error("Filed to load texture " + fileloc);
@@ -1600,57 +1816,283 @@ stbi_uc* VulkanRenderer::loadTextureFile(std::string filename, int* width, int*
     return image;
 }
 
-int VulkanRenderer::createTextureImage(std::string filename) {
-    int width, height;
+std::vector<char> VulkanRenderer::readAsset(const std::string& filename) {
+    const AssetPackEntry* entry = asset_pack.find(filename);
+    if (!entry) {
+        return readFile(filename);
+    }
+    std::vector<char> contents(static_cast<size_t>(entry->size));
+    if (!asset_pack.readInto(*entry, contents.data())) {
+        throw std::runtime_error("Corrupt asset pack entry " + filename);
+    }
+    return contents;
+}
+
+u64 VulkanRenderer::hashAsset(const std::string& filename) {
+    const AssetPackEntry* entry = asset_pack.find(filename);
+    return entry ? entry->content_hash : MeshCache::hashFile(filename);
+}
+
+DecodedTexture VulkanRenderer::decodeTexture(std::string filename) {
+    DecodedTexture decoded;
+
+    // a compressed copy made offline skips the decode, mips included; out of the pack its
+    // levels are copied to staging in place
+    Ktx2Image ktx;
+    std::string ktx_name = "Textures/" + ktx2Name(filename);
+    const AssetPackEntry* entry = asset_pack.find(ktx_name);
+    if (!compressed_formats.empty() && entry) {
+        const u8* contents = asset_pack.read(*entry, &decoded.backing);
+        if (contents &&
+            parseKtx2(contents, static_cast<size_t>(entry->size), &ktx, &decoded.mapped_levels) &&
+            compressed_formats.count(ktx.format)) {
+            decoded.width = static_cast<int>(ktx.width);
+            decoded.height = static_cast<int>(ktx.height);
+            decoded.format = ktx.format;
+            decoded.mip_levels = ktx.level_count;
+            return decoded;
+        }
+        decoded.mapped_levels.clear();
+        decoded.backing.clear();
+    } else if (!compressed_formats.empty() && readKtx2(ktx_name, &ktx) &&
+               compressed_formats.count(ktx.format)) {
+        decoded.width = static_cast<int>(ktx.width);
+        decoded.height = static_cast<int>(ktx.height);
+        decoded.format = ktx.format;
+        decoded.mip_levels = ktx.level_count;
+        decoded.mip_data = std::move(ktx.data);
+        return decoded;
+    }
+
     VkDeviceSize imgsize;
-    stbi_uc* image_data = loadTextureFile(filename, &width, &height, &imgsize);
+    decoded.pixels = loadTextureFile(filename, &decoded.width, &decoded.height, &imgsize);
+    prepareMipChain(&decoded);
+    return decoded;
+}
+
+DecodedTexture VulkanRenderer::decodeEmbeddedTexture(const EmbeddedImage& image,
+                                                     const std::string& name) {
+    DecodedTexture decoded;
+    int channels;
+    decoded.pixels = stbi_load_from_memory(image.data, static_cast<int>(image.size),
+                                           &decoded.width, &decoded.height, &channels,
+                                           STBI_rgb_alpha);
+    if (!decoded.pixels) {
+        throw std::runtime_error("Filed to load texture " + name);
+    }
+    prepareMipChain(&decoded);
+    return decoded;
+}
+
+void VulkanRenderer::prepareMipChain(DecodedTexture* decoded) {
+    u32 width = static_cast<u32>(decoded->width);
+    u32 height = static_cast<u32>(decoded->height);
+    decoded->mip_levels = mipLevelCount(width, height);
+    if (!blit_mipmaps) {
+        decoded->mip_data = buildMipChain(decoded->pixels, width, height);
+    }
+}
+
+PendingTextures VulkanRenderer::requestTextures(const std::vector<std::string>& names,
+                                                const std::vector<EmbeddedImage>* embedded) {
+    PendingTextures pending;
+    pending.mat_to_tex.assign(names.size(), 0);
+    pending.shared_with.assign(names.size(), -1);
+    pending.paths.resize(names.size());
+    pending.decodes.resize(names.size());
+
+    std::map<std::string, int> first_use; // resolved path -> first material using it
+    for (size_t i = 0; i < names.size(); i++) {
+        if (names[i].empty()) {
+            continue;
+        }
+        std::string path = TextureRegistry::resolvePath(names[i]);
+        auto first = first_use.find(path);
+        if (first != first_use.end()) {
+            pending.shared_with[i] = first->second;
+            continue;
+        }
+        first_use[path] = static_cast<int>(i);
+
+        // embedded images were hashed by the loader and can skip the decode; a file is
+        // hashed on the loader pool along with its decode, see streamTextures
+        const EmbeddedImage* image =
+            embedded && (*embedded)[i].data ? &(*embedded)[i] : nullptr;
+        if (image) {
+            int tex_id = texture_registry.acquire(path, image->hash);
+            if (tex_id >= 0) {
+                pending.mat_to_tex[i] = tex_id;
+                pending.references.push_back(tex_id);
+                continue;
+            }
+        }
+        pending.paths[i] = path;
+        std::string name = names[i];
+        if (image) {
+            EmbeddedImage bytes = *image;
+            pending.decodes[i] = loader_pool.submit([this, bytes, name]() {
+                DecodedTexture decoded = decodeEmbeddedTexture(bytes, name);
+                decoded.hash = bytes.hash;
+                return decoded;
+            });
+        } else {
+            pending.decodes[i] = loader_pool.submit([this, name, path]() {
+                DecodedTexture decoded = decodeTexture(name);
+                decoded.hash = hashAsset(path);
+                return decoded;
+            });
+        }
+    }
+    return pending;
+}
+
+// bytes of staging a decoded texture's upload takes
+static VkDeviceSize stagingBytes(const DecodedTexture& decoded) {
+    u32 width = static_cast<u32>(decoded.width);
+    u32 height = static_cast<u32>(decoded.height);
+    VkDeviceSize bytes = decoded.mip_data.size();
+    if (decoded.pixels) {
+        bytes += mipLevelSize(decoded.format, width, height);
+    }
+    for (u32 level = 0; level < decoded.mapped_levels.size(); level++) {
+        bytes += mipLevelSize(decoded.format, mipExtent(width, level), mipExtent(height, level));
+    }
+    return bytes;
+}
 
-    VkBuffer image_staging_buff;
-    VkDeviceMemory image_staging_mem;
+bool VulkanRenderer::streamTextures(PendingTextures* pending, VkDeviceSize* budget, bool wait) {
+    // uploads are recorded in material order as the decodes come in, so the texture ids
+    // don't depend on which decode finishes first
+    for (; pending->next < pending->decodes.size(); pending->next++) {
+        size_t i = pending->next;
+        std::future<DecodedTexture>& decode = pending->decodes[i];
+        if (!decode.valid()) {
+            continue;
+        }
+        if (*budget == 0 ||
+            (!wait && decode.wait_for(std::chrono::seconds(0)) != std::future_status::ready)) {
+            return false;
+        }
+        DecodedTexture decoded = decode.get();
+
+        // the file may already be loaded, or another model brought it in while this one
+        // decoded; the decode is thrown away then
+        int tex_id = texture_registry.acquire(pending->paths[i], decoded.hash);
+        if (tex_id < 0) {
+            tex_id = createTexture(decoded);
+            texture_registry.add(pending->paths[i], decoded.hash, tex_id);
+            *budget -= std::min(*budget, stagingBytes(decoded));
+        }
+        stbi_image_free(decoded.pixels);
+        pending->mat_to_tex[i] = tex_id;
+        pending->references.push_back(tex_id);
+    }
+    for (size_t i = 0; i < pending->shared_with.size(); i++) {
+        if (pending->shared_with[i] >= 0) {
+            pending->mat_to_tex[i] = pending->mat_to_tex[pending->shared_with[i]];
+        }
+    }
+    return true;
+}
 
-    createBuffer(mainDevice.physical_device, mainDevice.logical_device, imgsize,
-                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                 &image_staging_buff, &image_staging_mem);
-    void* data;
-    vkMapMemory(mainDevice.logical_device, image_staging_mem, 0, imgsize, 0, &data);
-    memcpy(data, image_data, static_cast<size_t>(imgsize));
-    vkUnmapMemory(mainDevice.logical_device, image_staging_mem);
+void VulkanRenderer::discardTextures(PendingTextures* pending) {
+    for (std::future<DecodedTexture>& decode : pending->decodes) {
+        if (!decode.valid()) {
+            continue;
+        }
+        try {
+            stbi_image_free(decode.get().pixels);
+        } catch (const std::exception&) {
+        }
+    }
+}
 
-    stbi_image_free(image_data);
+int VulkanRenderer::createTextureImage(const DecodedTexture& decoded) {
+    u32 width = static_cast<u32>(decoded.width);
+    u32 height = static_cast<u32>(decoded.height);
+    VkFormat format = decoded.format;
+    u32 mip_levels = decoded.mip_levels;
+    VkDeviceSize base_size = decoded.pixels ? mipLevelSize(format, width, height) : 0;
+    VkDeviceSize imgsize = stagingBytes(decoded);
+
+    // level 0 from stb_image (if any), then the packed levels right behind it
+    StagingRegion image_staging = staging.allocate(imgsize);
+    if (decoded.pixels) {
+        memcpy(image_staging.mapped, decoded.pixels, static_cast<size_t>(base_size));
+    }
+    if (!decoded.mip_data.empty()) {
+        memcpy(static_cast<u8*>(image_staging.mapped) + base_size, decoded.mip_data.data(),
+               decoded.mip_data.size());
+    }
+    u8* level_staging = static_cast<u8*>(image_staging.mapped);
+    for (u32 level = 0; level < decoded.mapped_levels.size(); level++) {
+        VkDeviceSize level_size =
+            mipLevelSize(format, mipExtent(width, level), mipExtent(height, level));
+        memcpy(level_staging, decoded.mapped_levels[level], static_cast<size_t>(level_size));
+        level_staging += level_size;
+    }
 
     VkImage teximg;
-    VkDeviceMemory teximgmem;
+    MemoryAllocation teximgmem;
 
-    teximg = createImage(width, height, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL,
-                         VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &teximgmem);
+    teximg = createImage(width, height, format, VK_IMAGE_TILING_OPTIMAL,
+                         VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                             VK_IMAGE_USAGE_SAMPLED_BIT,
+                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Texture, &teximgmem,
+                         mip_levels);
+
+    // recorded into the current upload batch, submitted together with the other uploads
+    VkCommandBuffer upload_cmd = staging.commandBuffer();
 
     // Transtition before copy
-    transitionImageLayout(mainDevice.logical_device, graphics_queue, graphics_command_pool, teximg,
-                          VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    transitionImageLayout(upload_cmd, teximg, VK_IMAGE_LAYOUT_UNDEFINED,
+                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mip_levels);
 
-    copyImageBuffer(mainDevice.logical_device, graphics_queue, graphics_command_pool,
-                    image_staging_buff, teximg, width, height);
+    VkImageLayout upload_layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    if (decoded.pixels) {
+        copyImageBuffer(upload_cmd, image_staging.buffer, image_staging.offset, teximg, width,
+                        height);
+    }
+    if (decoded.pixels && decoded.mip_data.empty()) {
+        recordMipmapBlits(upload_cmd, teximg, width, height, mip_levels);
+        upload_layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    } else {
+        VkDeviceSize offset = image_staging.offset + base_size;
+        for (u32 level = decoded.pixels ? 1 : 0; level < mip_levels; level++) {
+            u32 level_width = mipExtent(width, level);
+            u32 level_height = mipExtent(height, level);
+            copyImageBuffer(upload_cmd, image_staging.buffer, offset, teximg, level_width,
+                            level_height, level);
+            offset += mipLevelSize(format, level_width, level_height);
+        }
+    }
 
-    // transition to shader readable
-    transitionImageLayout(mainDevice.logical_device, graphics_queue, graphics_command_pool, teximg,
-                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    // transition to shader readable, handing the image to the graphics queue on the way
+    staging.releaseImage(teximg, upload_layout, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                         VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
 
     texture_images.push_back(teximg);
     texture_image_memory.push_back(teximgmem);
-    vkDestroyBuffer(mainDevice.logical_device, image_staging_buff, nullptr);
-    vkFreeMemory(mainDevice.logical_device, image_staging_mem, nullptr);
+    texture_extents.push_back({width, height});
+    texture_mip_levels.push_back(mip_levels);
+    texture_formats.push_back(format);
 
     return texture_images.size() - 1;
 }
 
 int VulkanRenderer::createTexture(std::string filename) {
-    int location = createTextureImage(filename);
+    DecodedTexture decoded = decodeTexture(filename);
+    int descloc = createTexture(decoded);
+    stbi_image_free(decoded.pixels);
+
+    return descloc;
+}
 
-    VkImageView imgview = createIMageView(texture_images[location], VK_FORMAT_R8G8B8A8_UNORM,
-                                          VK_IMAGE_ASPECT_COLOR_BIT);
+int VulkanRenderer::createTexture(const DecodedTexture& decoded) {
+    int location = createTextureImage(decoded);
+
+    VkImageView imgview = createIMageView(texture_images[location], texture_formats[location],
+                                          VK_IMAGE_ASPECT_COLOR_BIT, texture_mip_levels[location]);
     texture_image_views.push_back(imgview);
 
     int descloc = createTextureDescriptor(imgview);
@@ -1659,6 +2101,12 @@ int VulkanRenderer::createTexture(std::string filename) {
 }
 
 int VulkanRenderer::createTextureDescriptor(VkImageView teximg) {
+    sampler_descriptor_sets.push_back(allocateTextureDescriptor(teximg));
+
+    return sampler_descriptor_sets.size() - 1;
+}
+
+VkDescriptorSet VulkanRenderer::allocateTextureDescriptor(VkImageView teximg) {
     VkDescriptorSet descset;
 
     VkDescriptorSetAllocateInfo alloc_info = {};
@@ -1685,36 +2133,718 @@ int VulkanRenderer::createTextureDescriptor(VkImageView teximg) {
 
     vkUpdateDescriptorSets(mainDevice.logical_device, 1, &descwrite, 0, nullptr);
 
-    sampler_descriptor_sets.push_back(descset);
+    return descset;
+}
 
-    return sampler_descriptor_sets.size() - 1;
+int VulkanRenderer::loadMeshModel(const std::string& filename) {
+    // the slot is taken now, draws skip it until the uploads land
+    int id = static_cast<int>(models.size());
+    models.push_back(MeshModel());
+    model_upload_tickets.push_back(MODEL_NOT_RESIDENT);
+    model_textures.push_back(std::vector<int>());
+
+    ModelLoad load;
+    load.id = id;
+    load.filename = filename;
+    load.imported = std::make_shared<ImportedModel>();
+    load.imported->mesh_options = mesh_optimization_enabled ? MESH_OPTION_OPTIMIZED : 0;
+    if (native_obj_enabled && isObjFile(filename)) {
+        load.imported->mesh_options |= MESH_OPTION_NATIVE_OBJ;
+    }
+    if (native_gltf_enabled && isGltfFile(filename)) {
+        load.imported->gltf.reset(new GltfModel());
+    }
+    std::shared_ptr<ImportedModel> imported = load.imported;
+    load.step = loader_pool.submit([this, filename, imported]() {
+        openModel(filename, imported.get());
+    });
+    model_loads.push_back(std::move(load));
+    return id;
+}
+
+bool VulkanRenderer::isModelResident(int id) {
+    return id >= 0 && id < static_cast<int>(models.size()) &&
+           staging.isReady(model_upload_tickets[id]);
+}
+
+int VulkanRenderer::createMeshModel(std::string filename) {
+    int id = loadMeshModel(filename);
+    streamModelLoads(std::numeric_limits<VkDeviceSize>::max(), true);
+    return id;
+}
+
+void VulkanRenderer::openModel(const std::string& filename, ImportedModel* imported) {
+    // glTF is read in place, already as fast as a warm start
+    if (imported->gltf) {
+        if (!loadGltf(filename, &asset_pack, &loader_pool, imported->gltf.get())) {
+            throw std::runtime_error("Filed to load model " + filename);
+        }
+        imported->texture_names = imported->gltf->texture_names;
+        imported->nodes = std::move(imported->gltf->nodes);
+        return;
+    }
+
+    // warm start: the geometry comes straight out of the mapped cache file
+    std::string cache_filename = filename + MESH_CACHE_EXTENSION;
+    imported->source_hash = hashAsset(filename);
+    imported->cached = imported->source_hash != 0 &&
+                       imported->cache.open(cache_filename, imported->source_hash,
+                                            MODEL_IMPORT_FLAGS, imported->mesh_options);
+    if (imported->cached) {
+        imported->texture_names = imported->cache.getMaterials();
+        return;
+    }
+
+    // the geometry comes out whole, processModel only has the per mesh passes left
+    if (imported->mesh_options & MESH_OPTION_NATIVE_OBJ) {
+        ObjModel obj;
+        if (!loadObj(filename, &asset_pack, &loader_pool, &obj)) {
+            throw std::runtime_error("Filed to load model " + filename);
+        }
+        imported->texture_names = std::move(obj.texture_names);
+        imported->nodes = std::move(obj.nodes);
+        imported->mesh_data = std::move(obj.meshes);
+        return;
+    }
+
+    imported->importer.reset(new Assimp::Importer());
+    if (asset_pack.isOpen()) {
+        imported->importer->SetIOHandler(new PackIOSystem(&asset_pack)); // importer owns it
+    }
+    imported->scene = imported->importer->ReadFile(filename, MODEL_IMPORT_FLAGS);
+    if (!imported->scene) {
+        throw std::runtime_error("Filed to load model " + filename);
+    }
+    imported->texture_names = MeshModel::LoadMaterials(imported->scene);
+}
+
+void VulkanRenderer::processModel(const std::string& filename, ImportedModel* imported) {
+    std::vector<MeshData>& mesh_data = imported->mesh_data;
+    if (imported->scene) {
+        MeshModel::LoadScene(imported->scene, &imported->nodes, &mesh_data, &loader_pool);
+        imported->scene = nullptr;
+        imported->importer.reset();
+    }
+
+    processMeshes(filename, &mesh_data, (imported->mesh_options & MESH_OPTION_OPTIMIZED) != 0);
+
+    // not fatal, the next start just imports again
+    std::string cache_filename = filename + MESH_CACHE_EXTENSION;
+    if (imported->source_hash == 0 ||
+        !MeshCache::write(cache_filename, imported->source_hash, MODEL_IMPORT_FLAGS,
+                          imported->mesh_options, imported->texture_names, imported->nodes,
+                          mesh_data)) {
+        std::cout << "Failed to write mesh cache " << cache_filename << std::endl;
+    }
+}
+
+void VulkanRenderer::streamModelLoads(VkDeviceSize budget, bool wait) {
+    for (size_t i = 0; i < model_loads.size();) {
+        ModelLoad& load = model_loads[i];
+        bool done = false;
+        try {
+            done = advanceModelLoad(&load, &budget, wait);
+        } catch (const std::exception& e) {
+            std::cout << "Failed to load model " << load.filename << ": " << e.what()
+                      << std::endl;
+            abandonModelLoad(&load);
+            done = true;
+        }
+        if (!done) {
+            i++;
+            continue;
+        }
+        bool unload = load.unload_requested;
+        int id = load.id;
+        model_loads.erase(model_loads.begin() + i);
+        if (unload) {
+            unloadMeshModel(id);
+        }
+    }
+}
+
+bool VulkanRenderer::advanceModelLoad(ModelLoad* load, VkDeviceSize* budget, bool wait) {
+    ImportedModel* imported = load->imported.get();
+    while (load->step.valid()) {
+        if (!wait && load->step.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return false;
+        }
+        load->step.get();
+        if (load->opened) {
+            break;
+        }
+        // the textures decode while the geometry is pulled out of the scene
+        load->opened = true;
+        load->textures = requestTextures(
+            imported->texture_names, imported->gltf ? &imported->gltf->embedded_images : nullptr);
+        if (!imported->cached && !imported->gltf) {
+            std::shared_ptr<ImportedModel> shared = load->imported;
+            std::string filename = load->filename;
+            load->step = loader_pool.submit([this, filename, shared]() {
+                processModel(filename, shared.get());
+            });
+        }
+    }
+    if (!streamTextures(&load->textures, budget, wait)) {
+        return false;
+    }
+    const std::vector<int>& mat_to_tex = load->textures.mat_to_tex; // mtl id -> desc set id
+
+    // the compact formats are picked per mesh when the geometry goes to the arena
+    bool compact = compact_geometry_enabled && compact_vertices_supported;
+    size_t mesh_count = imported->cached ? imported->cache.getMeshCount()
+                        : imported->gltf ? imported->gltf->meshes.size()
+                                         : imported->mesh_data.size();
+    while (load->meshes.size() < mesh_count) {
+        if (*budget == 0) {
+            return false;
+        }
+        u32 i = static_cast<u32>(load->meshes.size());
+        if (imported->cached) {
+            const MeshCacheEntry& entry = imported->cache.getMesh(i);
+            load->meshes.push_back(Mesh(&geometry, imported->cache.getSource(entry),
+                                        mat_to_tex[entry.material], compact));
+        } else if (imported->gltf) {
+            // interleaved or quantized from the mapped file straight into staging
+            load->meshes.push_back(Mesh(&geometry, imported->gltf->meshes[i],
+                                        mat_to_tex[imported->gltf->materials[i]], compact));
+        } else {
+            const MeshData& data = imported->mesh_data[i];
+            load->meshes.push_back(
+                Mesh(&geometry, MeshSource(data), mat_to_tex[data.material], compact));
+        }
+        *budget -= std::min(*budget, load->meshes.back().getGeometryBytes());
+    }
+    // keeps any transform set while it loaded
+    MeshModel model = MeshModel(load->meshes, imported->cached ? imported->cache.getNodes()
+                                                               : imported->nodes);
+    model.setModel(models[load->id].getModel());
+    models[load->id] = model;
+    model_textures[load->id] = load->textures.references;
+    load->imported.reset();
+
+    // the last of the model's uploads go out now, the render loop starts drawing it once
+    // they have landed
+    model_upload_tickets[load->id] = staging.flush();
+    return true;
+}
+
+void VulkanRenderer::abandonModelLoad(ModelLoad* load) {
+    // whatever got uploaded has to go through the usual deferred frees
+    if (load->step.valid()) {
+        load->step.wait();
+    }
+    discardTextures(&load->textures);
+    staging.wait(staging.flush());
+    for (Mesh& mesh : load->meshes) {
+        mesh.destroyBuffers();
+    }
+    for (int tex_id : load->textures.references) {
+        if (texture_registry.release(tex_id)) {
+            retireTexture(tex_id);
+        }
+    }
+}
+
+void VulkanRenderer::processMeshes(const std::string& filename,
+                                   std::vector<MeshData>* mesh_data, bool optimize) {
+    u32 count = static_cast<u32>(mesh_data->size());
+    // the biggest go first, so none of them starts last and holds the whole import up
+    std::vector<u32> order(count);
+    for (u32 i = 0; i < count; i++) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [mesh_data](u32 a, u32 b) {
+        return (*mesh_data)[a].indices.size() > (*mesh_data)[b].indices.size();
+    });
+
+    std::vector<VertexCacheStats> before(count);
+    std::vector<VertexCacheStats> after(count);
+    loader_pool.parallelFor(count, [&](u32 i) {
+        u32 m = order[i];
+        MeshData& mesh = (*mesh_data)[m];
+        if (optimize) {
+            before[m] = analyzeVertexCache(mesh.indices, static_cast<u32>(mesh.vertices.size()));
+            optimizeMesh(&mesh);
+            after[m] = analyzeVertexCache(mesh.indices, static_cast<u32>(mesh.vertices.size()));
+        }
+        // over the final index order, optimizeMesh renumbers the vertices
+        buildMeshlets(mesh.vertices.data(), static_cast<u32>(mesh.vertices.size()),
+                      mesh.indices.data(), static_cast<u32>(mesh.indices.size()), &mesh.meshlets);
+        buildMeshLods(&mesh);
+        mesh.bounds = computeBounds(mesh.vertices.data(), static_cast<u32>(mesh.vertices.size()));
+    });
+
+    VertexCacheStats cache_before, cache_after;
+    for (u32 i = 0; i < count; i++) {
+        cache_before.add(before[i]);
+        cache_after.add(after[i]);
+    }
+
+    if (optimize) {
+        printf("%s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f (%u entry FIFO)\n", filename.c_str(),
+               cache_before.acmr(), cache_after.acmr(), cache_before.atvr(), cache_after.atvr(),
+               VERTEX_CACHE_SIZE);
+    }
+}
+
+float VulkanRenderer::lodPixelsPerUnit(MeshModel& model) {
+    if (!lod_selection_enabled) {
+        return FLT_MAX;
+    }
+    glm::mat4 transform = model.getModel();
+    const glm::vec4& bounds = model.getBounds();
+    float scale = std::max({glm::length(glm::vec3(transform[0])),
+                            glm::length(glm::vec3(transform[1])),
+                            glm::length(glm::vec3(transform[2]))});
+
+    // distance from the eye to the closest the model can get, inside it is full detail
+    glm::vec3 eye = glm::vec3(glm::inverse(ubo_view_proj.view)[3]);
+    glm::vec3 center = glm::vec3(transform * glm::vec4(glm::vec3(bounds), 1.0f));
+    float distance = glm::length(center - eye) - bounds.w * scale;
+    if (distance <= 0.0f) {
+        return FLT_MAX;
+    }
+    // projection[1][1] is cot(fovy / 2): half the viewport height spans 1 / it units at
+    // distance 1
+    float half_height = 0.5f * static_cast<float>(sc_extent.height);
+    return scale * std::fabs(ubo_view_proj.projection[1][1]) * half_height / distance;
 }
 
-void VulkanRenderer::createMeshModel(std::string filename) {
+void VulkanRenderer::unloadMeshModel(int id) {
+    if (id < 0 || id >= static_cast<int>(models.size())) {
+        return;
+    }
+    // still streaming in, it goes as soon as it is complete
+    for (ModelLoad& load : model_loads) {
+        if (load.id == id) {
+            load.unload_requested = true;
+            return;
+        }
+    }
+    if (model_upload_tickets[id] == MODEL_NOT_RESIDENT) {
+        return;
+    }
+    // pending acquires still name the resources, they are recorded before the frees run
+    if (!staging.isReady(model_upload_tickets[id])) {
+        staging.wait(model_upload_tickets[id]);
+    }
+
+    models[id].destroyMeshModel();
+    for (int tex_id : model_textures[id]) {
+        if (texture_registry.release(tex_id)) {
+            retireTexture(tex_id);
+        }
+    }
+    model_textures[id].clear();
+}
+
+void VulkanRenderer::retireTexture(int tex_id) {
+    RetiredTexture retired;
+    retired.image = texture_images[tex_id];
+    retired.image_view = texture_image_views[tex_id];
+    retired.memory = texture_image_memory[tex_id];
+    retired.descriptor_set = sampler_descriptor_sets[tex_id];
+    retired.frame = frame_number;
+    retired_textures.push_back(retired);
+
+    texture_images[tex_id] = VK_NULL_HANDLE;
+    texture_image_views[tex_id] = VK_NULL_HANDLE;
+    texture_image_memory[tex_id] = MemoryAllocation();
+    sampler_descriptor_sets[tex_id] = VK_NULL_HANDLE;
+}
+
+void VulkanRenderer::releaseRetiredTextures(u64 frame) {
+    size_t kept = 0;
+    for (size_t i = 0; i < retired_textures.size(); i++) {
+        RetiredTexture& retired = retired_textures[i];
+        if (retired.frame + MAX_FRAME_DRAWS > frame) {
+            retired_textures[kept++] = retired;
+            continue;
+        }
+        vkDestroyImageView(mainDevice.logical_device, retired.image_view, host_callbacks);
+        vkDestroyImage(mainDevice.logical_device, retired.image, host_callbacks);
+        allocator.free(retired.memory);
+        vkFreeDescriptorSets(mainDevice.logical_device, sampler_descriptor_pool, 1,
+                             &retired.descriptor_set);
+    }
+    retired_textures.resize(kept);
+}
+
+void VulkanRenderer::defragmentGeometry(VkCommandBuffer cmd_buffer) {
+    std::vector<GeometryMove> moves;
+    geometry.defragment(cmd_buffer, GEOMETRY_DEFRAG_BYTES_PER_FRAME, &moves);
+    if (moves.empty()) {
+        return;
+    }
+    for (auto& model : models) {
+        model.applyMoves(moves);
+    }
+    for (ModelLoad& load : model_loads) {
+        for (Mesh& mesh : load.meshes) {
+            for (const GeometryMove& move : moves) {
+                mesh.applyMove(move);
+            }
+        }
+    }
+}
+
+void VulkanRenderer::defragmentTextures(VkCommandBuffer cmd_buffer) {
+    struct TextureMove {
+        int tex_id;
+        VkImage image;
+        MemoryAllocation memory;
+    };
+    std::vector<TextureMove> moves;
+
+    // Copies of the textures living in mostly empty blocks, placed in fuller ones.
+    // Once every texture left a block the allocator gives it back.
+    VkDeviceSize moved_bytes = 0;
+    for (size_t i = 0; i < texture_images.size(); i++) {
+        if (moved_bytes >= TEXTURE_DEFRAG_BYTES_PER_FRAME) {
+            break;
+        }
+        if (texture_images[i] == VK_NULL_HANDLE ||
+            !allocator.isRelocationCandidate(texture_image_memory[i])) {
+            continue;
+        }
+
+        VkImage new_image = createImageObject(
+            texture_extents[i].width, texture_extents[i].height, texture_formats[i],
+            VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                VK_IMAGE_USAGE_SAMPLED_BIT,
+            texture_mip_levels[i]);
+        MemoryAllocation new_memory = allocator.relocateImage(
+            new_image, texture_image_memory[i], VK_IMAGE_TILING_OPTIMAL);
+        if (new_memory.memory == VK_NULL_HANDLE) {
+            vkDestroyImage(mainDevice.logical_device, new_image, host_callbacks);
+            continue;
+        }
+
+        moves.push_back({static_cast<int>(i), new_image, new_memory});
+        moved_bytes += new_memory.size;
+    }
+    if (moves.empty()) {
+        return;
+    }
+
+    std::vector<VkImageMemoryBarrier> barriers;
+    for (const TextureMove& move : moves) {
+        VkImageMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+
+        // earlier frames sampled the old image
+        barrier.image = texture_images[move.tex_id];
+        barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barriers.push_back(barrier);
+
+        barrier.image = move.image;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barriers.push_back(barrier);
+    }
+    vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr,
+                         static_cast<u32>(barriers.size()), barriers.data());
+
+    barriers.clear();
+    for (const TextureMove& move : moves) {
+        // every level of the chain, one region each
+        VkExtent2D extent = texture_extents[move.tex_id];
+        std::vector<VkImageCopy> regions(texture_mip_levels[move.tex_id]);
+        for (u32 level = 0; level < regions.size(); level++) {
+            VkImageCopy& region = regions[level];
+            region = {};
+            region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.srcSubresource.mipLevel = level;
+            region.srcSubresource.baseArrayLayer = 0;
+            region.srcSubresource.layerCount = 1;
+            region.dstSubresource = region.srcSubresource;
+            region.extent = {mipExtent(extent.width, level), mipExtent(extent.height, level), 1};
+        }
+
+        vkCmdCopyImage(cmd_buffer, texture_images[move.tex_id],
+                       VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, move.image,
+                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<u32>(regions.size()),
+                       regions.data());
+
+        VkImageMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = move.image;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        barriers.push_back(barrier);
+    }
+    vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr,
+                         static_cast<u32>(barriers.size()), barriers.data());
+
+    // Sets bound by frames in flight can't be rewritten, each moved texture gets a new one.
+    // The old image, view and set go away with the frames still using them.
+    for (const TextureMove& move : moves) {
+        retireTexture(move.tex_id);
+
+        texture_images[move.tex_id] = move.image;
+        texture_image_memory[move.tex_id] = move.memory;
+        texture_image_views[move.tex_id] =
+            createIMageView(move.image, texture_formats[move.tex_id], VK_IMAGE_ASPECT_COLOR_BIT,
+                            texture_mip_levels[move.tex_id]);
+        sampler_descriptor_sets[move.tex_id] =
+            allocateTextureDescriptor(texture_image_views[move.tex_id]);
+    }
+}
+
+MemoryStats VulkanRenderer::getMemoryStats() {
+    return allocator.getStats();
+}
+
+bool VulkanRenderer::dumpMemoryReport(const std::string& filename) {
+    return allocator.dumpJson(filename);
+}
+
+void VulkanRenderer::benchmarkUploads(const std::string& filename, int iterations) {
     Assimp::Importer importer;
-    const aiScene* scene = importer.ReadFile(filename, aiProcess_Triangulate | aiProcess_FlipUVs |
-                                                           aiProcess_JoinIdenticalVertices);
+    const aiScene* scene = importer.ReadFile(filename, MODEL_IMPORT_FLAGS);
     if (!scene) {
         throw std::runtime_error("Filed to load model " + filename);
     }
+    // only geometry is measured, every material gets the default texture
+    std::vector<int> mat_to_tex(scene->mNumMaterials, 0);
+    // imported once, the timings cover the uploads alone
+    std::vector<SceneNode> nodes;
+    std::vector<MeshData> mesh_data;
+    MeshModel::LoadScene(scene, &nodes, &mesh_data);
+
+    const bool direct_writes = allocator.directWritesEnabled();
+    const bool paths[] = {false, true};
+    for (bool direct : paths) {
+        if (direct && !allocator.directWritesAvailable()) {
+            printf("direct: no large DEVICE_LOCAL|HOST_VISIBLE heap, skipped\n");
+            continue;
+        }
+        // a fresh arena, its buffers are placed for the path being measured
+        vkDeviceWaitIdle(mainDevice.logical_device);
+        geometry.destroy();
+        allocator.setDirectWrites(direct);
+        geometry.init(&allocator, mainDevice.logical_device, &staging);
+
+        VkDeviceSize bytes = 0;
+        double total_ms = 0.0;
+        for (int i = 0; i < iterations; i++) {
+            auto start = std::chrono::high_resolution_clock::now();
+            std::vector<Mesh> meshes = MeshModel::CreateMeshes(&geometry, mesh_data, mat_to_tex);
+            staging.wait(staging.flush());
+            auto end = std::chrono::high_resolution_clock::now();
+            total_ms += std::chrono::duration<double, std::milli>(end - start).count();
+
+            for (auto& mesh : meshes) {
+                bytes += mesh.getGeometryBytes();
+                mesh.destroyBuffers();
+            }
+            // nothing reads the ranges any more, they can be reused right away
+            vkDeviceWaitIdle(mainDevice.logical_device);
+            geometry.releaseRetired();
+        }
 
-    std::vector<std::string> texture_names = MeshModel::LoadMaterials(scene);
+        double mb = bytes / (1024.0 * 1024.0);
+        printf("%-7s %d x %.2f MB: %.3f ms per upload, %.1f MB/s\n", direct ? "direct" : "staging",
+               iterations, mb / iterations, total_ms / iterations, mb / (total_ms / 1000.0));
+    }
+    allocator.setDirectWrites(direct_writes);
+}
 
-    std::vector<int> mat_to_tex(texture_names.size()); // associate mtl id to desc set id
+// the walk LoadScene replaced: recursive, grows the mesh array as it goes, no transforms
+static void loadNodeRecursive(const aiNode* node, const aiScene* scene,
+                              std::vector<MeshData>* meshes) {
+    for (u32 i = 0; i < node->mNumMeshes; i++) {
+        meshes->push_back(MeshData());
+        MeshModel::LoadMeshData(scene->mMeshes[node->mMeshes[i]], &meshes->back());
+    }
+    for (u32 i = 0; i < node->mNumChildren; i++) {
+        loadNodeRecursive(node->mChildren[i], scene, meshes);
+    }
+}
 
-    for (size_t i = 0; i < texture_names.size(); i++) {
-        if (texture_names[i].empty()) {
-            mat_to_tex[i] = 0;
-        } else {
-            mat_to_tex[i] = createTexture(texture_names[i]);
+// a chain of depth nodes, each one step up from its parent with a leaf hanging off it; every
+// node references the same single triangle so the walk itself dominates
+static aiScene* createDeepScene(int depth) {
+    aiScene* scene = new aiScene();
+    aiMesh* mesh = new aiMesh();
+    mesh->mNumVertices = 3;
+    mesh->mVertices = new aiVector3D[3];
+    mesh->mVertices[1] = aiVector3D(1.0f, 0.0f, 0.0f);
+    mesh->mVertices[2] = aiVector3D(0.0f, 1.0f, 0.0f);
+    mesh->mNumFaces = 1;
+    mesh->mFaces = new aiFace[1];
+    mesh->mFaces[0].mNumIndices = 3;
+    mesh->mFaces[0].mIndices = new unsigned int[3]{0, 1, 2};
+    scene->mNumMeshes = 1;
+    scene->mMeshes = new aiMesh*[1]{mesh};
+
+    auto createNode = [](aiNode* parent) {
+        aiNode* node = new aiNode();
+        node->mParent = parent;
+        node->mTransformation.b4 = 1.0f;
+        node->mNumMeshes = 1;
+        node->mMeshes = new unsigned int[1]{0};
+        return node;
+    };
+    scene->mRootNode = createNode(nullptr);
+    aiNode* node = scene->mRootNode;
+    for (int i = 1; i < depth; i++) {
+        aiNode* next = createNode(node);
+        node->mNumChildren = 2;
+        node->mChildren = new aiNode*[2]{createNode(node), next};
+        node = next;
+    }
+    return scene;
+}
+
+void VulkanRenderer::benchmarkImport(int depth, int iterations) {
+    std::unique_ptr<aiScene> scene(createDeepScene(depth));
+
+    double recursive_ms = 0.0;
+    double iterative_ms = 0.0;
+    size_t recursive_meshes = 0;
+    size_t node_count = 0;
+    size_t mesh_count = 0;
+    for (int i = 0; i < iterations; i++) {
+        // both start from empty arrays and free them outside the timed part
+        std::vector<MeshData> recursive_data;
+        std::vector<SceneNode> nodes;
+        std::vector<MeshData> mesh_data;
+        auto start = std::chrono::high_resolution_clock::now();
+        loadNodeRecursive(scene->mRootNode, scene.get(), &recursive_data);
+        auto middle = std::chrono::high_resolution_clock::now();
+        MeshModel::LoadScene(scene.get(), &nodes, &mesh_data);
+        auto end = std::chrono::high_resolution_clock::now();
+        recursive_ms += std::chrono::duration<double, std::milli>(middle - start).count();
+        iterative_ms += std::chrono::duration<double, std::milli>(end - middle).count();
+        recursive_meshes = recursive_data.size();
+        node_count = nodes.size();
+        mesh_count = mesh_data.size();
+    }
+
+    printf("depth %d: %llu nodes, %llu meshes (%llu recursive)\n", depth,
+           (unsigned long long)node_count, (unsigned long long)mesh_count,
+           (unsigned long long)recursive_meshes);
+    printf("recursive %.3f ms, iterative %.3f ms per import\n", recursive_ms / iterations,
+           iterative_ms / iterations);
+}
+
+void VulkanRenderer::benchmarkObj(const std::string& filename, int iterations) {
+    ThreadPool pool;
+    pool.init();
+    AssetPack no_pack; // loose files only
+
+    double native_ms = 0.0;
+    double assimp_ms = 0.0;
+    size_t native_vertices = 0;
+    size_t native_triangles = 0;
+    size_t assimp_vertices = 0;
+    size_t assimp_triangles = 0;
+    for (int i = 0; i < iterations; i++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        ObjModel obj;
+        if (!loadObj(filename, &no_pack, &pool, &obj)) {
+            throw std::runtime_error("Filed to load model " + filename);
         }
+        auto middle = std::chrono::high_resolution_clock::now();
+        std::vector<SceneNode> nodes;
+        std::vector<MeshData> mesh_data;
+        {
+            Assimp::Importer importer;
+            const aiScene* scene = importer.ReadFile(filename, MODEL_IMPORT_FLAGS);
+            if (!scene) {
+                throw std::runtime_error("Filed to load model " + filename);
+            }
+            MeshModel::LoadScene(scene, &nodes, &mesh_data, &pool);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        native_ms += std::chrono::duration<double, std::milli>(middle - start).count();
+        assimp_ms += std::chrono::duration<double, std::milli>(end - middle).count();
+
+        native_vertices = native_triangles = assimp_vertices = assimp_triangles = 0;
+        for (const MeshData& mesh : obj.meshes) {
+            native_vertices += mesh.vertices.size();
+            native_triangles += mesh.indices.size() / 3;
+        }
+        for (const MeshData& mesh : mesh_data) {
+            assimp_vertices += mesh.vertices.size();
+            assimp_triangles += mesh.indices.size() / 3;
+        }
+    }
+
+    printf("%s: native %.3f ms, %llu vertices, %llu triangles\n", filename.c_str(),
+           native_ms / iterations, (unsigned long long)native_vertices,
+           (unsigned long long)native_triangles);
+    printf("%s: assimp %.3f ms, %llu vertices, %llu triangles\n", filename.c_str(),
+           assimp_ms / iterations, (unsigned long long)assimp_vertices,
+           (unsigned long long)assimp_triangles);
+}
+
+void VulkanRenderer::benchmarkMeshlets(const std::string& filename, int iterations) {
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(filename, MODEL_IMPORT_FLAGS);
+    if (!scene) {
+        throw std::runtime_error("Filed to load model " + filename);
+    }
+    // meshlets are built over the optimised order at import, measure the same input
+    std::vector<SceneNode> nodes;
+    std::vector<MeshData> mesh_data;
+    MeshModel::LoadScene(scene, &nodes, &mesh_data);
+    u64 triangles = 0;
+    for (MeshData& mesh : mesh_data) {
+        optimizeMesh(&mesh);
+        triangles += mesh.indices.size() / 3;
     }
 
-    std::vector<Mesh> model_meshes = MeshModel::LoadNode(
-        mainDevice, graphics_queue, graphics_command_pool, scene->mRootNode, scene, mat_to_tex);
-    MeshModel model = MeshModel(model_meshes);
+    double total_ms = 0.0;
+    MeshletStats stats;
+    for (int i = 0; i < iterations; i++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (MeshData& mesh : mesh_data) {
+            buildMeshlets(mesh.vertices.data(), static_cast<u32>(mesh.vertices.size()),
+                          mesh.indices.data(), static_cast<u32>(mesh.indices.size()),
+                          &mesh.meshlets);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        total_ms += std::chrono::duration<double, std::milli>(end - start).count();
+    }
+    for (MeshData& mesh : mesh_data) {
+        stats.add(MeshletView(mesh.meshlets));
+    }
 
-    models.push_back(model);
+    double ms = total_ms / iterations;
+    printf("%s: %llu triangles in %.3f ms, %.2f M triangles/s\n", filename.c_str(),
+           (unsigned long long)triangles, ms, triangles / (ms * 1000.0));
+    printf("%llu meshlets (%u/%u), vertex fill %.1f%%, triangle fill %.1f%%, %.1f%% with a "
+           "normal cone\n",
+           (unsigned long long)stats.meshlets, MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES,
+           stats.vertexFill() * 100.0f, stats.triangleFill() * 100.0f,
+           stats.meshlets ? stats.cones * 100.0 / stats.meshlets : 0.0);
 }
 
 void VulkanRenderer::allocateDynamicBufferTransferSpace() {
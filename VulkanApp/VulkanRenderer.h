@@ -7,17 +7,102 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <algorithm>
+#include <array>
+#include <memory>
 #include <set>
 #include <string>
 #include <vector>
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
+#include "AssetPack.h"
+#include "GeometryArena.h"
+#include "GltfLoader.h"
+#include "HostAllocator.h"
+#include "Ktx2.h"
+#include "MemoryAllocator.h"
 #include "Mesh.h"
+#include "MeshCache.h"
 #include "MeshModel.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "MipChain.h"
+#include "ObjLoader.h"
+#include "PackIOSystem.h"
+#include "StagingRing.h"
+#include "TextureCompressor.h"
+#include "TextureRegistry.h"
+#include "ThreadPool.h"
+#include "UniformArena.h"
 #include "Utilities.h"
 #include "stb_image.h"
 
+// Bytes of texture memory moved out of sparse blocks per frame
+const VkDeviceSize TEXTURE_DEFRAG_BYTES_PER_FRAME = 8ull * 1024 * 1024;
+// Bytes of streaming model data staged per frame, at least one texture or mesh always goes
+const VkDeviceSize MODEL_UPLOAD_BYTES_PER_FRAME = 8ull * 1024 * 1024;
+// upload ticket of a model that is still loading, never ready
+const u64 MODEL_NOT_RESIDENT = ~0ull;
+
+// A texture ready for upload: RGBA8 decoded by stb_image, or the blocks of a KTX2 file
+struct DecodedTexture {
+    stbi_uc* pixels = nullptr; // RGBA8 level 0, freed with stbi_image_free; null for KTX2
+    int width = 0;
+    int height = 0;
+    VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+    u32 mip_levels = 1;
+    // the levels not in pixels, packed: 1.. when built on the CPU, empty when they're
+    // blitted, every level of a KTX2 file
+    std::vector<u8> mip_data;
+    // KTX2 levels read in place, out of the asset pack mapping or backing, level 0 first;
+    // they go to staging in place of mip_data
+    std::vector<const u8*> mapped_levels;
+    std::vector<u8> backing; // decompressed pack entry, when it was stored compressed
+    u64 hash = 0;            // of the source file, for the texture registry
+};
+
+// A model's textures while it loads. Embedded images the registry already has resolve
+// straight away; files are hashed and decoded on the loader pool, and only looked up once the
+// hash is known.
+struct PendingTextures {
+    std::vector<int> mat_to_tex;  // material -> texture id
+    std::vector<int> shared_with; // earlier material naming the same file, or -1
+    std::vector<std::string> paths;
+    std::vector<std::future<DecodedTexture>> decodes; // valid for textures being created
+    std::vector<int> references;                     // registry references the model holds
+    size_t next = 0;                                 // material whose upload is next
+};
+
+// Geometry of a model on its way off the loader pool
+struct ImportedModel {
+    u64 source_hash = 0;
+    u32 mesh_options = 0;
+    MeshCache cache; // open on a warm start, the meshes come straight out of it
+    bool cached = false;
+    std::unique_ptr<Assimp::Importer> importer; // owns the scene until the meshes are out
+    const aiScene* scene = nullptr;
+    std::vector<std::string> texture_names;
+    std::vector<SceneNode> nodes;
+    std::vector<MeshData> mesh_data;
+    // glTF files skip the cache and the mesh processing, the meshes are created straight
+    // from the mapped accessors; set when the load starts
+    std::unique_ptr<GltfModel> gltf;
+};
+
+// A model streaming in. The import and then, on a cache miss, the mesh processing run on the
+// loader pool while the textures decode there too; the main thread uploads whatever is
+// ready a budget per frame.
+struct ModelLoad {
+    int id;
+    std::string filename;
+    std::shared_ptr<ImportedModel> imported;
+    std::future<void> step; // import or processing in flight
+    bool opened = false;    // imported, textures requested
+    PendingTextures textures;
+    std::vector<Mesh> meshes;
+    bool unload_requested = false;
+};
+
 class VulkanRenderer {
 public:
     VulkanRenderer();
@@ -29,16 +114,79 @@ public:
 
     void draw();
     void cleanup();
-    void createMeshModel(std::string filename);
+    // Starts loading a model and returns its id straight away. Import and decoding run on the
+    // loader pool and draw() uploads a budget per frame; the model is drawn from the first
+    // frame everything of it is resident.
+    int loadMeshModel(const std::string& filename);
+    bool isModelResident(int id);
+    // loadMeshModel, then blocks until every pending model is resident
+    int createMeshModel(std::string filename);
+    // vertex cache/overdraw/fetch reordering of imported meshes, on by default
+    void setMeshOptimization(bool enabled) {
+        mesh_optimization_enabled = enabled;
+    }
+    // quantized vertices and 16-bit indices for the meshes that fit them, on by default
+    void setCompactGeometry(bool enabled) {
+        compact_geometry_enabled = enabled;
+    }
+    // coarser LODs for models that are small on screen, on by default
+    void setLodSelection(bool enabled) {
+        lod_selection_enabled = enabled;
+    }
+    // OBJ files through loadObj instead of Assimp, on by default
+    void setNativeObj(bool enabled) {
+        native_obj_enabled = enabled;
+    }
+    // glTF/GLB files through loadGltf instead of Assimp, on by default
+    void setNativeGltf(bool enabled) {
+        native_gltf_enabled = enabled;
+    }
+    // frees the model's geometry and textures once the frames drawing it are done,
+    // the id stays taken
+    void unloadMeshModel(int id);
+
+    // device memory usage per heap/category, against VK_EXT_memory_budget when available,
+    // and the driver's host allocations per scope
+    MemoryStats getMemoryStats();
+    bool dumpMemoryReport(const std::string& filename);
+
+    // times uploading a model's geometry through staging copies and, when the device has a
+    // large host visible device local heap, written in place
+    void benchmarkUploads(const std::string& filename, int iterations);
+    // times meshlet generation over a model's meshes and reports how full the meshlets are,
+    // needs no device
+    static void benchmarkMeshlets(const std::string& filename, int iterations);
+    // times flattening a generated scene of depth nested nodes into meshes and nodes, the
+    // iterative importer against a recursive walk, needs no device
+    static void benchmarkImport(int depth, int iterations);
+    // times loadObj against the Assimp import of the same OBJ, needs no device
+    static void benchmarkObj(const std::string& filename, int iterations);
 
 private:
     GLFWwindow* window;
 
+    HostAllocator host_allocator;
+    const VkAllocationCallbacks* host_callbacks = nullptr; // passed to every vkCreate*
+
+    ThreadPool loader_pool; // asset decoding off the main thread
+    AssetPack asset_pack;   // opened at init when there is one, read from any thread
+    bool mesh_optimization_enabled = true;
+    bool compact_geometry_enabled = true;
+    bool lod_selection_enabled = true;
+    bool native_obj_enabled = true;
+    bool native_gltf_enabled = true;
+
     VkInstance instance;
     VkDev mainDevice;
+    MemoryAllocator allocator;
+    StagingRing staging;
     VkQueue graphics_queue;
     VkQueue presentation_queue;
+    VkQueue transfer_queue;
     VkSurfaceKHR surface;
+    bool has_properties2 = false;              // VK_KHR_get_physical_device_properties2 enabled
+    bool memory_budget_enabled = false;        // VK_EXT_memory_budget enabled
+    bool dedicated_allocation_enabled = false; // VK_KHR_dedicated_allocation enabled
     VkSwapchainKHR swapchain;
 
     std::vector<SwapchainImage> swapchain_images;
@@ -47,21 +195,41 @@ private:
 
     std::vector<VkImage> depth_image;
     std::vector<VkImageView> depth_image_view;
-    std::vector<VkDeviceMemory> depth_image_memory;
+    std::vector<MemoryAllocation> depth_image_memory;
     VkFormat depth_fmt;
 
     std::vector<VkImage> color_image;
     std::vector<VkImageView> color_image_view;
-    std::vector<VkDeviceMemory> color_image_memory;
+    std::vector<MemoryAllocation> color_image_memory;
     VkFormat color_fmt;
 
     VkSampler texture_sampler;
     std::vector<VkImage> texture_images;
-    std::vector<VkDeviceMemory> texture_image_memory;
+    std::vector<MemoryAllocation> texture_image_memory;
     std::vector<VkImageView> texture_image_views;
+    std::vector<VkExtent2D> texture_extents;
+    std::vector<u32> texture_mip_levels;
+    std::vector<VkFormat> texture_formats;
+    // block compressed formats the device samples, a KTX2 file in any other is ignored
+    std::set<VkFormat> compressed_formats;
+    bool bc_compression_enabled = false;
+    // mip chains blitted on the GPU at upload, otherwise built on the loader pool
+    bool blit_mipmaps = false;
+
+    // unloaded or relocated textures, destroyed once no frame in flight samples them
+    struct RetiredTexture {
+        VkImage image;
+        VkImageView image_view;
+        MemoryAllocation memory;
+        VkDescriptorSet descriptor_set;
+        u64 frame;
+    };
+    std::vector<RetiredTexture> retired_textures;
 
     // - Pipeline
-    VkPipeline graphics_pipeline;
+    // one per VertexFormat, null when the device can't fetch the format
+    std::array<VkPipeline, VERTEX_FORMAT_COUNT> graphics_pipelines = {};
+    bool compact_vertices_supported = false;
     VkPipelineLayout pipeline_layout;
 
     VkPipeline second_pipeline;
@@ -70,6 +238,7 @@ private:
 
     // - Pools
     VkCommandPool graphics_command_pool;
+    VkCommandPool transfer_command_pool;
 
     // Validation
     VkDebugUtilsMessengerEXT debugMessenger;
@@ -84,10 +253,11 @@ private:
     VkFormat sc_img_format;
     VkExtent2D sc_extent;
 
-    // VkDeviceSize min_uniform_buff_offset;
+    VkDeviceSize min_uniform_buff_offset;
     // size_t model_uniform_alignment;
 
     int current_frame = 0;
+    u64 frame_number = 0; // frames recorded so far, for deferred frees
     // Synchronisation
     std::vector<VkSemaphore> image_available;
     std::vector<VkSemaphore> render_finished;
@@ -121,7 +291,7 @@ private:
 
     void createPushConstantRange();
 
-    void updateUniformBuffers(u32 img_idx);
+    void updateUniformBuffers();
 
     void recordCommands(u32 curr_img);
     void createSynchronisation();
@@ -131,6 +301,7 @@ private:
     bool checkInstanceExtensionsSupport(std::vector<const char*>* checkExtenstions);
     bool checkDeviceInstanceExtensionsSupport(VkPhysicalDevice device);
     bool checkDeviceSuitable(VkPhysicalDevice device);
+    bool checkDeviceExtensionSupport(VkPhysicalDevice device, const char* extension);
     void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo);
 
     static VkResult CreateDebugUtilsMessengerEXT(
@@ -160,14 +331,24 @@ private:
 
     VkImage createImage(u32 width, u32 height, VkFormat format, VkImageTiling tiling,
                         VkImageUsageFlags flags, VkMemoryPropertyFlags propflags,
-                        VkDeviceMemory* imagemem);
-
-    VkImageView createIMageView(VkImage image, VkFormat format, VkImageAspectFlags flags);
+                        MemoryCategory category, MemoryAllocation* imagemem,
+                        u32 mip_levels = 1);
+    VkImage createImageObject(u32 width, u32 height, VkFormat format, VkImageTiling tiling,
+                              VkImageUsageFlags flags, u32 mip_levels = 1);
+    // swapchain sized, transient and lazily allocated when the device supports it
+    VkImage createAttachmentImage(VkFormat format, VkImageUsageFlags flags,
+                                  MemoryAllocation* imagemem);
+
+    VkImageView createIMageView(VkImage image, VkFormat format, VkImageAspectFlags flags,
+                                u32 mip_levels = 1);
+    bool supportsLinearBlit(VkFormat format);
+    bool supportsVertexFormat(VertexFormat format);
+    void findCompressedFormats();
 
     VkShaderModule createShaderModule(const std::vector<char>& code);
 
     // Scene objects
-    std::vector<Mesh> meshes;
+    GeometryArena geometry;
 
     // Scene settings
     struct UboViewProjection {
@@ -182,12 +363,12 @@ private:
     VkDescriptorPool descriptor_pool;
     VkDescriptorPool sampler_descriptor_pool;
     VkDescriptorPool input_descriptor_pool;
-    std::vector<VkDescriptorSet> descriptor_sets;
+    VkDescriptorSet uniform_descriptor_set; // dynamic offsets into the uniform arena
     std::vector<VkDescriptorSet> sampler_descriptor_sets;
     std::vector<VkDescriptorSet> input_descriptor_sets;
 
-    std::vector<VkBuffer> vp_uniform_buffer;
-    std::vector<VkDeviceMemory> vp_uniform_buffer_memory;
+    UniformArena uniforms;
+    u32 vp_uniform_offset; // this frame's view/projection in the uniform arena
 
     std::vector<VkBuffer> model_uniform_buffer;
     std::vector<VkDeviceMemory> model_uniform_buffer_memory;
@@ -196,12 +377,59 @@ private:
 
     VkPushConstantRange push_constant_range;
 
-    // loader funcs
+    // loader funcs, out of the asset pack when it has the file and else from loose files
+    std::vector<char> readAsset(const std::string& filename);
+    // content hash of an asset, 0 when it can't be read
+    u64 hashAsset(const std::string& filename);
     stbi_uc* loadTextureFile(std::string filename, int* width, int* height, VkDeviceSize* imgsize);
-    int createTextureImage(std::string filename);
+    DecodedTexture decodeTexture(std::string filename);
+    // an image embedded in a model file, decoded where it lies
+    DecodedTexture decodeEmbeddedTexture(const EmbeddedImage& image, const std::string& name);
+    // the CPU built mips of a freshly decoded RGBA8 texture, unless they're blitted
+    void prepareMipChain(DecodedTexture* decoded);
+    // Everything freshly imported meshes go through before the cache, one loader pool task
+    // per mesh: the optional reorder, meshlets, the LOD chain and bounds. Reports the vertex
+    // cache statistics when reordering.
+    void processMeshes(const std::string& filename, std::vector<MeshData>* mesh_data,
+                       bool optimize);
+    // screen pixels one model space unit covers at the model's nearest point this frame,
+    // FLT_MAX for full detail
+    float lodPixelsPerUnit(MeshModel& model);
+    // Looks every material texture up in the registry and starts decoding the missing ones.
+    // Materials with embedded image data decode it in place, it has to outlive the decodes.
+    PendingTextures requestTextures(const std::vector<std::string>& names,
+                                    const std::vector<EmbeddedImage>* embedded = nullptr);
+    // uploads the decoded textures in material order and fills in mat_to_tex, until the
+    // budget runs out or, unless waiting, a decode isn't done. True once all are uploaded.
+    bool streamTextures(PendingTextures* pending, VkDeviceSize* budget, bool wait);
+    // drops decodes nobody is going to upload
+    void discardTextures(PendingTextures* pending);
+
+    // loader pool halves of a model load: the mesh cache or the Assimp scene, then on a miss
+    // the meshes pulled out, optimised, split and simplified and the cache written
+    void openModel(const std::string& filename, ImportedModel* imported);
+    void processModel(const std::string& filename, ImportedModel* imported);
+    // moves every model load along within budget bytes of uploads
+    void streamModelLoads(VkDeviceSize budget, bool wait);
+    // true once the model is submitted
+    bool advanceModelLoad(ModelLoad* load, VkDeviceSize* budget, bool wait);
+    void abandonModelLoad(ModelLoad* load);
+    int createTextureImage(const DecodedTexture& decoded);
     int createTexture(std::string filename);
+    int createTexture(const DecodedTexture& decoded);
     int createTextureDescriptor(VkImageView teximg);
+    VkDescriptorSet allocateTextureDescriptor(VkImageView teximg);
+
+    // defragmentation and deferred frees
+    void defragmentGeometry(VkCommandBuffer cmd_buffer);
+    void defragmentTextures(VkCommandBuffer cmd_buffer);
+    void retireTexture(int tex_id);
+    void releaseRetiredTextures(u64 frame);
 
     // Assets
     std::vector<MeshModel> models;
+    std::vector<u64> model_upload_tickets; // staging ticket of each model's uploads
+    std::vector<std::vector<int>> model_textures; // texture references of each model
+    std::vector<ModelLoad> model_loads;           // models still streaming in, oldest first
+    TextureRegistry texture_registry;
 };